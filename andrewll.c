@@ -2,26 +2,89 @@
 #include <string.h>
 
 #include "andrewll.h"
+#include "mem_track.h"
 
 void LL_Init(LL* list, void (*destroy)(void* data))
+{
+	LL_Init_Alloc(list, destroy, NULL, NULL);
+}
+
+void LL_Init_Alloc(LL* list, void (*destroy)(void* data),
+                   void* (*alloc)(void* ctx, size_t size), void* alloc_ctx)
 {
 	list->size = 0;
 	list->destroy = destroy;
+	list->alloc = alloc;
+	list->alloc_ctx = alloc_ctx;
+	list->intrusive = 0;
+	list->link_offset = 0;
 	list->head = NULL;
 	list->tail = NULL;
 }
 
-void LL_Destroy(LL* list)
+void LL_Init_Intrusive(LL* list, size_t link_offset,
+                       void (*destroy)(void* data),
+                       void* (*alloc)(void* ctx, size_t size), void* alloc_ctx)
+{
+	LL_Init_Alloc(list, destroy, alloc, alloc_ctx);
+	list->intrusive = 1;
+	list->link_offset = link_offset;
+}
+
+void* LL_Alloc(LL* list, size_t size)
+{
+	if (list->alloc)
+		return list->alloc(list->alloc_ctx, size);
+
+	return memAlloc(MEM_SWITCH, size);
+}
+
+void LL_Free(LL* list, void* p)
+{
+	if (!list->alloc)
+		memFree(p);
+}
+
+// Empties the list. The elements of an intrusive list are part of the
+// payloads, so it's a single pass over the payloads with no unlinking,
+// and no pass at all if there's nothing to destroy.
+void LL_Clear(LL* list)
 {
 	void* data = NULL;
 
+	if (list->intrusive) {
+		LL_elem* elem = list->head;
+
+		while (elem && list->destroy) {
+			LL_elem* next = elem->next;
+
+			list->destroy(elem->data);
+			elem = next;
+		}
+
+		list->head = NULL;
+		list->tail = NULL;
+		list->size = 0;
+		return;
+	}
+
 	while (LL_Size(list) > 0)
 		if (LL_Rem_Next(list, NULL, (void**)&data) == 0)
 			if (list->destroy)
 				list->destroy(data);
+}
+
+// A list that uses an allocator was allocated from it as well (see
+// matchRuleSet() in rule_set.c), so only the struct is cleared
+void LL_Destroy(LL* list)
+{
+	int owned = list->alloc == NULL;
+
+	LL_Clear(list);
 
 	memset(list, 0, sizeof(LL));
-	free(list);
+	if (owned)
+		memFree(list);
 }
 
 int LL_Rem_Next(LL* list, LL_elem* elem, void** data)
@@ -52,7 +115,8 @@ int LL_Rem_Next(LL* list, LL_elem* elem, void** data)
 			list->tail = elem;
 	}
 
-	free(old_elem);
+	if (!list->intrusive)
+		LL_Free(list, old_elem);
 	list->size--;
 	return 0;
 }
@@ -61,7 +125,9 @@ int LL_Ins_Next(LL* list, LL_elem* elem, void* data)
 {
 	LL_elem* new_elem;
 
-	if ((new_elem = malloc(sizeof(LL_elem))) == NULL)
+	if (list->intrusive)
+		new_elem = (LL_elem*)((char*)data + list->link_offset);
+	else if ((new_elem = LL_Alloc(list, sizeof(LL_elem))) == NULL)
 		return -1;
 
 	new_elem->data = data;
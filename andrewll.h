@@ -16,6 +16,19 @@ typedef struct LList {
 	int	(*match)(const void* key1, const void* key2);
 	void	(*destroy)(void* data);
 
+	// Allocator for the elements, and for the payloads of lists that use
+	// LL_Alloc(). NULL means memAlloc() and memFree() (see mem_track.c).
+	// Memory from an allocator is never freed by the list; it belongs to
+	// the allocator.
+	void*	(*alloc)(void* ctx, size_t size);
+	void*	alloc_ctx;
+
+	// Intrusive lists don't allocate elements. Each payload has an
+	// LL_elem member 'link_offset' bytes from its start, which is linked
+	// in place, and whose data pointer points back at the payload.
+	int	intrusive;
+	size_t	link_offset;
+
 	LL_elem*	head;
 	LL_elem*	tail;
 } LL;
@@ -23,6 +36,19 @@ typedef struct LList {
 
 void LL_Init(LL* list, void (*destroy)(void* data));
 
+void LL_Init_Alloc(LL* list, void (*destroy)(void* data),
+                   void* (*alloc)(void* ctx, size_t size), void* alloc_ctx);
+
+void LL_Init_Intrusive(LL* list, size_t link_offset,
+                       void (*destroy)(void* data),
+                       void* (*alloc)(void* ctx, size_t size), void* alloc_ctx);
+
+void* LL_Alloc(LL* list, size_t size);
+
+void LL_Free(LL* list, void* p);
+
+void LL_Clear(LL* list);
+
 void LL_Destroy(LL* list);
 
 int LL_Ins_Next(LL* list, LL_elem* elem, void* data);
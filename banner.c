@@ -132,8 +132,6 @@ LRESULT CALLBACK bannerProc(HWND hwnd, UINT message, WPARAM wParam,
 
 		case BTN_ID_ARROW:
 			if (arrow_enabled) {
-				size_t length = strlen(vsi.num);
-				vsi.parse = (length == 6) ? parseOrderBuffer : parseVssBuffer;
 
 				// Store # from edit control into 'num' buffer
 				if (!getNumFromEdit(hwnd_edit, vsi.num, 14)) {
@@ -142,38 +140,27 @@ LRESULT CALLBACK bannerProc(HWND hwnd, UINT message, WPARAM wParam,
 					break;
 				}
 
-				// Store EDB URL into 'url' buffer
-				if (length == 6) {
-					if (genOrderURL(vsi.num, vsi.url, 200) < 0) {
-						MessageBoxA(NULL, "Error executing order search",
-							"Error", MB_ICONERROR);
-						break;
-					}
-				}
-				else {
-					if (genVssURL(vsi.num, vsi.url, 200) < 0) {
-						MessageBoxA(NULL, "Error executing vss search",
-							"Error", MB_ICONERROR);
-						break;
-					}
+				// Store EDB URL, cache key and parse function
+				if (genSpecRequest(&vsi) != 0) {
+					MessageBoxA(NULL, (strlen(vsi.num) == 6) ?
+						"Error executing order search" :
+						"Error executing vss search",
+						"Error", MB_ICONERROR);
+					break;
 				}
 
 				// Disable search button
 				arrow_enabled = FALSE;
 				InvalidateRect(hwnd_arrow, NULL, FALSE);
 
-				// Without this UpdateWindow call, the arrow button would
-				// not be redrawn until the spec retrieval had completed
-				UpdateWindow(hwnd_arrow);
-
-				// Initiate spec retrieval
+				// Initiate spec retrieval. The main window copies 'vsi'
+				// and loads the spec on a worker thread, so this returns
+				// right away.
 				SendMessageA(GetParent(hwnd), WM_COMMAND,
 				             MAKEWPARAM(BTN_ID_ARROW, 0), (LPARAM)&vsi);
 
-				// Clear edit box and restore cusor to arrow (it was set to
-				// the wait animation in the WM_COMMAND processing in ostool.c)
+				// Clear edit box
 				SetWindowTextA(hwnd_edit, NULL);
-				SetCursor(LoadCursorA(NULL, IDC_ARROW));
 			}
 			break;
 
@@ -594,5 +581,35 @@ int genOrderURL(const char* src, char* dest, int dest_size)
 	strcat_s(dest, dest_size, src);
 	strcat_s(dest, dest_size, p2);
 
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// genSpecRequest                                                             //
+//                                                                            //
+// Fills in the URL, cache key and parse function of 'p_spec' from its 'num', //
+// which checkInput() has accepted: a six digit order number or a VSS number. //
+// The key is the product class the URL asks for (orders are looked up by     //
+// signature instead) and the number (see spec_cache.c). The search button    //
+// and the prefetch list (see prefetch.c) both use this. Returns 0 on         //
+// success, or -1 if the URL doesn't fit.                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+int genSpecRequest(struct spec* p_spec)
+{
+	BOOL is_order = (strlen(p_spec->num) == 6);
+
+	if (is_order) {
+		p_spec->parse = parseOrderBuffer;
+		if (genOrderURL(p_spec->num, p_spec->url, sizeof(p_spec->url)) < 0)
+			return -1;
+	}
+	else {
+		p_spec->parse = parseVssBuffer;
+		if (genVssURL(p_spec->num, p_spec->url, sizeof(p_spec->url)) < 0)
+			return -1;
+	}
+
+	wsprintfA(p_spec->key, "%s/%s", is_order ? "VTNA" : "04", p_spec->num);
 	return 0;
 }
\ No newline at end of file
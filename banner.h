@@ -22,6 +22,7 @@ void drawEditRect(HWND hwnd, HDC hdc, HDC hdc_mem, LPRECT p_rect,
 int getNumFromEdit(HWND hwnd_edit, char* buf_vss, unsigned buf_size);
 int genVssURL(const char* src, char* dest, int dest_size);
 int genOrderURL(const char* src, char* dest, int dest_size);
+int genSpecRequest(struct spec* p_spec);
 LRESULT CALLBACK vssEditProc(HWND hwnd, UINT message, WPARAM wParam,
                              LPARAM lParam);
 
@@ -41,8 +41,14 @@
 // list view will cause a blue rectangle to be drawn around the selected      //
 // switch in the dash. The functions that perform these operations are also   //
 // in this TU.                                                                //
+//                                                                            //
+// The composed dash is kept between paints, with and without the legend, and //
+// only composed again when the switches change. Most repaints, such as       //
+// moving the highlight, just copy it to the window.                          //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <string.h>
+
 #include "cab_view.h"
 #include "ost_shared.h"
 #include "andrewll.h"
@@ -178,6 +184,28 @@ static BOOL f_legend;
 // The location of the currently drawn highlight. -1 means it's disabled
 static int highlight = -1;
 
+// The dash as drawDash() last composed it, kept between paints. Each layer
+// is a memory DC with a bitmap the size of the blank dash selected into
+// it, or NULL until it's first needed. The switches only change when a spec
+// is loaded or cleared and the legend only when it's toggled, so a repaint
+// for anything else, e.g. a new highlight or an uncovered window, is one
+// BitBlt from here.
+static struct {
+	HDC hdc_dash;               // the blank dash with the switches drawn
+	HBITMAP h_dash;
+	HDC hdc_legend;             // the same with the legend drawn over it
+	HBITMAP h_legend;
+	SIZE size;
+	BOOL f_dash_valid;
+	BOOL f_legend_valid;
+	int src_bitmap_pos[14];     // what 'hdc_dash' was composed from
+	HFONT h_font;               // what 'hdc_legend' was drawn with
+} dash_cache;
+
+static int createDashLayer(HDC hdc, HDC* p_hdc_layer, HBITMAP* p_h_layer);
+static void composeDash(HDC hdc_dest, const P_STATE_DATA p_data);
+static void freeDashCache(void);
+
 LRESULT CALLBACK cabViewProc(HWND hwnd, UINT message, WPARAM wParam,
                              LPARAM lParam)
 {
@@ -249,6 +277,10 @@ LRESULT CALLBACK cabViewProc(HWND hwnd, UINT message, WPARAM wParam,
 		highlight = (int)lParam;
 		InvalidateRect(hwnd, NULL, FALSE);
 		return 0;
+
+	case WM_DESTROY:
+		freeDashCache();
+		return 0;
 	}
 	return DefWindowProcA(hwnd, message, wParam, lParam);
 }
@@ -256,55 +288,139 @@ LRESULT CALLBACK cabViewProc(HWND hwnd, UINT message, WPARAM wParam,
 ////////////////////////////////////////////////////////////////////////////////
 // drawDash                                                                   //
 //                                                                            //
-// Performs all of the BitBlt operations to draw the dash. This requires      //
-// multiple steps:                                                            //
+// Draws the dash, with the switches of the current spec and the legend if    //
+// it's enabled, to 'hdc' at 'x_pos', 'y_pos'. The dash is composed in layers //
+// that are kept between calls (see 'dash_cache' above), and each is only     //
+// drawn again when what it shows has changed:                                //
 //                                                                            //
-// 1: Create the temporary memory DC, or 'shadow bitmap', to perform all      //
-//    intermediate operations on. Create and select a bitmap into this DC.    //
-//    This bitmap is the same size as the final drawn dash.                   //
+// 1: The dash layer, the blank dash with the switches of every location      //
+// drawn over it (see composeDash()), when 'src_bitmap_pos' has changed since //
+// it was drawn.                                                              //
 //                                                                            //
-// 2: Perform BitBlt operations for all switches except 23 and 28.            //
+// 2: The legend layer, a copy of the dash layer with the legend drawn over   //
+// it in the font 'h_font', when the legend is enabled and the dash layer or  //
+// the font has changed since it was drawn. Toggling the legend doesn't touch //
+// the dash layer.                                                            //
 //                                                                            //
-// 3: Perform BitBlt operations for 23 and 28. These locations require        //
-//    special treatment (masking).                                            //
+// 3: The layer that's shown, legend or dash, is BitBlt to the destination    //
+// DC, which is all a repaint does when nothing has changed.                  //
+//                                                                            //
+// If the dash layer can't be created, the dash isn't drawn; if the legend    //
+// layer can't be, the dash is drawn without the legend. Creating either is   //
+// tried again on the next call.                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+void drawDash
+(HDC hdc, HFONT h_font, int x_pos, int y_pos, const P_STATE_DATA p_data)
+{
+	HDC hdc_shown;
+
+	if (!dash_cache.hdc_dash) {
+		BITMAP bm = { 0 };
+
+		GetObjectA(p_data->p_bitmaps[6].h_bitmap, sizeof(BITMAP), &bm);
+		dash_cache.size.cx = bm.bmWidth;
+		dash_cache.size.cy = bm.bmHeight;
+
+		if (createDashLayer(hdc, &dash_cache.hdc_dash,
+		                    &dash_cache.h_dash) != 0)
+			return;
+	}
+
+	if (!dash_cache.f_dash_valid ||
+	    memcmp(dash_cache.src_bitmap_pos, p_data->src_bitmap_pos,
+	           sizeof(dash_cache.src_bitmap_pos)) != 0) {
+		composeDash(dash_cache.hdc_dash, p_data);
+		memcpy(dash_cache.src_bitmap_pos, p_data->src_bitmap_pos,
+		       sizeof(dash_cache.src_bitmap_pos));
+		dash_cache.f_dash_valid = TRUE;
+		dash_cache.f_legend_valid = FALSE;
+	}
+
+	hdc_shown = dash_cache.hdc_dash;
+
+	// Without a legend layer, the dash is shown without the legend
+	if (f_legend && (dash_cache.hdc_legend ||
+	                 createDashLayer(hdc, &dash_cache.hdc_legend,
+	                                 &dash_cache.h_legend) == 0)) {
+		if (!dash_cache.f_legend_valid || dash_cache.h_font != h_font) {
+			HFONT h_font_old;
+
+			BitBlt(dash_cache.hdc_legend, 0, 0, dash_cache.size.cx,
+			       dash_cache.size.cy, dash_cache.hdc_dash, 0, 0, SRCCOPY);
+
+			// The font isn't left selected, so it can be deleted while
+			// the layer is kept
+			h_font_old = SelectObject(dash_cache.hdc_legend, h_font);
+			drawLegend(dash_cache.hdc_legend, dash_cache.src_bitmap_pos[0]);
+			SelectObject(dash_cache.hdc_legend, h_font_old);
+			dash_cache.h_font = h_font;
+			dash_cache.f_legend_valid = TRUE;
+		}
+
+		hdc_shown = dash_cache.hdc_legend;
+	}
+
+	// Copy the layer to the destination DC
+	BitBlt(hdc, x_pos, y_pos, dash_cache.size.cx, dash_cache.size.cy - 120,
+	       hdc_shown, 0, 104, SRCCOPY);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// createDashLayer                                                            //
+//                                                                            //
+// Creates a memory DC compatible with 'hdc' for a layer of the dash, with a  //
+// bitmap the size of the blank dash selected into it, and returns them in    //
+// '*p_hdc_layer' and '*p_h_layer'. Returns 0 on success, or -1 if either     //
+// can't be created, in which case both are NULL.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static int createDashLayer(HDC hdc, HDC* p_hdc_layer, HBITMAP* p_h_layer)
+{
+	*p_h_layer = CreateCompatibleBitmap(hdc, dash_cache.size.cx,
+	                                    dash_cache.size.cy);
+	if (!*p_h_layer)
+		return -1;
+
+	if ((*p_hdc_layer = CreateCompatibleDC(hdc)) == NULL) {
+		DeleteObject(*p_h_layer);
+		*p_h_layer = NULL;
+		return -1;
+	}
+
+	SelectObject(*p_hdc_layer, *p_h_layer);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// composeDash                                                                //
 //                                                                            //
-// 4: Draw the legend (if the toggle button is enabled).                      //
+// Performs all of the BitBlt operations to compose the dash onto 'hdc_dest', //
+// a layer the size of the blank dash. This requires multiple steps:          //
 //                                                                            //
-// 5: BitBlt the intermediate shadow bitmap to the destination DC.            //
+// 1: BitBlt the blank dash.                                                  //
 //                                                                            //
-// Potential future improvements: the drawLegend() call happens in this       //
-// function. It is required to perform these options when the legend is       //
-// removed, but drawing the legend over an already-painted dash should not    //
-// require the dash be painted again.                                         //
+// 2: Perform BitBlt operations for all switches except 23 and 28.            //
+//                                                                            //
+// 3: Perform BitBlt operations for 23 and 28. These locations require        //
+// special treatment (masking).                                               //
 //                                                                            //
 // Additionally, this function is quite long. I could break up the operations //
-// in this function, and call each of those sub-functions from drawDash().    //
-// This would make the code easier to debug in case of an error.              //
+// in this function, and call each of those sub-functions from here. This     //
+// would make the code easier to debug in case of an error.                   //
 ////////////////////////////////////////////////////////////////////////////////
 
-void drawDash
-(HDC hdc, HFONT h_font, int x_pos, int y_pos, const P_STATE_DATA p_data)
+static void composeDash(HDC hdc_dest, const P_STATE_DATA p_data)
 {
 	int i;
 
 	HDC hdc_mem_src;
-	BITMAP bm = { 0 };
-
-	HDC hdc_mem_temp;
-	HBITMAP h_bitmap;
 
 	const P_SW_BITMAP p_sw_bitmap = p_data->p_bitmaps;
 	const int* p_src_bitmap_pos = p_data->src_bitmap_pos;
-	int zone_4 = p_data->src_bitmap_pos[0];
 
-	// Prepare temporary memory DC with shadow bitmap
-	GetObjectA(p_sw_bitmap[6].h_bitmap, sizeof(BITMAP), &bm);
-	h_bitmap = CreateCompatibleBitmap(hdc, bm.bmWidth, bm.bmHeight);
-	hdc_mem_temp = CreateCompatibleDC(hdc);
-	SelectObject(hdc_mem_temp, h_bitmap);
-
-	// BitBlt blank dash to the temporary memory DC
-	BitBlt(hdc_mem_temp, 0, 0, bm.bmWidth, bm.bmHeight,
+	// BitBlt blank dash to the destination DC
+	BitBlt(hdc_dest, 0, 0, dash_cache.size.cx, dash_cache.size.cy,
 	       p_sw_bitmap[6].hdc_mem, 0, 0, SRCCOPY);
 
 	// BitBlt for bitmap sections  0 - 11 (ref destBitmapInfo[] struct above).
@@ -338,7 +454,7 @@ void drawDash
 		default: x = 0;    hdc_mem_src = p_sw_bitmap[i].hdc_mem;  break;
 		}
 
-		BitBlt(hdc_mem_temp,
+		BitBlt(hdc_dest,
 		       destBitmapInfo[i].pt.x, destBitmapInfo[i].pt.y,
 		       destBitmapInfo[i].size.cx, destBitmapInfo[i].size.cy,
 		       hdc_mem_src, x,
@@ -357,7 +473,7 @@ void drawDash
 			// with an area around the switch colored white, and it's surrounding
 			// in black. This operation draws a black area around the switch in
 			// the temporary memory DC.
-			BitBlt(hdc_mem_temp,
+			BitBlt(hdc_dest,
 			       destBitmapInfo[i].pt.x, destBitmapInfo[i].pt.y,
 			       destBitmapInfo[i].size.cx, destBitmapInfo[i].size.cy,
 			       p_sw_bitmap[5].hdc_mem, 288, -(12 - i) * 96, 0x220326);
@@ -366,26 +482,34 @@ void drawDash
 			// is an image of the switch (either occupied or not) surrounded by
 			// black. The black parts get ignored and the switch is drawn onto
 			// the dash leaving the surroundings untouched.
-			BitBlt(hdc_mem_temp,
+			BitBlt(hdc_dest,
 			       destBitmapInfo[i].pt.x, destBitmapInfo[i].pt.y,
 			       destBitmapInfo[i].size.cx, destBitmapInfo[i].size.cy,
 			       p_sw_bitmap[5].hdc_mem, p_src_bitmap_pos[i] ? 288 : 336,
 			       -(12 - i) * 96 + 48, SRCPAINT);
 		}
 	}
-	
-	// Draw legend if it's enabled (based on the toggle button setting)
-	if (f_legend) {
-		SelectObject(hdc_mem_temp, h_font);
-		drawLegend(hdc_mem_temp, zone_4);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeDashCache                                                              //
+//                                                                            //
+// Deletes the layers of the dash, when the cab view window is destroyed.     //
+////////////////////////////////////////////////////////////////////////////////
+
+static void freeDashCache(void)
+{
+	if (dash_cache.hdc_dash) {
+		DeleteDC(dash_cache.hdc_dash);
+		DeleteObject(dash_cache.h_dash);
 	}
 
-	// Final BitBlt. Copy the shadow bitmap to the destination DC
-	BitBlt(hdc, x_pos, y_pos, bm.bmWidth, bm.bmHeight - 120,
-	       hdc_mem_temp, 0, 104, SRCCOPY);
+	if (dash_cache.hdc_legend) {
+		DeleteDC(dash_cache.hdc_legend);
+		DeleteObject(dash_cache.h_legend);
+	}
 
-	DeleteDC(hdc_mem_temp);
-	DeleteObject(h_bitmap);
+	memset(&dash_cache, 0, sizeof(dash_cache));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
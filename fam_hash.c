@@ -0,0 +1,322 @@
+////////////////////////////////////////////////////////////////////////////////
+// fam_hash.c                                                                 //
+//                                                                            //
+// This TU holds the perfect hash of the variant families that the family     //
+// index of every spec is built with (see storeVariant() in var_store.c).     //
+// Questions like "which variant of the W7D family does this spec have?" (the //
+// zone-4 panel, see getSwPanel() in ostool.c) used to be answered by         //
+// scanning every variant of the spec; with the index, it's one lookup.       //
+//                                                                            //
+// The families come from the fam_codes_6605.txt resource, one 3-character    //
+// code per line, ending with the '~' eof marker. It lists every family in    //
+// the specs of the 'VSS numbers' directory, and can be regenerated from a    //
+// newer set of specs with the '/selectivity' command line mode (see          //
+// tool_mode.c). A family that isn't in the resource has no slot, and         //
+// findFamily() scans the spec for it instead.                                //
+//                                                                            //
+// The hash is built with the hash and displace method. Every family is put   //
+// in a bucket by one hash, and the buckets are placed in the table, largest  //
+// first, each with the smallest displacement that moves all of its families  //
+// to free slots of a second hash. The table has about twice as many slots as //
+// there are families, so this never has to look far. The hash is built once, //
+// when the program starts (see WM_CREATE in ostool.c, and runToolMode() in   //
+// tool_mode.c), and isn't changed after that.                                //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fam_hash.h"
+#include "rule_set.h"   // for packFamily()
+#include "resource.h"
+#include "mem_track.h"
+
+static FAM_HASH fam_hash;
+
+////////////////////////////////////////////////////////////////////////////////
+// compareFamKeys                                                             //
+//                                                                            //
+// qsort() comparison function for FAM_KEYs.                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compareFamKeys(const void* a, const void* b)
+{
+	FAM_KEY fam_a = *(const FAM_KEY*)a;
+	FAM_KEY fam_b = *(const FAM_KEY*)b;
+
+	return (fam_a > fam_b) - (fam_a < fam_b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// bucketOf                                                                   //
+//                                                                            //
+// Multiplicative (Fibonacci) hash of a family, the same as hashSlot() in     //
+// rule_set.c. The top 'bits' bits of the product are the family's bucket.    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int bucketOf(FAM_KEY fam, int bits)
+{
+	return (int)((fam * 0x9E3779B1u) >> (32 - bits));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// slotOf                                                                     //
+//                                                                            //
+// The second hash, with the multiplier chosen when the table is built. The   //
+// top 'bits' bits of the product are the family's slot before it's           //
+// displaced.                                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+static int slotOf(FAM_KEY fam, unsigned int mult, int bits)
+{
+	return (int)((fam * mult) >> (32 - bits));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// placeBuckets                                                               //
+//                                                                            //
+// Places every bucket of 'fams' in the table with the slot hash multiplier   //
+// 'mult'. 'bucket_start' lists the families of each bucket the same way      //
+// rule_start lists the rules of a symbol (see rule_set.h), and 'order' has   //
+// the buckets largest first. Returns 0 on success, or -1 if a bucket         //
+// couldn't be placed, in which case the table is left partly filled.         //
+////////////////////////////////////////////////////////////////////////////////
+
+static int placeBuckets(const FAM_KEY* fams, const int* bucket_start,
+                        const int* order, int num_buckets, unsigned int mult)
+{
+	int bits = fam_hash.table_bits;
+	int mask = (1 << bits) - 1;
+	int b, d, i;
+
+	for (b = 0; b < num_buckets; b++) {
+		int bucket = order[b];
+		int first = bucket_start[bucket];
+		int last = bucket_start[bucket + 1];
+
+		if (first == last)
+			break;
+
+		for (d = 0; d <= mask; d++) {
+			for (i = first; i < last; i++) {
+				int slot = (slotOf(fams[i], mult, bits) + d) & mask;
+				int j;
+
+				if (fam_hash.keys[slot])
+					break;
+
+				// Two families of the bucket can't share a slot either
+				for (j = first; j < i; j++)
+					if (((slotOf(fams[j], mult, bits) + d) & mask) == slot)
+						break;
+				if (j < i)
+					break;
+			}
+
+			if (i == last)
+				break;
+		}
+
+		if (d > mask)
+			return -1;
+
+		fam_hash.disp[bucket] = (WORD)d;
+		for (i = first; i < last; i++)
+			fam_hash.keys[(slotOf(fams[i], mult, bits) + d) & mask] = fams[i];
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildTable                                                                 //
+//                                                                            //
+// Builds the table for the sorted, distinct families in 'fams', trying up to //
+// FAM_HASH_TRIES slot hash multipliers. Returns 0 on success, -1 if memory   //
+// couldn't be allocated, or -4 if no multiplier worked.                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static int buildTable(const FAM_KEY* fams, int num_fams)
+{
+	FAM_KEY* sorted = NULL;
+	int* bucket_start = NULL;
+	int* order = NULL;
+	int num_buckets;
+	int slots;
+	int res = -4;
+	int i, t;
+
+	fam_hash.table_bits = 4;
+	while ((1 << fam_hash.table_bits) < 2 * num_fams)
+		fam_hash.table_bits++;
+	fam_hash.bucket_bits = fam_hash.table_bits - 2;
+	slots = 1 << fam_hash.table_bits;
+	num_buckets = 1 << fam_hash.bucket_bits;
+
+	fam_hash.keys = memCalloc(MEM_RULES, (size_t)slots, sizeof(FAM_KEY));
+	fam_hash.disp = memCalloc(MEM_RULES, (size_t)num_buckets, sizeof(WORD));
+	sorted = memCalloc(MEM_RULES, (size_t)num_fams + 1, sizeof(FAM_KEY));
+	bucket_start = memCalloc(MEM_RULES, (size_t)num_buckets + 1, sizeof(int));
+	order = memAlloc(MEM_RULES, sizeof(int) * (size_t)num_buckets);
+	if (!fam_hash.keys || !fam_hash.disp || !sorted || !bucket_start ||
+	    !order) {
+		res = -1;
+		goto done;
+	}
+
+	// Counting sort of the families by bucket. A family is never 0, so
+	// the first 0 in a bucket's range is its next free entry.
+	for (i = 0; i < num_fams; i++)
+		bucket_start[bucketOf(fams[i], fam_hash.bucket_bits) + 1]++;
+	for (i = 0; i < num_buckets; i++)
+		bucket_start[i + 1] += bucket_start[i];
+	for (i = 0; i < num_fams; i++) {
+		int bucket = bucketOf(fams[i], fam_hash.bucket_bits);
+		int pos = bucket_start[bucket];
+
+		while (sorted[pos] != 0)
+			pos++;
+		sorted[pos] = fams[i];
+	}
+
+	// Insertion sort of the buckets, largest first
+	for (i = 0; i < num_buckets; i++) {
+		int size = bucket_start[i + 1] - bucket_start[i];
+		int j;
+
+		for (j = i; j > 0 && bucket_start[order[j - 1] + 1] -
+		                     bucket_start[order[j - 1]] < size; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	for (t = 0; t < FAM_HASH_TRIES && res != 0; t++) {
+		fam_hash.mult = 0x85EBCA6Bu + 2u * (unsigned int)t;
+		memset(fam_hash.keys, 0, sizeof(FAM_KEY) * (size_t)slots);
+		res = placeBuckets(sorted, bucket_start, order, num_buckets,
+		                   fam_hash.mult) ? -4 : 0;
+	}
+
+done:
+	memFree(sorted);
+	memFree(bucket_start);
+	memFree(order);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadFamHash                                                                //
+//                                                                            //
+// Reads the family codes from the resource and builds the process-wide hash. //
+// Duplicate codes are ignored. Calling it again once the hash is built does  //
+// nothing.                                                                   //
+//                                                                            //
+// Returns 0 on success, -1 if memory couldn't be allocated, -2 if the        //
+// resource couldn't be loaded, -3 if a line isn't a 3-character code, or -4  //
+// if the table couldn't be built.                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+int loadFamHash(void)
+{
+	HRSRC hrsrc;
+	HGLOBAL hglobal;
+	const char* res;
+	const char* c;
+	FAM_KEY* fams;
+	int num_lines = 0;
+	int num_fams = 0;
+	int i, err;
+
+	if (fam_hash.keys)
+		return 0;
+
+	hrsrc = FindResourceA(NULL, MAKEINTRESOURCEA(IDR_CSV7), "CSV");
+	if (hrsrc == NULL)
+		return -2;
+	if ((hglobal = LoadResource(NULL, hrsrc)) == NULL)
+		return -2;
+	if ((res = LockResource(hglobal)) == NULL)
+		return -2;
+
+	for (c = res; *c != '~'; c++)
+		if (*c == '\n')
+			num_lines++;
+
+	fams = memAlloc(MEM_RULES, sizeof(FAM_KEY) * ((size_t)num_lines + 1));
+	if (fams == NULL)
+		return -1;
+
+	for (c = res; *c != '~'; ) {
+		for (i = 0; i < 3; i++)
+			if (c[i] == '\n' || c[i] == '~')
+				break;
+		if (i < 3 || (c[3] != '\n' && c[3] != '~')) {
+			memFree(fams);
+			return -3;
+		}
+
+		fams[num_fams++] = packFamily(c);
+		c += 3;
+		if (*c == '\n')
+			c++;
+	}
+
+	qsort(fams, num_fams, sizeof(FAM_KEY), compareFamKeys);
+	for (i = 0, num_lines = num_fams, num_fams = 0; i < num_lines; i++)
+		if (num_fams == 0 || fams[i] != fams[num_fams - 1])
+			fams[num_fams++] = fams[i];
+
+	if ((err = buildTable(fams, num_fams)) != 0)
+		freeFamHash();
+	else
+		fam_hash.num_families = num_fams;
+
+	memFree(fams);
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeFamHash                                                                //
+//                                                                            //
+// Frees the hash. famSlot() finds nothing until it's loaded again.           //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeFamHash(void)
+{
+	memFree(fam_hash.keys);
+	memFree(fam_hash.disp);
+	memset(&fam_hash, 0, sizeof(FAM_HASH));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// famHashSize                                                                //
+//                                                                            //
+// Returns the number of slots in the table, or 0 if it isn't loaded. A       //
+// spec's family index has one entry per slot.                                //
+////////////////////////////////////////////////////////////////////////////////
+
+int famHashSize(void)
+{
+	return fam_hash.keys ? 1 << fam_hash.table_bits : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// famSlot                                                                    //
+//                                                                            //
+// Returns the slot of a known family, or -1 if 'fam' isn't one of them (or   //
+// the hash isn't loaded).                                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+int famSlot(FAM_KEY fam)
+{
+	int slot;
+
+	if (!fam_hash.keys || !fam)
+		return -1;
+
+	slot = (slotOf(fam, fam_hash.mult, fam_hash.table_bits) +
+	        fam_hash.disp[bucketOf(fam, fam_hash.bucket_bits)]) &
+	       ((1 << fam_hash.table_bits) - 1);
+
+	return fam_hash.keys[slot] == fam ? slot : -1;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef FAM_HASH_H_
+#define FAM_HASH_H_
+
+#include <Windows.h>
+#include "ost_data.h"
+
+// Multipliers tried for the slot hash before giving up on the table
+#define FAM_HASH_TRIES      16
+
+// A perfect hash of the known variant families, from fam_codes_6605.txt.
+// A family's slot is (slot hash + disp[bucket]) masked to the table size,
+// and no two known families share a slot. keys[slot] is the family in
+// that slot, or 0 if it's empty, so an unknown family is detected with one
+// comparison.
+typedef struct fam_hash {
+	FAM_KEY* keys;          // slot -> family
+	WORD* disp;             // bucket -> displacement
+	unsigned int mult;      // multiplier of the slot hash
+	int table_bits;
+	int bucket_bits;
+	int num_families;
+} FAM_HASH, * P_FAM_HASH;
+
+int loadFamHash(void);
+void freeFamHash(void);
+int famHashSize(void);
+int famSlot(FAM_KEY fam);
+
+#endif
\ No newline at end of file
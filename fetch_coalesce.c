@@ -0,0 +1,392 @@
+////////////////////////////////////////////////////////////////////////////////
+// fetch_coalesce.c                                                           //
+//                                                                            //
+// This TU makes lookups of the same page share one download. A prefetch list //
+// often names a spec more than once, and the main window starts a new job    //
+// for a spec the moment the one before it is cancelled, e.g. when the same   //
+// number is entered again; each of them used to download the page for        //
+// itself, the later ones while the first download was still running.         //
+//                                                                            //
+// A FETCH_COALESCER is a VSS_TRANSPORT that looks up through another one,    //
+// usually an EDB session's. The first lookup of a page starts a download on  //
+// a thread of its own, a "flight"; a lookup of the same URL, with the same   //
+// validators, that comes while the flight is running waits for it instead of //
+// downloading the page again. When the flight is done, every lookup waiting  //
+// for it gets the same result: the same page, each in a buffer of its own as //
+// the VSS_TRANSPORT contract requires, and the same validators. Lookups that //
+// come after it's done start a new flight, so nothing is kept longer than    //
+// the download takes; the spec cache is what keeps pages (see spec_cache.c). //
+//                                                                            //
+// Each lookup still has its own cancel flag and timeout: a lookup that gives //
+// up stops waiting, but the flight runs on for the others. Once all of its   //
+// lookups have given up, it keeps running for FLIGHT_GRACE_MS in case a      //
+// lookup of the same page comes, which is what happens when the main window  //
+// cancels a job and starts one for the same number; only if none does is it  //
+// cancelled, the way a lookup of its own would have been. The flight's       //
+// timeout is that of the lookup that started it.                             //
+//                                                                            //
+// Only the download is shared. The spec jobs parse each page into an arena   //
+// of their own, which the window takes over (see spec_job.c), so the parse   //
+// of a page can't be shared without copying it, which takes about as long as //
+// parsing it again.                                                          //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "fetch_coalesce.h"
+#include "mem_track.h"
+
+static int coalescedFetch(void* ctx, const char* p_url,
+                          const FETCH_CTL* p_ctl, char** p_data,
+                          DWORD* p_size);
+static int waitFlight(FETCH_FLIGHT* p_flight, const FETCH_CTL* p_ctl,
+                      ULONGLONG start);
+static FETCH_FLIGHT* findFlight(const FETCH_COALESCER* p_coal,
+                                const char* p_url,
+                                const PAGE_VALIDATORS* p_validators);
+static FETCH_FLIGHT* startFlight(P_FETCH_COALESCER p_coal, const char* p_url,
+                                 const FETCH_CTL* p_ctl,
+                                 const PAGE_VALIDATORS* p_validators);
+static DWORD WINAPI flightWorker(LPVOID param);
+static void lingerFlight(P_FETCH_COALESCER p_coal, FETCH_FLIGHT* p_flight);
+static void unlinkFlight(P_FETCH_COALESCER p_coal, FETCH_FLIGHT* p_flight);
+static void releaseFlight(FETCH_FLIGHT* p_flight);
+static void freeFlight(FETCH_FLIGHT* p_flight);
+
+////////////////////////////////////////////////////////////////////////////////
+// openFetchCoalescer                                                         //
+//                                                                            //
+// Creates a coalescer, returned in '*pp_coal', whose 'transport' looks up    //
+// through 'p_inner'. Returns 0 on success, or -1 if there isn't enough       //
+// memory.                                                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+int openFetchCoalescer(const VSS_TRANSPORT* p_inner,
+                       P_FETCH_COALESCER* pp_coal)
+{
+	P_FETCH_COALESCER p_coal;
+
+	*pp_coal = NULL;
+
+	if ((p_coal = memCalloc(MEM_NETWORK, 1, sizeof(FETCH_COALESCER))) == NULL)
+		return -1;
+
+	p_coal->p_inner = p_inner;
+	p_coal->transport.fetch = coalescedFetch;
+	p_coal->transport.ctx = p_coal;
+	InitializeSRWLock(&(p_coal->lock));
+
+	*pp_coal = p_coal;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// closeFetchCoalescer                                                        //
+//                                                                            //
+// Frees the coalescer, once the flights that every lookup gave up on have    //
+// finished. No lookup may be running through it, and it must be closed       //
+// before the transport it looks up through. 'p_coal' may be NULL.            //
+////////////////////////////////////////////////////////////////////////////////
+
+void closeFetchCoalescer(P_FETCH_COALESCER p_coal)
+{
+	if (!p_coal)
+		return;
+
+	// Cancelled flights have had their request aborted, and stop soon
+	while (p_coal->num_running)
+		Sleep(10);
+
+	memFree(p_coal);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// coalescedFetch                                                             //
+//                                                                            //
+// The 'fetch' function of a coalescer's transport. 'ctx' is the coalescer.   //
+// Joins the flight for the same request if there is one, or starts one, and  //
+// waits for it. If no flight can be started, the lookup is made on this      //
+// thread, without sharing it. Returns what the flight's download did, with   //
+// GetLastError() set from it, or VSS_CANCELLED or VSS_TIMED_OUT if this      //
+// lookup gave up first. The last lookup to give up on a flight returns once  //
+// the flight is done, joined or cancelled, up to FLIGHT_GRACE_MS later (see  //
+// lingerFlight()).                                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static int coalescedFetch(void* ctx, const char* p_url,
+                          const FETCH_CTL* p_ctl, char** p_data,
+                          DWORD* p_size)
+{
+	P_FETCH_COALESCER p_coal = (P_FETCH_COALESCER)ctx;
+	const VSS_TRANSPORT* p_inner = p_coal->p_inner;
+	const PAGE_VALIDATORS none = { 0 };
+	const PAGE_VALIDATORS* p_sent = &none;
+	ULONGLONG start = GetTickCount64();
+	FETCH_FLIGHT* p_flight;
+	BOOL f_last;
+	int res;
+
+	*p_data = NULL;
+	*p_size = 0;
+
+	if (p_ctl && p_ctl->p_validators)
+		p_sent = p_ctl->p_validators;
+
+	AcquireSRWLockExclusive(&(p_coal->lock));
+	p_coal->num_lookups++;
+	if ((p_flight = findFlight(p_coal, p_url, p_sent)) != NULL) {
+		InterlockedIncrement(&(p_flight->refs));
+		p_coal->num_shared++;
+	}
+	else
+		p_flight = startFlight(p_coal, p_url, p_ctl, p_sent);
+
+	if (p_flight)
+		p_flight->num_waiters++;
+	ReleaseSRWLockExclusive(&(p_coal->lock));
+
+	if (!p_flight)
+		return p_inner->fetch(p_inner->ctx, p_url, p_ctl, p_data, p_size);
+
+	res = waitFlight(p_flight, p_ctl, start);
+
+	AcquireSRWLockExclusive(&(p_coal->lock));
+	f_last = --p_flight->num_waiters == 0;
+	ReleaseSRWLockExclusive(&(p_coal->lock));
+
+	if (f_last && res != 0)
+		lingerFlight(p_coal, p_flight);
+
+	if (res == 0) {
+		res = p_flight->res;
+
+		if (res >= 0 && p_ctl && p_ctl->p_validators)
+			*p_ctl->p_validators = p_flight->received;
+
+		if (res == 0) {
+			*p_data = memAlloc(MEM_NETWORK, max(p_flight->size, 1));
+			if (*p_data) {
+				memcpy(*p_data, p_flight->data, p_flight->size);
+				*p_size = p_flight->size;
+			}
+			else
+				res = VSS_NO_MEMORY;
+		}
+
+		SetLastError(p_flight->error);
+	}
+
+	releaseFlight(p_flight);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// waitFlight                                                                 //
+//                                                                            //
+// Waits for 'p_flight' to be done, for a lookup bounded by 'p_ctl', which    //
+// may be NULL, that started at 'start' (a GetTickCount64() value). Returns 0 //
+// once the flight is done, or VSS_CANCELLED or VSS_TIMED_OUT as soon as the  //
+// lookup's cancel flag is set or its timeout has passed.                     //
+////////////////////////////////////////////////////////////////////////////////
+
+static int waitFlight(FETCH_FLIGHT* p_flight, const FETCH_CTL* p_ctl,
+                      ULONGLONG start)
+{
+	while (WaitForSingleObject(p_flight->h_done, FLIGHT_POLL_MS) !=
+	       WAIT_OBJECT_0) {
+		if (p_ctl && p_ctl->p_cancel && *p_ctl->p_cancel)
+			return VSS_CANCELLED;
+		if (p_ctl && p_ctl->timeout_ms &&
+		    GetTickCount64() - start > p_ctl->timeout_ms)
+			return VSS_TIMED_OUT;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findFlight                                                                 //
+//                                                                            //
+// Returns the coalescer's flight for 'p_url' that sent the validators        //
+// '*p_validators', or NULL if there isn't one. A request with other          //
+// validators may be answered differently, e.g. VSS_NOT_MODIFIED instead of   //
+// the page, so it doesn't share the flight. The coalescer's lock must be     //
+// held.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static FETCH_FLIGHT* findFlight(const FETCH_COALESCER* p_coal,
+                                const char* p_url,
+                                const PAGE_VALIDATORS* p_validators)
+{
+	FETCH_FLIGHT* p_flight;
+
+	for (p_flight = p_coal->p_flights; p_flight; p_flight = p_flight->p_next)
+		if (strcmp(p_flight->p_url, p_url) == 0 &&
+		    strcmp(p_flight->sent.etag, p_validators->etag) == 0 &&
+		    p_flight->sent.modified == p_validators->modified)
+			return p_flight;
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// startFlight                                                                //
+//                                                                            //
+// Starts a flight for 'p_url' with the validators '*p_validators' and the    //
+// timeout of 'p_ctl', which may be NULL, and adds it to the coalescer's      //
+// list. The coalescer's lock must be held. Returns the flight, held for the  //
+// thread and for the caller, or NULL if it couldn't be allocated or its      //
+// thread couldn't be started.                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+static FETCH_FLIGHT* startFlight(P_FETCH_COALESCER p_coal, const char* p_url,
+                                 const FETCH_CTL* p_ctl,
+                                 const PAGE_VALIDATORS* p_validators)
+{
+	FETCH_FLIGHT* p_flight;
+	size_t length = strlen(p_url) + 1;
+	HANDLE h_thread;
+
+	p_flight = memCalloc(MEM_NETWORK, 1, sizeof(FETCH_FLIGHT));
+	if (!p_flight)
+		return NULL;
+
+	p_flight->p_owner = p_coal;
+	p_flight->refs = 2;
+	p_flight->sent = *p_validators;
+	p_flight->received = *p_validators;
+	p_flight->ctl.p_cancel = &(p_flight->cancelled);
+	p_flight->ctl.timeout_ms = p_ctl ? p_ctl->timeout_ms : 0;
+	p_flight->ctl.p_validators = &(p_flight->received);
+	p_flight->ctl.p_abort = &(p_flight->abort);
+	InitializeSRWLock(&(p_flight->abort.lock));
+
+	if ((p_flight->p_url = memAlloc(MEM_NETWORK, length)) == NULL ||
+	    (p_flight->h_done = CreateEventA(NULL, TRUE, FALSE, NULL)) == NULL) {
+		freeFlight(p_flight);
+		return NULL;
+	}
+	memcpy(p_flight->p_url, p_url, length);
+
+	InterlockedIncrement(&(p_coal->num_running));
+	h_thread = CreateThread(NULL, 0, flightWorker, p_flight, 0, NULL);
+	if (!h_thread) {
+		InterlockedDecrement(&(p_coal->num_running));
+		freeFlight(p_flight);
+		return NULL;
+	}
+	CloseHandle(h_thread);
+
+	p_flight->p_next = p_coal->p_flights;
+	p_coal->p_flights = p_flight;
+	return p_flight;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// flightWorker                                                               //
+//                                                                            //
+// The thread of a flight started by startFlight(). 'param' is the flight.    //
+// The flight leaves the coalescer's list before it's marked done, so no      //
+// lookup joins it after that.                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD WINAPI flightWorker(LPVOID param)
+{
+	FETCH_FLIGHT* p_flight = (FETCH_FLIGHT*)param;
+	P_FETCH_COALESCER p_coal = p_flight->p_owner;
+	const VSS_TRANSPORT* p_inner = p_coal->p_inner;
+
+	p_flight->res = p_inner->fetch(p_inner->ctx, p_flight->p_url,
+	                               &(p_flight->ctl), &(p_flight->data),
+	                               &(p_flight->size));
+	p_flight->error = GetLastError();
+
+	AcquireSRWLockExclusive(&(p_coal->lock));
+	unlinkFlight(p_coal, p_flight);
+	ReleaseSRWLockExclusive(&(p_coal->lock));
+
+	SetEvent(p_flight->h_done);
+	releaseFlight(p_flight);
+
+	// The coalescer may be closed as soon as this is done
+	InterlockedDecrement(&(p_coal->num_running));
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// lingerFlight                                                               //
+//                                                                            //
+// Called by the last lookup to give up on 'p_flight', while the flight is    //
+// still running. Waits up to FLIGHT_GRACE_MS for the flight to be done or    //
+// for another lookup to join it, and if neither happens, cancels it,         //
+// aborting a request that's waiting for the server, and takes it off the     //
+// coalescer's list, so the lookups that come after it start a new one.       //
+////////////////////////////////////////////////////////////////////////////////
+
+static void lingerFlight(P_FETCH_COALESCER p_coal, FETCH_FLIGHT* p_flight)
+{
+	ULONGLONG start = GetTickCount64();
+	BOOL f_joined = FALSE;
+
+	while (!f_joined && WaitForSingleObject(p_flight->h_done, FLIGHT_POLL_MS) !=
+	       WAIT_OBJECT_0) {
+		AcquireSRWLockExclusive(&(p_coal->lock));
+		f_joined = p_flight->num_waiters > 0;
+		if (!f_joined && GetTickCount64() - start >= FLIGHT_GRACE_MS) {
+			p_flight->cancelled = TRUE;
+			abortFetch(&(p_flight->abort));
+			unlinkFlight(p_coal, p_flight);
+			f_joined = TRUE;
+		}
+		ReleaseSRWLockExclusive(&(p_coal->lock));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// unlinkFlight                                                               //
+//                                                                            //
+// Takes 'p_flight' off the coalescer's list, if it's still on it. The        //
+// coalescer's lock must be held.                                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static void unlinkFlight(P_FETCH_COALESCER p_coal, FETCH_FLIGHT* p_flight)
+{
+	FETCH_FLIGHT** pp_link;
+
+	for (pp_link = &(p_coal->p_flights); *pp_link;
+	     pp_link = &((*pp_link)->p_next)) {
+		if (*pp_link == p_flight) {
+			*pp_link = p_flight->p_next;
+			return;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// releaseFlight                                                              //
+//                                                                            //
+// Lets go of 'p_flight', for its thread or for a lookup, and frees it once   //
+// all of them have.                                                          //
+////////////////////////////////////////////////////////////////////////////////
+
+static void releaseFlight(FETCH_FLIGHT* p_flight)
+{
+	if (InterlockedDecrement(&(p_flight->refs)) == 0)
+		freeFlight(p_flight);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeFlight                                                                 //
+//                                                                            //
+// Frees 'p_flight' and the page it got.                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static void freeFlight(FETCH_FLIGHT* p_flight)
+{
+	if (p_flight->h_done)
+		CloseHandle(p_flight->h_done);
+
+	memFree(p_flight->data);
+	memFree(p_flight->p_url);
+	memFree(p_flight);
+}
\ No newline at end of file
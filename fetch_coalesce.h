@@ -0,0 +1,55 @@
+#ifndef FETCH_COALESCE_H_
+#define FETCH_COALESCE_H_
+
+#include <Windows.h>
+
+#include "vss_connect.h"
+
+// How often a lookup waiting on a shared download checks its cancel flag
+// and timeout, in ms
+#define FLIGHT_POLL_MS      20
+
+// How long a download that every lookup has given up on keeps running for
+// a lookup of the same page to join it, in ms
+#define FLIGHT_GRACE_MS     500
+
+// One download that lookups of the same page share. It runs on a thread
+// of its own, and is freed by whichever of the thread and the lookups lets
+// go of it last.
+typedef struct fetch_flight {
+	struct fetch_flight* p_next;
+	char* p_url;
+	PAGE_VALIDATORS sent;       // sent with the request; never changes
+	PAGE_VALIDATORS received;   // the transport's, until 'h_done' is set
+	FETCH_CTL ctl;
+	volatile LONG cancelled;    // set once every lookup has given up
+	FETCH_ABORT abort;          // aborted along with it
+	HANDLE h_done;              // set when the download is done
+	int num_waiters;            // lookups still waiting for it
+	volatile LONG refs;
+	struct fetch_coalescer* p_owner;
+
+	int res;                    // what the transport returned
+	DWORD error;                // its GetLastError()
+	char* data;                 // the page, shared by every lookup
+	DWORD size;
+} FETCH_FLIGHT;
+
+// A transport that looks up through another one, and makes lookups of a
+// page that's already being downloaded wait for that download instead of
+// starting one of their own
+typedef struct fetch_coalescer {
+	VSS_TRANSPORT transport;    // coalesces lookups through 'p_inner'
+	const VSS_TRANSPORT* p_inner;
+	SRWLOCK lock;               // for the list and the counters
+	FETCH_FLIGHT* p_flights;    // downloads in flight
+	volatile LONG num_running;  // downloads whose thread hasn't finished
+	long long num_lookups;
+	long long num_shared;       // lookups that joined a download
+} FETCH_COALESCER, * P_FETCH_COALESCER;
+
+int openFetchCoalescer(const VSS_TRANSPORT* p_inner,
+                       P_FETCH_COALESCER* pp_coal);
+void closeFetchCoalescer(P_FETCH_COALESCER p_coal);
+
+#endif
\ No newline at end of file
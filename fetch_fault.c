@@ -0,0 +1,367 @@
+////////////////////////////////////////////////////////////////////////////////
+// fetch_fault.c                                                              //
+//                                                                            //
+// This TU checks that the lookups of an EDB session follow its FETCH_POLICY  //
+// (see fetch_policy.c) when the server fails or stalls. That only happens    //
+// now and then against EDB, and never on cue, so the retries, the time       //
+// limits and the hedged requests can't be checked against it.                //
+//                                                                            //
+// A FAULT_SERVER is a VSS_TRANSPORT that stands in for EDB. It answers the   //
+// requests made to it by following a script: a few steps, each of which      //
+// answers a number of requests in a row, after a delay, with a page or with  //
+// a failure, such as a 5xx answer or a connection that timed out. A session  //
+// whose requests are sent to it (see setEdbServer()) makes its lookups the   //
+// way it does against EDB, policy, statistics and hedging included. The      //
+// waits are cut short by a request's cancel flag and timeout, as a download  //
+// is, so a request that the policy gives up on, or one that loses to its     //
+// hedge, stops the way it would against EDB.                                 //
+//                                                                            //
+// runFaultChecks() makes one lookup against each of a few scripts, on a      //
+// session of its own, and compares what the lookup returned, how many        //
+// requests it took and how long it took with what the policy should have     //
+// done. The /faultcheck command line mode (see tool_mode.c) writes the       //
+// results to a report.                                                       //
+//                                                                            //
+// A FAULT_SERVER answers above WinInet, so its stalls are cut short by the   //
+// checks between reads, never by WinInet's own timeouts. A server that       //
+// stalls before it sends the answer's headers is only given up on by those,  //
+// so one check is made through WinInet instead, to a stand-in HTTP server on //
+// the loopback interface (see http_server.c) that waits longer than a        //
+// request may take before it answers.                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "fetch_fault.h"
+#include "fetch_policy.h"
+#include "http_server.h"
+#include "mem_track.h"
+
+// The URL the checks look up; the stand-in server answers any URL the same
+#define FAULT_URL   "https://edb.stand-in/fault_check"
+
+// The path looked up on a stand-in HTTP server, which has no pages
+#define FAULT_HTTP_PATH "/fault_check"
+
+// One check: the script of the stand-in server, the policy and the lookup
+// it's made with, and what the lookup should come back with
+typedef struct fault_case {
+	const char* name;
+	FAULT_STEP steps[FAULT_MAX_STEPS];
+	int num_steps;
+	DWORD attempt_ms;           // 0 for FETCH_ATTEMPT_MS
+	DWORD timeout_ms;           // the lookup's, 0 for no limit
+	BOOL f_hedge;
+	BOOL f_cancelled;           // the lookup is cancelled before it starts
+	int num_warmup;             // lookups made first, which aren't checked
+	int res;
+	int num_requests;           // -1 if any number will do
+	int num_hedge_wins;
+	DWORD max_ms;
+	DWORD http_delay_ms;        // not 0: made through WinInet to an HTTP
+	                            // server that waits this long to answer
+} FAULT_CASE;
+
+static int faultFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                      char** p_data, DWORD* p_size);
+static const FAULT_STEP* findStep(const FAULT_SERVER* p_server, LONG num);
+static int runFaultCase(const FAULT_CASE* p_case, FAULT_CHECK* p_check);
+
+// The page the stand-in server answers with
+static const char fault_page[] = "<html><body>stand-in page</body></html>";
+
+// The checks runFaultChecks() makes. Every retry waits up to
+// FAULT_BACKOFF_MS, so the limits on the time leave room for those and
+// for a lookup that isn't scheduled at once.
+static const FAULT_CASE fault_cases[NUM_FAULT_CHECKS] = {
+	{ "5xx twice, then a page",
+	  { { VSS_SERVER_ERROR, 0, 0, 2 }, { 0, 0, 0, 0 } }, 2,
+	  0, 0, FALSE, FALSE, 0, 0, 3, 0, 1000, 0 },
+	{ "5xx every time",
+	  { { VSS_SERVER_ERROR, 0, 0, 0 } }, 1,
+	  0, 0, FALSE, FALSE, 0, VSS_SERVER_ERROR, FETCH_MAX_ATTEMPTS, 0, 1000,
+	  0 },
+	{ "connect timed out, then a page",
+	  { { VSS_NO_URL, ERROR_INTERNET_TIMEOUT, 0, 1 }, { 0, 0, 0, 0 } }, 2,
+	  0, 0, FALSE, FALSE, 0, 0, 2, 0, 1000, 0 },
+	{ "server not found",
+	  { { VSS_NO_URL, ERROR_INTERNET_NAME_NOT_RESOLVED, 0, 0 } }, 1,
+	  0, 0, FALSE, FALSE, 0, VSS_NO_URL, 1, 0, 1000, 0 },
+	{ "stuck once, then a page",
+	  { { 0, 0, 10000, 1 }, { 0, 0, 0, 0 } }, 2,
+	  300, 0, FALSE, FALSE, 0, 0, 2, 0, 1500, 0 },
+	{ "stuck past the lookup's timeout",
+	  { { 0, 0, 10000, 0 } }, 1,
+	  300, 500, FALSE, FALSE, 0, VSS_TIMED_OUT, -1, 0, 1000, 0 },
+	{ "cancelled lookup",
+	  { { 0, 0, 10000, 0 } }, 1,
+	  0, 0, FALSE, TRUE, 0, VSS_CANCELLED, 1, 0, 1000, 0 },
+	{ "slow request, hedged",
+	  { { 0, 0, 5, FETCH_HEDGE_MIN_SAMPLES }, { 0, 0, 10000, 1 },
+	    { 0, 0, 5, 0 } }, 3,
+	  0, 0, TRUE, FALSE, FETCH_HEDGE_MIN_SAMPLES, 0, 2, 1, 1500, 0 },
+	{ "stalled before headers, HTTP",
+	  { { 0 } }, 0,
+	  300, 500, FALSE, FALSE, 0, VSS_TIMED_OUT, -1, 0, 1000, 2000 },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// initFaultServer                                                            //
+//                                                                            //
+// Sets up the stand-in server '*p_server' to answer with the first           //
+// 'num_steps' of 'steps', at most FAULT_MAX_STEPS. Lookups are made to it    //
+// through its 'transport', or through an EDB session it has been set for     //
+// (see setEdbServer()). With no steps, it answers every request with a page  //
+// at once.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+void initFaultServer(P_FAULT_SERVER p_server, const FAULT_STEP* steps,
+                     int num_steps)
+{
+	memset(p_server, 0, sizeof(FAULT_SERVER));
+
+	p_server->num_steps = min(num_steps, FAULT_MAX_STEPS);
+	memcpy(p_server->steps, steps, p_server->num_steps * sizeof(FAULT_STEP));
+
+	p_server->transport.fetch = faultFetch;
+	p_server->transport.ctx = p_server;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runFaultChecks                                                             //
+//                                                                            //
+// Makes the lookup of each of the checks in 'fault_cases' (see the top of    //
+// this file) and stores what came of it in '*p_report'. Returns 0 once every //
+// check has been made, whether they passed or not, or -1 if a session can't  //
+// be opened or a stand-in HTTP server can't be started.                      //
+////////////////////////////////////////////////////////////////////////////////
+
+int runFaultChecks(FAULT_REPORT* p_report)
+{
+	int i;
+
+	memset(p_report, 0, sizeof(FAULT_REPORT));
+
+	for (i = 0; i < NUM_FAULT_CHECKS; i++) {
+		FAULT_CHECK* p_check = p_report->checks + i;
+
+		if (runFaultCase(fault_cases + i, p_check) != 0)
+			return -1;
+
+		p_report->num_checks++;
+		if (!p_check->f_passed)
+			p_report->num_failed++;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeFaultReport                                                           //
+//                                                                            //
+// Writes the checks of 'p_report' to the file 'path', one line each: whether //
+// it passed, the lookup's result, the requests it made, the retries and      //
+// hedged requests among them, the hedged requests that won, and the time it  //
+// took. Returns 0 on success, or -1 if the file can't be written.            //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeFaultReport(const FAULT_REPORT* p_report, const char* path)
+{
+	FILE* p_file;
+	int i;
+
+	if (fopen_s(&p_file, path, "w") != 0)
+		return -1;
+
+	fprintf(p_file, "Fetch policy against a stand-in server, %d of %d "
+	        "checks passed\n\n", p_report->num_checks - p_report->num_failed,
+	        p_report->num_checks);
+	fprintf(p_file, "%-6s %-32s %5s %5s %7s %6s %4s %6s\n", "", "check",
+	        "res", "reqs", "retries", "hedges", "wins", "ms");
+
+	for (i = 0; i < p_report->num_checks; i++) {
+		const FAULT_CHECK* p_check = p_report->checks + i;
+
+		fprintf(p_file, "%-6s %-32s %5d %5d %7d %6d %4d %6llu\n",
+		        p_check->f_passed ? "ok" : "FAILED", p_check->name,
+		        p_check->res, p_check->num_requests, p_check->num_retries,
+		        p_check->num_hedges, p_check->num_hedge_wins,
+		        p_check->elapsed_ms);
+	}
+
+	fclose(p_file);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// faultFetch                                                                 //
+//                                                                            //
+// The 'fetch' function of a stand-in server's transport. 'ctx' is the        //
+// server. The request is answered by the step of the script it falls on,     //
+// with the same contract as connectToEDB(); a page comes without validators, //
+// so it replaces any the request was made with.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int faultFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                      char** p_data, DWORD* p_size)
+{
+	P_FAULT_SERVER p_server = (P_FAULT_SERVER)ctx;
+	double start = nowMs();
+	const FAULT_STEP* p_step;
+	int stop;
+
+	(void)p_url;
+
+	*p_data = NULL;
+	*p_size = 0;
+
+	p_step = findStep(p_server,
+	                  InterlockedIncrement(&(p_server->num_requests)) - 1);
+
+	// Cancelled before it starts, the request is answered VSS_CANCELLED at
+	// once, as waitFetch() checks the flag first
+	if ((stop = waitFetch(p_ctl, start, p_step->delay_ms,
+	                      FAULT_POLL_MS)) != 0) {
+		InterlockedIncrement(&(p_server->num_stopped));
+		return stop;
+	}
+
+	if (p_step->res != 0) {
+		SetLastError(p_step->error);
+		return p_step->res;
+	}
+
+	if (p_ctl && p_ctl->p_validators)
+		memset(p_ctl->p_validators, 0, sizeof(PAGE_VALIDATORS));
+
+	if ((*p_data = memAlloc(MEM_NETWORK, sizeof(fault_page) - 1)) == NULL)
+		return VSS_NO_MEMORY;
+
+	memcpy(*p_data, fault_page, sizeof(fault_page) - 1);
+	*p_size = sizeof(fault_page) - 1;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findStep                                                                   //
+//                                                                            //
+// Returns the step of the script of 'p_server' that answers its request      //
+// number 'num', counting from 0. Requests past the end of the script are     //
+// answered by its last step, and without a script by a page at once.         //
+////////////////////////////////////////////////////////////////////////////////
+
+static const FAULT_STEP* findStep(const FAULT_SERVER* p_server, LONG num)
+{
+	static const FAULT_STEP page_step = { 0 };
+	int i;
+
+	if (p_server->num_steps == 0)
+		return &page_step;
+
+	for (i = 0; i < p_server->num_steps - 1; i++) {
+		if (p_server->steps[i].count == 0 || num < p_server->steps[i].count)
+			break;
+		num -= p_server->steps[i].count;
+	}
+
+	return p_server->steps + i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runFaultCase                                                               //
+//                                                                            //
+// Makes the lookup of the check '*p_case' through a session of its own,      //
+// whose requests go to a stand-in server following the check's script, and   //
+// fills '*p_check' with what came of it. A check with an 'http_delay_ms'     //
+// looks up a stand-in HTTP server with that delay through WinInet instead,   //
+// and has no script. The session's policy is the default one, with the       //
+// check's time limit per request and hedging, and short waits before retries //
+// (FAULT_BACKOFF_MS). The requests, retries and hedges counted are those of  //
+// the checked lookup alone, not of the ones made before it to time the       //
+// server. Returns 0 on success, or -1 if the session can't be opened or the  //
+// HTTP server can't be started.                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runFaultCase(const FAULT_CASE* p_case, FAULT_CHECK* p_check)
+{
+	P_EDB_SESSION p_session = NULL;
+	P_HTTP_SERVER p_http = NULL;
+	FAULT_SERVER server;
+	volatile LONG* p_num_requests = &(server.num_requests);
+	char url[64] = FAULT_URL;
+	FETCH_POLICY policy;
+	FETCH_STATS before;
+	FETCH_STATS after;
+	FETCH_CTL ctl;
+	volatile LONG cancelled = 0;
+	LONG num_before;
+	ULONGLONG start;
+	char* data;
+	DWORD size;
+	int i;
+
+	if (openEdbSession(FETCH_ATTEMPT_MS, &p_session) != 0)
+		return -1;
+
+	initFaultServer(&server, p_case->steps, p_case->num_steps);
+	if (p_case->http_delay_ms == 0)
+		setEdbServer(p_session, &(server.transport));
+	else if (openHttpServer(NULL, &p_http) == 0) {
+		p_http->delay_ms = p_case->http_delay_ms;
+		p_num_requests = &(p_http->num_requests);
+		sprintf_s(url, sizeof(url), "http://127.0.0.1:%u%s", p_http->port,
+		          FAULT_HTTP_PATH);
+	}
+	else {
+		closeEdbSession(p_session);
+		return -1;
+	}
+
+	getFetchPolicyDefaults(&policy);
+	policy.backoff_ms = FAULT_BACKOFF_MS;
+	policy.max_backoff_ms = FAULT_MAX_BACKOFF_MS;
+	policy.f_hedge = p_case->f_hedge;
+	if (p_case->attempt_ms)
+		policy.attempt_ms = p_case->attempt_ms;
+	setFetchPolicy(p_session, &policy);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.p_cancel = &cancelled;
+	ctl.timeout_ms = p_case->timeout_ms;
+
+	for (i = 0; i < p_case->num_warmup; i++) {
+		if (fetchWithPolicy(p_session, url, &ctl, &data, &size) == 0)
+			memFree(data);
+	}
+
+	cancelled = p_case->f_cancelled;
+	getFetchStats(p_session, &before);
+	num_before = *p_num_requests;
+
+	start = GetTickCount64();
+	p_check->res = fetchWithPolicy(p_session, url, &ctl, &data, &size);
+	p_check->elapsed_ms = GetTickCount64() - start;
+	if (p_check->res == 0)
+		memFree(data);
+
+	getFetchStats(p_session, &after);
+
+	// Waits for a hedged request that lost, which the server must outlive
+	closeEdbSession(p_session);
+
+	// The HTTP server finishes the answers it was waiting to send first
+	p_check->num_requests = (int)(*p_num_requests - num_before);
+	closeHttpServer(p_http);
+
+	p_check->name = p_case->name;
+	p_check->num_retries = after.num_retries - before.num_retries;
+	p_check->num_hedges = after.num_hedges - before.num_hedges;
+	p_check->num_hedge_wins = after.num_hedge_wins - before.num_hedge_wins;
+
+	p_check->f_passed = p_check->res == p_case->res &&
+	                    (p_case->num_requests < 0 ||
+	                     p_check->num_requests == p_case->num_requests) &&
+	                    p_check->num_hedge_wins == p_case->num_hedge_wins &&
+	                    p_check->elapsed_ms <= p_case->max_ms;
+	return 0;
+}
\ No newline at end of file
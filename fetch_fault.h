@@ -0,0 +1,67 @@
+#ifndef FETCH_FAULT_H_
+#define FETCH_FAULT_H_
+
+#include <Windows.h>
+#include <stdio.h>
+
+#include "vss_connect.h"
+
+// How often a stand-in request that's waiting checks its cancel flag, in ms
+#define FAULT_POLL_MS           5
+
+// The wait before the first retry of the checks, in ms, so they run
+// quickly, and the longest one
+#define FAULT_BACKOFF_MS        20
+#define FAULT_MAX_BACKOFF_MS    100
+
+// The most steps a stand-in server's script has
+#define FAULT_MAX_STEPS         4
+
+// What a stand-in server does with 'count' requests in a row (0 for every
+// request from there on): it waits 'delay_ms', then answers with 'res', 0
+// for a page or a connectToEDB() failure, with 'error' as GetLastError()
+typedef struct fault_step {
+	int res;
+	DWORD error;
+	DWORD delay_ms;
+	int count;
+} FAULT_STEP;
+
+// A transport that stands in for EDB, and answers the requests made to it
+// by following a script of steps, in the order they come
+typedef struct fault_server {
+	VSS_TRANSPORT transport;    // answers from 'steps'
+	FAULT_STEP steps[FAULT_MAX_STEPS];
+	int num_steps;
+	volatile LONG num_requests;
+	volatile LONG num_stopped;  // cancelled or timed out while waiting
+} FAULT_SERVER, * P_FAULT_SERVER;
+
+// The number of checks runFaultChecks() makes
+#define NUM_FAULT_CHECKS        9
+
+// One check of runFaultChecks(): what the lookup returned, what it took,
+// and whether that's what the session's FETCH_POLICY should have done
+typedef struct fault_check {
+	const char* name;
+	int res;
+	int num_requests;
+	int num_retries;
+	int num_hedges;
+	int num_hedge_wins;
+	ULONGLONG elapsed_ms;
+	BOOL f_passed;
+} FAULT_CHECK;
+
+typedef struct fault_report {
+	int num_checks;
+	int num_failed;
+	FAULT_CHECK checks[NUM_FAULT_CHECKS];
+} FAULT_REPORT;
+
+void initFaultServer(P_FAULT_SERVER p_server, const FAULT_STEP* steps,
+                     int num_steps);
+int runFaultChecks(FAULT_REPORT* p_report);
+int writeFaultReport(const FAULT_REPORT* p_report, const char* path);
+
+#endif
\ No newline at end of file
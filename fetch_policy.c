@@ -0,0 +1,549 @@
+////////////////////////////////////////////////////////////////////////////////
+// fetch_policy.c                                                             //
+//                                                                            //
+// This TU makes the lookups of an EDB session's transport (see               //
+// vss_connect.h) hold up against a slow or failing server. connectToEDB()    //
+// makes a single request, which either succeeds or fails; over the VPN, a    //
+// request now and then fails for reasons that are gone a moment later, such  //
+// as a dropped connection or a server that's restarting, and now and then    //
+// one takes many times as long as the rest, stuck behind a slow server or a  //
+// lost packet.                                                               //
+//                                                                            //
+// fetchWithPolicy() makes the lookup in up to 'max_attempts' requests,       //
+// following the session's FETCH_POLICY. A request that failed in a way that  //
+// may not last is made again, after a wait that doubles with every retry, so //
+// a server that's struggling isn't flooded, and is picked at random up to    //
+// that length, so lookups that failed together don't all retry together.     //
+// Every request is limited to 'attempt_ms', so one that's stuck is given up  //
+// on while there's still time for another, and none goes past the timeout of //
+// the lookup. The requests are GETs of a page, so making one again has no    //
+// effect on EDB.                                                             //
+//                                                                            //
+// The session keeps a histogram of how long its lookups take (see            //
+// FETCH_STATS). With hedging turned on, a request that's still running after //
+// the 95th percentile of that time gets a second request for the same page,  //
+// and whichever succeeds first is used. That only costs a second request for //
+// the slowest 5% of lookups, and cuts the long tail of the time a lookup     //
+// takes down to about the 95th percentile plus a typical lookup. The first   //
+// request is made on the lookup's own thread, which is already a worker (see //
+// spec_job.c), and a thread is only started for the second one, when it's    //
+// needed. If the second request wins, the first is aborted (see              //
+// abortFetch()); if the first wins, the second is cancelled and finishes on  //
+// its own, and the session waits for it before it's closed. When the lookup  //
+// is cancelled, both are aborted.                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "fetch_policy.h"
+#include "mem_track.h"
+
+static BOOL isTransient(int res, DWORD error);
+static void makeAttemptCtl(const FETCH_CTL* p_ctl, double start,
+                           DWORD attempt_ms, FETCH_CTL* p_attempt);
+static DWORD randomBelow(DWORD n);
+static void countEvent(P_EDB_SESSION p_session, int* p_count);
+static int hedgedFetch(P_EDB_SESSION p_session, const char* p_url,
+                       const FETCH_CTL* p_ctl, DWORD hedge_ms,
+                       char** p_data, DWORD* p_size);
+static VOID CALLBACK hedgeTimer(PVOID param, BOOLEAN f_fired);
+static FETCH_ATTEMPT* startAttempt(P_EDB_SESSION p_session,
+                                   const char* p_url, const FETCH_CTL* p_ctl,
+                                   double start);
+static DWORD WINAPI attemptWorker(LPVOID param);
+static void releaseAttempt(FETCH_ATTEMPT* p_attempt);
+static void freeAttempt(FETCH_ATTEMPT* p_attempt);
+
+////////////////////////////////////////////////////////////////////////////////
+// getFetchPolicyDefaults                                                     //
+//                                                                            //
+// Fills 'p_policy' with the policy a session starts with: FETCH_MAX_ATTEMPTS //
+// requests of at most FETCH_ATTEMPT_MS each, with retries after              //
+// FETCH_BACKOFF_MS, doubling up to FETCH_MAX_BACKOFF_MS, and without         //
+// hedging.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+void getFetchPolicyDefaults(FETCH_POLICY* p_policy)
+{
+	memset(p_policy, 0, sizeof(FETCH_POLICY));
+	p_policy->max_attempts = FETCH_MAX_ATTEMPTS;
+	p_policy->attempt_ms = FETCH_ATTEMPT_MS;
+	p_policy->backoff_ms = FETCH_BACKOFF_MS;
+	p_policy->max_backoff_ms = FETCH_MAX_BACKOFF_MS;
+	p_policy->f_hedge = FALSE;
+	p_policy->hedge_min_samples = FETCH_HEDGE_MIN_SAMPLES;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setFetchPolicy                                                             //
+//                                                                            //
+// Makes lookups through the transport of 'p_session' follow '*p_policy'.     //
+// WinInet bounds connecting, sending a request and waiting for the answer    //
+// for the whole session, not for each request, so those timeouts are set to  //
+// 'attempt_ms' here, or to the timeout the session was opened with if that's //
+// shorter. A server that stalls before it sends the headers is then given up //
+// on as soon as one that stops partway through the page.                     //
+////////////////////////////////////////////////////////////////////////////////
+
+void setFetchPolicy(P_EDB_SESSION p_session, const FETCH_POLICY* p_policy)
+{
+	DWORD timeout = p_session->timeout_ms;
+
+	if (p_policy->attempt_ms && p_policy->attempt_ms < timeout)
+		timeout = p_policy->attempt_ms;
+
+	AcquireSRWLockExclusive(&(p_session->lock));
+	p_session->policy = *p_policy;
+	ReleaseSRWLockExclusive(&(p_session->lock));
+
+	InternetSetOptionA(p_session->h_open, INTERNET_OPTION_CONNECT_TIMEOUT,
+	                   &timeout, sizeof(timeout));
+	InternetSetOptionA(p_session->h_open, INTERNET_OPTION_SEND_TIMEOUT,
+	                   &timeout, sizeof(timeout));
+	InternetSetOptionA(p_session->h_open, INTERNET_OPTION_RECEIVE_TIMEOUT,
+	                   &timeout, sizeof(timeout));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// fetchWithPolicy                                                            //
+//                                                                            //
+// Looks up 'p_url' through 'p_session' the way its policy says (see the top  //
+// of this file), with the same arguments and results as connectToEDB().      //
+// 'p_ctl' bounds the whole lookup, retries and waits included. When every    //
+// request fails, the result is the last one's, unless the lookup was         //
+// cancelled while it waited for a retry, which returns VSS_CANCELLED.        //
+//                                                                            //
+// Hedging only starts once the session has timed 'hedge_min_samples' lookups //
+// that succeeded, since before that its 95th percentile says little.         //
+////////////////////////////////////////////////////////////////////////////////
+
+int fetchWithPolicy(P_EDB_SESSION p_session, const char* p_url,
+                    const FETCH_CTL* p_ctl, char** p_data, DWORD* p_size)
+{
+	double start = nowMs();
+	FETCH_POLICY policy;
+	DWORD backoff;
+	DWORD hedge_ms = 0;
+	int attempt;
+	int res = 0;
+
+	AcquireSRWLockShared(&(p_session->lock));
+	policy = p_session->policy;
+	ReleaseSRWLockShared(&(p_session->lock));
+
+	if (policy.f_hedge) {
+		FETCH_STATS stats;
+		int num_timed = 0;
+		int i;
+
+		getFetchStats(p_session, &stats);
+		for (i = 0; i < FETCH_HIST_BUCKETS; i++)
+			num_timed += stats.latency_hist[i];
+
+		// At least 1 ms, as 0 stands for no hedging
+		if (num_timed >= policy.hedge_min_samples)
+			hedge_ms = max((DWORD)getFetchPercentile(&stats, 95), 1);
+	}
+
+	backoff = policy.backoff_ms;
+	for (attempt = 0; attempt < max(policy.max_attempts, 1); attempt++) {
+		FETCH_CTL ctl;
+
+		if (attempt > 0) {
+			// waitFetch() counts the wait from the start of the lookup
+			double wait_ms = nowMs() - start + randomBelow(backoff + 1);
+			int stop = VSS_TIMED_OUT;
+
+			// Not worth waiting for if the lookup would run out of time first
+			if (!p_ctl || !p_ctl->timeout_ms || wait_ms < p_ctl->timeout_ms)
+				stop = waitFetch(p_ctl, start, wait_ms, FETCH_POLL_MS);
+
+			// Out of time, the last failure says more than a timeout
+			if (stop) {
+				if (stop == VSS_CANCELLED)
+					res = stop;
+				break;
+			}
+
+			backoff = min(backoff * 2, policy.max_backoff_ms);
+			countEvent(p_session, &(p_session->stats.num_retries));
+		}
+
+		makeAttemptCtl(p_ctl, start, policy.attempt_ms, &ctl);
+
+		if (hedge_ms)
+			res = hedgedFetch(p_session, p_url, &ctl, hedge_ms, p_data,
+			                  p_size);
+		else
+			res = connectToEDB(p_session, p_url, &ctl, p_data, p_size);
+
+		if (!isTransient(res, GetLastError()))
+			break;
+	}
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// isTransient                                                                //
+//                                                                            //
+// Returns TRUE if a request that failed with 'res', and 'error' from         //
+// GetLastError(), may well succeed if it's made again: a page that stopped   //
+// arriving or took too long, a 5xx answer, or a connection that timed out or //
+// was dropped. A server that can't be found or refuses the connection (e.g.  //
+// when the computer isn't on Volvo's network) isn't tried again, so the      //
+// window falls back on a stale page without delay.                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL isTransient(int res, DWORD error)
+{
+	switch (res) {
+	case VSS_READ_FAILED:
+	case VSS_TIMED_OUT:
+	case VSS_SERVER_ERROR:
+		return TRUE;
+
+	case VSS_NO_URL:
+		return error == ERROR_INTERNET_TIMEOUT ||
+		       error == ERROR_INTERNET_CONNECTION_RESET ||
+		       error == ERROR_INTERNET_CONNECTION_ABORTED;
+	}
+
+	return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// makeAttemptCtl                                                             //
+//                                                                            //
+// Fills '*p_attempt' for one request of a lookup bounded by 'p_ctl', which   //
+// started at 'start': the request has the lookup's cancel flag, validators   //
+// and FETCH_ABORT, and may take 'attempt_ms', or whatever is left of the     //
+// lookup's timeout if that's less. 'p_ctl' may be NULL, and 'attempt_ms' 0   //
+// for no limit of its own.                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static void makeAttemptCtl(const FETCH_CTL* p_ctl, double start,
+                           DWORD attempt_ms, FETCH_CTL* p_attempt)
+{
+	p_attempt->p_cancel = p_ctl ? p_ctl->p_cancel : NULL;
+	p_attempt->p_validators = p_ctl ? p_ctl->p_validators : NULL;
+	p_attempt->p_abort = p_ctl ? p_ctl->p_abort : NULL;
+	p_attempt->timeout_ms = attempt_ms;
+
+	if (p_ctl && p_ctl->timeout_ms) {
+		double elapsed = nowMs() - start;
+		DWORD left = 1;
+
+		// A request with no time left fails straight away
+		if (elapsed < p_ctl->timeout_ms)
+			left = max((DWORD)(p_ctl->timeout_ms - elapsed), 1);
+
+		if (!attempt_ms || left < attempt_ms)
+			p_attempt->timeout_ms = left;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// randomBelow                                                                //
+//                                                                            //
+// Returns a number from 0 to 'n' - 1, or 0 if 'n' is 0, made from the        //
+// performance counter. It's nowhere near random enough for anything but      //
+// spreading retries out in time, which is all it's used for.                 //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD randomBelow(DWORD n)
+{
+	LARGE_INTEGER now;
+	ULONGLONG x;
+
+	if (n == 0)
+		return 0;
+
+	QueryPerformanceCounter(&now);
+	x = (ULONGLONG)now.QuadPart * 6364136223846793005ULL +
+	    1442695040888963407ULL;
+	return (DWORD)((x >> 33) % n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// countEvent                                                                 //
+//                                                                            //
+// Adds one to the counter '*p_count' of the statistics of 'p_session', under //
+// the session's lock.                                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static void countEvent(P_EDB_SESSION p_session, int* p_count)
+{
+	AcquireSRWLockExclusive(&(p_session->lock));
+	(*p_count)++;
+	ReleaseSRWLockExclusive(&(p_session->lock));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// hedgedFetch                                                                //
+//                                                                            //
+// Makes one request of a lookup, hedged: the request is made on this thread, //
+// and if it's still running after 'hedge_ms', a second one is started        //
+// alongside it on a thread of its own (see hedgeTimer()). The first to       //
+// succeed is used, with its page returned in '*p_data' and '*p_size' and its //
+// validators copied to 'p_ctl'. If both fail, the first one's result is      //
+// returned. When the second request wins, the first is aborted; when the     //
+// first wins, the second is cancelled, and isn't waited for. The lookup's    //
+// cancel flag is passed on to both requests.                                 //
+//                                                                            //
+// If the timer can't be created, the request is made without a hedge.        //
+// Returns what connectToEDB() does, with GetLastError() set from the request //
+// whose result is returned.                                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int hedgedFetch(P_EDB_SESSION p_session, const char* p_url,
+                       const FETCH_CTL* p_ctl, DWORD hedge_ms,
+                       char** p_data, DWORD* p_size)
+{
+	FETCH_HEDGE hedge;
+	FETCH_CTL ctl = *p_ctl;
+	FETCH_ATTEMPT* p_second;
+	HANDLE h_timer;
+	DWORD error;
+	int res;
+
+	memset(&hedge, 0, sizeof(FETCH_HEDGE));
+	hedge.p_session = p_session;
+	hedge.p_url = p_url;
+	hedge.p_ctl = p_ctl;
+	hedge.start = nowMs();
+	hedge.hedge_ms = hedge_ms;
+	InitializeSRWLock(&(hedge.abort.lock));
+
+	// The first request writes the lookup's validators when it's done, so
+	// the second is started from a copy of what they were
+	hedge.second_ctl = *p_ctl;
+	if (p_ctl->p_validators) {
+		hedge.validators = *p_ctl->p_validators;
+		hedge.second_ctl.p_validators = &(hedge.validators);
+	}
+
+	if (!CreateTimerQueueTimer(&h_timer, NULL, hedgeTimer, &hedge,
+	                           FETCH_POLL_MS, FETCH_POLL_MS,
+	                           WT_EXECUTEDEFAULT))
+		return connectToEDB(p_session, p_url, p_ctl, p_data, p_size);
+
+	ctl.p_cancel = &(hedge.cancelled);
+	ctl.p_abort = &(hedge.abort);
+	res = connectToEDB(p_session, p_url, &ctl, p_data, p_size);
+	error = GetLastError();
+
+	// Waits for a callback that's running, after which 'hedge' is this
+	// thread's alone
+	DeleteTimerQueueTimer(NULL, h_timer, INVALID_HANDLE_VALUE);
+	p_second = hedge.p_second;
+
+	// The first request failed, or was aborted because the second one had
+	// succeeded, so the second is waited for. It has what's left of the
+	// lookup's time, and its cancel flag is kept in step with the lookup's.
+	if (res < 0 && p_second) {
+		while (WaitForSingleObject(p_second->h_done, FETCH_POLL_MS) !=
+		       WAIT_OBJECT_0) {
+			if (p_ctl->p_cancel && *p_ctl->p_cancel) {
+				p_second->cancelled = TRUE;
+				abortFetch(&(p_second->abort));
+			}
+		}
+
+		if (p_second->res >= 0) {
+			res = p_second->res;
+			error = p_second->error;
+			*p_data = p_second->data;
+			*p_size = p_second->size;
+			p_second->data = NULL;
+			if (p_ctl->p_validators)
+				*p_ctl->p_validators = p_second->validators;
+			countEvent(p_session, &(p_session->stats.num_hedge_wins));
+		}
+	}
+
+	// A second request that's still running stops at its next read, and
+	// frees itself when it's done
+	if (p_second) {
+		p_second->cancelled = TRUE;
+		releaseAttempt(p_second);
+	}
+
+	SetLastError(error);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// hedgeTimer                                                                 //
+//                                                                            //
+// The timer callback of a hedged request, run every FETCH_POLL_MS while the  //
+// first request is running. 'param' is the FETCH_HEDGE. Passes the lookup's  //
+// cancel flag on to both requests, and aborts them once it's set, so a       //
+// cancelled lookup stops within FETCH_POLL_MS even while a request waits for //
+// the server. Starts the second request once 'hedge_ms' has passed, and      //
+// aborts the first once the second has succeeded.                            //
+//                                                                            //
+// Starting a thread and closing a request's handle can take a while, so the  //
+// callback runs on a thread of the pool rather than on the timer queue's     //
+// own, which would hold up every other timer of the process. A call that     //
+// comes while the one before is still running returns at once, so only one   //
+// second request is ever started.                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+static VOID CALLBACK hedgeTimer(PVOID param, BOOLEAN f_fired)
+{
+	FETCH_HEDGE* p_hedge = (FETCH_HEDGE*)param;
+	const FETCH_CTL* p_ctl = p_hedge->p_ctl;
+	FETCH_ATTEMPT* p_second = p_hedge->p_second;
+
+	UNREFERENCED_PARAMETER(f_fired);
+
+	if (InterlockedCompareExchange(&(p_hedge->busy), 1, 0) != 0)
+		return;
+
+	if (p_ctl->p_cancel && *p_ctl->p_cancel) {
+		p_hedge->cancelled = TRUE;
+		abortFetch(&(p_hedge->abort));
+		if (p_second) {
+			p_second->cancelled = TRUE;
+			abortFetch(&(p_second->abort));
+		}
+		InterlockedExchange(&(p_hedge->busy), 0);
+		return;
+	}
+
+	if (!p_second && !p_hedge->f_no_second &&
+	    nowMs() - p_hedge->start >= p_hedge->hedge_ms) {
+		p_second = startAttempt(p_hedge->p_session, p_hedge->p_url,
+		                        &(p_hedge->second_ctl), p_hedge->start);
+		if (p_second) {
+			p_hedge->p_second = p_second;
+			countEvent(p_hedge->p_session,
+			           &(p_hedge->p_session->stats.num_hedges));
+		}
+		else
+			p_hedge->f_no_second = TRUE;
+	}
+
+	if (p_second && !p_hedge->cancelled &&
+	    WaitForSingleObject(p_second->h_done, 0) == WAIT_OBJECT_0 &&
+	    p_second->res >= 0) {
+		p_hedge->cancelled = TRUE;
+		abortFetch(&(p_hedge->abort));
+	}
+
+	InterlockedExchange(&(p_hedge->busy), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// startAttempt                                                               //
+//                                                                            //
+// Starts the second request of a hedged lookup, for 'p_url' through          //
+// 'p_session', on a new thread, with the validators of 'p_ctl' and the time  //
+// left of its timeout, counted from 'start'. Returns the attempt, or NULL if //
+// it couldn't be allocated or its thread couldn't be started.                //
+////////////////////////////////////////////////////////////////////////////////
+
+static FETCH_ATTEMPT* startAttempt(P_EDB_SESSION p_session,
+                                   const char* p_url, const FETCH_CTL* p_ctl,
+                                   double start)
+{
+	FETCH_ATTEMPT* p_attempt;
+	size_t length = strlen(p_url) + 1;
+	HANDLE h_thread;
+
+	p_attempt = memCalloc(MEM_NETWORK, 1, sizeof(FETCH_ATTEMPT));
+	if (!p_attempt)
+		return NULL;
+
+	p_attempt->p_session = p_session;
+	p_attempt->refs = 2;
+	p_attempt->ctl.p_cancel = &(p_attempt->cancelled);
+	p_attempt->ctl.p_abort = &(p_attempt->abort);
+	InitializeSRWLock(&(p_attempt->abort.lock));
+
+	if (p_ctl->timeout_ms) {
+		double elapsed = nowMs() - start;
+
+		p_attempt->ctl.timeout_ms = 1;
+		if (elapsed < p_ctl->timeout_ms)
+			p_attempt->ctl.timeout_ms = max((DWORD)(p_ctl->timeout_ms -
+			                                        elapsed), 1);
+	}
+
+	if (p_ctl->p_validators) {
+		p_attempt->validators = *p_ctl->p_validators;
+		p_attempt->ctl.p_validators = &(p_attempt->validators);
+	}
+
+	if ((p_attempt->p_url = memAlloc(MEM_NETWORK, length)) == NULL ||
+	    (p_attempt->h_done = CreateEventA(NULL, TRUE, FALSE, NULL)) == NULL) {
+		freeAttempt(p_attempt);
+		return NULL;
+	}
+	memcpy(p_attempt->p_url, p_url, length);
+
+	InterlockedIncrement(&(p_session->num_attempts));
+	h_thread = CreateThread(NULL, 0, attemptWorker, p_attempt, 0, NULL);
+	if (!h_thread) {
+		InterlockedDecrement(&(p_session->num_attempts));
+		freeAttempt(p_attempt);
+		return NULL;
+	}
+
+	CloseHandle(h_thread);
+	return p_attempt;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// attemptWorker                                                              //
+//                                                                            //
+// The thread of a request started by startAttempt(). 'param' is the attempt. //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD WINAPI attemptWorker(LPVOID param)
+{
+	FETCH_ATTEMPT* p_attempt = (FETCH_ATTEMPT*)param;
+	P_EDB_SESSION p_session = p_attempt->p_session;
+
+	p_attempt->res = connectToEDB(p_session, p_attempt->p_url,
+	                              &(p_attempt->ctl), &(p_attempt->data),
+	                              &(p_attempt->size));
+	p_attempt->error = GetLastError();
+
+	SetEvent(p_attempt->h_done);
+	releaseAttempt(p_attempt);
+
+	// The session may be closed as soon as this is done
+	InterlockedDecrement(&(p_session->num_attempts));
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// releaseAttempt                                                             //
+//                                                                            //
+// Lets go of 'p_attempt', for the thread or the lookup, and frees it once    //
+// both have.                                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+static void releaseAttempt(FETCH_ATTEMPT* p_attempt)
+{
+	if (InterlockedDecrement(&(p_attempt->refs)) == 0)
+		freeAttempt(p_attempt);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeAttempt                                                                //
+//                                                                            //
+// Frees 'p_attempt', with the page it got if the lookup didn't take it.      //
+////////////////////////////////////////////////////////////////////////////////
+
+static void freeAttempt(FETCH_ATTEMPT* p_attempt)
+{
+	if (p_attempt->h_done)
+		CloseHandle(p_attempt->h_done);
+
+	memFree(p_attempt->data);
+	memFree(p_attempt->p_url);
+	memFree(p_attempt);
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef FETCH_POLICY_H_
+#define FETCH_POLICY_H_
+
+#include <Windows.h>
+
+#include "vss_connect.h"
+
+// How often a lookup that's waiting, for a retry or for its requests,
+// checks its cancel flag, in ms
+#define FETCH_POLL_MS   20
+
+// One request of a hedged lookup, running on a thread of its own. It's
+// shared by the thread and the lookup, and freed by whichever lets go of it
+// last, since the lookup doesn't wait for the request that loses.
+typedef struct fetch_attempt {
+	P_EDB_SESSION p_session;
+	char* p_url;
+	FETCH_CTL ctl;
+	volatile LONG cancelled;
+	FETCH_ABORT abort;
+	PAGE_VALIDATORS validators;
+	HANDLE h_done;              // set when the request is done
+	volatile LONG refs;
+
+	int res;                    // connectToEDB() result
+	DWORD error;                // its GetLastError()
+	char* data;                 // NULL once the lookup has taken it
+	DWORD size;
+} FETCH_ATTEMPT;
+
+// A hedged request: the first request runs on the lookup's thread, and a
+// timer checks on it every FETCH_POLL_MS, from a thread of the pool, one
+// callback at a time. Once the timer is deleted, only the lookup touches it.
+typedef struct fetch_hedge {
+	P_EDB_SESSION p_session;
+	const char* p_url;
+	const FETCH_CTL* p_ctl;     // the lookup's
+	FETCH_CTL second_ctl;       // what the second request is started with
+	PAGE_VALIDATORS validators; // sent with both requests
+	double start;               // a nowMs() value
+	DWORD hedge_ms;
+	volatile LONG cancelled;    // the first request's cancel flag
+	FETCH_ABORT abort;          // the first request's
+	FETCH_ATTEMPT* p_second;    // NULL until the hedge fires
+	BOOL f_no_second;           // the second request couldn't be started
+	volatile LONG busy;         // a timer callback is running
+} FETCH_HEDGE;
+
+void getFetchPolicyDefaults(FETCH_POLICY* p_policy);
+void setFetchPolicy(P_EDB_SESSION p_session, const FETCH_POLICY* p_policy);
+int fetchWithPolicy(P_EDB_SESSION p_session, const char* p_url,
+                    const FETCH_CTL* p_ctl, char** p_data, DWORD* p_size);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,601 @@
+////////////////////////////////////////////////////////////////////////////////
+// fetch_replay.c                                                             //
+//                                                                            //
+// This TU records EDB lookups to a directory of fixture files, and replays   //
+// them, so the load pipeline (see spec_job.c) can be measured without EDB.   //
+// Off Volvo's network nothing past connectToEDB() can be run at all, and on  //
+// it the times depend on the VPN more than on the tool.                      //
+//                                                                            //
+// A FETCH_RECORDER is a VSS_TRANSPORT that looks up through another one,     //
+// usually an EDB session's, and writes every lookup to the directory on its  //
+// way back: the page to a file of its own, and a line to index.txt with the  //
+// result, the time the lookup took, the page's length and its validators,    //
+// and the URL. Each line is flushed as it's written, so a recording that's   //
+// cut short keeps what it has.                                               //
+//                                                                            //
+// A FETCH_REPLAY loads the directory into memory and answers lookups from    //
+// it, without any network. A URL that was recorded more than once answers    //
+// with the last recording, and one that wasn't recorded fails the way an     //
+// unreachable server does. How long a lookup takes comes from a              //
+// REPLAY_PROFILE: the time that was recorded, or a fixed latency plus the    //
+// page's length at a fixed rate, so runs on any computer can be compared.    //
+// The wait is cut short by the lookup's cancel flag and timeout, as a        //
+// download is, and a lookup whose validators match the recorded page answers //
+// VSS_NOT_MODIFIED, so the spec cache behaves as it does against EDB.        //
+//                                                                            //
+// The /record command line mode (see tool_mode.c) makes a recording of the   //
+// specs of a list, and /replaybench runs the list through the spec jobs      //
+// again with a replay of it, under each of a few profiles (see               //
+// measureReplay()).                                                          //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "fetch_replay.h"
+#include "mem_track.h"
+
+static int recorderFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                         char** p_data, DWORD* p_size);
+static int writeRecord(P_FETCH_RECORDER p_rec, const char* p_url, int res,
+                       double ms, const char* data, DWORD size,
+                       const PAGE_VALIDATORS* p_validators);
+static int replayFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                       char** p_data, DWORD* p_size);
+static BOOL sameValidators(const PAGE_VALIDATORS* p_a,
+                           const PAGE_VALIDATORS* p_b);
+static int loadEntries(P_FETCH_REPLAY p_replay, const char* dir, FILE* fp);
+static int addEntry(P_FETCH_REPLAY p_replay, const REPLAY_ENTRY* p_entry);
+static REPLAY_ENTRY* findEntry(const FETCH_REPLAY* p_replay,
+                               const char* p_url);
+static void getFixturePath(const char* dir, int num, char* path);
+
+// The profiles measureReplay() runs, the first of which is also a replay's
+// profile until setReplayProfile() is called. "none" times the pipeline
+// alone; "lan" is about a 100 Mbit/s office network, and "vpn" about the
+// VPN from home.
+static const REPLAY_PROFILE replay_profiles[NUM_REPLAY_PROFILES] = {
+	{ "recorded", TRUE,  0,  0 },
+	{ "none",     FALSE, 0,  0 },
+	{ "lan",      FALSE, 2,  12500 },
+	{ "vpn",      FALSE, 80, 250 },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// openFetchRecorder                                                          //
+//                                                                            //
+// Creates the fixture directory 'dir', if it doesn't exist, and starts a new //
+// recording in it, which replaces the index of any earlier one. The recorder //
+// is returned in '*pp_rec', and lookups made through its 'transport' go      //
+// through 'p_inner' and are recorded. Returns 0 on success, -1 if there      //
+// isn't enough memory, -2 if the directory can't be created, or -3 if the    //
+// index file can't be written.                                               //
+////////////////////////////////////////////////////////////////////////////////
+
+int openFetchRecorder(const char* dir, const VSS_TRANSPORT* p_inner,
+                      P_FETCH_RECORDER* pp_rec)
+{
+	P_FETCH_RECORDER p_rec;
+	char path[MAX_PATH];
+
+	*pp_rec = NULL;
+
+	if ((p_rec = memCalloc(MEM_NETWORK, 1, sizeof(FETCH_RECORDER))) == NULL)
+		return -1;
+
+	strcpy_s(p_rec->dir, MAX_PATH, dir);
+	if (!CreateDirectoryA(p_rec->dir, NULL) &&
+	    GetLastError() != ERROR_ALREADY_EXISTS) {
+		memFree(p_rec);
+		return -2;
+	}
+
+	sprintf_s(path, MAX_PATH, "%s\\index.txt", p_rec->dir);
+	if (fopen_s(&(p_rec->p_index), path, "w") != 0) {
+		memFree(p_rec);
+		return -3;
+	}
+	fprintf(p_rec->p_index, "# num res ms size modified etag url\n");
+
+	p_rec->p_inner = p_inner;
+	p_rec->transport.fetch = recorderFetch;
+	p_rec->transport.ctx = p_rec;
+	InitializeSRWLock(&(p_rec->lock));
+
+	*pp_rec = p_rec;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// closeFetchRecorder                                                         //
+//                                                                            //
+// Closes the recording's index file and frees the recorder. No lookup may be //
+// running through it. 'p_rec' may be NULL.                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+void closeFetchRecorder(P_FETCH_RECORDER p_rec)
+{
+	if (!p_rec)
+		return;
+
+	fclose(p_rec->p_index);
+	memFree(p_rec);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// openFetchReplay                                                            //
+//                                                                            //
+// Loads the recording in the fixture directory 'dir' into a new replay,      //
+// returned in '*pp_replay', which times its lookups the way they were        //
+// recorded until setReplayProfile() says otherwise. Returns 0 on success, -1 //
+// if there isn't enough memory, -2 if there's no recording in the directory, //
+// or -3 if the page of a recorded lookup is missing or short.                //
+////////////////////////////////////////////////////////////////////////////////
+
+int openFetchReplay(const char* dir, P_FETCH_REPLAY* pp_replay)
+{
+	P_FETCH_REPLAY p_replay;
+	char path[MAX_PATH];
+	FILE* fp;
+	int res;
+
+	*pp_replay = NULL;
+
+	if ((p_replay = memCalloc(MEM_NETWORK, 1, sizeof(FETCH_REPLAY))) == NULL)
+		return -1;
+
+	sprintf_s(path, MAX_PATH, "%s\\index.txt", dir);
+	if (fopen_s(&fp, path, "r") != 0) {
+		memFree(p_replay);
+		return -2;
+	}
+
+	res = loadEntries(p_replay, dir, fp);
+	fclose(fp);
+
+	if (res != 0) {
+		closeFetchReplay(p_replay);
+		return res;
+	}
+
+	p_replay->profile = replay_profiles[0];
+	p_replay->transport.fetch = replayFetch;
+	p_replay->transport.ctx = p_replay;
+
+	*pp_replay = p_replay;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setReplayProfile                                                           //
+//                                                                            //
+// Makes the lookups through 'p_replay' take as long as '*p_profile' says. No //
+// lookup may be running through it.                                          //
+////////////////////////////////////////////////////////////////////////////////
+
+void setReplayProfile(P_FETCH_REPLAY p_replay,
+                      const REPLAY_PROFILE* p_profile)
+{
+	p_replay->profile = *p_profile;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// closeFetchReplay                                                           //
+//                                                                            //
+// Frees a replay and the pages it loaded. No lookup may be running through   //
+// it. 'p_replay' may be NULL.                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void closeFetchReplay(P_FETCH_REPLAY p_replay)
+{
+	int i;
+
+	if (!p_replay)
+		return;
+
+	for (i = 0; i < p_replay->num_entries; i++)
+		memFree(p_replay->entries[i].data);
+
+	memFree(p_replay->entries);
+	memFree(p_replay);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// measureReplay                                                              //
+//                                                                            //
+// Loads every VSS and order number listed in the file 'list_path' (see       //
+// readPrefetchList()) through a replay of the recording in the fixture       //
+// directory 'dir', with spec jobs matching 'p_rules', once for every profile //
+// in replay_profiles with one job at a time and once with PREFETCH_CONNS,    //
+// and stores the totals of each run in '*p_bench'. Nothing is cached, so     //
+// every spec goes through the whole pipeline each time: the lookup, parsing, //
+// matching and the layout. Returns 0 on success, -1 if the list can't be     //
+// read, -2 if the recording can't be loaded (see openFetchReplay()), or -3   //
+// if a run can't be started.                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+int measureReplay(const char* list_path, const char* dir,
+                  const struct rule_set* p_rules, REPLAY_BENCH* p_bench)
+{
+	const int conns[2] = { 1, PREFETCH_CONNS };
+	P_FETCH_REPLAY p_replay;
+	int res = 0;
+	int i, j;
+
+	memset(p_bench, 0, sizeof(REPLAY_BENCH));
+
+	if (openFetchReplay(dir, &p_replay) != 0)
+		return -2;
+	p_bench->num_entries = p_replay->num_entries;
+
+	for (i = 0; i < NUM_REPLAY_PROFILES && res == 0; i++) {
+		setReplayProfile(p_replay, replay_profiles + i);
+
+		for (j = 0; j < 2 && res == 0; j++) {
+			REPLAY_RUN* p_bench_run = p_bench->runs + p_bench->num_runs;
+			P_PREFETCH_RUN p_run;
+
+			// A new run for each pass, as its totals only add up
+			if (readPrefetchList(list_path, &p_run) != 0) {
+				res = -1;
+				break;
+			}
+
+			if (runPrefetch(p_run, conns[j], p_rules,
+			                &(p_replay->transport), NULL) != 0) {
+				freePrefetch(p_run);
+				res = -3;
+				break;
+			}
+
+			p_bench->num_items = p_run->num_items;
+			p_bench_run->profile = replay_profiles[i].name;
+			p_bench_run->num_conns = p_run->num_conns;
+			p_bench_run->num_ok = p_run->num_ok;
+			p_bench_run->num_failed = p_run->num_failed;
+			p_bench_run->elapsed_ms = p_run->elapsed_ms;
+			p_bench_run->job_ms = p_run->job_ms;
+			p_bench->num_runs++;
+
+			freePrefetch(p_run);
+		}
+	}
+
+	p_bench->num_unknown = p_replay->num_unknown;
+
+	// The jobs have posted their results, but may not have returned yet
+	waitSpecJobs(SPEC_JOB_TIMEOUT);
+	closeFetchReplay(p_replay);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeReplayReport                                                          //
+//                                                                            //
+// Writes the runs of 'p_bench' to the file 'path': for each profile and      //
+// number of jobs at a time, the specs that loaded, the wall time of the list //
+// and the average time of a job. The difference between a profile and "none" //
+// is what the network costs; "none" itself is the pipeline. Returns 0 on     //
+// success, or -1 if the file can't be written.                               //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeReplayReport(const REPLAY_BENCH* p_bench, const char* path)
+{
+	FILE* p_file;
+	int i;
+
+	if (fopen_s(&p_file, path, "w") != 0)
+		return -1;
+
+	fprintf(p_file, "Replayed loads, %d specs, %d recorded lookups\n\n",
+	        p_bench->num_items, p_bench->num_entries);
+	fprintf(p_file, "%-10s %5s %6s %6s %10s %10s\n", "profile", "conns",
+	        "ok", "failed", "wall ms", "avg job ms");
+
+	for (i = 0; i < p_bench->num_runs; i++) {
+		const REPLAY_RUN* p_run = p_bench->runs + i;
+		int num_jobs = p_run->num_ok + p_run->num_failed;
+
+		fprintf(p_file, "%-10s %5d %6d %6d %10llu %10.1f\n", p_run->profile,
+		        p_run->num_conns, p_run->num_ok, p_run->num_failed,
+		        p_run->elapsed_ms,
+		        num_jobs ? (double)p_run->job_ms / num_jobs : 0.0);
+	}
+
+	fprintf(p_file, "\n%d lookups of URLs that weren't recorded\n",
+	        p_bench->num_unknown);
+
+	fclose(p_file);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// recorderFetch                                                              //
+//                                                                            //
+// The 'fetch' function of a recorder's transport. 'ctx' is the recorder. The //
+// lookup is made through the recorder's inner transport and recorded, unless //
+// it was cancelled, which says nothing about the server. Returns what the    //
+// inner transport did.                                                       //
+////////////////////////////////////////////////////////////////////////////////
+
+static int recorderFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                         char** p_data, DWORD* p_size)
+{
+	P_FETCH_RECORDER p_rec = (P_FETCH_RECORDER)ctx;
+	const VSS_TRANSPORT* p_inner = p_rec->p_inner;
+	const PAGE_VALIDATORS none = { 0 };
+	const PAGE_VALIDATORS* p_validators = &none;
+	double start = nowMs();
+	double ms;
+	int res;
+
+	res = p_inner->fetch(p_inner->ctx, p_url, p_ctl, p_data, p_size);
+	ms = nowMs() - start;
+
+	if (res == VSS_CANCELLED)
+		return res;
+
+	if (res >= 0 && p_ctl && p_ctl->p_validators)
+		p_validators = p_ctl->p_validators;
+
+	AcquireSRWLockExclusive(&(p_rec->lock));
+	if (writeRecord(p_rec, p_url, res, ms, (res == 0) ? *p_data : NULL,
+	                (res == 0) ? *p_size : 0, p_validators) != 0)
+		p_rec->num_unwritten++;
+	ReleaseSRWLockExclusive(&(p_rec->lock));
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeRecord                                                                //
+//                                                                            //
+// Writes a lookup to the recorder's directory: 'data' to the next fixture    //
+// file, unless it's NULL, and then its line to the index. The recorder's     //
+// lock must be held. Returns 0 on success, -1 if the URL is too long or has  //
+// a blank in it, or -2 if a file couldn't be written.                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int writeRecord(P_FETCH_RECORDER p_rec, const char* p_url, int res,
+                       double ms, const char* data, DWORD size,
+                       const PAGE_VALIDATORS* p_validators)
+{
+	char path[MAX_PATH];
+	int num = p_rec->num_recorded;
+
+	if (strlen(p_url) >= REPLAY_URL_LENGTH || strchr(p_url, ' '))
+		return -1;
+
+	if (data) {
+		FILE* fp;
+		size_t num_written;
+
+		getFixturePath(p_rec->dir, num, path);
+		if (fopen_s(&fp, path, "wb") != 0)
+			return -2;
+
+		num_written = fwrite(data, 1, size, fp);
+		if (fclose(fp) != 0 || num_written != size) {
+			DeleteFileA(path);
+			return -2;
+		}
+	}
+
+	fprintf(p_rec->p_index, "%d %d %.3f %lu %lld %s %s\n", num, res, ms,
+	        size, p_validators->modified,
+	        p_validators->etag[0] ? p_validators->etag : "-", p_url);
+	if (fflush(p_rec->p_index) != 0)
+		return -2;
+
+	p_rec->num_recorded++;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// replayFetch                                                                //
+//                                                                            //
+// The 'fetch' function of a replay's transport. 'ctx' is the replay. Answers //
+// the lookup with its recording, after the wait its profile gives, with the  //
+// same contract as connectToEDB(). Returns VSS_NO_URL at once for a URL that //
+// wasn't recorded.                                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static int replayFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                       char** p_data, DWORD* p_size)
+{
+	P_FETCH_REPLAY p_replay = (P_FETCH_REPLAY)ctx;
+	const REPLAY_PROFILE* p_profile = &(p_replay->profile);
+	const REPLAY_ENTRY* p_entry;
+	double start = nowMs();
+	double wait_ms;
+	int stop;
+	int res;
+
+	*p_data = NULL;
+	*p_size = 0;
+
+	InterlockedIncrement(&(p_replay->num_lookups));
+
+	if ((p_entry = findEntry(p_replay, p_url)) == NULL) {
+		InterlockedIncrement(&(p_replay->num_unknown));
+		return VSS_NO_URL;
+	}
+
+	res = p_entry->res;
+	if (res == 0 && p_ctl && p_ctl->p_validators &&
+	    sameValidators(p_ctl->p_validators, &(p_entry->validators)))
+		res = VSS_NOT_MODIFIED;
+
+	if (p_profile->f_recorded)
+		wait_ms = p_entry->ms;
+	else {
+		wait_ms = p_profile->latency_ms;
+		if (res == 0 && p_profile->bytes_per_ms)
+			wait_ms += (double)p_entry->size / p_profile->bytes_per_ms;
+	}
+
+	if ((stop = waitFetch(p_ctl, start, wait_ms, REPLAY_POLL_MS)) != 0)
+		return stop;
+
+	if (res >= 0 && p_ctl && p_ctl->p_validators)
+		*p_ctl->p_validators = p_entry->validators;
+
+	if (res != 0)
+		return res;
+
+	// An empty page still gets a buffer, as from connectToEDB()
+	if ((*p_data = memAlloc(MEM_NETWORK, max(p_entry->size, 1))) == NULL)
+		return VSS_NO_MEMORY;
+
+	memcpy(*p_data, p_entry->data, p_entry->size);
+	*p_size = p_entry->size;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// sameValidators                                                             //
+//                                                                            //
+// Returns TRUE if a request conditional on '*p_a' would be answered 304 Not  //
+// Modified for a page that came with '*p_b', the way a server decides it: by //
+// the ETag if there is one, or else by the time the page was last modified.  //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL sameValidators(const PAGE_VALIDATORS* p_a,
+                           const PAGE_VALIDATORS* p_b)
+{
+	if (p_a->etag[0] || p_b->etag[0])
+		return strcmp(p_a->etag, p_b->etag) == 0;
+
+	return p_a->modified && p_a->modified == p_b->modified;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadEntries                                                                //
+//                                                                            //
+// Reads the index file 'fp' of the fixture directory 'dir' (see the top of   //
+// this file), and the page of every lookup that succeeded, into the replay.  //
+// Lines starting with '#' and lines that don't parse are skipped. Returns 0  //
+// on success, -1 if there isn't enough memory, or -3 if a page is missing or //
+// short.                                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+static int loadEntries(P_FETCH_REPLAY p_replay, const char* dir, FILE* fp)
+{
+	char line[REPLAY_URL_LENGTH + 128];
+
+	while (fgets(line, sizeof(line), fp)) {
+		REPLAY_ENTRY entry = { 0 };
+		PAGE_VALIDATORS* p_valid = &(entry.validators);
+		int num;
+
+		if (line[0] == '#')
+			continue;
+
+		if (sscanf_s(line, "%d %d %lf %lu %lld %63s %255s", &num,
+		             &(entry.res), &(entry.ms), &(entry.size),
+		             &(p_valid->modified), p_valid->etag,
+		             (unsigned)VSS_ETAG_LENGTH, entry.url,
+		             (unsigned)REPLAY_URL_LENGTH) < 7)
+			continue;
+
+		if (strcmp(p_valid->etag, "-") == 0)
+			p_valid->etag[0] = '\0';
+
+		if (entry.res == 0) {
+			char path[MAX_PATH];
+			FILE* p_page;
+			size_t num_read;
+
+			entry.data = memAlloc(MEM_NETWORK, max(entry.size, 1));
+			if (!entry.data)
+				return -1;
+
+			getFixturePath(dir, num, path);
+			if (fopen_s(&p_page, path, "rb") != 0) {
+				memFree(entry.data);
+				return -3;
+			}
+
+			num_read = fread(entry.data, 1, entry.size, p_page);
+			fclose(p_page);
+
+			if (num_read != entry.size) {
+				memFree(entry.data);
+				return -3;
+			}
+		}
+
+		if (addEntry(p_replay, &entry) != 0) {
+			memFree(entry.data);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addEntry                                                                   //
+//                                                                            //
+// Adds '*p_entry' to the replay, which takes its page, or replaces the entry //
+// for the same URL. The entry list grows as needed. Returns 0 on success, or //
+// -1 if there isn't enough memory.                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static int addEntry(P_FETCH_REPLAY p_replay, const REPLAY_ENTRY* p_entry)
+{
+	REPLAY_ENTRY* p_old = findEntry(p_replay, p_entry->url);
+
+	if (p_old) {
+		memFree(p_old->data);
+		*p_old = *p_entry;
+		return 0;
+	}
+
+	if (p_replay->num_entries == p_replay->max_entries) {
+		int new_max = p_replay->max_entries ? p_replay->max_entries * 2 : 64;
+		REPLAY_ENTRY* p_new;
+
+		p_new = memRealloc(MEM_NETWORK, p_replay->entries,
+		                   new_max * sizeof(REPLAY_ENTRY));
+		if (!p_new)
+			return -1;
+
+		p_replay->entries = p_new;
+		p_replay->max_entries = new_max;
+	}
+
+	p_replay->entries[p_replay->num_entries++] = *p_entry;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findEntry                                                                  //
+//                                                                            //
+// Returns the replay's entry for 'p_url', or NULL if it wasn't recorded. A   //
+// recording holds a few hundred lookups at most, which a list is fast enough //
+// for.                                                                       //
+////////////////////////////////////////////////////////////////////////////////
+
+static REPLAY_ENTRY* findEntry(const FETCH_REPLAY* p_replay,
+                               const char* p_url)
+{
+	int i;
+
+	for (i = 0; i < p_replay->num_entries; i++)
+		if (strcmp(p_replay->entries[i].url, p_url) == 0)
+			return p_replay->entries + i;
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getFixturePath                                                             //
+//                                                                            //
+// Builds the path of the page of recorded lookup 'num' in the fixture        //
+// directory 'dir' into 'path', which holds MAX_PATH characters.              //
+////////////////////////////////////////////////////////////////////////////////
+
+static void getFixturePath(const char* dir, int num, char* path)
+{
+	sprintf_s(path, MAX_PATH, "%s\\%05d.page", dir, num);
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef FETCH_REPLAY_H_
+#define FETCH_REPLAY_H_
+
+#include <Windows.h>
+#include <stdio.h>
+
+#include "vss_connect.h"
+#include "prefetch.h"
+
+// The fixture directory lookups are recorded to and replayed from
+#define REPLAY_DIR          "fixtures"
+
+// Longest URL a fixture keeps, including the terminating null
+#define REPLAY_URL_LENGTH   256
+
+// How often a replayed lookup that's waiting checks its cancel flag, in ms
+#define REPLAY_POLL_MS      10
+
+// One recorded lookup: what the transport returned, how long it took, and
+// the page and validators it came with, if it succeeded
+typedef struct replay_entry {
+	char url[REPLAY_URL_LENGTH];
+	int res;
+	double ms;
+	DWORD size;
+	PAGE_VALIDATORS validators;
+	char* data;                 // NULL if there's no page
+} REPLAY_ENTRY;
+
+// How long a replayed lookup takes. With 'f_recorded' set, it takes as
+// long as the recorded one did. Otherwise the response starts after
+// 'latency_ms', and the page follows at 'bytes_per_ms' (0 for no limit);
+// a lookup without a page only takes the latency.
+typedef struct replay_profile {
+	const char* name;
+	BOOL f_recorded;
+	DWORD latency_ms;
+	DWORD bytes_per_ms;
+} REPLAY_PROFILE;
+
+// A transport that looks up through another one, and writes every lookup
+// to a fixture directory on its way back
+typedef struct fetch_recorder {
+	VSS_TRANSPORT transport;    // records what 'p_inner' returns
+	const VSS_TRANSPORT* p_inner;
+	char dir[MAX_PATH];
+	SRWLOCK lock;               // for the rest
+	FILE* p_index;
+	int num_recorded;
+	int num_unwritten;          // lookups that couldn't be recorded
+} FETCH_RECORDER, * P_FETCH_RECORDER;
+
+// A transport that answers from a fixture directory, without a network
+typedef struct fetch_replay {
+	VSS_TRANSPORT transport;    // replays 'entries'
+	REPLAY_PROFILE profile;
+	REPLAY_ENTRY* entries;
+	int num_entries;
+	int max_entries;
+	volatile LONG num_lookups;
+	volatile LONG num_unknown;  // lookups of URLs that weren't recorded
+} FETCH_REPLAY, * P_FETCH_REPLAY;
+
+// The runs measureReplay() makes: every profile in replay_profiles, with
+// one download at a time and with PREFETCH_CONNS
+#define NUM_REPLAY_PROFILES 4
+#define NUM_REPLAY_RUNS     (NUM_REPLAY_PROFILES * 2)
+
+// One pass over the list, with its totals (see PREFETCH_RUN)
+typedef struct replay_run {
+	const char* profile;
+	int num_conns;
+	int num_ok;
+	int num_failed;
+	ULONGLONG elapsed_ms;       // wall time of the whole list
+	ULONGLONG job_ms;           // sum of the times of the jobs
+} REPLAY_RUN;
+
+typedef struct replay_bench {
+	int num_items;
+	int num_entries;            // lookups in the recording
+	int num_unknown;            // lookups that weren't recorded, all runs
+	int num_runs;
+	REPLAY_RUN runs[NUM_REPLAY_RUNS];
+} REPLAY_BENCH;
+
+int openFetchRecorder(const char* dir, const VSS_TRANSPORT* p_inner,
+                      P_FETCH_RECORDER* pp_rec);
+void closeFetchRecorder(P_FETCH_RECORDER p_rec);
+int openFetchReplay(const char* dir, P_FETCH_REPLAY* pp_replay);
+void setReplayProfile(P_FETCH_REPLAY p_replay,
+                      const REPLAY_PROFILE* p_profile);
+void closeFetchReplay(P_FETCH_REPLAY p_replay);
+int measureReplay(const char* list_path, const char* dir,
+                  const struct rule_set* p_rules, REPLAY_BENCH* p_bench);
+int writeReplayReport(const REPLAY_BENCH* p_bench, const char* path);
+
+#endif
\ No newline at end of file
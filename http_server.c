@@ -0,0 +1,1075 @@
+////////////////////////////////////////////////////////////////////////////////
+// http_server.c                                                              //
+//                                                                            //
+// This TU checks the parts of an EDB lookup that happen in HTTP: that the    //
+// connection to the server is kept alive between lookups, that a page that   //
+// hasn't changed is answered with 304 Not Modified when the lookup has its   //
+// validators, and that a page sent gzip compressed decodes to exactly the    //
+// bytes of the page sent as it is. WinInet does all three for                //
+// connectToEDB(), and none of them can be seen from the pages it returns, so //
+// they can only be checked against a server that counts what it's asked. EDB //
+// can't be made to do that, and fetch_fault.c's stand-in answers above HTTP, //
+// in place of WinInet.                                                       //
+//                                                                            //
+// An HTTP_SERVER is a small HTTP/1.1 server, on Winsock, that listens on the //
+// loopback interface and serves the files of a directory. The directory      //
+// holds pages saved from EDB; the spec files in "VSS numbers" are such       //
+// pages. Each file is served at '/<file name>' with an ETag made from its    //
+// CRC-32, and with a gzip copy of it, made when it's loaded, to requests     //
+// that accept gzip. A request with the page's ETag in If-None-Match is       //
+// answered 304. Every connection is served on a thread of its own, and is    //
+// kept open for as many requests as the client sends on it, which lets the   //
+// server count how many connections a number of lookups took.                //
+//                                                                            //
+// The gzip copies are deflated with the fixed Huffman codes, and matches     //
+// found with a hash chain, which gets a spec page down to around a third of  //
+// its length. gzip's own codes do better, but that's enough to tell a        //
+// compressed transfer from a plain one, and keeps this TU from needing zlib. //
+//                                                                            //
+// The server can also be made slow and unreliable: it can wait before every  //
+// answer, and answer every few requests with 503 Service Unavailable. A page //
+// saved under its VSS or order number is served at the path of the number's  //
+// EDB URL too, so a session whose requests are sent to the server (see       //
+// setEdbServer()) can load it by its number, the way a prefetch list does    //
+// (see prefetch.c).                                                          //
+//                                                                            //
+// runHttpChecks() looks up every page with measureFetchList() (see           //
+// vss_connect.c), then prefetches the specs among them through a slowed      //
+// down, failing server, and checks what the server counted and what the      //
+// lookups returned. The /httpcheck command line mode (see tool_mode.c)       //
+// writes the results to a report.                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <WinSock2.h>
+#include <Windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "http_server.h"
+#include "banner.h"         // for checkInput() and genSpecRequest()
+#include "mem_track.h"
+
+// Deflate's limits, and how hard the gzip copies look for matches
+#define GZ_MIN_MATCH    3
+#define GZ_MAX_MATCH    258
+#define GZ_WINDOW       32768
+#define GZ_HASH_SIZE    32768
+#define GZ_MAX_CHAIN    64
+
+// The bits of a deflate stream, which are written from the least
+// significant bit of each byte up
+typedef struct bit_writer {
+	BYTE* out;
+	DWORD pos;
+	DWORD bits;
+	int num_bits;
+} BIT_WRITER;
+
+// A connection the server has accepted, handed to the thread that serves it
+typedef struct server_conn {
+	P_HTTP_SERVER p_server;
+	SOCKET s;
+} SERVER_CONN;
+
+// A transport that sends every request to a stand-in server, whatever
+// server its URL names, through a session of its own
+typedef struct server_redirect {
+	VSS_TRANSPORT transport;    // looks up through 'p_session'
+	const HTTP_SERVER* p_server;
+	P_EDB_SESSION p_session;
+} SERVER_REDIRECT;
+
+static int loadPage(SERVER_PAGE* p_page, const char* dir, const char* name);
+static void setEdbPath(SERVER_PAGE* p_page, const char* name);
+static int gzipPage(SERVER_PAGE* p_page, DWORD crc);
+static DWORD crc32(const BYTE* data, DWORD size);
+static void putBits(BIT_WRITER* p_w, DWORD value, int num_bits);
+static void putCode(BIT_WRITER* p_w, DWORD code, int num_bits);
+static void putLiteral(BIT_WRITER* p_w, int sym);
+static void putMatch(BIT_WRITER* p_w, int length, int dist);
+static DWORD WINAPI acceptConnections(LPVOID param);
+static DWORD WINAPI serveConnection(LPVOID param);
+static int answerRequest(P_HTTP_SERVER p_server, SOCKET s,
+                         const char* request, LONG num_request);
+static const SERVER_PAGE* findPage(const HTTP_SERVER* p_server,
+                                   const char* path);
+static BOOL findHeader(const char* request, const char* name, char* value,
+                       int value_size);
+static BOOL sendAll(SOCKET s, const char* data, DWORD size);
+static int redirectFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                         char** p_data, DWORD* p_size);
+static int checkPrefetch(P_HTTP_SERVER p_server,
+                         const struct rule_set* p_rules,
+                         HTTP_REPORT* p_report);
+
+// The first length and distance of each of deflate's length and distance
+// codes, and the number of extra bits that follow the code
+static const int len_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+	67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int len_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+	5, 5, 5, 5, 0
+};
+static const int dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+	769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const int dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+	11, 11, 12, 12, 13, 13
+};
+
+// A gzip header for deflated data, without a name or a time
+static const BYTE gz_header[10] = {
+	0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// openHttpServer                                                             //
+//                                                                            //
+// Loads the .txt files in the directory 'dir', up to HTTP_MAX_PAGES of them, //
+// and starts serving them on a port of the loopback interface that the       //
+// system picks (see getPageUrl()). The server is returned in '*pp_server'.   //
+// Files that can't be read are left out. 'dir' may be NULL for a server      //
+// without pages, which answers every request 404 (see fetch_fault.c).        //
+// Returns 0 on success, -1 if there isn't enough memory, -2 if the server's  //
+// socket or thread can't be set up, or -3 if there are no pages to serve in  //
+// 'dir'.                                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+int openHttpServer(const char* dir, P_HTTP_SERVER* pp_server)
+{
+	P_HTTP_SERVER p_server;
+	WSADATA wsa;
+	WIN32_FIND_DATAA find_data;
+	HANDLE h_find;
+	SOCKET listener;
+	struct sockaddr_in addr = { 0 };
+	int addr_size = sizeof(addr);
+	char path[MAX_PATH];
+	int res = 0;
+
+	*pp_server = NULL;
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return -2;
+
+	// From here on closeHttpServer() cleans up
+	p_server = memCalloc(MEM_NETWORK, 1, sizeof(HTTP_SERVER));
+	if (p_server)
+		p_server->pages = memCalloc(MEM_NETWORK, HTTP_MAX_PAGES,
+		                            sizeof(SERVER_PAGE));
+	if (!p_server || !p_server->pages) {
+		memFree(p_server);
+		WSACleanup();
+		return -1;
+	}
+	p_server->listener = INVALID_SOCKET;
+	InitializeSRWLock(&(p_server->lock));
+
+	if (dir)
+		sprintf_s(path, MAX_PATH, "%s\\*.txt", dir);
+	if (dir &&
+	    (h_find = FindFirstFileA(path, &find_data)) != INVALID_HANDLE_VALUE) {
+		do {
+			if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				continue;
+
+			res = loadPage(p_server->pages + p_server->num_pages, dir,
+			               find_data.cFileName);
+			if (res == 0)
+				p_server->num_pages++;
+			else if (res == -1)
+				res = 0;    // left out
+			else
+				res = -1;
+		} while (res == 0 && p_server->num_pages < HTTP_MAX_PAGES &&
+		         FindNextFileA(h_find, &find_data));
+		FindClose(h_find);
+	}
+
+	if (res == 0 && dir && p_server->num_pages == 0)
+		res = -3;
+
+	// Port 0 lets the system pick a free one
+	if (res == 0) {
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = 0;
+
+		listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		p_server->listener = listener;
+		if (listener == INVALID_SOCKET ||
+		    bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+		    listen(listener, SOMAXCONN) != 0 ||
+		    getsockname(listener, (struct sockaddr*)&addr, &addr_size) != 0)
+			res = -2;
+		p_server->port = ntohs(addr.sin_port);
+	}
+
+	if (res == 0 &&
+	    (p_server->h_thread = CreateThread(NULL, 0, acceptConnections,
+	                                       p_server, 0, NULL)) == NULL)
+		res = -2;
+
+	if (res != 0) {
+		closeHttpServer(p_server);
+		return res;
+	}
+
+	*pp_server = p_server;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getPageUrl                                                                 //
+//                                                                            //
+// Stores the URL of the page at index 'page' of 'p_server' in 'url', which   //
+// holds 'url_size' characters.                                               //
+////////////////////////////////////////////////////////////////////////////////
+
+void getPageUrl(const HTTP_SERVER* p_server, int page, char* url,
+                int url_size)
+{
+	sprintf_s(url, url_size, "http://127.0.0.1:%u%s", p_server->port,
+	          p_server->pages[page].path);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// closeHttpServer                                                            //
+//                                                                            //
+// Stops the server and frees it, once the connections it has accepted have   //
+// been closed. The clients should close theirs first; a connection that's    //
+// left open is closed by the server after HTTP_IDLE_MS. 'p_server' may be    //
+// NULL.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+void closeHttpServer(P_HTTP_SERVER p_server)
+{
+	int i;
+
+	if (!p_server)
+		return;
+
+	// Closing the listener makes accept() fail, which ends the thread
+	if (p_server->listener != INVALID_SOCKET)
+		closesocket((SOCKET)p_server->listener);
+	if (p_server->h_thread) {
+		WaitForSingleObject(p_server->h_thread, INFINITE);
+		CloseHandle(p_server->h_thread);
+	}
+	while (p_server->num_handlers)
+		Sleep(10);
+
+	for (i = 0; i < p_server->num_pages; i++) {
+		memFree(p_server->pages[i].data);
+		memFree(p_server->pages[i].gz_data);
+	}
+	memFree(p_server->pages);
+	memFree(p_server);
+	WSACleanup();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadPage                                                                   //
+//                                                                            //
+// Reads the file 'name' in the directory 'dir' into '*p_page', and makes its //
+// ETag, its gzip copy and, if it's named by a spec's number, its EDB path.   //
+// Returns 0 on success, -1 if the file can't be read, or -2 if there isn't   //
+// enough memory.                                                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static int loadPage(SERVER_PAGE* p_page, const char* dir, const char* name)
+{
+	FILE* fp;
+	char path[MAX_PATH];
+	long size;
+	DWORD crc;
+
+	sprintf_s(path, MAX_PATH, "%s\\%s", dir, name);
+	if (fopen_s(&fp, path, "rb") != 0)
+		return -1;
+
+	if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+	    fseek(fp, 0, SEEK_SET) != 0) {
+		fclose(fp);
+		return -1;
+	}
+
+	if ((p_page->data = memAlloc(MEM_NETWORK, size + 1)) == NULL) {
+		fclose(fp);
+		return -2;
+	}
+
+	if (fread(p_page->data, 1, size, fp) != (size_t)size) {
+		fclose(fp);
+		memFree(p_page->data);
+		p_page->data = NULL;
+		return -1;
+	}
+	fclose(fp);
+
+	p_page->size = (DWORD)size;
+	sprintf_s(p_page->path, MAX_PATH, "/%s", name);
+	setEdbPath(p_page, name);
+
+	crc = crc32((const BYTE*)p_page->data, p_page->size);
+	sprintf_s(p_page->etag, VSS_ETAG_LENGTH, "\"%08lx\"", crc);
+
+	if (gzipPage(p_page, crc) != 0) {
+		memFree(p_page->data);
+		p_page->data = NULL;
+		return -2;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setEdbPath                                                                 //
+//                                                                            //
+// If the file name 'name', without ".txt", is a VSS or order number as the   //
+// banner's edit box takes it, stores the number in 'p_page->num', and the    //
+// path of its EDB URL, from the server on, in 'p_page->edb_path'. Both are   //
+// left empty otherwise.                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static void setEdbPath(SERVER_PAGE* p_page, const char* name)
+{
+	struct spec spec = { 0 };
+	size_t length = strlen(name) - 4;
+	const char* path;
+
+	if (length >= sizeof(spec.num))
+		return;
+	memcpy(spec.num, name, length);
+
+	if (checkInput(spec.num, length) != 0 || genSpecRequest(&spec) != 0 ||
+	    (path = strstr(spec.url, "://")) == NULL ||
+	    (path = strchr(path + 3, '/')) == NULL)
+		return;
+
+	strcpy_s(p_page->num, sizeof(p_page->num), spec.num);
+	strcpy_s(p_page->edb_path, MAX_PATH, path);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// gzipPage                                                                   //
+//                                                                            //
+// Makes the gzip copy of '*p_page', whose CRC-32 is 'crc', as a single       //
+// deflate block with the fixed Huffman codes. At each position, the last     //
+// GZ_MAX_CHAIN positions that started with the same three bytes, within the  //
+// window, are tried, and the longest match is taken if it's at least         //
+// GZ_MIN_MATCH long; otherwise the byte is sent as it is. Returns 0 on       //
+// success, or -2 if there isn't enough memory.                               //
+////////////////////////////////////////////////////////////////////////////////
+
+static int gzipPage(SERVER_PAGE* p_page, DWORD crc)
+{
+	const BYTE* data = (const BYTE*)p_page->data;
+	DWORD size = p_page->size;
+	BIT_WRITER w = { 0 };
+	int* head;
+	int* prev;
+	DWORD i = 0;
+	int j;
+
+	// The fixed codes take at most 9 bits a byte
+	w.out = memAlloc(MEM_NETWORK, size + size / 8 + 64);
+	head = memAlloc(MEM_NETWORK, sizeof(int) * (GZ_HASH_SIZE + GZ_WINDOW));
+	if (!w.out || !head) {
+		memFree(w.out);
+		memFree(head);
+		return -2;
+	}
+	prev = head + GZ_HASH_SIZE;
+	memset(head, 0xff, sizeof(int) * GZ_HASH_SIZE);    // -1, no position
+
+	memcpy(w.out, gz_header, sizeof(gz_header));
+	w.pos = sizeof(gz_header);
+	putBits(&w, 1, 1);      // the last block
+	putBits(&w, 1, 2);      // with the fixed codes
+
+	while (i < size) {
+		int best_len = 0;
+		int best_dist = 0;
+		int hash = 0;
+
+		if (i + GZ_MIN_MATCH <= size) {
+			int max_len = (int)min(GZ_MAX_MATCH, size - i);
+			int num_tries = GZ_MAX_CHAIN;
+			int cand;
+
+			hash = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) &
+			       (GZ_HASH_SIZE - 1);
+			cand = head[hash];
+
+			// A position past the window may have had its link reused
+			while (cand >= 0 && i - cand <= GZ_WINDOW && num_tries--) {
+				int len = 0;
+
+				while (len < max_len && data[cand + len] == data[i + len])
+					len++;
+				if (len > best_len) {
+					best_len = len;
+					best_dist = i - cand;
+					if (len == max_len)
+						break;
+				}
+				cand = prev[cand & (GZ_WINDOW - 1)];
+			}
+		}
+
+		if (best_len >= GZ_MIN_MATCH)
+			putMatch(&w, best_len, best_dist);
+		else {
+			putLiteral(&w, data[i]);
+			best_len = 1;
+		}
+
+		// Every position the match covers can start a later one
+		for (j = 0; j < best_len; j++, i++) {
+			if (i + GZ_MIN_MATCH > size)
+				continue;
+			hash = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) &
+			       (GZ_HASH_SIZE - 1);
+			prev[i & (GZ_WINDOW - 1)] = head[hash];
+			head[hash] = i;
+		}
+	}
+
+	putLiteral(&w, 256);    // the end of the block
+	if (w.num_bits)
+		w.out[w.pos++] = (BYTE)w.bits;
+	memFree(head);
+
+	// The trailer is the CRC-32 and the length, least significant byte first
+	for (j = 0; j < 4; j++)
+		w.out[w.pos++] = (BYTE)(crc >> (8 * j));
+	for (j = 0; j < 4; j++)
+		w.out[w.pos++] = (BYTE)(size >> (8 * j));
+
+	p_page->gz_data = (char*)w.out;
+	p_page->gz_size = w.pos;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// crc32                                                                      //
+//                                                                            //
+// Returns the CRC-32 of 'size' bytes at 'data', as gzip checks it.           //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD crc32(const BYTE* data, DWORD size)
+{
+	DWORD crc = 0xffffffff;
+	DWORD i;
+	int k;
+
+	for (i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// putBits                                                                    //
+//                                                                            //
+// Adds the 'num_bits' low bits of 'value' to the stream, least significant   //
+// bit first, as deflate's extra bits and headers go.                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static void putBits(BIT_WRITER* p_w, DWORD value, int num_bits)
+{
+	p_w->bits |= value << p_w->num_bits;
+	p_w->num_bits += num_bits;
+
+	while (p_w->num_bits >= 8) {
+		p_w->out[p_w->pos++] = (BYTE)p_w->bits;
+		p_w->bits >>= 8;
+		p_w->num_bits -= 8;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// putCode                                                                    //
+//                                                                            //
+// Adds a Huffman code of 'num_bits' bits to the stream. Huffman codes go     //
+// most significant bit first, so they're reversed.                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static void putCode(BIT_WRITER* p_w, DWORD code, int num_bits)
+{
+	DWORD reversed = 0;
+	int i;
+
+	for (i = 0; i < num_bits; i++)
+		reversed |= ((code >> i) & 1) << (num_bits - 1 - i);
+	putBits(p_w, reversed, num_bits);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// putLiteral                                                                 //
+//                                                                            //
+// Adds the fixed code of the literal/length symbol 'sym': a byte, the end of //
+// the block (256), or a length code (257 to 285).                            //
+////////////////////////////////////////////////////////////////////////////////
+
+static void putLiteral(BIT_WRITER* p_w, int sym)
+{
+	if (sym < 144)
+		putCode(p_w, 0x30 + sym, 8);
+	else if (sym < 256)
+		putCode(p_w, 0x190 + sym - 144, 9);
+	else if (sym < 280)
+		putCode(p_w, sym - 256, 7);
+	else
+		putCode(p_w, 0xc0 + sym - 280, 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// putMatch                                                                   //
+//                                                                            //
+// Adds a match of 'length' bytes, 'dist' bytes back: its length code and     //
+// extra bits, then its distance code, which is 5 bits with the fixed codes,  //
+// and extra bits.                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+static void putMatch(BIT_WRITER* p_w, int length, int dist)
+{
+	int code;
+
+	for (code = 28; len_base[code] > length; code--)
+		;
+	putLiteral(p_w, 257 + code);
+	putBits(p_w, length - len_base[code], len_extra[code]);
+
+	for (code = 29; dist_base[code] > dist; code--)
+		;
+	putCode(p_w, code, 5);
+	putBits(p_w, dist - dist_base[code], dist_extra[code]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// acceptConnections                                                          //
+//                                                                            //
+// The server's thread. Accepts connections until the listener is closed, and //
+// starts a thread to serve each.                                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD WINAPI acceptConnections(LPVOID param)
+{
+	P_HTTP_SERVER p_server = param;
+	DWORD idle_ms = HTTP_IDLE_MS;
+	BOOL f_no_delay = TRUE;
+
+	for (;;) {
+		SOCKET s = accept((SOCKET)p_server->listener, NULL, NULL);
+		SERVER_CONN* p_conn;
+		HANDLE h_thread;
+
+		if (s == INVALID_SOCKET)
+			break;
+
+		// The headers and the page are sent separately, and with Nagle's
+		// algorithm the page would wait for the client's delayed ACK
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&idle_ms,
+		           sizeof(idle_ms));
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&f_no_delay,
+		           sizeof(f_no_delay));
+
+		if ((p_conn = memAlloc(MEM_NETWORK, sizeof(SERVER_CONN))) == NULL) {
+			closesocket(s);
+			continue;
+		}
+		p_conn->p_server = p_server;
+		p_conn->s = s;
+
+		InterlockedIncrement(&(p_server->num_connections));
+		InterlockedIncrement(&(p_server->num_handlers));
+		h_thread = CreateThread(NULL, 0, serveConnection, p_conn, 0, NULL);
+		if (h_thread)
+			CloseHandle(h_thread);
+		else {
+			InterlockedDecrement(&(p_server->num_handlers));
+			memFree(p_conn);
+			closesocket(s);
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// serveConnection                                                            //
+//                                                                            //
+// Answers the requests that come on one connection, in order, until the      //
+// client closes it, asks for it to be closed, or sends nothing for           //
+// HTTP_IDLE_MS. A request ends at the blank line after its headers, since a  //
+// GET has no body, and what's read past that is kept for the next one. A     //
+// request whose headers don't fit in HTTP_REQUEST_LENGTH closes the          //
+// connection. The requests being answered on all connections at once are     //
+// counted, and the most there have been is kept.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD WINAPI serveConnection(LPVOID param)
+{
+	SERVER_CONN* p_conn = param;
+	P_HTTP_SERVER p_server = p_conn->p_server;
+	SOCKET s = p_conn->s;
+	char request[HTTP_REQUEST_LENGTH + 1];
+	LONG num_request;
+	int length = 0;
+	int res = 0;
+
+	memFree(p_conn);
+
+	while (res == 0) {
+		char* end;
+		int num_read;
+
+		request[length] = '\0';
+		if ((end = strstr(request, "\r\n\r\n")) == NULL) {
+			if (length == HTTP_REQUEST_LENGTH)
+				break;
+			num_read = recv(s, request + length,
+			                HTTP_REQUEST_LENGTH - length, 0);
+			if (num_read <= 0)
+				break;
+			length += num_read;
+			continue;
+		}
+
+		// The last header keeps its line break, for findHeader()
+		end += 4;
+		end[-2] = '\0';
+
+		num_request = InterlockedIncrement(&(p_server->num_requests));
+
+		AcquireSRWLockExclusive(&(p_server->lock));
+		if (++p_server->num_active > p_server->max_active)
+			p_server->max_active = p_server->num_active;
+		ReleaseSRWLockExclusive(&(p_server->lock));
+
+		res = answerRequest(p_server, s, request, num_request);
+
+		AcquireSRWLockExclusive(&(p_server->lock));
+		p_server->num_active--;
+		ReleaseSRWLockExclusive(&(p_server->lock));
+
+		length -= (int)(end - request);
+		memmove(request, end, length);
+	}
+
+	closesocket(s);
+	InterlockedDecrement(&(p_server->num_handlers));
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// answerRequest                                                              //
+//                                                                            //
+// Answers the request 'request', its request line and headers, on the        //
+// connection 's'. It's the 'num_request'-th the server has been sent,        //
+// counting from 1. The server's delay is waited first, and if the request is //
+// one of those it fails, it's answered 503. Otherwise a GET of a page is     //
+// answered 304 if its If-None-Match is the page's ETag, or with the page,    //
+// with the gzip copy if its Accept-Encoding has gzip; anything else is       //
+// answered 404. Returns 0 if the connection can take another request, or 1   //
+// if it has to be closed.                                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int answerRequest(P_HTTP_SERVER p_server, SOCKET s,
+                         const char* request, LONG num_request)
+{
+	const SERVER_PAGE* p_page;
+	char path[MAX_PATH];
+	char value[VSS_ETAG_LENGTH + 64];
+	char head[512];
+	const char* body;
+	DWORD body_size;
+	BOOL f_gzip;
+	BOOL f_close;
+	int length;
+
+	f_close = findHeader(request, "Connection", value, sizeof(value)) &&
+	          _stricmp(value, "close") == 0;
+
+	if (p_server->delay_ms)
+		Sleep(p_server->delay_ms);
+
+	if (p_server->fail_every && num_request % p_server->fail_every == 0) {
+		InterlockedIncrement(&(p_server->num_unavailable));
+		length = sprintf_s(head, sizeof(head), "HTTP/1.1 503 Service "
+		                   "Unavailable\r\nContent-Length: 0\r\n\r\n");
+		return sendAll(s, head, length) ? f_close : 1;
+	}
+
+	if (sscanf_s(request, "GET %259s", path, (unsigned)sizeof(path)) != 1 ||
+	    (p_page = findPage(p_server, path)) == NULL) {
+		InterlockedIncrement(&(p_server->num_unknown));
+		length = sprintf_s(head, sizeof(head), "HTTP/1.1 404 Not Found\r\n"
+		                   "Content-Length: 0\r\n\r\n");
+		return sendAll(s, head, length) ? f_close : 1;
+	}
+
+	if (findHeader(request, "If-None-Match", value, sizeof(value)) &&
+	    strcmp(value, p_page->etag) == 0) {
+		InterlockedIncrement(&(p_server->num_not_modified));
+		length = sprintf_s(head, sizeof(head), "HTTP/1.1 304 Not Modified\r\n"
+		                   "ETag: %s\r\n\r\n", p_page->etag);
+		return sendAll(s, head, length) ? f_close : 1;
+	}
+
+	f_gzip = findHeader(request, "Accept-Encoding", value, sizeof(value)) &&
+	         strstr(value, "gzip") != NULL;
+	if (f_gzip)
+		InterlockedIncrement(&(p_server->num_compressed));
+
+	body = f_gzip ? p_page->gz_data : p_page->data;
+	body_size = f_gzip ? p_page->gz_size : p_page->size;
+
+	length = sprintf_s(head, sizeof(head), "HTTP/1.1 200 OK\r\n"
+	                   "Content-Type: text/html\r\n"
+	                   "Content-Length: %lu\r\n"
+	                   "ETag: %s\r\n%s\r\n", body_size, p_page->etag,
+	                   f_gzip ? "Content-Encoding: gzip\r\n" : "");
+
+	if (!sendAll(s, head, length) || !sendAll(s, body, body_size))
+		return 1;
+	return f_close;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findPage                                                                   //
+//                                                                            //
+// Returns the page of 'p_server' served at 'path', its own or its EDB path,  //
+// or NULL if there's none.                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static const SERVER_PAGE* findPage(const HTTP_SERVER* p_server,
+                                   const char* path)
+{
+	int i;
+
+	for (i = 0; i < p_server->num_pages; i++)
+		if (strcmp(p_server->pages[i].path, path) == 0 ||
+		    strcmp(p_server->pages[i].edb_path, path) == 0)
+			return p_server->pages + i;
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findHeader                                                                 //
+//                                                                            //
+// Looks for the header 'name' in 'request', whose lines end with CRLF, and   //
+// stores its value, without the blanks around it, in 'value', which holds    //
+// 'value_size' characters. Returns TRUE if the request has the header.       //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL findHeader(const char* request, const char* name, char* value,
+                       int value_size)
+{
+	size_t name_length = strlen(name);
+	const char* line = strstr(request, "\r\n");
+	int length;
+
+	while (line) {
+		line += 2;
+		if (_strnicmp(line, name, name_length) == 0 &&
+		    line[name_length] == ':') {
+			line += name_length + 1;
+			while (*line == ' ' || *line == '\t')
+				line++;
+
+			length = (int)strcspn(line, "\r\n");
+			while (length && (line[length - 1] == ' ' ||
+			                  line[length - 1] == '\t'))
+				length--;
+			length = min(length, value_size - 1);
+
+			memcpy(value, line, length);
+			value[length] = '\0';
+			return TRUE;
+		}
+		line = strstr(line, "\r\n");
+	}
+
+	return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// sendAll                                                                    //
+//                                                                            //
+// Sends 'size' bytes at 'data' on 's', in as many calls to send() as it      //
+// takes. Returns FALSE if the connection fails.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL sendAll(SOCKET s, const char* data, DWORD size)
+{
+	while (size) {
+		int num_sent = send(s, data, (int)min(size, 65536), 0);
+
+		if (num_sent <= 0)
+			return FALSE;
+		data += num_sent;
+		size -= num_sent;
+	}
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runHttpChecks                                                              //
+//                                                                            //
+// Starts a stand-in server for the pages in the directory 'dir' (see         //
+// openHttpServer()), looks up each of them with measureFetchList(),          //
+// prefetches the ones named by a spec's number (see checkPrefetch()),        //
+// matching 'p_rules', and stores the lookups, what the server counted and    //
+// the results of four checks in '*p_report':                                 //
+//                                                                            //
+// 1) Keep-alive: each lookup with a session of its own takes a connection,   //
+//    and the three lookups of each page through the two shared sessions (see //
+//    measureFetchList()) reuse one connection per session, so there should   //
+//    be no more connections than pages plus two.                             //
+// 2) Compression: the two lookups of each page by sessions that ask for      //
+//    compression and aren't revalidations should get the gzip copy, as many  //
+//    bytes of it as the server sent, and the lookup that doesn't ask should  //
+//    get the page as it is; both should come out as the same bytes.          //
+// 3) 304: every revalidation, whose request carries the ETag of the page it  //
+//    got before, should be answered 304 and return VSS_NOT_MODIFIED.         //
+// 4) Prefetch: every spec should load, although some requests are answered   //
+//    503, with a retry for each of those; the server should never have more  //
+//    than PREFETCH_CONNS requests at once, but more than one at some point.  //
+//                                                                            //
+// Returns 0 if the checks could be made, whether they passed or not, -1 if   //
+// there isn't enough memory, -2 if the server can't be started, -3 if there  //
+// are no pages in 'dir', -4 if an internet session can't be opened, or -5 if //
+// the prefetch can't be run.                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+int runHttpChecks(const char* dir, const struct rule_set* p_rules,
+                  HTTP_REPORT* p_report)
+{
+	P_HTTP_SERVER p_server;
+	FETCH_BENCH* p_bench = &(p_report->bench);
+	int num_pages;
+	int i;
+	int res;
+
+	memset(p_report, 0, sizeof(HTTP_REPORT));
+
+	if ((res = openHttpServer(dir, &p_server)) != 0)
+		return res;
+
+	num_pages = p_server->num_pages;
+	for (i = 0; i < num_pages; i++) {
+		getPageUrl(p_server, i, p_bench->urls[i], sizeof(p_bench->urls[i]));
+		p_report->num_bytes += p_server->pages[i].size;
+		p_report->num_gz_bytes += p_server->pages[i].gz_size;
+	}
+	p_bench->num_urls = num_pages;
+
+	if (measureFetchList(p_bench) != 0) {
+		closeHttpServer(p_server);
+		return -4;
+	}
+
+	p_report->num_pages = num_pages;
+	p_report->num_connections = p_server->num_connections;
+	p_report->num_requests = p_server->num_requests;
+	p_report->num_compressed = p_server->num_compressed;
+	p_report->num_not_modified = p_server->num_not_modified;
+
+	p_report->f_keep_alive = p_report->num_requests == 4 * num_pages &&
+	                         p_report->num_connections <= num_pages + 2;
+	p_report->f_same = p_report->num_compressed == 2 * num_pages;
+	p_report->f_not_modified = p_report->num_not_modified == num_pages;
+
+	for (i = 0; i < num_pages; i++) {
+		const SERVER_PAGE* p_page = p_server->pages + i;
+
+		if (!p_bench->same[i] ||
+		    p_bench->warm[i].wire_bytes != p_page->gz_size ||
+		    p_bench->plain[i].wire_bytes != p_page->size ||
+		    p_bench->warm[i].bytes != p_page->size)
+			p_report->f_same = FALSE;
+
+		if (p_bench->reval[i].res != VSS_NOT_MODIFIED)
+			p_report->f_not_modified = FALSE;
+	}
+
+	res = checkPrefetch(p_server, p_rules, p_report);
+	closeHttpServer(p_server);
+	if (res != 0)
+		return res;
+
+	p_report->num_failed = !p_report->f_keep_alive + !p_report->f_same +
+	                       !p_report->f_not_modified + !p_report->f_prefetch;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeHttpReport                                                            //
+//                                                                            //
+// Writes the results of runHttpChecks() to the file 'path': whether each     //
+// check passed, with the counts it's based on. Returns 0 on success, or -1   //
+// if the file can't be written.                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeHttpReport(const HTTP_REPORT* p_report, const char* path)
+{
+	const FETCH_BENCH* p_bench = &(p_report->bench);
+	FILE* p_file;
+	int num_same = 0;
+	int num_unchanged = 0;
+	int i;
+
+	if (fopen_s(&p_file, path, "w") != 0)
+		return -1;
+
+	for (i = 0; i < p_report->num_pages; i++) {
+		num_same += p_bench->same[i];
+		num_unchanged += (p_bench->reval[i].res == VSS_NOT_MODIFIED);
+	}
+
+	fprintf(p_file, "EDB lookups against a stand-in HTTP server, %d pages, "
+	        "%d of %d checks passed\n\n", p_report->num_pages,
+	        NUM_HTTP_CHECKS - p_report->num_failed, NUM_HTTP_CHECKS);
+
+	fprintf(p_file, "%-6s keep-alive   %d connections for %d requests, "
+	        "%d of them with a session per lookup\n",
+	        p_report->f_keep_alive ? "ok" : "FAILED",
+	        p_report->num_connections, p_report->num_requests,
+	        p_report->num_pages);
+	fprintf(p_file, "%-6s compression  %d of %d pages the same with and "
+	        "without, %d sent gzip, %lld bytes as %lld\n",
+	        p_report->f_same ? "ok" : "FAILED", num_same,
+	        p_report->num_pages, p_report->num_compressed,
+	        p_report->num_bytes, p_report->num_gz_bytes);
+	fprintf(p_file, "%-6s 304          %d of %d revalidations answered "
+	        "304 Not Modified, %d returned VSS_NOT_MODIFIED\n",
+	        p_report->f_not_modified ? "ok" : "FAILED",
+	        p_report->num_not_modified, p_report->num_pages, num_unchanged);
+	fprintf(p_file, "%-6s prefetch     %d of %d specs loaded %d at a time, "
+	        "%d requests at most at once, %d answered 503, %d retries, "
+	        "%llu ms in all, %llu ms of jobs\n",
+	        p_report->f_prefetch ? "ok" : "FAILED", p_report->num_loaded,
+	        p_report->num_specs, p_report->num_conns, p_report->max_active,
+	        p_report->num_unavailable, p_report->num_retries,
+	        p_report->prefetch_ms, p_report->job_ms);
+
+	fclose(p_file);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// redirectFetch                                                              //
+//                                                                            //
+// The fetch function of a SERVER_REDIRECT (see VSS_TRANSPORT). Looks up the  //
+// path of 'p_url', from its server on, on the stand-in server instead,       //
+// through the redirect's own session, and returns what connectToEDB() does.  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int redirectFetch(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                         char** p_data, DWORD* p_size)
+{
+	SERVER_REDIRECT* p_redirect = ctx;
+	const char* path = strstr(p_url, "://");
+	char url[MAX_PATH + 32];
+
+	path = path ? strchr(path + 3, '/') : NULL;
+	sprintf_s(url, sizeof(url), "http://127.0.0.1:%u%s",
+	          p_redirect->p_server->port, path ? path : "/");
+
+	return connectToEDB(p_redirect->p_session, url, p_ctl, p_data, p_size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// checkPrefetch                                                              //
+//                                                                            //
+// Prefetches the pages of 'p_server' that are named by a spec's number,      //
+// PREFETCH_CONNS at a time, without the spec cache, matching 'p_rules', the  //
+// way the /prefetch command line mode loads a list. The lookups are made     //
+// through an EDB session with the default FETCH_POLICY, whose requests are   //
+// sent to the server, and the server waits HTTP_PREFETCH_DELAY_MS before     //
+// every answer and answers every HTTP_PREFETCH_FAIL_EVERY-th request 503.    //
+// Stores what the prefetch and the server counted, and whether the check     //
+// passed (see runHttpChecks()), in '*p_report'. Returns 0 on success, -1 if  //
+// there isn't enough memory, -4 if an internet session can't be opened, or   //
+// -5 if the prefetch can't be run.                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static int checkPrefetch(P_HTTP_SERVER p_server,
+                         const struct rule_set* p_rules,
+                         HTTP_REPORT* p_report)
+{
+	SERVER_REDIRECT redirect = { 0 };
+	P_EDB_SESSION p_session = NULL;     // the one the jobs look up through
+	P_PREFETCH_RUN p_run;
+	FETCH_STATS stats;
+	int res = 0;
+	int i;
+
+	if ((p_run = memCalloc(MEM_NETWORK, 1, sizeof(PREFETCH_RUN))) == NULL)
+		return -1;
+
+	for (i = 0; i < p_server->num_pages && res == 0; i++)
+		if (p_server->pages[i].num[0])
+			res = addPrefetchItem(p_run, p_server->pages[i].num);
+
+	if (res == 0 &&
+	    (openEdbSession(SPEC_JOB_TIMEOUT, &(redirect.p_session)) != 0 ||
+	     openEdbSession(SPEC_JOB_TIMEOUT, &p_session) != 0))
+		res = -4;
+
+	if (res == 0) {
+		redirect.transport.fetch = redirectFetch;
+		redirect.transport.ctx = &redirect;
+		redirect.p_server = p_server;
+		setEdbServer(p_session, &(redirect.transport));
+		setMaxEdbConnections(PREFETCH_CONNS);
+
+		// No request is being answered between the checks
+		p_server->delay_ms = HTTP_PREFETCH_DELAY_MS;
+		p_server->fail_every = HTTP_PREFETCH_FAIL_EVERY;
+		p_server->max_active = 0;
+
+		if (runPrefetch(p_run, PREFETCH_CONNS, p_rules,
+		                &(p_session->transport), NULL) != 0)
+			res = -5;
+
+		// The jobs have posted their results, but may not have returned yet
+		waitSpecJobs(SPEC_JOB_TIMEOUT);
+	}
+
+	if (res == 0) {
+		getFetchStats(p_session, &stats);
+
+		p_report->num_specs = p_run->num_items;
+		p_report->num_loaded = p_run->num_ok;
+		p_report->num_conns = p_run->num_conns;
+		p_report->num_unavailable = p_server->num_unavailable;
+		p_report->num_retries = stats.num_retries;
+		p_report->max_active = p_server->max_active;
+		p_report->prefetch_ms = p_run->elapsed_ms;
+		p_report->job_ms = p_run->job_ms;
+
+		// Every 503 should have been retried, and none given up on
+		p_report->f_prefetch = p_report->num_specs > 0 &&
+		                       p_report->num_loaded == p_report->num_specs;
+		if (p_report->num_unavailable == 0 ||
+		    p_report->num_retries != p_report->num_unavailable)
+			p_report->f_prefetch = FALSE;
+		if (p_report->max_active < 2 || p_report->max_active > PREFETCH_CONNS)
+			p_report->f_prefetch = FALSE;
+	}
+
+	closeEdbSession(p_session);
+	closeEdbSession(redirect.p_session);
+	freePrefetch(p_run);
+	return res;
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#ifndef HTTP_SERVER_H_
+#define HTTP_SERVER_H_
+
+#include <Windows.h>
+#include <stdio.h>
+
+#include "vss_connect.h"
+#include "prefetch.h"
+
+// Most pages a stand-in HTTP server serves
+#define HTTP_MAX_PAGES          MAX_BENCH_URLS
+
+// Longest request header block a connection reads
+#define HTTP_REQUEST_LENGTH     4096
+
+// How long a connection waits for the next request before it's closed, in
+// ms, so one the client forgot can't keep the server from closing
+#define HTTP_IDLE_MS            5000
+
+// What the stand-in server does to the lookups of runHttpChecks()'s
+// prefetch check: it waits before every answer, and answers every few
+// requests with 503 Service Unavailable
+#define HTTP_PREFETCH_DELAY_MS  50
+#define HTTP_PREFETCH_FAIL_EVERY 7
+
+// One page of a stand-in HTTP server: a file of its directory, served at
+// '/<file name>', with a gzip copy of it and an ETag made from its CRC-32.
+// A file named by a VSS or order number, such as "VSS-21-836303.txt", is
+// also served at the path of the number's EDB URL.
+typedef struct server_page {
+	char path[MAX_PATH];
+	char num[14];                   // empty if it isn't named by one
+	char edb_path[MAX_PATH];
+	char* data;
+	DWORD size;
+	char* gz_data;
+	DWORD gz_size;
+	char etag[VSS_ETAG_LENGTH];
+} SERVER_PAGE;
+
+// A plain HTTP/1.1 server on the loopback interface that stands in for EDB,
+// with counts of what it was asked and how it answered. 'listener' is a
+// SOCKET, kept as its underlying type so this header doesn't need
+// WinSock2.h, which has to come before Windows.h. 'delay_ms' and
+// 'fail_every' may only be changed while no request is being answered.
+typedef struct http_server {
+	UINT_PTR listener;
+	USHORT port;
+	HANDLE h_thread;                // accepts connections
+	SERVER_PAGE* pages;
+	int num_pages;
+	volatile LONG num_handlers;     // connections still open
+	volatile LONG num_connections;
+	volatile LONG num_requests;
+	volatile LONG num_not_modified; // answered 304
+	volatile LONG num_compressed;   // answered with the gzip copy
+	volatile LONG num_unknown;      // answered 404
+	DWORD delay_ms;                 // waited before every answer
+	int fail_every;                 // every n-th request answered 503, or 0
+	volatile LONG num_unavailable;  // answered 503
+	SRWLOCK lock;                   // for the rest
+	int num_active;                 // requests being answered
+	int max_active;
+} HTTP_SERVER, * P_HTTP_SERVER;
+
+// The number of checks runHttpChecks() makes
+#define NUM_HTTP_CHECKS         4
+
+// What runHttpChecks() found: the lookups of measureFetchList() against a
+// stand-in server, what the server counted, and whether each check passed
+typedef struct http_report {
+	FETCH_BENCH bench;
+	int num_pages;
+	int num_connections;
+	int num_requests;
+	int num_compressed;
+	long long num_bytes;            // of the pages
+	long long num_gz_bytes;         // of their gzip copies
+	int num_not_modified;
+	BOOL f_keep_alive;
+	BOOL f_same;
+	BOOL f_not_modified;
+	int num_specs;                  // pages named by a number
+	int num_loaded;                 // of them, by the prefetch check
+	int num_conns;
+	int num_unavailable;
+	int num_retries;
+	int max_active;
+	ULONGLONG prefetch_ms;          // wall time of the prefetch
+	ULONGLONG job_ms;               // sum of the times of its jobs
+	BOOL f_prefetch;
+	int num_failed;
+} HTTP_REPORT;
+
+int openHttpServer(const char* dir, P_HTTP_SERVER* pp_server);
+void getPageUrl(const HTTP_SERVER* p_server, int page, char* url,
+                int url_size);
+void closeHttpServer(P_HTTP_SERVER p_server);
+int runHttpChecks(const char* dir, const struct rule_set* p_rules,
+                  HTTP_REPORT* p_report);
+int writeHttpReport(const HTTP_REPORT* p_report, const char* path);
+
+#endif
\ No newline at end of file
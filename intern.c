@@ -0,0 +1,238 @@
+////////////////////////////////////////////////////////////////////////////////
+// intern.c                                                                   //
+//                                                                            //
+// This TU contains the string intern pool. Every switch that's matched used  //
+// to get its own copy of its rule's variant string (e.g. 'INT-GEN2,BLAM-     //
+// HDO,WLT-LED'), and every variant of a spec its own copy of its family and  //
+// variant descriptions, although the same few thousand strings come up in    //
+// spec after spec.                                                           //
+//                                                                            //
+// Interning a string returns a pointer to the one copy of it in the pool,    //
+// adding it the first time it's seen. The pointer is the string's handle: it //
+// stays valid, and never changes, until the pool is freed when the program   //
+// exits (see WM_DESTROY in ostool.c, and runToolMode()). Two interned        //
+// strings are equal if and only if their handles are.                        //
+//                                                                            //
+// The pool is a hash table of handles, open addressing with linear probing,  //
+// and a chain of blocks the strings are copied into. It's shared by the      //
+// whole process, so it's guarded with a slim reader/writer lock.             //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "mem_track.h"
+
+typedef struct intern_slot {
+	const char* str;            // NULL if the slot is empty
+	unsigned hash;
+} INTERN_SLOT;
+
+typedef struct intern_block {
+	struct intern_block* next;
+	size_t size;
+	size_t used;
+} INTERN_BLOCK;
+
+static SRWLOCK pool_lock = SRWLOCK_INIT;
+static INTERN_SLOT* slots;
+static unsigned num_slots;
+static INTERN_BLOCK* blocks;    // the block being filled is first
+static INTERN_STATS stats;
+
+////////////////////////////////////////////////////////////////////////////////
+// hashString                                                                 //
+//                                                                            //
+// FNV-1a hash of the first 'len' characters of 'str'.                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static unsigned hashString(const char* str, size_t len)
+{
+	unsigned hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// growTable                                                                  //
+//                                                                            //
+// Allocates a hash table twice the size of the current one (or               //
+// INTERN_MIN_SLOTS slots if there isn't one yet) and moves every handle into //
+// it. Returns 0 on success, or -1 if memory couldn't be allocated, in which  //
+// case the current table is kept.                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+static int growTable(void)
+{
+	unsigned new_num = num_slots ? num_slots * 2 : INTERN_MIN_SLOTS;
+	INTERN_SLOT* new_slots;
+	unsigned i;
+
+	new_slots = memCalloc(MEM_INTERN, new_num, sizeof(INTERN_SLOT));
+	if (new_slots == NULL)
+		return -1;
+
+	for (i = 0; i < num_slots; i++) {
+		unsigned j;
+
+		if (!slots[i].str)
+			continue;
+
+		for (j = slots[i].hash & (new_num - 1); new_slots[j].str;
+		     j = (j + 1) & (new_num - 1)) {}
+		new_slots[j] = slots[i];
+	}
+
+	memFree(slots);
+	stats.bytes_reserved += (long long)(new_num - num_slots) *
+	                        sizeof(INTERN_SLOT);
+	stats.num_mallocs++;
+
+	slots = new_slots;
+	num_slots = new_num;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// storeString                                                                //
+//                                                                            //
+// Copies the first 'len' characters of 'str' into the current block, or a    //
+// new one if it doesn't have room, and terminates the copy with '\0'.        //
+// Returns the copy, or NULL if memory couldn't be allocated.                 //
+////////////////////////////////////////////////////////////////////////////////
+
+static const char* storeString(const char* str, size_t len)
+{
+	char* copy;
+
+	if (!blocks || blocks->size - blocks->used < len + 1) {
+		size_t size = blocks ? blocks->size * 2 : INTERN_BLOCK_SIZE;
+		INTERN_BLOCK* p_new;
+
+		while (size < len + 1)
+			size *= 2;
+
+		p_new = memAlloc(MEM_INTERN, sizeof(INTERN_BLOCK) + size);
+		if (p_new == NULL)
+			return NULL;
+
+		p_new->next = blocks;
+		p_new->size = size;
+		p_new->used = 0;
+		blocks = p_new;
+
+		stats.bytes_reserved += (long long)size;
+		stats.num_mallocs++;
+	}
+
+	copy = (char*)(blocks + 1) + blocks->used;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	blocks->used += len + 1;
+
+	stats.bytes_stored += (long long)len + 1;
+	stats.num_strings++;
+	return copy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// internStringN                                                              //
+//                                                                            //
+// Returns the handle of the first 'len' characters of 'str', adding them to  //
+// the pool if they aren't in it yet. 'str' doesn't have to be terminated.    //
+// Returns NULL if memory couldn't be allocated.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+const char* internStringN(const char* str, size_t len)
+{
+	unsigned hash = hashString(str, len);
+	const char* handle = NULL;
+	unsigned mask;
+	unsigned i;
+
+	AcquireSRWLockExclusive(&pool_lock);
+
+	stats.num_requests++;
+	stats.bytes_requested += (long long)len + 1;
+
+	if ((stats.num_strings + 1) * 2 > num_slots && growTable() != 0 &&
+	    !slots) {
+		ReleaseSRWLockExclusive(&pool_lock);
+		return NULL;
+	}
+
+	mask = num_slots - 1;
+	for (i = hash & mask; slots[i].str; i = (i + 1) & mask) {
+		if (slots[i].hash == hash && strncmp(slots[i].str, str, len) == 0 &&
+		    slots[i].str[len] == '\0') {
+			handle = slots[i].str;
+			break;
+		}
+	}
+
+	if (!handle && (handle = storeString(str, len)) != NULL) {
+		slots[i].str = handle;
+		slots[i].hash = hash;
+	}
+
+	ReleaseSRWLockExclusive(&pool_lock);
+	return handle;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// internString                                                               //
+//                                                                            //
+// internStringN() for a string terminated with '\0'.                         //
+////////////////////////////////////////////////////////////////////////////////
+
+const char* internString(const char* str)
+{
+	return internStringN(str, strlen(str));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getInternStats                                                             //
+//                                                                            //
+// Copies the pool's counters into '*p_stats'.                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void getInternStats(P_INTERN_STATS p_stats)
+{
+	AcquireSRWLockShared(&pool_lock);
+	*p_stats = stats;
+	ReleaseSRWLockShared(&pool_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeInternPool                                                             //
+//                                                                            //
+// Frees every string in the pool and the hash table, and resets the          //
+// counters. Every handle is invalid afterwards, so this is only called when  //
+// nothing holds one any more.                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeInternPool(void)
+{
+	AcquireSRWLockExclusive(&pool_lock);
+
+	while (blocks) {
+		INTERN_BLOCK* p_next = blocks->next;
+
+		memFree(blocks);
+		blocks = p_next;
+	}
+
+	memFree(slots);
+	slots = NULL;
+	num_slots = 0;
+	memset(&stats, 0, sizeof(INTERN_STATS));
+
+	ReleaseSRWLockExclusive(&pool_lock);
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <Windows.h>
+
+// Size of the first block of string storage
+#define INTERN_BLOCK_SIZE   (16 * 1024)
+
+// Hash table slots when the pool is first used. The table is doubled when
+// it's half full.
+#define INTERN_MIN_SLOTS    1024
+
+// Counters for the whole process, since the pool was first used (or last
+// freed). 'bytes_requested' is what the requests would have taken if each
+// had been given its own copy, and 'bytes_stored' is what they actually
+// take.
+typedef struct intern_stats {
+	long long num_requests;     // internString() calls
+	long long num_strings;      // distinct strings in the pool
+	long long bytes_requested;
+	long long bytes_stored;
+	long long bytes_reserved;   // string blocks and hash table
+	long long num_mallocs;
+} INTERN_STATS, * P_INTERN_STATS;
+
+const char* internString(const char* str);
+const char* internStringN(const char* str, size_t len);
+void getInternStats(P_INTERN_STATS p_stats);
+void freeInternPool(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,806 @@
+////////////////////////////////////////////////////////////////////////////////
+// layout_solver.c                                                            //
+//                                                                            //
+// This TU answers the reverse of the question parseCSV() answers. Instead of //
+// "which switches does this spec get?", it answers "which variants have to   //
+// be added to this spec to get these switches?". Engineers often start from  //
+// the dash they want (e.g. "22392513 in location 21 and 22392520 in location //
+// 26") and would otherwise have to search the csv files by hand for a        //
+// combination of options that produces it.                                   //
+//                                                                            //
+// A query is a base spec and a list of targets (a location and a part        //
+// number). A solution is a set of variants that, when added to the base      //
+// spec, makes every target switch appear without creating a new conflict (a  //
+// location with more than one switch). Adding a variant replaces the variant //
+// of the same family in the spec, since a spec can only have one variant of  //
+// each family, so a solution also lists the variants it replaces. The search //
+// looks for the solution that adds the fewest variants.                      //
+//                                                                            //
+// The search is a depth-first branch and bound over the compiled rule set    //
+// (see rule_set.c):                                                          //
+//                                                                            //
+// 1) The candidates for a target are the rules that place its part number    //
+//    in its location. Targets with fewer candidates are searched first, and  //
+//    the candidates of each target are tried in order of how many variants   //
+//    they're missing from the base spec, so a good solution is found early.  //
+// 2) Choosing a candidate adds its missing variants. A candidate is          //
+//    rejected right away if one of its variants belongs to a family that     //
+//    has already been added with a different variant, or if adding it would  //
+//    replace a variant that an earlier choice relies on.                     //
+// 3) A branch is abandoned as soon as it adds as many variants as the best   //
+//    solution found so far.                                                  //
+// 4) Once every target has a rule, the resulting spec is checked with        //
+//    getPlacedRules(), which applies the CA removals and catches switches    //
+//    placed by rules that weren't chosen.                                    //
+//                                                                            //
+// The candidates of the first target are split between worker threads, one   //
+// per processor. The workers share the cost of the best solution found so    //
+// far, so a good solution found by one of them prunes the search in all the  //
+// others. When two solutions add the same number of variants, the one from   //
+// the earlier candidate is kept, so the result doesn't depend on how the     //
+// threads were scheduled.                                                    //
+//                                                                            //
+// Variant families come from the spec for the base variants and from the     //
+// rule set for the variants that are added. A variant whose family isn't     //
+// known is assumed not to replace anything.                                  //
+//                                                                            //
+// Queries are run with the /solve command line mode (see tool_mode.c), which //
+// reads one from a file and solves it for a spec file or for every spec in a //
+// directory, with the time each took (see writeSolveReport()).               //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout_solver.h"
+#include "ost_shared.h"
+#include "parse_vss.h"
+#include "sw_desc.h"
+#include "vss_connect.h"	// for nowMs()
+#include "mem_track.h"
+
+// A family used by the base spec, and the index of the variant that has it
+typedef struct fam_entry {
+	FAM_KEY fam;
+	int var;
+} FAM_ENTRY;
+
+// The choices made so far on one branch of the search
+typedef struct solve_state {
+	int num_added;
+	int added[MAX_SOLVE_SYMBOLS];
+	int num_replaced;
+	int replaced[MAX_SOLVE_SYMBOLS];
+	int rule[MAX_SOLVE_TARGETS];        // indexed by search order
+} SOLVE_STATE;
+
+// Everything the worker threads share. Only best_key, best, next_branch
+// and error are written once the workers have started.
+typedef struct solve_ctx {
+	const RULE_SET* p_rules;
+
+	FAM_ENTRY* base_fams;               // sorted by family
+	int num_base_fams;
+	int* base_ids;                      // variant index -> symbol id or -1
+	BYTE* base_present;                 // symbol id -> in the base spec
+	int base_count[NUM_LOC_6605 + 1];   // switches per location in the base
+
+	int num_targets;
+	LAYOUT_TARGET targets[MAX_SOLVE_TARGETS];   // in search order
+	int target_pos[MAX_SOLVE_TARGETS];          // position in the query
+	int* cands;
+	int cand_start[MAX_SOLVE_TARGETS + 1];
+
+	volatile LONG next_branch;
+	volatile LONG best_key;             // (cost << 16) | branch
+	volatile LONG error;
+	CRITICAL_SECTION cs;
+	SOLVE_STATE best;
+} SOLVE_CTX;
+
+// A worker's scratch memory. 'present' and 'required' have one row of
+// num_symbols bytes per search level, so backtracking is free.
+typedef struct solve_worker {
+	SOLVE_CTX* ctx;
+	BYTE* present;
+	BYTE* required;
+	int* placed;
+	int branch;
+} SOLVE_WORKER;
+
+////////////////////////////////////////////////////////////////////////////////
+// compareFamEntry                                                            //
+//                                                                            //
+// qsort() callback that orders the base spec's families.                     //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compareFamEntry(const void* a, const void* b)
+{
+	const FAM_ENTRY* p_a = a;
+	const FAM_ENTRY* p_b = b;
+
+	if (p_a->fam != p_b->fam)
+		return p_a->fam < p_b->fam ? -1 : 1;
+	return p_a->var - p_b->var;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findBaseFamily                                                             //
+//                                                                            //
+// Returns the index of the first base_fams entry with family 'fam', or       //
+// num_base_fams if the base spec has no variant of that family.              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int findBaseFamily(const SOLVE_CTX* ctx, FAM_KEY fam)
+{
+	int lo = 0;
+	int hi = ctx->num_base_fams;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (ctx->base_fams[mid].fam < fam)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// isPruned                                                                   //
+//                                                                            //
+// Returns TRUE if a branch that has added 'cost' variants can't beat the     //
+// best solution found so far by any thread.                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL isPruned(SOLVE_CTX* ctx, int cost, int branch)
+{
+	return (((LONG)cost << 16) | branch) >= ctx->best_key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addVariant                                                                 //
+//                                                                            //
+// Adds symbol 'id' to the spec in 'present', replacing the base variants of  //
+// the same family. Returns FALSE if the variant can't be added on this       //
+// branch: another variant of its family was already added, it would replace  //
+// a variant in 'required', or the solution would get too big.                //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL addVariant(SOLVE_CTX* ctx, SOLVE_STATE* p_state, BYTE* present,
+                       const BYTE* required, int id)
+{
+	FAM_KEY fam = ctx->p_rules->sym_fams[id];
+	int i;
+
+	if (p_state->num_added == MAX_SOLVE_SYMBOLS)
+		return FALSE;
+
+	if (fam) {
+		for (i = 0; i < p_state->num_added; i++)
+			if (ctx->p_rules->sym_fams[p_state->added[i]] == fam)
+				return FALSE;
+
+		for (i = findBaseFamily(ctx, fam);
+		     i < ctx->num_base_fams && ctx->base_fams[i].fam == fam; i++) {
+			int var_id = ctx->base_ids[ctx->base_fams[i].var];
+
+			if (var_id >= 0) {
+				if (required[var_id])
+					return FALSE;
+				present[var_id] = 0;
+			}
+
+			if (p_state->num_replaced == MAX_SOLVE_SYMBOLS)
+				return FALSE;
+			p_state->replaced[p_state->num_replaced++] = ctx->base_fams[i].var;
+		}
+	}
+
+	present[id] = 1;
+	p_state->added[p_state->num_added++] = id;
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// applyRule                                                                  //
+//                                                                            //
+// Adds the variants rule 'rule' is missing and marks all of its variants as  //
+// required, so a later choice can't replace them. Returns FALSE if one of    //
+// the variants can't be added.                                               //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL applyRule(SOLVE_CTX* ctx, SOLVE_STATE* p_state, BYTE* present,
+                      BYTE* required, int rule)
+{
+	const struct sw_rule* p_rule = ctx->p_rules->rules + rule;
+	int i;
+
+	for (i = 0; i < p_rule->num_terms; i++) {
+		int id = p_rule->terms[i];
+
+		if (!present[id] && !addVariant(ctx, p_state, present, required, id))
+			return FALSE;
+		required[id] = 1;
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// checkLayout                                                                //
+//                                                                            //
+// Runs the whole rule set against the spec in 'present' and returns TRUE if  //
+// every target is placed and no location has more switches than it has in    //
+// the base spec (when that's more than one).                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL checkLayout(SOLVE_WORKER* p_w, const BYTE* present)
+{
+	const SOLVE_CTX* ctx = p_w->ctx;
+	const RULE_SET* p_rules = ctx->p_rules;
+	int count[NUM_LOC_6605 + 1] = { 0 };
+	int num_placed;
+	int i, j;
+
+	num_placed = getPlacedRules(p_rules, present, p_w->placed);
+
+	for (i = 0; i < num_placed; i++)
+		count[p_rules->rules[p_w->placed[i]].loc]++;
+
+	for (i = 0; i <= NUM_LOC_6605; i++)
+		if (count[i] > 1 && count[i] > ctx->base_count[i])
+			return FALSE;
+
+	for (i = 0; i < ctx->num_targets; i++) {
+		for (j = 0; j < num_placed; j++)
+			if (p_rules->rules[p_w->placed[j]].loc == ctx->targets[i].loc &&
+			    p_rules->rules[p_w->placed[j]].pn == ctx->targets[i].pn)
+				break;
+		if (j == num_placed)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// recordSolution                                                             //
+//                                                                            //
+// Keeps the solution if it's better than the best one found so far.          //
+////////////////////////////////////////////////////////////////////////////////
+
+static void recordSolution(SOLVE_WORKER* p_w, const SOLVE_STATE* p_state)
+{
+	SOLVE_CTX* ctx = p_w->ctx;
+	LONG key = ((LONG)p_state->num_added << 16) | p_w->branch;
+
+	EnterCriticalSection(&ctx->cs);
+	if (key < ctx->best_key) {
+		ctx->best = *p_state;
+		InterlockedExchange(&ctx->best_key, key);
+	}
+	LeaveCriticalSection(&ctx->cs);
+}
+
+static void searchLevel(SOLVE_WORKER* p_w, int level,
+                        const SOLVE_STATE* p_state);
+
+////////////////////////////////////////////////////////////////////////////////
+// tryRule                                                                    //
+//                                                                            //
+// Chooses rule 'rule' for the target at search level 'level' and searches    //
+// the levels below it. The spec at this level is copied to the next row      //
+// first, so this level's row is left untouched for the next candidate.       //
+////////////////////////////////////////////////////////////////////////////////
+
+static void tryRule(SOLVE_WORKER* p_w, int level, const SOLVE_STATE* p_state,
+                    int rule)
+{
+	SOLVE_CTX* ctx = p_w->ctx;
+	size_t n = (size_t)ctx->p_rules->num_symbols;
+	BYTE* present = p_w->present + n * (level + 1);
+	BYTE* required = p_w->required + n * (level + 1);
+	SOLVE_STATE state = *p_state;
+
+	memcpy(present, present - n, n);
+	memcpy(required, required - n, n);
+
+	if (!applyRule(ctx, &state, present, required, rule))
+		return;
+	if (isPruned(ctx, state.num_added, p_w->branch))
+		return;
+
+	state.rule[level] = rule;
+	searchLevel(p_w, level + 1, &state);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// searchLevel                                                                //
+//                                                                            //
+// Tries every candidate of the target at search level 'level'. Once every    //
+// target has a rule, the layout is checked and recorded.                     //
+////////////////////////////////////////////////////////////////////////////////
+
+static void searchLevel(SOLVE_WORKER* p_w, int level,
+                        const SOLVE_STATE* p_state)
+{
+	SOLVE_CTX* ctx = p_w->ctx;
+	int i;
+
+	if (level == ctx->num_targets) {
+		size_t n = (size_t)ctx->p_rules->num_symbols;
+
+		if (checkLayout(p_w, p_w->present + n * level))
+			recordSolution(p_w, p_state);
+		return;
+	}
+
+	for (i = ctx->cand_start[level]; i < ctx->cand_start[level + 1]; i++)
+		tryRule(p_w, level, p_state, ctx->cands[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// solveWorker                                                                //
+//                                                                            //
+// Thread function. Takes candidates of the first target one at a time and    //
+// searches everything below them until there are none left.                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD WINAPI solveWorker(LPVOID param)
+{
+	SOLVE_CTX* ctx = param;
+	SOLVE_WORKER w;
+	SOLVE_STATE state;
+	size_t n = (size_t)ctx->p_rules->num_symbols;
+	size_t rows = (size_t)ctx->num_targets + 1;
+	int num_branches = ctx->cand_start[1] - ctx->cand_start[0];
+
+	w.ctx = ctx;
+	w.present = memAlloc(MEM_ANALYSIS, n * rows + 1);
+	w.required = memAlloc(MEM_ANALYSIS, n * rows + 1);
+	w.placed = memAlloc(MEM_ANALYSIS, sizeof(int) *
+	                    ((size_t)ctx->p_rules->num_rules + 1));
+
+	if (!w.present || !w.required || !w.placed) {
+		memFree(w.present); memFree(w.required); memFree(w.placed);
+		InterlockedExchange(&ctx->error, 1);
+		return 1;
+	}
+
+	memset(&state, 0, sizeof(SOLVE_STATE));
+
+	while ((w.branch = InterlockedIncrement(&ctx->next_branch) - 1) <
+	       num_branches) {
+		// Every later branch loses a tie with the best solution
+		if (isPruned(ctx, 0, w.branch))
+			break;
+
+		memcpy(w.present, ctx->base_present, n);
+		memset(w.required, 0, n);
+		tryRule(&w, 0, &state, ctx->cands[ctx->cand_start[0] + w.branch]);
+	}
+
+	memFree(w.present);
+	memFree(w.required);
+	memFree(w.placed);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// missingInBase                                                              //
+//                                                                            //
+// Returns the number of variants rule 'rule' needs that aren't in the base   //
+// spec.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static int missingInBase(const SOLVE_CTX* ctx, int rule)
+{
+	const struct sw_rule* p_rule = ctx->p_rules->rules + rule;
+	int missing = 0;
+	int i;
+
+	for (i = 0; i < p_rule->num_terms; i++)
+		if (!ctx->base_present[p_rule->terms[i]])
+			missing++;
+
+	return missing;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setupBase                                                                  //
+//                                                                            //
+// Looks up every variant of the base spec in the rule set, sorts their       //
+// families, and counts the switches the base spec already has in each        //
+// location.                                                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int setupBase(SOLVE_CTX* ctx, const VAR_STORE* p_vars)
+{
+	const RULE_SET* p_rules = ctx->p_rules;
+	int num_var = p_vars->num_var;
+	int* placed;
+	int num_placed;
+	int i;
+
+	ctx->base_fams = memAlloc(MEM_ANALYSIS, sizeof(FAM_ENTRY) *
+	                          ((size_t)num_var + 1));
+	ctx->base_ids = memAlloc(MEM_ANALYSIS, sizeof(int) * ((size_t)num_var + 1));
+	ctx->base_present = memCalloc(MEM_ANALYSIS,
+	                              (size_t)p_rules->num_symbols + 1, 1);
+	placed = memAlloc(MEM_ANALYSIS, sizeof(int) *
+	                  ((size_t)p_rules->num_rules + 1));
+
+	if (!ctx->base_fams || !ctx->base_ids || !ctx->base_present || !placed) {
+		memFree(placed);
+		return -2;
+	}
+
+	for (i = 0; i < num_var; i++) {
+		FAM_KEY fam = p_vars->fam_keys[i];
+
+		ctx->base_ids[i] = findSymbol(p_rules, p_vars->sym_keys[i]);
+		if (ctx->base_ids[i] >= 0)
+			ctx->base_present[ctx->base_ids[i]] = 1;
+
+		if (fam) {
+			ctx->base_fams[ctx->num_base_fams].fam = fam;
+			ctx->base_fams[ctx->num_base_fams].var = i;
+			ctx->num_base_fams++;
+		}
+	}
+
+	qsort(ctx->base_fams, ctx->num_base_fams, sizeof(FAM_ENTRY),
+	      compareFamEntry);
+
+	num_placed = getPlacedRules(p_rules, ctx->base_present, placed);
+	for (i = 0; i < num_placed; i++)
+		ctx->base_count[p_rules->rules[placed[i]].loc]++;
+
+	memFree(placed);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setupTargets                                                               //
+//                                                                            //
+// Finds the candidate rules of every target and puts the targets in search   //
+// order. Returns 1 if a target has no candidates, since the layout can't be  //
+// built in that case.                                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int setupTargets(SOLVE_CTX* ctx, const LAYOUT_TARGET* targets,
+                        int num_targets)
+{
+	const RULE_SET* p_rules = ctx->p_rules;
+	int count[MAX_SOLVE_TARGETS] = { 0 };
+	int i, j, k;
+
+	for (i = 0; i < p_rules->num_rules; i++)
+		for (j = 0; j < num_targets; j++)
+			if (p_rules->rules[i].loc == targets[j].loc &&
+			    p_rules->rules[i].pn == targets[j].pn &&
+			    p_rules->rules[i].qty > 0)
+				count[j]++;
+
+	// Fewest candidates first (insertion sort, keeps the query order on ties)
+	for (i = 0; i < num_targets; i++) {
+		if (count[i] == 0)
+			return 1;
+
+		for (j = i; j > 0 && count[ctx->target_pos[j - 1]] > count[i]; j--)
+			ctx->target_pos[j] = ctx->target_pos[j - 1];
+		ctx->target_pos[j] = i;
+	}
+
+	ctx->num_targets = num_targets;
+	ctx->cand_start[0] = 0;
+	for (i = 0; i < num_targets; i++) {
+		ctx->targets[i] = targets[ctx->target_pos[i]];
+		ctx->cand_start[i + 1] = ctx->cand_start[i] + count[ctx->target_pos[i]];
+	}
+
+	ctx->cands = memAlloc(MEM_ANALYSIS,
+	                      sizeof(int) * ctx->cand_start[num_targets]);
+	if (ctx->cands == NULL)
+		return -2;
+
+	// Fill each target's candidates, closest to the base spec first
+	for (k = 0; k < num_targets; k++) {
+		int num = ctx->cand_start[k];
+
+		for (i = 0; i < p_rules->num_rules; i++) {
+			int missing;
+
+			if (p_rules->rules[i].loc != ctx->targets[k].loc ||
+			    p_rules->rules[i].pn != ctx->targets[k].pn ||
+			    p_rules->rules[i].qty <= 0)
+				continue;
+
+			missing = missingInBase(ctx, i);
+			for (j = num; j > ctx->cand_start[k] &&
+			     missingInBase(ctx, ctx->cands[j - 1]) > missing; j--)
+				ctx->cands[j] = ctx->cands[j - 1];
+			ctx->cands[j] = i;
+			num++;
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// solveLayout                                                                //
+//                                                                            //
+// Finds the smallest set of variants that has to be added to the spec in     //
+// 'p_vars' to place every switch in 'targets' without creating a conflict.   //
+// The solution is stored in 'p_sol', with the rules listed in the same order //
+// as the targets.                                                            //
+//                                                                            //
+// Returns 0 if a solution was found, 1 if there's no solution that adds at   //
+// most MAX_SOLVE_SYMBOLS variants, or a negative value on error.             //
+////////////////////////////////////////////////////////////////////////////////
+
+int solveLayout(const RULE_SET* p_rules, const VAR_STORE* p_vars,
+                const LAYOUT_TARGET* targets, int num_targets,
+                P_LAYOUT_SOLUTION p_sol)
+{
+	SOLVE_CTX* ctx;
+	int res;
+	int i;
+
+	if (!p_rules || !p_vars || !targets || !p_sol ||
+	    num_targets < 1 || num_targets > MAX_SOLVE_TARGETS)
+		return -1;
+
+	memset(p_sol, 0, sizeof(LAYOUT_SOLUTION));
+
+	if ((ctx = memCalloc(MEM_ANALYSIS, 1, sizeof(SOLVE_CTX))) == NULL)
+		return -2;
+
+	ctx->p_rules = p_rules;
+	ctx->best_key = (LONG)(MAX_SOLVE_SYMBOLS + 1) << 16;
+
+	if ((res = setupBase(ctx, p_vars)) == 0 &&
+	    (res = setupTargets(ctx, targets, num_targets)) == 0) {
+		InitializeCriticalSection(&ctx->cs);
+		runWorkerThreads(solveWorker, ctx,
+		                 ctx->cand_start[1] - ctx->cand_start[0]);
+		DeleteCriticalSection(&ctx->cs);
+
+		if (ctx->error)
+			res = -2;
+		else if (ctx->best_key >> 16 > MAX_SOLVE_SYMBOLS)
+			res = 1;
+	}
+
+	if (res == 0) {
+		p_sol->num_added = ctx->best.num_added;
+		memcpy(p_sol->added, ctx->best.added, sizeof(p_sol->added));
+		p_sol->num_replaced = ctx->best.num_replaced;
+		memcpy(p_sol->replaced, ctx->best.replaced, sizeof(p_sol->replaced));
+
+		for (i = 0; i < num_targets; i++)
+			p_sol->rule[ctx->target_pos[i]] = ctx->best.rule[i];
+	}
+
+	memFree(ctx->base_fams);
+	memFree(ctx->base_ids);
+	memFree(ctx->base_present);
+	memFree(ctx->cands);
+	memFree(ctx);
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// readSolveQuery                                                             //
+//                                                                            //
+// Reads a query from the file 'path' into '*p_query'. Blank lines and lines  //
+// starting with '#' are skipped. The first line left is the spec file, or    //
+// the directory of spec files, to solve the query for, and each line after   //
+// it is a target: a location and a part number. Returns 0 on success, -1 if  //
+// the file can't be read, or -2 if it has a target that can't be read, no    //
+// targets, or more than MAX_SOLVE_TARGETS.                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int readSolveQuery(const char* path, LAYOUT_QUERY* p_query)
+{
+	FILE* p_file;
+	char line[MAX_PATH];
+	int res = 0;
+
+	memset(p_query, 0, sizeof(LAYOUT_QUERY));
+
+	if (fopen_s(&p_file, path, "r") != 0)
+		return -1;
+
+	while (res == 0 && fgets(line, sizeof(line), p_file)) {
+		char* text = line;
+		size_t length;
+		LAYOUT_TARGET target;
+
+		while (isspace((unsigned char)*text))
+			text++;
+		length = strlen(text);
+		while (length && isspace((unsigned char)text[length - 1]))
+			text[--length] = '\0';
+
+		if (length == 0 || text[0] == '#')
+			continue;
+
+		if (p_query->spec_path[0] == '\0')
+			strcpy_s(p_query->spec_path, MAX_PATH, text);
+		else if (p_query->num_targets == MAX_SOLVE_TARGETS ||
+		         sscanf_s(text, "%d %d", &target.loc, &target.pn) != 2)
+			res = -2;
+		else
+			p_query->targets[p_query->num_targets++] = target;
+	}
+
+	fclose(p_file);
+
+	if (res == 0 && p_query->num_targets == 0)
+		res = -2;
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeSolution                                                              //
+//                                                                            //
+// Writes the result of solveLayout(), 'res' and 'p_sol', for one spec,       //
+// 'p_vars', read from the file 'name', to the report 'fp' (see               //
+// writeSolveReport()): the variants to add and the ones they replace, and    //
+// the rule that places each target.                                          //
+////////////////////////////////////////////////////////////////////////////////
+
+static void writeSolution(FILE* fp, const RULE_SET* p_rules,
+                          const LAYOUT_QUERY* p_query, const char* name,
+                          const VAR_STORE* p_vars, int res,
+                          const LAYOUT_SOLUTION* p_sol, double ms)
+{
+	char sym[SYMBOL_LENGTH + 1];
+	int i;
+
+	if (res == 1) {
+		fprintf(fp, "\n%s: no solution  %.3f ms\n", name, ms);
+		return;
+	}
+
+	fprintf(fp, "\n%s: %d added, %d replaced  %.3f ms\n", name,
+	        p_sol->num_added, p_sol->num_replaced, ms);
+
+	for (i = 0; i < p_sol->num_added; i++) {
+		unpackSymbol(p_rules->sym_keys[p_sol->added[i]], sym,
+		             SYMBOL_LENGTH + 1);
+		fprintf(fp, "    add      %s\n", sym);
+	}
+
+	for (i = 0; i < p_sol->num_replaced; i++) {
+		int var = p_sol->replaced[i];
+
+		unpackSymbol(p_vars->sym_keys[var], sym, SYMBOL_LENGTH + 1);
+		fprintf(fp, "    replace  %s  (%s)\n", sym,
+		        p_vars->var_descs[var] ? p_vars->var_descs[var] : "?");
+	}
+
+	for (i = 0; i < p_query->num_targets; i++)
+		fprintf(fp, "    location %d  %d  from %s  %s\n",
+		        p_query->targets[i].loc, p_query->targets[i].pn,
+		        p_sol->rule[i] < p_rules->num_sp_rules ? "SP" : "CA",
+		        p_rules->rules[p_sol->rule[i]].vars);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeSolveReport                                                           //
+//                                                                            //
+// Solves the query 'p_query' for its spec file, or for every .txt spec file  //
+// in it if it's a directory, and writes the results to the file 'file_path'. //
+// The report starts with the targets, then has the solution and the time     //
+// solveLayout() took for each spec, and ends with the number of specs solved //
+// and the mean and the longest time per spec. Files that can't be parsed as  //
+// a spec are skipped. Returns 0 on success, -1 if the report file couldn't   //
+// be created, -2 if there's no spec to read, or -3 if memory couldn't be     //
+// allocated.                                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeSolveReport(const RULE_SET* p_rules, const LAYOUT_QUERY* p_query,
+                     const char* file_path)
+{
+	WIN32_FIND_DATAA find_data;
+	HANDLE h_find;
+	char dir[MAX_PATH];
+	char path[MAX_PATH];
+	const char* spec_path = p_query->spec_path;
+	DWORD attrs = GetFileAttributesA(spec_path);
+	FILE* fp;
+	int num_specs = 0;
+	int num_solved = 0;
+	double total_ms = 0.0;
+	double max_ms = 0.0;
+	int res = 0;
+	int i;
+
+	if (attrs == INVALID_FILE_ATTRIBUTES)
+		return -2;
+
+	// A single file is found the same way as the files of a directory
+	if (attrs & FILE_ATTRIBUTE_DIRECTORY) {
+		strcpy_s(dir, MAX_PATH, spec_path);
+		sprintf_s(path, MAX_PATH, "%s\\*.txt", spec_path);
+	}
+	else {
+		const char* name = max(strrchr(spec_path, '\\'),
+		                       strrchr(spec_path, '/'));
+
+		sprintf_s(dir, MAX_PATH, "%.*s", name ? (int)(name - spec_path) : 1,
+		          name ? spec_path : ".");
+		strcpy_s(path, MAX_PATH, spec_path);
+	}
+
+	if ((h_find = FindFirstFileA(path, &find_data)) == INVALID_HANDLE_VALUE)
+		return -2;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0) {
+		FindClose(h_find);
+		return -1;
+	}
+
+	fprintf(fp, "Layout query: %d targets, %s\n", p_query->num_targets,
+	        spec_path);
+	for (i = 0; i < p_query->num_targets; i++) {
+		const char* desc = findSwDesc(p_query->targets[i].pn);
+
+		fprintf(fp, "    location %d  %d  (%s)\n", p_query->targets[i].loc,
+		        p_query->targets[i].pn, desc ? desc : "?");
+	}
+
+	do {
+		P_VAR_STORE p_vars;
+		LAYOUT_SOLUTION sol;
+		double t0;
+		double ms;
+
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		sprintf_s(path, MAX_PATH, "%s\\%s", dir, find_data.cFileName);
+		if ((p_vars = parseVssFile(path, NULL)) == NULL)
+			continue;
+
+		t0 = nowMs();
+		res = solveLayout(p_rules, p_vars, p_query->targets,
+		                  p_query->num_targets, &sol);
+		ms = nowMs() - t0;
+
+		if (res >= 0) {
+			writeSolution(fp, p_rules, p_query, find_data.cFileName, p_vars,
+			              res, &sol, ms);
+			num_solved += res == 0;
+			num_specs++;
+			total_ms += ms;
+			max_ms = max(max_ms, ms);
+			res = 0;
+		}
+		memFree(p_vars);
+	} while (res == 0 && FindNextFileA(h_find, &find_data));
+
+	FindClose(h_find);
+
+	if (res == 0 && num_specs)
+		fprintf(fp, "\nSpecs: %d, solved %d, no solution %d\n"
+		        "Time per spec: mean %.3f ms, max %.3f ms\n", num_specs,
+		        num_solved, num_specs - num_solved, total_ms / num_specs,
+		        max_ms);
+	fclose(fp);
+
+	if (res < 0)
+		return -3;
+	if (num_specs == 0)
+		return -2;
+	return 0;
+}
\ No newline at end of file
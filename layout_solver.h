@@ -0,0 +1,44 @@
+#ifndef LAYOUT_SOLVER_H_
+#define LAYOUT_SOLVER_H_
+
+#include "rule_set.h"
+
+// Most switches a single query can ask for
+#define MAX_SOLVE_TARGETS   8
+// Solutions that need more variants than this aren't searched for
+#define MAX_SOLVE_SYMBOLS   16
+
+// A switch the layout must have: part number 'pn' in location 'loc'
+typedef struct layout_target {
+	int loc;
+	int pn;
+} LAYOUT_TARGET;
+
+// The variants to add to a spec to get the requested layout. Adding a
+// variant replaces the variant of the same family in the spec, if there is
+// one, so the replaced variants are listed as well.
+typedef struct layout_solution {
+	int num_added;
+	int added[MAX_SOLVE_SYMBOLS];       // symbol ids
+	int num_replaced;
+	int replaced[MAX_SOLVE_SYMBOLS];    // indices into the spec's store
+	int rule[MAX_SOLVE_TARGETS];        // rule that places each target
+} LAYOUT_SOLUTION, * P_LAYOUT_SOLUTION;
+
+// A query read by readSolveQuery(): the spec file, or directory of spec
+// files, to solve it for, and the switches the layout must have
+typedef struct layout_query {
+	char spec_path[MAX_PATH];
+	int num_targets;
+	LAYOUT_TARGET targets[MAX_SOLVE_TARGETS];
+} LAYOUT_QUERY;
+
+int solveLayout(const RULE_SET* p_rules, const VAR_STORE* p_vars,
+                const LAYOUT_TARGET* targets, int num_targets,
+                P_LAYOUT_SOLUTION p_sol);
+
+int readSolveQuery(const char* path, LAYOUT_QUERY* p_query);
+int writeSolveReport(const RULE_SET* p_rules, const LAYOUT_QUERY* p_query,
+                     const char* file_path);
+
+#endif
\ No newline at end of file
@@ -29,38 +29,18 @@
 #include "ost_shared.h"
 #include "resource.h"
 
-// Pointer to a text file resource that contains switch descriptions
-static const char* g_desc_res;
-
 LRESULT CALLBACK listViewProc
 (HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
 	static HWND hwnd_sw_list_box;
 	static P_STATE_DATA p_data;
 
-	// h_rsrc and h_global don't need to be static because they are
-	// freed automatically when the program closes
-	HRSRC h_rsrc;
-	HGLOBAL h_global;
-
 	PAINTSTRUCT ps;
 	HDC hdc;
 	int sw_index;
 
 	switch (message) {
 	case WM_CREATE:
-
-		// Load switch description resource
-		h_rsrc = FindResourceA(NULL, MAKEINTRESOURCEA(IDR_CSV1), "CSV");
-		if (h_rsrc == NULL)
-			return -1;
-
-		if ((h_global = LoadResource(NULL, h_rsrc)) == NULL)
-			return -1;
-
-		if ((g_desc_res = LockResource(h_global)) == NULL)
-			return -1;
-
 		SetWindowLongPtrA(hwnd, GWLP_USERDATA,
 								(LONG_PTR)((LPCREATESTRUCT)lParam)->lpCreateParams);
 
@@ -107,10 +87,8 @@ LRESULT CALLBACK listViewProc
 
 		// Only populate the list box if it's currently empty
 		// Potential improvement - find a more elegant way of doing this.
-		if (!SendMessageA(hwnd_sw_list_box, LB_GETCOUNT, 0, 0)) {
-			populateListBox(hwnd_sw_list_box, p_data->p_sw_list);
-			setLbItemFlags(hwnd_sw_list_box, p_data);
-		}
+		if (!SendMessageA(hwnd_sw_list_box, LB_GETCOUNT, 0, 0))
+			populateListBox(hwnd_sw_list_box, p_data->p_layout);
 
 		ReleaseDC(hwnd, hdc);
 		return 0;
@@ -126,8 +104,7 @@ LRESULT CALLBACK listViewProc
 		HBRUSH hbrush_old;
 		HFONT h_font_old;
 		RECT rect_lb;
-		char lb_buf[60] = { 0 };
-		int len = 0;
+		const SW_ENTRY* p_entry;
 
 		switch (pdis->itemAction) {
 		case ODA_SELECT:
@@ -144,20 +121,21 @@ LRESULT CALLBACK listViewProc
 			// fall through
 
 		case ODA_DRAWENTIRE: {
-			h_font_old = SelectObject(pdis->hDC, p_data->h_font_text);
 			DRAWTEXTPARAMS dpt = { 0 };
 
-			// The longest switch description is 43 characters in length.
-			// Therefore, len should range from 0 - 46. This variable is
-			// used as an argument for DrawTextA, which takes an int for its
-			// fourth parameter.
-			len = (int)SendMessageA(hwnd_sw_list_box, LB_GETTEXT, pdis->itemID,
-			                        (LPARAM)lb_buf);
+			// The list box holds no strings; each item is drawn straight
+			// from the layout snapshot (see sw_layout.c). itemID is -1
+			// when the list box is empty and only its focus is drawn.
+			p_entry = getSwEntry(p_data->p_layout, (int)pdis->itemID);
+			if (!p_entry)
+				break;
+
+			h_font_old = SelectObject(pdis->hDC, p_data->h_font_text);
 
 			CopyRect(&rect_lb, &(pdis->rcItem));
 			rect_lb.left += 16;
 
-			if (SendMessage(hwnd_sw_list_box, LB_GETITEMDATA, pdis->itemID, 0))
+			if (p_entry->conflict)
 				SetTextColor(pdis->hDC, RGB(255, 0, 0));
 			else
 				SetTextColor(pdis->hDC, 0);
@@ -165,7 +143,7 @@ LRESULT CALLBACK listViewProc
 			dpt.cbSize = sizeof(DRAWTEXTPARAMS);
 			dpt.iTabLength = 6;
 
-			DrawTextExA(pdis->hDC, lb_buf, len, &rect_lb,
+			DrawTextExA(pdis->hDC, p_entry->text, -1, &rect_lb,
 			            DT_SINGLELINE | DT_VCENTER | DT_EXPANDTABS | DT_TABSTOP,
 			            &dpt);
 			SelectObject(pdis->hDC, h_font_old);
@@ -187,13 +165,15 @@ LRESULT CALLBACK listViewProc
 //                                                                            //
 // The list box control has the LBS_OWNERDRAWFIXED style. This is necessary   //
 // to control the colors of the list box items; in particular, coloring the   //
-// text red in the event of a switch conflict.                                //
+// text red in the event of a switch conflict. It also has the LBS_NODATA     //
+// style: it only keeps a count of its items, and each item is drawn from the //
+// layout snapshot (see sw_layout.c) at the same index.                       //
 ////////////////////////////////////////////////////////////////////////////////
 
 HWND createListBox(HWND hwnd_parent)
 {
 	DWORD list_style = WS_CHILD | WS_VISIBLE | LBS_OWNERDRAWFIXED |
-	                   LBS_HASSTRINGS | LBS_NOTIFY | WS_VSCROLL;
+	                   LBS_NODATA | LBS_NOTIFY | WS_VSCROLL;
 
 	// The list box parent window is 777 pixels in height. Since
 	// the list box is placed 136 pixels below the origin, it should
@@ -286,154 +266,35 @@ void printListBoxHeader(HDC hdc, HFONT h_font)
 ////////////////////////////////////////////////////////////////////////////////
 // populateListBox                                                            //
 //                                                                            //
-// Populates the list box with switches in the switch list after a spec is    //
-// processed. The switch link list is traveresed, and for every item in the   //
-// list, a string is inserted into the list box. Each of these strings        //
-// consists of a location and a description, separated by a tab.              //
+// Populates the list box with switches in the layout snapshot after a spec   //
+// is processed. The list box doesn't store any strings (see                  //
+// createListBox()), so all this does is set its item count to the number of  //
+// switches. Each item is drawn from the layout entry with the same index,    //
+// whose text consists of a location and a description, separated by a tab.   //
 //                                                                            //
 // The location for each entry is taken from the item in the list. The        //
 // description comes from a resource file, which is just a text file that     //
-// lists switch part numbers and associated descriptions in a table. The      //
-// part number is taken from the item in the list, and cross-referenced with  //
-// this resource to retrieve the description.                                 //
+// lists switch part numbers and associated descriptions in a table. The part //
+// number is taken from the item in the list, and cross-referenced with this  //
+// resource to retrieve the description when the layout is built.             //
 //                                                                            //
-// Before the list box is populated, this function sends a message to prevent //
-// the list box from updating itself every time a string is inserted. This    //
-// is re-enabled once the switch is populated and then the list is updated.   //
+// The list box is redrawn once its count is set.                             //
 ////////////////////////////////////////////////////////////////////////////////
 
-int populateListBox(HWND hwnd, LL* p_sw_list)
+int populateListBox(HWND hwnd, const SW_LAYOUT* p_layout)
 {
 	LRESULT list_res;
-	LL_elem* p_tmp = NULL;
-	char list_buf[60] = { 0 };
-	char desc_buf[50] = { 0 };
 
-	if (!p_sw_list)
+	if (!p_layout)
 		return -1;
 
-	p_tmp = p_sw_list->head;
-	
-	// Pause updating so the list isn't redrawn for every insertion
-	SendMessageA(hwnd, WM_SETREDRAW, FALSE, 0);
-
-	// Loop through switch list, adding each item to the list box
-	while (p_tmp) {
-
-		int loc = ((SW_link*)(p_tmp->data))->loc;
-		int pn  = ((SW_link*)(p_tmp->data))->pn;
-
-		// Get switch description from resource file
-		getSWDesc(desc_buf, 50, pn);
-
-		// Concatenate the location and description, separated by a tab
-		wsprintfA(list_buf, "%d\t%s", loc, desc_buf);
-
-		// Insert item into the list
-		list_res = SendMessageA(hwnd, LB_ADDSTRING, 0, (LPARAM)list_buf);
-		if (list_res == LB_ERR || list_res == LB_ERRSPACE)
-			return -2;
-
-		p_tmp = p_tmp->next;
-	}
+	list_res = SendMessageA(hwnd, LB_SETCOUNT, p_layout->num_entries, 0);
+	if (list_res == LB_ERR || list_res == LB_ERRSPACE)
+		return -2;
 
 	// Redraw the list
-	SendMessageA(hwnd, WM_SETREDRAW, TRUE, 0);
 	UINT rdr_fl = RDW_ERASE | RDW_FRAME | RDW_INVALIDATE | RDW_ALLCHILDREN;
 	RedrawWindow(hwnd, NULL, NULL, rdr_fl);
 
 	return 0;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-// getSWDesc                                                                  //
-//                                                                            //
-// The descriptions for the switches, which are displayed in the list box,    //
-// are located in a text file which is compiled as a resource for this        //
-// application. This text file contains a table with all of the descriptions  //
-// linked to the part numbers for each switch. This function retrieves the    //
-// description for a given part number from this resource and stores it in    //
-// the buffer pointed to by desc.                                             //
-////////////////////////////////////////////////////////////////////////////////
-
-void getSWDesc(char* desc, int desc_size, int pn)
-{
-	const char* desc_tmp = g_desc_res;
-
-	char buf[BUF_LENGTH] = { 0 };
-	int i = 0;
-
-	if (!desc)
-		return;
-
-	*desc = '\0';
-
-	if (desc_size < 0)
-		return;
-
-	// At this point desc_tmp points to the first byte of data
-	// in the sw_desc.txt resource
-
-	while (*desc_tmp != '~') {			// '~' == EOF marker
-		if ((buf[i++] = *desc_tmp++) != '\n')
-			continue;
-
-		buf[i - 1] = '\0';
-
-		if (atoi(buf) == pn) {
-			i = 0;
-			while (buf[i++] != ';') {}
-
-			strncpy_s(desc, desc_size, buf + i, strlen(buf + i));
-			return;
-		}
-		i = 0;
-	}
-}
-
-////////////////////////////////////////////////////////////////////////////////
-// setLbItemFlags                                                             //
-//                                                                            //
-// The built-in list box control supports appending 'user data' to each item  //
-// in the list box. This program utilizes this feature to enable drawing      //
-// text red for switches that conflict with other switches or the zone 4      //
-// panel.                                                                     //
-//                                                                            //
-// This function checks each switch to see if the subsequent switch occupies  //
-// the same location; if so, it sets this user data equal to 1 for both. It   //
-// also checks if each switch conflicts with the zone 4 panel chosen, and     //
-// assigns the value 1 to the user data section of each affected switch.      //
-//                                                                            //
-// When the list box is drawn, the custom processing draws the text red if    //
-// this user data is 1, and black otherwise. Enabling this functionality      //
-// required the LBS_OWNERDRAWFIXED window style for the list box control.     //
-////////////////////////////////////////////////////////////////////////////////
-
-void setLbItemFlags(HWND hwnd_list, P_STATE_DATA p_data)
-{
-	int i = 0;
-
-	// LB_GETCOUNT can return LB_ERR which is defined as -1, so count must
-	// be signed. An int is more than large enough to hold the number of
-	// items in the list box.
-	int count = (int)SendMessageA(hwnd_list, LB_GETCOUNT, 0, 0);
-
-	char buf_cur[60]  = { 0 };
-	char buf_next[60] = { 0 };
-	int loc = 0;
-
-	for (i = 0; i < count - 1; i++) {
-		SendMessageA(hwnd_list, LB_GETTEXT, i,             (LPARAM)buf_cur);
-		SendMessageA(hwnd_list, LB_GETTEXT, (WPARAM)i + 1, (LPARAM)buf_next);
-		loc = atoi(buf_cur);
-
-		// Check for switches in the same location
-		if (buf_cur[0] == buf_next[0] && buf_cur[1] == buf_next[1]) {
-			SendMessageA(hwnd_list, LB_SETITEMDATA, i, 1);
-			SendMessageA(hwnd_list, LB_SETITEMDATA, (WPARAM)i + 1, 1);
-		}
-		// Check for switches that conflict with the zone 4 panel chosen
-		else if (panelConflict(loc, p_data))
-			SendMessageA(hwnd_list, LB_SETITEMDATA, i, 1);
-	}
 }
\ No newline at end of file
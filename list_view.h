@@ -4,12 +4,11 @@
 #include <Windows.h>
 #include "ost_data.h"
 #include "andrewll.h"
+#include "sw_layout.h"
 
 LRESULT CALLBACK listViewProc(HWND hwnd, UINT message, WPARAM wParam,
                               LPARAM lParam);
 HWND createListBox(HWND hwnd_parent);
 void printListBoxHeader(HDC hdc, HFONT h_font);
-int populateListBox(HWND hwnd, LL* p_sw_list);
-void getSWDesc(char* desc, int desc_size, int pn);
-void setLbItemFlags(HWND hwnd_list, P_STATE_DATA p_data);
+int populateListBox(HWND hwnd, const SW_LAYOUT* p_layout);
 #endif
\ No newline at end of file
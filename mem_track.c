@@ -0,0 +1,279 @@
+////////////////////////////////////////////////////////////////////////////////
+// mem_track.c                                                                //
+//                                                                            //
+// This TU contains the allocator every part of the program allocates its     //
+// heap memory through, so that what a spec load, the compiled rules or a     //
+// download costs can be measured. memAlloc(), memCalloc() and memRealloc()   //
+// take a tag naming the subsystem the memory is for (see mem_track.h), and   //
+// memFree() releases a block from any of them.                               //
+//                                                                            //
+// Each block starts with a small header holding its size and tag, so a block //
+// can be freed without knowing where it came from, and the live bytes of its //
+// subsystem still come out right. The counters of each subsystem (calls,     //
+// live bytes and peak bytes) are kept under a slim reader/writer lock, since //
+// the downloads happen on a worker thread.                                   //
+//                                                                            //
+// The blocks come from malloc() unless setMemHooks() is given other          //
+// functions, for instance a debug heap that checks for overruns. That can    //
+// only be done while nothing is allocated, since a block must be freed by    //
+// the functions that allocated it.                                           //
+//                                                                            //
+// The counters can be written out at any time with dumpMemStats() (F8 in the //
+// main window writes mem_stats.txt), and the '/loadbench' and '/selectivity' //
+// command line modes add them to their reports.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem_track.h"
+
+typedef struct mem_header {
+	size_t size;
+	int tag;
+} MEM_HEADER;
+
+static const char* tag_names[NUM_MEM_TAGS] = {
+	"spec", "switch", "rules", "analysis", "intern", "network"
+};
+
+static SRWLOCK mem_lock = SRWLOCK_INIT;
+static MEM_HOOKS hooks = { malloc, realloc, free };
+static MEM_STATS stats;
+
+////////////////////////////////////////////////////////////////////////////////
+// addLiveBytes                                                               //
+//                                                                            //
+// Adds 'delta' (which can be negative) to the live bytes of a tag and of the //
+// total, and raises the peaks. The caller holds the lock.                    //
+////////////////////////////////////////////////////////////////////////////////
+
+static void addLiveBytes(int tag, long long delta)
+{
+	MEM_TAG_STATS* p_tag = stats.tags + tag;
+
+	p_tag->live_bytes += delta;
+	if (p_tag->live_bytes > p_tag->peak_bytes)
+		p_tag->peak_bytes = p_tag->live_bytes;
+
+	stats.total.live_bytes += delta;
+	if (stats.total.live_bytes > stats.total.peak_bytes)
+		stats.total.peak_bytes = stats.total.live_bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setMemHooks                                                                //
+//                                                                            //
+// Makes the allocator get its blocks from 'p_hooks', or from malloc(),       //
+// realloc() and free() again if 'p_hooks' is NULL. Returns 0 on success, or  //
+// -1 if there are blocks that haven't been freed, in which case the hooks    //
+// aren't changed.                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+int setMemHooks(const MEM_HOOKS* p_hooks)
+{
+	static const MEM_HOOKS crt_hooks = { malloc, realloc, free };
+	int res = 0;
+
+	AcquireSRWLockExclusive(&mem_lock);
+
+	if (stats.total.live_bytes != 0 ||
+	    stats.total.num_allocs != stats.total.num_frees)
+		res = -1;
+	else
+		hooks = p_hooks ? *p_hooks : crt_hooks;
+
+	ReleaseSRWLockExclusive(&mem_lock);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// memAlloc                                                                   //
+//                                                                            //
+// Returns a block of 'size' bytes for the subsystem 'tag', or NULL if memory //
+// couldn't be allocated.                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+void* memAlloc(int tag, size_t size)
+{
+	MEM_HEADER* p_header;
+
+	if (size > (size_t)-1 - MEM_HEADER_SIZE)
+		return NULL;
+
+	if ((p_header = hooks.alloc(size + MEM_HEADER_SIZE)) == NULL)
+		return NULL;
+
+	p_header->size = size;
+	p_header->tag = tag;
+
+	AcquireSRWLockExclusive(&mem_lock);
+	stats.tags[tag].num_allocs++;
+	stats.total.num_allocs++;
+	addLiveBytes(tag, (long long)size);
+	ReleaseSRWLockExclusive(&mem_lock);
+
+	return (char*)p_header + MEM_HEADER_SIZE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// memCalloc                                                                  //
+//                                                                            //
+// memAlloc() for 'num' items of 'size' bytes each, with the block set to     //
+// zeros.                                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+void* memCalloc(int tag, size_t num, size_t size)
+{
+	void* p;
+
+	if (size && num > ((size_t)-1 - MEM_HEADER_SIZE) / size)
+		return NULL;
+
+	if ((p = memAlloc(tag, num * size)) != NULL)
+		memset(p, 0, num * size);
+
+	return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// memRealloc                                                                 //
+//                                                                            //
+// Resizes a block, the same way realloc() does: the contents are kept, NULL  //
+// is returned and the block is left alone if memory couldn't be allocated,   //
+// and a NULL block is allocated for the subsystem 'tag'. An existing block   //
+// stays with the subsystem it was allocated for.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+void* memRealloc(int tag, void* p, size_t size)
+{
+	MEM_HEADER* p_header;
+	size_t old_size;
+
+	if (p == NULL)
+		return memAlloc(tag, size);
+
+	if (size > (size_t)-1 - MEM_HEADER_SIZE)
+		return NULL;
+
+	p_header = (MEM_HEADER*)((char*)p - MEM_HEADER_SIZE);
+	old_size = p_header->size;
+
+	if ((p_header = hooks.realloc(p_header, size + MEM_HEADER_SIZE)) == NULL)
+		return NULL;
+
+	p_header->size = size;
+	tag = p_header->tag;
+
+	AcquireSRWLockExclusive(&mem_lock);
+	stats.tags[tag].num_reallocs++;
+	stats.total.num_reallocs++;
+	addLiveBytes(tag, (long long)size - (long long)old_size);
+	ReleaseSRWLockExclusive(&mem_lock);
+
+	return (char*)p_header + MEM_HEADER_SIZE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// memFree                                                                    //
+//                                                                            //
+// Frees a block from memAlloc(), memCalloc() or memRealloc(). Does nothing   //
+// if 'p' is NULL.                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+void memFree(void* p)
+{
+	MEM_HEADER* p_header;
+	int tag;
+
+	if (p == NULL)
+		return;
+
+	p_header = (MEM_HEADER*)((char*)p - MEM_HEADER_SIZE);
+	tag = p_header->tag;
+
+	AcquireSRWLockExclusive(&mem_lock);
+	stats.tags[tag].num_frees++;
+	stats.total.num_frees++;
+	addLiveBytes(tag, -(long long)p_header->size);
+	ReleaseSRWLockExclusive(&mem_lock);
+
+	hooks.free(p_header);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getMemStats                                                                //
+//                                                                            //
+// Copies the counters into '*p_stats'.                                       //
+////////////////////////////////////////////////////////////////////////////////
+
+void getMemStats(P_MEM_STATS p_stats)
+{
+	AcquireSRWLockShared(&mem_lock);
+	*p_stats = stats;
+	ReleaseSRWLockShared(&mem_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeMemTag                                                                //
+//                                                                            //
+// Writes one line of the table writeMemStats() writes.                       //
+////////////////////////////////////////////////////////////////////////////////
+
+static void writeMemTag(FILE* fp, const char* name,
+                        const MEM_TAG_STATS* p_before,
+                        const MEM_TAG_STATS* p_after)
+{
+	fprintf(fp, "  %-10s  %9lld  %9lld  %9lld  %12lld  %12lld\n", name,
+	        p_after->num_allocs - p_before->num_allocs,
+	        p_after->num_reallocs - p_before->num_reallocs,
+	        p_after->num_frees - p_before->num_frees,
+	        p_after->live_bytes, p_after->peak_bytes);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeMemStats                                                              //
+//                                                                            //
+// Writes a table of the counters in 'p_after', one line per subsystem and a  //
+// total. The calls are counted from 'p_before', so a benchmark can report    //
+// the calls it made; if 'p_before' is NULL, they're counted from the start   //
+// of the program. The live and peak bytes are always those of 'p_after'.     //
+////////////////////////////////////////////////////////////////////////////////
+
+void writeMemStats(FILE* fp, const MEM_STATS* p_before,
+                   const MEM_STATS* p_after)
+{
+	static const MEM_STATS no_stats;
+	int i;
+
+	if (!p_before)
+		p_before = &no_stats;
+
+	fprintf(fp, "%-12s%11s%11s%11s%14s%14s\n", "Memory", "allocs",
+	        "reallocs", "frees", "live bytes", "peak bytes");
+	for (i = 0; i < NUM_MEM_TAGS; i++)
+		writeMemTag(fp, tag_names[i], p_before->tags + i, p_after->tags + i);
+	writeMemTag(fp, "total", &p_before->total, &p_after->total);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// dumpMemStats                                                               //
+//                                                                            //
+// Writes the counters since the start of the program to a new file. Returns  //
+// 0 on success or -1 if the file couldn't be created.                        //
+////////////////////////////////////////////////////////////////////////////////
+
+int dumpMemStats(const char* file_path)
+{
+	MEM_STATS now;
+	FILE* fp;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0)
+		return -1;
+
+	getMemStats(&now);
+	writeMemStats(fp, NULL, &now);
+
+	fclose(fp);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef MEM_TRACK_H_
+#define MEM_TRACK_H_
+
+#include <stdio.h>
+#include <Windows.h>
+
+// The subsystems allocations are tagged with
+#define MEM_SPEC            0   // variant stores and the spec arena
+#define MEM_SWITCH          1   // switch lists and links on the heap
+#define MEM_RULES           2   // rule set, diagrams, family hash, sw descs
+#define MEM_ANALYSIS        3   // near misses, conflicts, layouts, statistics
+#define MEM_INTERN          4   // the string intern pool
+#define MEM_NETWORK         5   // downloaded specs (vss_connect.c)
+#define NUM_MEM_TAGS        6
+
+// Every block starts with a header this size, which keeps the memory after
+// it aligned the same as malloc()'s
+#define MEM_HEADER_SIZE     16
+
+// The functions the blocks come from. setMemHooks() replaces malloc(),
+// realloc() and free() with them.
+typedef struct mem_hooks {
+	void* (*alloc)(size_t size);
+	void* (*realloc)(void* p, size_t size);
+	void (*free)(void* p);
+} MEM_HOOKS, * P_MEM_HOOKS;
+
+// Counters for one subsystem, since the program started. The bytes are
+// what was asked for, without the headers.
+typedef struct mem_tag_stats {
+	long long num_allocs;       // memAlloc() and memCalloc() calls
+	long long num_reallocs;
+	long long num_frees;
+	long long live_bytes;
+	long long peak_bytes;       // most live bytes at any one time
+} MEM_TAG_STATS;
+
+typedef struct mem_stats {
+	MEM_TAG_STATS tags[NUM_MEM_TAGS];
+	MEM_TAG_STATS total;        // the peak is of the sum, not a sum of peaks
+} MEM_STATS, * P_MEM_STATS;
+
+int setMemHooks(const MEM_HOOKS* p_hooks);
+void* memAlloc(int tag, size_t size);
+void* memCalloc(int tag, size_t num, size_t size);
+void* memRealloc(int tag, void* p, size_t size);
+void memFree(void* p);
+void getMemStats(P_MEM_STATS p_stats);
+void writeMemStats(FILE* fp, const MEM_STATS* p_before,
+                   const MEM_STATS* p_after);
+int dumpMemStats(const char* file_path);
+
+#endif
\ No newline at end of file
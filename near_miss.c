@@ -0,0 +1,348 @@
+////////////////////////////////////////////////////////////////////////////////
+// near_miss.c                                                                //
+//                                                                            //
+// This TU finds the switch rules that are one or two variants away from      //
+// firing for a given spec. When a quote is being put together, it's useful   //
+// to know what could be added to a spec to fill a location or change the     //
+// switch in it, e.g. "add 5WLAMP-H and location 1 gets 22392513".            //
+//                                                                            //
+// A 'near miss' is a rule from the compiled rule set (see rule_set.c) whose  //
+// variant string is not completely contained in the spec, but would be if    //
+// one or two more variants were added. The near misses are computed for the  //
+// whole SP + CA rule set in a single pass over the spec:                     //
+//                                                                            //
+// 1) Every variant in the spec is looked up in the rule set's symbol table.  //
+//    Variants that aren't used by any rule are ignored.                      //
+// 2) For each variant that is used by a rule, every rule in its inverted     //
+//    index list has its hit counter incremented.                             //
+// 3) A rule with 'num_terms - hits' missing variants is a near miss if that  //
+//    number is between 1 and the maximum requested.                          //
+//                                                                            //
+// This touches each (variant, rule) pair that actually shares a symbol once, //
+// instead of running checkVarString() on every rule for every candidate      //
+// variant.                                                                   //
+//                                                                            //
+// Rules that would place a switch that the spec already has in the same      //
+// location aren't reported, since adding their variants wouldn't change      //
+// anything. Plugs, covers, and rules with a quantity of -1 aren't reported   //
+// either.                                                                    //
+//                                                                            //
+// The main window doesn't show near misses, so they aren't found when a spec //
+// is loaded. The /nearmiss command line mode (see tool_mode.c) writes them   //
+// for a spec file, or for every spec in a directory, with                    //
+// writeNearMissReport().                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "near_miss.h"
+#include "parse_vss.h"
+#include "sw_desc.h"
+#include "mem_track.h"
+
+static int writeSpecMisses(FILE* fp, const RULE_SET* p_rules,
+                           const char* name, const VAR_STORE* p_vars);
+
+////////////////////////////////////////////////////////////////////////////////
+// isPlaced                                                                   //
+//                                                                            //
+// Returns TRUE if one of the rules listed in 'placed' puts part number 'pn'  //
+// in location 'loc'.                                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL isPlaced(const RULE_SET* p_rules, const int* placed,
+                     int num_placed, int loc, int pn)
+{
+	int i;
+
+	for (i = 0; i < num_placed; i++)
+		if (p_rules->rules[placed[i]].loc == loc &&
+		    p_rules->rules[placed[i]].pn == pn)
+			return TRUE;
+
+	return FALSE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// missingCount                                                               //
+//                                                                            //
+// Returns the number of variants rule 'i' is missing if it's a near miss     //
+// worth reporting, or 0 if it isn't.                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static int missingCount(const RULE_SET* p_rules, const int* hits, int i,
+                        int max_missing, const int* placed, int num_placed)
+{
+	const struct sw_rule* p_rule = p_rules->rules + i;
+	int missing = p_rule->num_terms - hits[i];
+
+	if (missing < 1 || missing > max_missing)
+		return 0;
+	if (p_rule->qty == -1 || p_rule->pn == PLUG || p_rule->pn == COVER)
+		return 0;
+	if (isPlaced(p_rules, placed, num_placed, p_rule->loc, p_rule->pn))
+		return 0;
+
+	return missing;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findNearMisses                                                             //
+//                                                                            //
+// Computes the near misses for a spec and stores them in a newly allocated   //
+// near miss set. The set must be freed with freeNearMisses().                //
+//                                                                            //
+// The results are grouped by location. Within each location, the rules       //
+// missing one variant come before the rules missing two, and rules with the  //
+// same count are in csv order (SP before CA). 'max_missing' is clamped to    //
+// MAX_NEAR_MISSING.                                                          //
+//                                                                            //
+// Returns 0 on success, or a negative value if memory couldn't be allocated. //
+////////////////////////////////////////////////////////////////////////////////
+
+int findNearMisses(const RULE_SET* p_rules, const VAR_STORE* p_vars,
+                   int max_missing, P_NEAR_MISS_SET* pp_set)
+{
+	P_NEAR_MISS_SET p_set = NULL;
+	BYTE* present = NULL;
+	int* hits = NULL;
+	int* placed = NULL;
+	int* p_next = NULL;
+	int num_placed = 0;
+	int res = 0;
+	int i, j, m;
+
+	*pp_set = NULL;
+
+	if (!p_rules || !p_vars)
+		return -1;
+
+	if (max_missing > MAX_NEAR_MISSING)
+		max_missing = MAX_NEAR_MISSING;
+
+	present = memCalloc(MEM_ANALYSIS, (size_t)p_rules->num_symbols + 1, 1);
+	hits    = memCalloc(MEM_ANALYSIS, (size_t)p_rules->num_rules + 1,
+	                    sizeof(int));
+	placed  = memAlloc(MEM_ANALYSIS, sizeof(int) *
+	                   ((size_t)p_rules->num_rules + 1));
+	p_next  = memAlloc(MEM_ANALYSIS, sizeof(int) * (NUM_LOC_6605 + 1));
+	p_set   = memCalloc(MEM_ANALYSIS, 1, sizeof(NEAR_MISS_SET));
+
+	if (!present || !hits || !placed || !p_next || !p_set) {
+		res = -2;
+		goto done;
+	}
+
+	// Count the terms each rule has in the spec, one pass over the inverted
+	// index of each rule symbol on the spec
+	markSpecSymbols(p_rules, p_vars, present);
+	for (i = 0; i < p_rules->num_symbols; i++) {
+		if (!present[i])
+			continue;
+
+		for (j = p_rules->rule_start[i]; j < p_rules->rule_start[i + 1]; j++)
+			hits[p_rules->rule_index[j]]++;
+	}
+
+	num_placed = getPlacedRules(p_rules, present, placed);
+
+	// Count the near misses in each location so they can be bucketed
+	for (i = 0; i < p_rules->num_rules; i++)
+		if (missingCount(p_rules, hits, i, max_missing, placed, num_placed))
+			p_set->num_misses++;
+
+	if (p_set->num_misses) {
+		p_set->misses = memAlloc(MEM_ANALYSIS,
+		                         sizeof(NEAR_MISS) * p_set->num_misses);
+		if (!p_set->misses) {
+			res = -3;
+			goto done;
+		}
+	}
+
+	for (i = 0; i < p_rules->num_rules; i++)
+		if (missingCount(p_rules, hits, i, max_missing, placed, num_placed))
+			p_set->loc_start[p_rules->rules[i].loc]++;
+
+	for (i = 0, j = 0; i <= NUM_LOC_6605; i++) {
+		int count = p_set->loc_start[i];
+		p_set->loc_start[i] = j;
+		p_next[i] = j;
+		j += count;
+	}
+
+	// Fill each location's bucket, closest rules first
+	for (m = 1; m <= max_missing; m++) {
+		for (i = 0; i < p_rules->num_rules; i++) {
+			const struct sw_rule* p_rule = p_rules->rules + i;
+			NEAR_MISS* p_miss;
+
+			if (missingCount(p_rules, hits, i, max_missing, placed,
+			                 num_placed) != m)
+				continue;
+
+			p_miss = p_set->misses + p_next[p_rule->loc]++;
+			p_miss->rule = i;
+			p_miss->num_missing = 0;
+
+			for (j = 0; j < p_rule->num_terms; j++)
+				if (!present[p_rule->terms[j]])
+					p_miss->missing[p_miss->num_missing++] = p_rule->terms[j];
+		}
+	}
+
+done:
+	memFree(present);
+	memFree(hits);
+	memFree(placed);
+	memFree(p_next);
+
+	if (res == 0)
+		*pp_set = p_set;
+	else
+		memFree(p_set);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeNearMisses                                                             //
+//                                                                            //
+// Frees a near miss set allocated by findNearMisses(). Safe to call with     //
+// NULL.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeNearMisses(P_NEAR_MISS_SET p_set)
+{
+	if (!p_set)
+		return;
+
+	memFree(p_set->misses);
+	memFree(p_set);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeNearMissReport                                                        //
+//                                                                            //
+// Writes the near misses of the spec file 'spec_path' to the file            //
+// 'file_path', or of every .txt spec file in it if it's a directory. For     //
+// each spec, the rules of each location that are at most MAX_NEAR_MISSING    //
+// variants from firing are listed closest first: which csv file they're      //
+// from, the part number and quantity, the description of the switch (see     //
+// sw_desc.c) if there is one, and the variants the spec would need. Files    //
+// that can't be parsed as a spec are skipped. Returns 0 on success, -1 if    //
+// the report file couldn't be created, -2 if there's no spec to read, or -3  //
+// if memory couldn't be allocated.                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeNearMissReport(const RULE_SET* p_rules, const char* spec_path,
+                        const char* file_path)
+{
+	WIN32_FIND_DATAA find_data;
+	HANDLE h_find;
+	char dir[MAX_PATH];
+	char path[MAX_PATH];
+	DWORD attrs = GetFileAttributesA(spec_path);
+	FILE* fp;
+	int num_specs = 0;
+	int res = 0;
+
+	if (attrs == INVALID_FILE_ATTRIBUTES)
+		return -2;
+
+	// A single file is found the same way as the files of a directory
+	if (attrs & FILE_ATTRIBUTE_DIRECTORY) {
+		strcpy_s(dir, MAX_PATH, spec_path);
+		sprintf_s(path, MAX_PATH, "%s\\*.txt", spec_path);
+	}
+	else {
+		const char* name = max(strrchr(spec_path, '\\'),
+		                       strrchr(spec_path, '/'));
+
+		sprintf_s(dir, MAX_PATH, "%.*s", name ? (int)(name - spec_path) : 1,
+		          name ? spec_path : ".");
+		strcpy_s(path, MAX_PATH, spec_path);
+	}
+
+	if ((h_find = FindFirstFileA(path, &find_data)) == INVALID_HANDLE_VALUE)
+		return -2;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0) {
+		FindClose(h_find);
+		return -1;
+	}
+
+	fprintf(fp, "Near misses: rules at most %d variants from firing, out of "
+	        "%d rules\n", MAX_NEAR_MISSING, p_rules->num_rules);
+
+	do {
+		P_VAR_STORE p_vars;
+
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		sprintf_s(path, MAX_PATH, "%s\\%s", dir, find_data.cFileName);
+		if ((p_vars = parseVssFile(path, NULL)) == NULL)
+			continue;
+
+		res = writeSpecMisses(fp, p_rules, find_data.cFileName, p_vars);
+		memFree(p_vars);
+		num_specs++;
+	} while (res == 0 && FindNextFileA(h_find, &find_data));
+
+	FindClose(h_find);
+	fclose(fp);
+
+	if (res == 0 && num_specs == 0)
+		res = -2;
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeSpecMisses                                                            //
+//                                                                            //
+// Writes the near misses of one spec, 'p_vars', read from the file 'name',   //
+// to the report 'fp' (see writeNearMissReport()). Returns 0 on success, or   //
+// -3 if memory couldn't be allocated.                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int writeSpecMisses(FILE* fp, const RULE_SET* p_rules,
+                           const char* name, const VAR_STORE* p_vars)
+{
+	P_NEAR_MISS_SET p_set;
+	char sym[SYMBOL_LENGTH + 1];
+	int loc, i, j;
+
+	if (findNearMisses(p_rules, p_vars, MAX_NEAR_MISSING, &p_set) != 0)
+		return -3;
+
+	fprintf(fp, "\n%s: %d near misses\n", name, p_set->num_misses);
+
+	for (loc = 0; loc < NUM_LOC_6605; loc++) {
+		if (p_set->loc_start[loc] == p_set->loc_start[loc + 1])
+			continue;
+
+		fprintf(fp, "\nLocation %d\n", loc);
+
+		for (i = p_set->loc_start[loc]; i < p_set->loc_start[loc + 1]; i++) {
+			const NEAR_MISS* p_miss = p_set->misses + i;
+			const struct sw_rule* p_rule = p_rules->rules + p_miss->rule;
+			const char* desc = findSwDesc(p_rule->pn);
+
+			fprintf(fp, "    %s  %d  qty %d  (%s)  add",
+			        p_miss->rule < p_rules->num_sp_rules ? "SP" : "CA",
+			        p_rule->pn, p_rule->qty, desc ? desc : "?");
+
+			for (j = 0; j < p_miss->num_missing; j++) {
+				unpackSymbol(p_rules->sym_keys[p_miss->missing[j]], sym,
+				             SYMBOL_LENGTH + 1);
+				fprintf(fp, "%s %s", j ? "," : "", sym);
+			}
+			fprintf(fp, "\n");
+		}
+	}
+
+	freeNearMisses(p_set);
+	return 0;
+}
\ No newline at end of file
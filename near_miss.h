@@ -0,0 +1,31 @@
+#ifndef NEAR_MISS_H_
+#define NEAR_MISS_H_
+
+#include "rule_set.h"
+
+// Rules more than this many variants away from firing are not reported
+#define MAX_NEAR_MISSING    2
+
+// A rule that would fire if the variants in 'missing' were added to the spec
+typedef struct near_miss {
+	int rule;                         // index into the rule set
+	int num_missing;
+	int missing[MAX_NEAR_MISSING];    // symbol ids
+} NEAR_MISS;
+
+// The near misses for location 'loc' are
+// misses[loc_start[loc]] ... misses[loc_start[loc + 1] - 1],
+// ordered by the number of missing variants (closest first)
+typedef struct near_miss_set {
+	struct near_miss* misses;
+	int num_misses;
+	int loc_start[NUM_LOC_6605 + 1];
+} NEAR_MISS_SET, * P_NEAR_MISS_SET;
+
+int findNearMisses(const RULE_SET* p_rules, const VAR_STORE* p_vars,
+                   int max_missing, P_NEAR_MISS_SET* pp_set);
+void freeNearMisses(P_NEAR_MISS_SET p_set);
+int writeNearMissReport(const RULE_SET* p_rules, const char* spec_path,
+                        const char* file_path);
+
+#endif
\ No newline at end of file
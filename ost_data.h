@@ -3,6 +3,7 @@
 
 #include <Windows.h>
 #include "andrewll.h"
+#include "spec_arena.h"
 
 #define LINE_LENGTH       500
 #define MAX_VARIANTS      1500
@@ -25,18 +26,60 @@
 #define BLACK      (RGB(0,0,0))
 #define WHITE      (RGB(255,255,255))
 
+// Symbols are at most SYMBOL_LENGTH (8) characters, so each one is packed
+// into a single 64-bit key. See packSymbol() in rule_set.c.
+typedef unsigned long long SYM_KEY;
+
+// The 3-character variant family code (the 'VF' column of a spec, and the
+// first three characters of the IDVAR6), packed the same way. 0 = unknown.
+typedef unsigned int FAM_KEY;
+
+// The whole IDVAR6, packed the same way. See packIdvar6() in var_store.c.
+typedef unsigned long long ID6_KEY;
+
+// One line of a spec, as a parser reads it. The descriptions are handles
+// from the intern pool (see intern.c). Once a line is read, it's stored in
+// the spec's variant store and the record isn't kept.
 typedef struct variant {
 	char idvar6[IDVAR6_LENGTH + 1];
 	char symbol[SYMBOL_LENGTH + 1];
-	char fam_desc[FAM_DESC_LENGTH + 1];
-	char var_desc[VAR_DESC_LENGTH + 1];
+	const char* fam_desc;
+	const char* var_desc;
 } Variant;
 
+// The variants of a spec, stored column by column (see var_store.c).
+// Variant i is entry i of every array, in the order of the spec. The keys
+// are packed when the spec is parsed, so a scan for a symbol or a family
+// reads 8 or 4 bytes per variant; the descriptions are only read when one
+// is shown. The family index maps the slot of a known family (see
+// fam_hash.c) to the spec's first variant of that family, or -1.
+//
+// The symbol set is the spec in canonical form: its distinct symbols in
+// key order (which is strcmp() order), each with the index of its first
+// variant. Set operations on specs are merges of these arrays.
+typedef struct var_store {
+	int num_var;
+	SYM_KEY* sym_keys;       // 0 if the symbol field is empty
+	ID6_KEY* id_keys;
+	FAM_KEY* fam_keys;
+	const char** fam_descs;  // handles from the intern pool
+	const char** var_descs;
+	short* fam_index;        // NULL if the family hash isn't loaded
+	int num_fam_slots;
+	SYM_KEY* sym_set;        // sorted, without duplicates or empty symbols
+	short* sym_set_var;
+	int num_set;
+} VAR_STORE, * P_VAR_STORE;
+
+// Switch lists are intrusive (see LL_Init_Intrusive() in andrewll.c): the
+// list element is the 'link' member, so a switch is a single allocation.
+// 'vars' is a handle from the intern pool (see intern.c).
 typedef struct sw_link {
 	int loc;
 	int pn;
-	char* vars;
+	const char* vars;
 	int qty;
+	LL_elem link;
 } SW_link;
 
 typedef struct vss_num_dlg {
@@ -52,6 +95,8 @@ typedef struct _tag_BITMAP {
 
 typedef struct _tag_STATE_DATA {
 	LL* p_sw_list;
+	const struct sw_layout* p_layout;
+	struct rule_set* p_rules;
 	P_SW_BITMAP p_bitmaps;
 	int num_bitmaps;
 	int src_bitmap_pos[14];
@@ -62,7 +107,8 @@ typedef struct _tag_STATE_DATA {
 struct spec {
 	char url[200];
 	char num[14];
-	struct variant *(*parse)(char* buf, int* num_var);
+	char key[24];       // product class and number (see spec_cache.c)
+	struct var_store *(*parse)(char* buf, DWORD size, P_SPEC_ARENA p_arena);
 };
 
 #endif
\ No newline at end of file
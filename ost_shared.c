@@ -420,8 +420,8 @@ void printWindowTitle(HDC hdc, HFONT h_font_title, char* p_text,
 // of the switches cause a conflict.                                          //
 //                                                                            //
 // In case of a conflict, the function returns FALSE. Otherwise it returns    //
-// TRUE. This function serves as a helpfer function and is used in            //
-// cab_view.c and list_view.c.                                                //
+// TRUE. This function serves as a helpfer function and is used in cab_view.c //
+// and sw_layout.c.                                                           //
 ////////////////////////////////////////////////////////////////////////////////
 
 BOOL panelConflict(int loc, P_STATE_DATA p_data) {
@@ -447,4 +447,47 @@ BOOL panelConflict(int loc, P_STATE_DATA p_data) {
 		}
 	}
 	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runWorkerThreads                                                           //
+//                                                                            //
+// Runs 'worker' on one thread per processor, but no more than 'max_threads'  //
+// or MAXIMUM_WAIT_OBJECTS, and waits for all of them to finish. Every thread //
+// gets the same 'param', so the workers have to divide the work among        //
+// themselves (the solver and the rule audit hand out work items with         //
+// InterlockedIncrement). If no thread can be started, the worker is run on   //
+// the calling thread instead.                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void runWorkerThreads(LPTHREAD_START_ROUTINE worker, LPVOID param,
+                      int max_threads)
+{
+	HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+	SYSTEM_INFO sys_info;
+	int num_threads;
+	int num_started = 0;
+	int i;
+
+	GetSystemInfo(&sys_info);
+	num_threads = (int)sys_info.dwNumberOfProcessors;
+	num_threads = min(num_threads, max_threads);
+	num_threads = min(num_threads, MAXIMUM_WAIT_OBJECTS);
+
+	for (i = 0; i < num_threads; i++) {
+		threads[num_started] = CreateThread(NULL, 0, worker, param, 0, NULL);
+		if (threads[num_started] == NULL)
+			break;
+		num_started++;
+	}
+
+	if (num_started == 0) {
+		worker(param);
+		return;
+	}
+
+	WaitForMultipleObjects(num_started, threads, TRUE, INFINITE);
+
+	for (i = 0; i < num_started; i++)
+		CloseHandle(threads[i]);
 }
\ No newline at end of file
@@ -42,6 +42,12 @@
 
 #define WM_SETFOCUSEDIT (WM_USER+2)
 
+// WM_SPECLOADED is posted to the main window by the worker thread that
+// loaded a spec from EDB (see spec_job.c), whether it succeeded, failed or
+// was cancelled. The lParam is the job, which the main window procedure
+// either adopts the results of or throws away, and then frees.
+#define WM_SPECLOADED (WM_USER+3)
+
 struct button_state {
         BOOL clicking;
         BOOL hovering;
@@ -65,5 +71,7 @@ int paintHatchLines(HDC hdc, P_SW_BITMAP p_bitmap_hatch,
 void printWindowTitle(HDC hdc, HFONT h_font_title, char* p_text,
                       P_SW_BITMAP p_bitmap_hatch);
 BOOL panelConflict(int loc, P_STATE_DATA p_data);
+void runWorkerThreads(LPTHREAD_START_ROUTINE worker, LPVOID param,
+                      int max_threads);
 
 #endif
\ No newline at end of file
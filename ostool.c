@@ -6,9 +6,10 @@
 // procedure.                                                                 //
 //                                                                            //
 // The WM_CREATE processing in the main window procedure creates the three    //
-// main child windows for the application: the banner, list view and cab      //
-// view windows. WM_COMMAND processing calls functions that parse the spec    //
-// and resource files.                                                        //
+// main child windows for the application: the banner, list view and cab view //
+// windows. WM_COMMAND processing calls functions that parse the spec and     //
+// resource files. A spec from EDB is loaded on a worker thread instead (see  //
+// spec_job.c), and is shown when WM_SPECLOADED arrives.                      //
 //                                                                            //
 // Static data declared in the main window procedure is shared between the    //
 // main window and child windows. This is achieved by storing the address of  //
@@ -53,6 +54,12 @@
 
 #include "ostool.h"
 #include "vss_connect.h"    // for internet retrieval of VSS spec
+#include "fetch_policy.h"   // for setFetchPolicy()
+#include "fetch_coalesce.h" // for sharing downloads between jobs
+#include "spec_job.h"       // for loading specs on a worker thread
+#include "tool_mode.h"      // for the command line modes
+#include "intern.h"         // for freeInternPool()
+#include "mem_track.h"      // for dumpMemStats()
 
 const char g_title[] = "CE Dash Visualizer";
 
@@ -64,6 +71,10 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 	HWND hwnd;
 	MSG msg;
 
+	// A command line runs one of the offline modes instead of the window
+	if (pCmdLine && *pCmdLine)
+		return runToolMode(pCmdLine);
+
 	WNDCLASSA wndclass = { 0 };
 	wndclass.style          = CS_HREDRAW | CS_VREDRAW; // repaint when maximized
 	wndclass.lpfnWndProc    = WindowProc;
@@ -102,7 +113,6 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
 	// Clear C4100 compiler warning
 	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(pCmdLine);
 
 	return (int)(msg.wParam);
 }
@@ -112,9 +122,27 @@ LRESULT CALLBACK WindowProc
 {
 	static HINSTANCE h_instance;
 
-	// VSS file variables
-	static struct variant* var_list;
-	static int num_var;
+	// The variants of the current spec
+	static P_VAR_STORE p_vars;
+
+	// Holds the variant store and switch list of the current spec. It's
+	// traded for the arena of each spec loaded from EDB (see spec_job.c).
+	static P_SPEC_ARENA p_arena;
+
+	// The spec being loaded from EDB, or NULL
+	static P_SPEC_JOB p_job;
+
+	// The specs downloaded before (see spec_cache.c), or NULL
+	static P_SPEC_CACHE p_cache;
+
+	// The WinInet session every EDB lookup goes through (see
+	// vss_connect.c), or NULL
+	static P_EDB_SESSION p_session;
+
+	// Lets jobs for the same page share its download, e.g. when a number
+	// is entered again while it's still loading (see fetch_coalesce.c).
+	// NULL if it couldn't be opened; jobs then use 'p_session' directly.
+	static P_FETCH_COALESCER p_flights;
 
 	static HWND hwnd_banner;
 	static HWND hwnd_list_view;
@@ -150,6 +178,8 @@ LRESULT CALLBACK WindowProc
 
 	switch (message) {
 
+	// If this fails, CreateWindowA() destroys the window, so everything
+	// that was set up before the failure is freed by WM_DESTROY below
 	case WM_CREATE:
 		
 		hdc = GetDC(hwnd);
@@ -169,16 +199,10 @@ LRESULT CALLBACK WindowProc
 		h_instance = ((LPCREATESTRUCTA)lParam)->hInstance;
 
 		if (loadBitmaps(h_instance, sw_bitmaps, state_data.num_bitmaps))
-		{
-			deleteMemoryDCs(sw_bitmaps, state_data.num_bitmaps);
 			return -1;
-		}
 
-		if (selectBitmaps(sw_bitmaps, state_data.num_bitmaps)) {
-			deleteMemoryDCs(sw_bitmaps, state_data.num_bitmaps);
-			destroyBitmaps( sw_bitmaps, state_data.num_bitmaps);
+		if (selectBitmaps(sw_bitmaps, state_data.num_bitmaps))
 			return -1;
-		}
 		
 		SetClassLongPtrA(hwnd, GCLP_HBRBACKGROUND,
 		                (LONG_PTR)CreateSolidBrush(RGB(240, 240, 240)));
@@ -186,10 +210,47 @@ LRESULT CALLBACK WindowProc
 		// Set starting zone 4 panel to the 10-switch panel
 		state_data.src_bitmap_pos[0] = 3;
 
+		if ((p_arena = arenaCreate()) == NULL)
+			return -1;
+
+		// Compile the SP and CA switch data into the rule set used for
+		// whole-rule-set queries (see rule_set.c)
+		if (compileRuleSet(&(state_data.p_rules)))
+			return -1;
+
+		// Parse the switch descriptions into the table every view and
+		// message box looks them up in (see sw_desc.c)
+		if (loadSwDescs())
+			return -1;
+
+		// Build the family hash every spec's family index uses (see
+		// fam_hash.c). Without it findFamily() scans the spec instead,
+		// so a failure here isn't an error.
+		loadFamHash();
+
+		// Open the cache of downloaded specs. Without it every spec is
+		// downloaded, so a failure here isn't an error either.
+		openSpecCache(NULL, &p_cache);
+
+		// Open the session for EDB lookups. Without it specs can still be
+		// opened from files, so it's only an error when one is looked up.
+		// Lookups are hedged, so a slow response from EDB doesn't hold
+		// up the window for long (see fetch_policy.c).
+		if (openEdbSession(SPEC_JOB_TIMEOUT, &p_session) == 0) {
+			FETCH_POLICY policy;
+
+			getFetchPolicyDefaults(&policy);
+			policy.f_hedge = TRUE;
+			setFetchPolicy(p_session, &policy);
+
+			openFetchCoalescer(&(p_session->transport), &p_flights);
+		}
+
 		///////////////////////////////////////////////////////////////
 		// Prepare CREATE_DATA structure
 
 		state_data.p_sw_list = NULL;
+		state_data.p_layout = NULL;
 		state_data.p_bitmaps = sw_bitmaps;
 		state_data.num_bitmaps = state_data.num_bitmaps;
 
@@ -205,11 +266,7 @@ LRESULT CALLBACK WindowProc
 		if (createChildWindows(h_instance, hwnd, &hwnd_banner,
 		                       &hwnd_list_view, &hwnd_cab_view,
 		                       &state_data))
-		{
-			deleteMemoryDCs(sw_bitmaps, state_data.num_bitmaps);
-			destroyBitmaps( sw_bitmaps, state_data.num_bitmaps);
 			return -1;
-		}
 
 		// WINDOW SIZING
 		dpi = GetDpiForWindow(hwnd);
@@ -289,8 +346,8 @@ LRESULT CALLBACK WindowProc
 				}
 
 				// parseVssFile closes the file
-				var_list = parseVssFile(ofn.lpstrFile, &num_var);
-				if (var_list == NULL) {
+				p_vars = parseVssFile(ofn.lpstrFile, p_arena);
+				if (p_vars == NULL) {
 					MessageBoxA(hwnd, "Couldn't parse VSS file...",
 					            "Error!", MB_ICONERROR);
 					SendMessageA(hwnd_banner, WM_SETFOCUSEDIT, 1, 0);
@@ -298,7 +355,7 @@ LRESULT CALLBACK WindowProc
 				}
 
 				// !
-				// At this point, var_list points to memory allocated on heap
+				// At this point, p_vars points to memory in p_arena
 				// !
 
 				// Set title bar text to display the opened file
@@ -309,75 +366,68 @@ LRESULT CALLBACK WindowProc
 			}
 			else {      // Spec retrieved from EDB
 
-				// Internet spec retrieval variables
-				char *vss_buf = NULL;
-				DWORD buf_size = 200000;
-				const char *url     = ((struct spec *)lParam)->url;
-
-				SetCursor(LoadCursor(NULL, IDC_WAIT));
-
-				// lParam points to a structure with the url
-				// connectToEDB closes h_open and h_url handles
-				if (connectToEDB(&vss_buf, url, buf_size)) {
+				// lParam points to a structure with the url and the parse
+				// function. The download, parse, match and layout run on a
+				// worker thread, which posts WM_SPECLOADED when it's done,
+				// so the window keeps responding in the meantime. Clearing
+				// above cancelled any spec that was still being loaded.
+				const struct spec *p_spec = (const struct spec *)lParam;
+
+				p_job = NULL;
+				if (p_session)
+					p_job = startSpecJob(hwnd, p_spec, state_data.p_rules,
+					                     p_flights ? &(p_flights->transport) :
+					                     &(p_session->transport), p_cache,
+					                     SPEC_JOB_TIMEOUT);
+				if (!p_job) {
 					MessageBoxA(NULL, "Error connecting to EDB",
 					            "Error", MB_ICONERROR);
 					SendMessageA(hwnd_banner, WM_SETFOCUSEDIT, 1, 0);
 					return 0;
 				}
 
-				// !
-				// At this point, vss_buf points to memory allocated on heap
-				// !
-
-				// parsing function frees vss_buf
-				var_list = ((struct spec*)lParam)->parse(vss_buf, &num_var);
-				if (var_list == NULL) {
-					MessageBoxA(hwnd, "Error downloading VSS spec!\n\n"
-					            "Make sure the VSS number was entered correctly.",
-					            "VSS Error", MB_ICONERROR);
-					SendMessageA(hwnd_banner, WM_SETFOCUSEDIT, 1, 0);
-					return 0;
-				}
-
-				// !
-				// At this point, var_list points to memory allocated on heap
-				// !
-
-				// Set title bar text to display the VSS # retrieved
-				strncpy_s(title_text, title_size, ((struct spec*)lParam)->num,
-				          strlen(((struct spec*)lParam)->num));
+				// Show which spec is on its way
+				strncpy_s(title_text, title_size, g_title, strlen(g_title));
+				strncat_s(title_text, title_size, " - Loading ", 11);
+				strncat_s(title_text, title_size, p_spec->num,
+				          strlen(p_spec->num));
 				SetWindowTextA(hwnd, title_text);
+				return 0;
 			}
 
 			// !
-			// At this point, var_list points to memory on the heap.
-			// It won't be freed until another spec is loaded, the
+			// At this point, p_vars points to memory in p_arena.
+			// It won't be released until another spec is loaded, the
 			// clear button is clicked, or the program is exited.
 			// !
 
-			// Parse standard product switch data file
-			if (parseCSV(&(state_data.p_sw_list), var_list, num_var,
-						 IDR_CSV3)) {
-				MessageBoxA(hwnd, "SP CSV Error!", "Error!",
-							MB_ICONERROR);
-				SendMessageA(hwnd, WM_COMMAND, MAKEWPARAM(BTN_ID_CLEAR, 0), 0);
-				return 0;
-			}
-
-			// Parse CA switch data file
+			// Match the SP and CA switch data against the spec. The compiled
+			// rule set builds the same list parseCSV() would build for
+			// IDR_CSV3 and then IDR_CSV4 (see matchRuleSet() in rule_set.c).
 			int pcsv;
 			char pc_buf[50] = { 0 };
-			if ((pcsv = parseCSV(&(state_data.p_sw_list), var_list, num_var,
-			                     IDR_CSV4)) != 0) {
-				wsprintfA(pc_buf, "CA CSV Error! (%d)", pcsv);
+			if ((pcsv = matchRuleSet(&(state_data.p_sw_list),
+			                         state_data.p_rules, p_vars,
+			                         p_arena)) != 0) {
+				wsprintfA(pc_buf, "CSV Error! (%d)", pcsv);
 				MessageBoxA(hwnd, pc_buf, "Error!", MB_ICONERROR);
 				SendMessageA(hwnd, WM_COMMAND, MAKEWPARAM(BTN_ID_CLEAR, 0), 0);
 				return 0;
 			}
 
-			getSrcBitmapPos(state_data.p_sw_list, state_data.src_bitmap_pos);
+			state_data.src_bitmap_pos[0] = getSwPanel(p_vars);
+
+			// Publish the layout the views read from. The conflict flags
+			// depend on the zone 4 panel, so it's built after that's known.
+			if (buildSwLayout(&state_data, p_arena,
+			                  &(state_data.p_layout)) != 0) {
+				MessageBoxA(hwnd, "Not enough memory to show the spec!",
+				            "Error!", MB_ICONERROR);
+				SendMessageA(hwnd, WM_COMMAND, MAKEWPARAM(BTN_ID_CLEAR, 0), 0);
+				return 0;
+			}
 
-			state_data.src_bitmap_pos[0] = getSwPanel(var_list, num_var);
+			getSrcBitmapPos(state_data.p_layout, state_data.src_bitmap_pos);
 
 			notifyConflicts(state_data.p_sw_list);
 			notifyPanel(state_data.p_sw_list, state_data.src_bitmap_pos[0]);
@@ -396,7 +446,14 @@ LRESULT CALLBACK WindowProc
 			return 0;
 
 		case BTN_ID_CLEAR:
-			freeMemory(&var_list, &(state_data.p_sw_list));
+			// A spec still being loaded is dropped when it arrives
+			if (p_job) {
+				cancelSpecJob(p_job);
+				p_job = NULL;
+			}
+
+			freeMemory(p_arena, &p_vars, &(state_data.p_sw_list),
+			           &(state_data.p_layout));
 			clearSrcBitmapPos(state_data.src_bitmap_pos);
 
 			// Clear list box
@@ -437,6 +494,14 @@ LRESULT CALLBACK WindowProc
 		case ID_ACCEL_OPEN:
 			SendMessageA(hwnd, WM_COMMAND, MAKEWPARAM(BTN_ID_FILE, 0), 0);
 			break;
+		case ID_ACCEL_MEM:
+			if (dumpMemStats("mem_stats.txt"))
+				MessageBoxA(hwnd, "Couldn't write mem_stats.txt!", "Error!",
+				            MB_ICONERROR);
+			else
+				MessageBoxA(hwnd, "Memory use written to mem_stats.txt",
+				            "CE Dash Visualizer", MB_ICONINFORMATION);
+			break;
 
 		}
 		return 0;
@@ -458,7 +523,7 @@ LRESULT CALLBACK WindowProc
 			return 0;
 		}
 
-		int hi_pos = getHighlightPos(state_data.p_sw_list, (int)wParam);
+		int hi_pos = getHighlightPos(state_data.p_layout, (int)wParam);
 
 		if (hi_pos < 0) {
 			SendMessageA(hwnd, WM_CLEARHIGHLIGHT, 0, 0);
@@ -474,8 +539,84 @@ LRESULT CALLBACK WindowProc
 		SendMessageA(hwnd_cab_view, WM_DRAWHIGHLIGHT, wParam, hi_pos);
 		return 0;
 	
-	// Free all memory dynamically reserved by the program
-	case WM_DESTROY:
+	// Custom message - see description in ost_shared.h
+	case WM_SPECLOADED: {
+		P_SPEC_JOB p_done = (P_SPEC_JOB)lParam;
+		char msg_buf[50] = { 0 };
+
+		// The spec was cleared, or another one was asked for, since this
+		// job started
+		if (p_done != p_job) {
+			freeSpecJob(p_done);
+			return 0;
+		}
+		p_job = NULL;
+
+		// The title said the spec was loading
+		if (p_done->result != SPEC_JOB_OK)
+			SetWindowTextA(hwnd, g_title);
+
+		switch (p_done->result) {
+		case SPEC_JOB_OK:
+			break;
+		case SPEC_JOB_NO_SPEC:
+			MessageBoxA(NULL, "Error connecting to EDB", "Error", MB_ICONERROR);
+			break;
+		case SPEC_JOB_TIMED_OUT:
+			MessageBoxA(hwnd, "EDB took too long to send the spec!",
+			            "Error", MB_ICONERROR);
+			break;
+		case SPEC_JOB_BAD_SPEC:
+			MessageBoxA(hwnd, "Error downloading VSS spec!\n\n"
+			            "Make sure the VSS number was entered correctly.",
+			            "VSS Error", MB_ICONERROR);
+			break;
+		case SPEC_JOB_NO_MATCH:
+			wsprintfA(msg_buf, "CSV Error! (%d)", p_done->match_res);
+			MessageBoxA(hwnd, msg_buf, "Error!", MB_ICONERROR);
+			break;
+		default:
+			MessageBoxA(hwnd, "Not enough memory to show the spec!",
+			            "Error!", MB_ICONERROR);
+			break;
+		}
+
+		if (p_done->result != SPEC_JOB_OK) {
+			freeSpecJob(p_done);
+			SendMessageA(hwnd_banner, WM_SETFOCUSEDIT, 1, 0);
+			return 0;
+		}
+
+		// The window's spec was cleared when the job started, and
+		// nothing has been loaded since, or the job would've been
+		// cancelled
+		adoptSpecJob(p_done, &p_arena, &p_vars, &state_data);
+
+		// Set title bar text to display the VSS # retrieved, and whether
+		// it's an old copy because EDB couldn't be reached
+		strncpy_s(msg_buf, sizeof(msg_buf), p_done->spec.num,
+		          strlen(p_done->spec.num));
+		if (p_done->stale)
+			strncat_s(msg_buf, sizeof(msg_buf), " (cached copy)", 14);
+		SetWindowTextA(hwnd, msg_buf);
+		freeSpecJob(p_done);
+
+		notifyConflicts(state_data.p_sw_list);
+		notifyPanel(state_data.p_sw_list, state_data.src_bitmap_pos[0]);
+
+		// This call is required to set the input focus to the VSS # edit
+		// control if notifyConflicts displays a message box
+		SendMessageA(hwnd_banner, WM_SETFOCUSEDIT, 1, 0);
+
+		InvalidateRect(hwnd, NULL, FALSE);
+		return 0;
+	}
+
+	// Free all memory dynamically reserved by the program. This also runs
+	// when WM_CREATE fails, so anything may still be NULL.
+	case WM_DESTROY: {
+		BOOL f_busy;
+
 		DeleteObject((HGDIOBJ)SetClassLongPtrA(hwnd, GCLP_HBRBACKGROUND,
 					     (LONG_PTR)GetStockObject(WHITE_BRUSH)));
 
@@ -484,11 +625,42 @@ LRESULT CALLBACK WindowProc
 		if (state_data.h_font_text)
 			DeleteObject(state_data.h_font_text);
 
-		freeMemory(&var_list, &(state_data.p_sw_list));
+		// The rule set, the intern pool, the spec cache and the EDB
+		// session can't be freed while a worker is still using them. A
+		// cancelled lookup aborts its requests, so the worker stops long
+		// before its timeout, and the window doesn't wait for that. The
+		// jobs that were posted but never got here are freed as well.
+		cancelSpecJob(p_job);
+		f_busy = waitSpecJobs(SPEC_JOB_CLOSE_MS) != 0;
+		{
+			MSG msg;
+			while (PeekMessageA(&msg, hwnd, WM_SPECLOADED, WM_SPECLOADED,
+			                    PM_REMOVE))
+				freeSpecJob((P_SPEC_JOB)msg.lParam);
+		}
+
+		// A worker that still hasn't stopped would use them once they're
+		// freed, and the process is about to exit anyway, so they're left
+		// to it
+		if (!f_busy) {
+			closeSpecCache(p_cache);
+			closeFetchCoalescer(p_flights);
+			closeEdbSession(p_session);
+			freeSwDescs();
+			freeFamHash();
+			freeRuleSet(state_data.p_rules);
+			freeInternPool();
+		}
+
+		if (p_arena)
+			freeMemory(p_arena, &p_vars, &(state_data.p_sw_list),
+			           &(state_data.p_layout));
+		arenaDestroy(p_arena);
 		deleteMemoryDCs(sw_bitmaps, state_data.num_bitmaps);
 		destroyBitmaps( sw_bitmaps, state_data.num_bitmaps);
 		PostQuitMessage(0);
 		return 0;
+		}
 	}
 
 	return DefWindowProcA(hwnd, message, wParam, lParam);
@@ -498,13 +670,16 @@ LRESULT CALLBACK WindowProc
 // freeMemory                                                                 //
 //                                                                            //
 // In this program there is some memory that needs to be allocated and freed  //
-// each time a spec is processed. This memory consists of the variant list    //
-// and the switch list.                                                       //
+// each time a spec is processed. This memory consists of the variant store   //
+// (see var_store.c), the switch list and the layout snapshot (see            //
+// sw_layout.c).                                                              //
 //                                                                            //
-// The variant list is an array of struct variant objects allocated on the    //
-// heap. The switch list is a linked list of struct sw_link objects, and is   //
-// also allocated on the heap. Both of these structs are declared in the      //
-// ost_data.h header file.                                                    //
+// The variant store is a struct var_store followed by its arrays, and the    //
+// switch list is a linked list of struct sw_link objects. Both of these      //
+// structs are declared in the ost_data.h header file. The store, the list    //
+// and the layout are allocated from the spec arena (see spec_arena.c), so    //
+// they're released together by resetting it, without walking the switch      //
+// list. The arena keeps its blocks for the next spec.                        //
 //                                                                            //
 // This function is called every time WM_COMMAND is processed with the        //
 // LOWORD(wParam) == BTN_ID_CLEAR, which is the ID for the button that clears //
@@ -515,14 +690,13 @@ LRESULT CALLBACK WindowProc
 // It is also called in the WM_DESTROY processing.                            //
 ////////////////////////////////////////////////////////////////////////////////
 
-void freeMemory(Variant** p_variant, LL** p_switch_list)
+void freeMemory(P_SPEC_ARENA p_arena, P_VAR_STORE* pp_vars,
+                LL** p_switch_list, const SW_LAYOUT** p_layout)
 {
-	free(*p_variant);
-	*p_variant = NULL;
-
-	if (*p_switch_list)
-		LL_Destroy(*p_switch_list);
+	arenaReset(p_arena);
+	*pp_vars = NULL;
 	*p_switch_list = NULL;
+	*p_layout = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -697,8 +871,9 @@ void clearSrcBitmapPos(int* p_src_bitmap_pos)
 // Populates the src_bitmap_pos array. This array of integers is a member of  //
 // the state_data array declared as a static variable in the main window      //
 // procedure. The array stores vertical offsets used to select the bitmaps    //
-// when drawing the dash. This function uses the previously-populated         //
-// switch list to determine these offsets.                                    //
+// when drawing the dash. This function uses the layout snapshot of the       //
+// previously-populated switch list (see sw_layout.c) to determine these      //
+// offsets.                                                                   //
 //                                                                            //
 // Each index of the array corresponds to section in the dash, each of which  //
 // has a bitmap that contains all switch configurations. These bitmaps        //
@@ -715,19 +890,18 @@ void clearSrcBitmapPos(int* p_src_bitmap_pos)
 // the leftmost two switches, then just the third, etc etc...                 //
 ////////////////////////////////////////////////////////////////////////////////
 
-int getSrcBitmapPos(LL* sw_list, int* p_src_bitmap_pos)
+int getSrcBitmapPos(const SW_LAYOUT* p_layout, int* p_src_bitmap_pos)
 {
-	LL_elem* p_sw_elem;
-
 	UINT index = 0;
 	UINT shift = 0;
 	UINT position;
+	int i;
 
-	if ((p_sw_elem = sw_list->head) == NULL)
+	if (!p_layout || p_layout->num_entries == 0)
 		return -1;
 
-	while (p_sw_elem) {
-		position = ((SW_link*)(p_sw_elem->data))->loc - 1;
+	for (i = 0; i < p_layout->num_entries; i++) {
+		position = p_layout->entries[i].loc - 1;
 
 		// Last four switch positions are not continuous.
 		// Switches jump from position 30 to position 35
@@ -754,8 +928,6 @@ int getSrcBitmapPos(LL* sw_list, int* p_src_bitmap_pos)
 		// to use when BitBlting from the source bitmap for each
 		// section of the dash to the destination.
 		p_src_bitmap_pos[index] |= 1 << (position - shift);
-
-		p_sw_elem = p_sw_elem->next;
 	}
 	return 0;
 }
@@ -848,6 +1020,7 @@ int loadBitmaps(HINSTANCE hInstance, P_SW_BITMAP p_sw_bitmap, int num_bitmaps)
 //                                                                            //
 // Frees the bitmaps from memory. It's only called when exiting the program,  //
 // whether that's because an error occurred or the program exited normally.   //
+// The handles are set to NULL, so calling it again does nothing.             //
 ////////////////////////////////////////////////////////////////////////////////
 
 void destroyBitmaps(P_SW_BITMAP p_sw_bitmap, int num_bitmaps)
@@ -855,8 +1028,10 @@ void destroyBitmaps(P_SW_BITMAP p_sw_bitmap, int num_bitmaps)
 	int i;
 
 	for (i = 0; i < num_bitmaps; i++)
-		if (p_sw_bitmap[i].h_bitmap)
+		if (p_sw_bitmap[i].h_bitmap) {
 			DeleteObject(p_sw_bitmap[i].h_bitmap);
+			p_sw_bitmap[i].h_bitmap = NULL;
+		}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -880,9 +1055,10 @@ int createMemoryDCs(HDC hdc, P_SW_BITMAP p_sw_bitmap, int num_dcs)
 ////////////////////////////////////////////////////////////////////////////////
 // deleteMemoryDCs                                                            //
 //                                                                            //
-// Deletes the memory DCs created in createMemoryDCs(). It's only called      //
-// when exiting the program, whether that's because an error occurred or the  //
-// program exited normally.                                                   //
+// Deletes the memory DCs created in createMemoryDCs(). It's only called when //
+// exiting the program, whether that's because an error occurred or the       //
+// program exited normally. The handles are set to NULL, so calling it again  //
+// does nothing.                                                              //
 ////////////////////////////////////////////////////////////////////////////////
 
 void deleteMemoryDCs(P_SW_BITMAP p_sw_bitmap, int num_dcs)
@@ -896,8 +1072,10 @@ void deleteMemoryDCs(P_SW_BITMAP p_sw_bitmap, int num_dcs)
 	// documentation. It may be perfectly fine to call DeleteDC with a NULL
 	// argument, which means checking for NULL as I did here is unnecessary.
 	for (i = 0; i < num_dcs; i++)
-		if (p_sw_bitmap[i].hdc_mem)
+		if (p_sw_bitmap[i].hdc_mem) {
 			DeleteDC(p_sw_bitmap[i].hdc_mem);
+			p_sw_bitmap[i].hdc_mem = NULL;
+		}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -934,8 +1112,10 @@ int selectBitmaps(P_SW_BITMAP p_sw_bitmap, int num_bitmaps)
 //                                                                            //
 // This function determines which one of the zone-4 panels the spec has. The  //
 // program needs to know this so it can draw the correct panel, and also      //
-// detect whether the spec is calling for a switch that will have no          //
-// location because of the panel selected.                                    //
+// detect whether the spec is calling for a switch that will have no location //
+// because of the panel selected. The panel is the variant of the W7D family; //
+// only the family codes of the spec are scanned to find it (see findFamily() //
+// in var_store.c), and only its symbol is unpacked.                          //
 //                                                                            //
 // In the state data structure declared as a static variable in the main      //
 // window procedure, there is an array member call src_bitmap_pos that        //
@@ -945,21 +1125,21 @@ int selectBitmaps(P_SW_BITMAP p_sw_bitmap, int num_bitmaps)
 // return value is stored.                                                    //
 ////////////////////////////////////////////////////////////////////////////////
 
-int getSwPanel(struct variant* var_list, int num_var)
+int getSwPanel(const VAR_STORE* p_vars)
 {
+	char symbol[SYMBOL_LENGTH + 1];
 	int i;
 
-	for (i = 0; i < num_var; i++) {
-		if (strstr(var_list[i].idvar6, "W7D")) {
-			if (strchr(var_list[i].symbol, '0'))
-				return 3;
-			else if (strchr(var_list[i].symbol, '6'))
-				return 2;
-			else if (strchr(var_list[i].symbol, '2'))
-				return 1;
-			else
-				return 0;
-		}
+	if ((i = findFamily(p_vars, packFamily("W7D"))) >= 0) {
+		unpackSymbol(p_vars->sym_keys[i], symbol, SYMBOL_LENGTH + 1);
+		if (strchr(symbol, '0'))
+			return 3;
+		else if (strchr(symbol, '6'))
+			return 2;
+		else if (strchr(symbol, '2'))
+			return 1;
+		else
+			return 0;
 	}
 
 	// The variant that describes the panel (part of the W7D family) should
@@ -1075,34 +1255,26 @@ int createChildWindows
 // occupies. That position is what this function determines.                  //
 //                                                                            //
 // The switches are displayed with a list box control, in the same order they //
-// were added to the linked list of switches. This function takes the index   //
-// of the selected switch in the list box, traverses the linked list <index>  //
-// number of times, and returns the location of the switch.                   //
+// were added to the linked list of switches. The layout snapshot (see        //
+// sw_layout.c) is in that order too, so this function takes the index of the //
+// selected switch in the list box, looks it up in the layout, and returns    //
+// the location of the switch.                                                //
 //                                                                            //
 // If an error occurs, the previous highlight rectangle is cleared, and a     //
 // new one is not drawn.                                                      //
 ////////////////////////////////////////////////////////////////////////////////
 
-int getHighlightPos(LL* sw_list, int index)
+int getHighlightPos(const SW_LAYOUT* p_layout, int index)
 {
-	LL_elem* p_temp_elem;
-	int i;
+	const SW_ENTRY* p_entry;
 
-	if (!sw_list)
+	if (!p_layout)
 		return -1;
 
-	p_temp_elem = sw_list->head;
-	if (!p_temp_elem)
-		return -2;
-
-	for (i = 0; i < index; i++) {
-		p_temp_elem = p_temp_elem->next;
-
-		if (!p_temp_elem)
-			return -3;
-	}
+	if ((p_entry = getSwEntry(p_layout, index)) == NULL)
+		return -3;
 
-	return ((SW_link*)(p_temp_elem->data))->loc;
+	return p_entry->loc;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -8,6 +8,11 @@
 #include "ost_data.h"
 #include "ost_shared.h"
 #include "cab_view.h"
+#include "rule_set.h"
+#include "sw_layout.h"
+#include "sw_desc.h"
+#include "var_store.h"
+#include "fam_hash.h"
 
 // Main window procedure
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT message, WPARAM wParam,
@@ -26,8 +31,9 @@ int loadNovumFont(HINSTANCE h_instance, char* res_name, char* res_type);
 void centerDialog(HWND hDlg);
 
 BOOL getFileInfo(HWND hwnd, OPENFILENAMEA* pOpenFile, char* pFilePath, int pathLength);
-void freeMemory(Variant** pVariant, LL** pSwitchList);
-int getHighlightPos(LL* sw_list, int index);
+void freeMemory(P_SPEC_ARENA pArena, P_VAR_STORE* ppVars,
+                LL** pSwitchList, const SW_LAYOUT** pLayout);
+int getHighlightPos(const SW_LAYOUT* p_layout, int index);
 static void notifyConflicts(LL* sw_list);
 static void notifyPanel(LL* sw_list, unsigned panel);
 
@@ -37,10 +43,10 @@ void destroyBitmaps(P_SW_BITMAP p_sw_bitmap, int num_bitmaps);
 int createMemoryDCs(HDC hdc, P_SW_BITMAP p_sw_bitmap, int num_dcs);
 void deleteMemoryDCs(P_SW_BITMAP p_sw_bitmap, int num_dcs);
 int selectBitmaps(P_SW_BITMAP p_sw_bitmap, int num_bitmaps);
-int getSwPanel(struct variant* var_list, int num_var);
+int getSwPanel(const VAR_STORE* p_vars);
 void drawTitle(HDC hdc, P_SW_BITMAP p_bitmap_truck,
 	       P_SW_BITMAP p_bitmap_title);
 void clearSrcBitmapPos(int* p_src_bitmap_pos);
-int getSrcBitmapPos(LL* sw_list, int* p_src_bitmap_pos);
+int getSrcBitmapPos(const SW_LAYOUT* p_layout, int* p_src_bitmap_pos);
 
 #endif
\ No newline at end of file
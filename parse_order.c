@@ -1,63 +1,77 @@
+#include <string.h>
+
 #include "parse_order.h"
+#include "intern.h"
+#include "var_store.h"
+#include "mem_track.h"
+
+// The buffer parsers are given a page and its length, and nothing marks
+// its end, so every scan is bounded by 'end'. A line is found with one
+// bounded memchr() (see findLineEnd()), and the fixed-width fields in it
+// are then copied without checking each character.
 
-int GetLineBuffer(const char *src, char *dest, int dest_size)
+const char* findLineEnd(const char* src, const char* end, int max_length)
 {
-   while ((*dest++ = *src++) != '\n') {
-		if (--dest_size <= 0) {
-			return -1;
-		}
-   }
-	*(dest - 1) = '\0';
-   return 0;
+	size_t avail = (size_t)(end - src);
+
+	// The '\n' may be one past the longest line
+	if (avail > (size_t)max_length + 1)
+		avail = (size_t)max_length + 1;
+
+	return memchr(src, '\n', avail);
 }
 
-static void GetProperty(char **line, char *dest, int skip, int length)
+int GetLineBuffer(const char *src, const char *end, char *dest, int dest_size)
 {
-	int i;
+	const char* line_end = findLineEnd(src, end, dest_size - 1);
 
-   for (i = 0; i < skip; i++) {
-      (*line)++;
-   }
-   
-   for (i = 0; i < length; i++) {
-		// Rarely, the variant description may be terminated with
-		// an endline before occupying the full 60 character limit
-		if ((*dest++ = *(*line)++) == '\n') {
-			*(dest - 1) = '\0';
-			return;
-		}
-   }
-	*dest = '\0';
+	if (!line_end)
+		return -1;
+
+	memcpy(dest, src, line_end - src);
+	dest[line_end - src] = '\0';
+	return 0;
 }
 
-static int skipToVariantsOrderBuffer(char **cur_pos)
+static void GetProperty(const char **line, const char *line_end, char *dest,
+                        int skip, int length)
 {
+	int avail = (int)(line_end - *line) - skip;
+
+	// Rarely, the variant description may be terminated with
+	// an endline before occupying the full 60 character limit
+	if (avail < 0)
+		avail = 0;
+	if (length > avail)
+		length = avail;
+
+	*line += skip;
+	if (*line > line_end)
+		*line = line_end;
+
+	memcpy(dest, *line, length);
+	dest[length] = '\0';
+	*line += length;
+}
+
+static int skipToVariantsOrderBuffer(char **cur_pos, const char *end)
+{
+	const char* line_end;
 	int i;
-	int count;
 	char line[LINE_LENGTH] = { 0 };
 
 	for (i = 0; i < 13; i++) {
-		count = 0;
-		while (**cur_pos != '\n') {
-			// '~' is used as the EOF marker. EOF should
-			// not be encountered at this point.
-			if (**cur_pos == '~') {
-				return -1;
-			}
-			// In a valid spec, no line before the variants
-			// begin should be more than 500 chars long.
-			if (++count > 500) {
-				return -2;
-			}
-			(*cur_pos)++;
-		}
-		(*cur_pos)++;
+		// In a valid spec, no line before the variants
+		// begin should be more than 500 chars long.
+		if ((line_end = findLineEnd(*cur_pos, end, 500)) == NULL)
+			return (end - *cur_pos > 500) ? -2 : -1;
+		*cur_pos = (char*)line_end + 1;
 	}
 
 	// Check for presence of "PRODUCT CLASS" which should exist
 	// on the first line of the variant list. Can't use strstr()
 	// on the buffer because lines aren't null-terminated.
-	if (GetLineBuffer(*cur_pos, line, LINE_LENGTH))
+	if (GetLineBuffer(*cur_pos, end, line, LINE_LENGTH))
 		return -3;
 	if (strstr(line, "PRODUCT CLASS") == NULL) {
 		return -4;
@@ -66,68 +80,77 @@ static int skipToVariantsOrderBuffer(char **cur_pos)
 	return 0;
 }
 
-static int countLinesOrderBuffer(char *buf)
+static int countLinesOrderBuffer(const char *buf, const char *end)
 {
+	const char* line_end;
 	int i = 0;
-	int count;
 
 	while (i < MAX_VARIANTS) {
-		count = 0;
-		while (*buf != '\n') {
-			// '~' is used as the EOF marker. EOF should
-			// not be encountered at this point.
-			if (*buf == '~') {
-				return -1;
-			}
-			// In a valid spec, a line containing variant data should not be
-			// 500 characters or more in length. In practice they will be much
-			// shorter; this is just a safeguard.
-			if (++count > 500) {
-				return -2;
-			}
-			buf++;
-		}
+		// In a valid spec, a line containing variant data should not be
+		// 500 characters or more in length. In practice they will be much
+		// shorter; this is just a safeguard.
+		if ((line_end = findLineEnd(buf, end, 500)) == NULL)
+			return (end - buf > 500) ? -2 : -1;
 		i++;
-		buf++;
+		buf = line_end + 1;
 
 		// A '<' in the first position denotes the end of the variant list
-		if (*buf == '<') {
+		if (buf < end && *buf == '<') {
 			return i;
 		}
 	}
 	return -3;
 }
 
-static void processOrderLineBuffer(char **buf_pos, struct variant *var)
+static int processOrderLineBuffer(char **buf_pos, const char *end,
+                                  struct variant *var)
 {
-	GetIDVAR6(buf_pos, var->idvar6);
-	GetFamDesc(buf_pos, var->fam_desc);
-	GetSymbol(buf_pos, var->symbol);
-	GetVarDesc(buf_pos, var->var_desc);
+	const char* line = *buf_pos;
+	const char* line_end;
+	char fam_desc[FAM_DESC_LENGTH + 1];
+	char var_desc[VAR_DESC_LENGTH + 1];
 
-	if (**buf_pos == '\n') {
-		(*buf_pos)++;
-	}
+	// countLinesOrderBuffer() found the end of every line
+	if ((line_end = findLineEnd(line, end, LINE_LENGTH)) == NULL)
+		return -6;
+
+	GetIDVAR6(&line, line_end, var->idvar6);
+	GetFamDesc(&line, line_end, fam_desc);
+	GetSymbol(&line, line_end, var->symbol);
+	GetVarDesc(&line, line_end, var_desc);
+
+	*buf_pos = (char*)line_end + 1;
+
+	// The descriptions are interned (see intern.c)
+	var->fam_desc = internString(fam_desc);
+	var->var_desc = internString(var_desc);
+	if (!var->fam_desc || !var->var_desc)
+		return -5;
+
+	return 0;
 }
 
-struct variant *parseOrderBuffer(char *buf, int *num_var)
+struct var_store *parseOrderBuffer(char *buf, DWORD size, P_SPEC_ARENA p_arena)
 {
-	struct variant *var_list;
+	struct var_store *p_vars;
+	struct variant var;
 	char *starting_pos = buf;
+	const char *end = buf + size;
+	int num_var;
 	int i;
 
 	if (!buf) return NULL;
 
-	if (skipToVariantsOrderBuffer(&buf)) {
-		free(starting_pos);
+	if (skipToVariantsOrderBuffer(&buf, end)) {
+		memFree(starting_pos);
 		return NULL;
 	}
 
 	// At this point, this function's local copy of buf points to the
 	// first line with variant data in the buffer
 
-	if ((*num_var = countLinesOrderBuffer(buf)) < 0) {
-		free(starting_pos);
+	if ((num_var = countLinesOrderBuffer(buf, end)) < 0) {
+		memFree(starting_pos);
 		return NULL;
 	}
 
@@ -135,22 +158,28 @@ struct variant *parseOrderBuffer(char *buf, int *num_var)
 	// first line with variant data in the buffer. countLinesOrderBuffer()
 	// received its own copy of buf.
 
-	if ((var_list = malloc(sizeof(struct variant) * (*num_var))) == NULL) {
-		free(starting_pos);
+	if ((p_vars = allocVarStore(num_var, p_arena)) == NULL) {
+		memFree(starting_pos);
 		return NULL;
 	}
 
 	// !
-	// At this point, var_list points to memory on the heap
+	// At this point, p_vars points to memory in the arena or on the heap
 	// !
 
-	for (i = 0; i < *num_var; i++) {
-		processOrderLineBuffer(&buf, var_list + i);
+	for (i = 0; i < num_var; i++) {
+		if (processOrderLineBuffer(&buf, end, &var) < 0) {
+			arenaRelease(p_arena, p_vars);
+			memFree(starting_pos);
+			return NULL;
+		}
+		storeVariant(p_vars, i, &var);
 	}
+	finishVarStore(p_vars);
 
-	// At this point, var_list still points to memory on the heap. It will
-	// be up to the application to ensure it is freed at some point.
+	// At this point, p_vars still points to that memory. It will be up
+	// to the application to ensure it is released at some point.
 
-	free(starting_pos);
-	return var_list;
+	memFree(starting_pos);
+	return p_vars;
 }
\ No newline at end of file
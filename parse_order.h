@@ -3,13 +3,14 @@
 
 #include "ost_data.h"
 
-int GetLineBuffer(const char* src, char* dest, int dest_size);
-struct variant* parseOrderBuffer(char* buf, int* num_var);
+const char* findLineEnd(const char* src, const char* end, int max_length);
+int GetLineBuffer(const char* src, const char* end, char* dest, int dest_size);
+struct var_store* parseOrderBuffer(char* buf, DWORD size, P_SPEC_ARENA p_arena);
 
 // Macros
-#define GetIDVAR6(line, dest)  GetProperty((line),(dest),5,IDVAR6_LENGTH)
-#define GetFamDesc(line, dest) GetProperty((line),(dest),1,FAM_DESC_LENGTH)
-#define GetSymbol(line, dest)  GetProperty((line),(dest),1,SYMBOL_LENGTH)
-#define GetVarDesc(line, dest) GetProperty((line),(dest),1,VAR_DESC_LENGTH)
+#define GetIDVAR6(l, e, d)  GetProperty((l),(e),(d),5,IDVAR6_LENGTH)
+#define GetFamDesc(l, e, d) GetProperty((l),(e),(d),1,FAM_DESC_LENGTH)
+#define GetSymbol(l, e, d)  GetProperty((l),(e),(d),1,SYMBOL_LENGTH)
+#define GetVarDesc(l, e, d) GetProperty((l),(e),(d),1,VAR_DESC_LENGTH)
 
 #endif
\ No newline at end of file
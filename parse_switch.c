@@ -27,11 +27,16 @@
 
 #include <stdlib.h>	// for atoi
 #include <stdio.h>
-#include <string.h>	// for strncmp
+#include <stddef.h>	// for offsetof
+#include <string.h>	// for strncpy_s
 #include "ost_data.h"
 
 #include "parse_switch.h"
 #include "resource.h"
+#include "intern.h"
+#include "var_store.h"
+#include "rule_set.h"   // for packSymbol()
+#include "mem_track.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // skipToSwitches                                                             //
@@ -171,16 +176,15 @@ int processCSVLine(int* loc, int* pn, int* qty, char* buf, const char* line)
 // 0. Otherwise, it returns -1.                                               //
 //                                                                            //
 // A variant string list contains one or more variant strings. Each one of    //
-// these strings is extracted into a buffer, terminated with a null           //
-// character, and compared against every string in the variant list until a   //
-// match is found or the entire list has been traversed.                      //
+// these strings is extracted into a buffer and packed into a key (see        //
+// packSymbol() in rule_set.c). The keys are sorted, and specHasAll() checks  //
+// them against the spec's sorted symbol set (see var_store.c) in one pass.   //
 //                                                                            //
 // Possible future improvement: this part of the program has a lot of room    //
-// for improvement. For every variant string in every variant list (one list  //
-// per switch link, around 750 total switch links), the entire list of        //
-// variants is checked with a linear search using strncmp. There are usually  //
-// around 900 variants in a spec. This results in many thousands of calls to  //
-// strncmp.                                                                   //
+// for improvement. Every variant list (one list per switch link, around 750  //
+// total switch links) is checked against the spec on its own, even though    //
+// many of them share variants. There are usually around 900 variants in a    //
+// spec.                                                                      //
 //                                                                            //
 // Possible improvements include using a different data structure (a hash     //
 // table?) or implementing a more intelligent search. The variants are stored //
@@ -199,13 +203,15 @@ int processCSVLine(int* loc, int* pn, int* qty, char* buf, const char* line)
 // important to improve this.                                                 //
 ////////////////////////////////////////////////////////////////////////////////
 
-int checkVarString(const Variant* var_list, int num_var, const char* sw_vars)
+int checkVarString(const VAR_STORE* p_vars, const char* sw_vars)
 {
 	int i   = 0;
 	int j   = 0;
 	int end = 0;          // == 1 if '\0' (end of variant string) is encountered
+	int num_keys = 0;
 
 	char var_tmp[SYMBOL_LENGTH + 1] = { 0 };
+	SYM_KEY keys[VAR_STR_LENGTH / 2];
 
 	while (!end) {
 		i = 0;
@@ -220,21 +226,20 @@ int checkVarString(const Variant* var_list, int num_var, const char* sw_vars)
 		end = (*sw_vars == '\0' ? 1 : 0);
 		sw_vars++;
 
-		// Loop through every variant in the spec. Check if var_tmp is
-		// one of those variants.
-		for (j = 0; j < num_var; j++) {
-			if (!strncmp((var_list + j)->symbol, var_tmp, i)) {
-				if (*((var_list + j)->symbol + i) == ' ' ||
-					 *((var_list + j)->symbol + i) == '\0') {
-					break;
-				}
-			}
-		}
-
-		if (j == num_var)
+		if (num_keys == VAR_STR_LENGTH / 2)
 			return -1;
+
+		// Insertion sort, there are only a few keys
+		keys[num_keys] = packSymbol(var_tmp, i);
+		for (j = num_keys++; j > 0 && keys[j - 1] > keys[j]; j--) {
+			SYM_KEY key = keys[j];
+			keys[j] = keys[j - 1];
+			keys[j - 1] = key;
+		}
 	}
-	return 0;
+
+	// An empty or unpackable variant has a key of 0, which no spec has
+	return (keys[0] != 0 && specHasAll(p_vars, keys, num_keys)) ? 0 : -1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -260,32 +265,22 @@ int checkVarString(const Variant* var_list, int num_var, const char* sw_vars)
 // error occurred while parsing the csv file will be displayed to the user.   //
 ////////////////////////////////////////////////////////////////////////////////
 
-int parseCSV(LL** pSwitchList, const Variant* var_list, int num_var, WORD res_ID)
+int parseCSV(LL** pSwitchList, const VAR_STORE* p_vars, WORD res_ID)
 {
-	HRSRC hrsrc;
-	HGLOBAL hglobal;
-
 	char* sw_tmp;
 	char line[LINE_LENGTH];
+	int res;
 
 	if (*pSwitchList == NULL) {
-		if ((*pSwitchList = malloc(sizeof(LL))) == NULL)
+		if ((*pSwitchList = memAlloc(MEM_SWITCH, sizeof(LL))) == NULL)
 			return -1;
 
-		LL_Init(*pSwitchList, freeSWLink);
+		LL_Init_Intrusive(*pSwitchList, offsetof(struct sw_link, link),
+		                  freeSWLink, NULL, NULL);
 	}
 
-	// Load CSV resource
-	hrsrc = FindResourceA(NULL, MAKEINTRESOURCEA(res_ID), "CSV");
-	if (hrsrc == NULL)
-		return -2;
-	if ((hglobal = LoadResource(NULL, hrsrc)) == NULL)
-		return -3;
-	if ((sw_tmp = LockResource(hglobal)) == NULL)
-		return -4;
-
-	if (skipToSwitches(&sw_tmp))
-		return -5;
+	if ((res = loadCSVResource(&sw_tmp, res_ID)) != 0)
+		return res;
 
 	// Process each line of the csv file
 	while (!getLine(line, LINE_LENGTH, &sw_tmp)) {
@@ -314,7 +309,7 @@ int parseCSV(LL** pSwitchList, const Variant* var_list, int num_var, WORD res_ID
 		if (pn == PLUG || pn == COVER)
 			continue;
 
-		if (checkVarString(var_list, num_var, buf))
+		if (checkVarString(p_vars, buf))
 			continue;
 		
 		if ((insw = (insertNewSW(*pSwitchList, loc, pn, buf, qty))) != 0)
@@ -323,6 +318,38 @@ int parseCSV(LL** pSwitchList, const Variant* var_list, int num_var, WORD res_ID
 	return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// loadCSVResource                                                            //
+//                                                                            //
+// Loads one of the csv resource files and moves the pointer stored in        //
+// 'p_data' past the metadata at the top of the file, so it points to the     //
+// first line with switch data. The resource is embedded in the executable,   //
+// so it doesn't need to be freed.                                            //
+//                                                                            //
+// This was split out of parseCSV() so the rule compiler in rule_set.c can    //
+// read the same files. The error values are the ones parseCSV() has always   //
+// returned for these steps.                                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+int loadCSVResource(char** p_data, WORD res_ID)
+{
+	HRSRC hrsrc;
+	HGLOBAL hglobal;
+
+	hrsrc = FindResourceA(NULL, MAKEINTRESOURCEA(res_ID), "CSV");
+	if (hrsrc == NULL)
+		return -2;
+	if ((hglobal = LoadResource(NULL, hrsrc)) == NULL)
+		return -3;
+	if ((*p_data = LockResource(hglobal)) == NULL)
+		return -4;
+
+	if (skipToSwitches(p_data))
+		return -5;
+
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // getLine                                                                    //
 //                                                                            //
@@ -371,8 +398,13 @@ int getLine(char* dest, int dest_size, char** src)
 // again in location 6 with a quantity of 1. removeSW() would remove it from  //
 // location 5, and only the link for location 6 would remain in the list.     //
 //                                                                            //
-// This function allocates memory for each switch link on the heap. It's      //
-// freed when the list is destroyed, which happens every time freeMemory()    //
+// This function allocates memory for each switch link with LL_Alloc(), so it //
+// comes from the list's allocator if it has one (the spec arena, see         //
+// spec_arena.c), and from the heap otherwise. The link and its list element  //
+// are one allocation, since the list is intrusive (see ost_data.h). The      //
+// variant string isn't copied; the link stores its handle from the intern    //
+// pool (see intern.c). Heap memory is freed when the list is destroyed, and  //
+// arena memory when the arena is reset. Both happen every time freeMemory()  //
 // is called in ostool.c. See description of that function for every time     //
 // it's called.                                                               //
 ////////////////////////////////////////////////////////////////////////////////
@@ -380,7 +412,6 @@ int getLine(char* dest, int dest_size, char** src)
 int insertNewSW(LL* sw_list, int loc, int pn, const char* buf, int qty)
 {
 	struct sw_link* new_link = NULL;
-	size_t vars_size = 0;
 
 	LL_elem* elem_tmp = NULL;
 	LL_elem* elem_prev_tmp = NULL;
@@ -396,24 +427,19 @@ int insertNewSW(LL* sw_list, int loc, int pn, const char* buf, int qty)
 		return 0;
 	}
 
-	if ((new_link = malloc(sizeof(struct sw_link))) == NULL)
+	if ((new_link = LL_Alloc(sw_list, sizeof(struct sw_link))) == NULL)
 		return -10;
 
-	// At this point, new_link points to memory allocated
-	// on the heap. It's member pointer vars does not.
+	// At this point, new_link points to memory allocated on the heap
+	// or in the arena
 
-	vars_size = strlen(buf) + 1;
-	if ((new_link->vars = malloc(vars_size)) == NULL) {
-		free(new_link);
+	if ((new_link->vars = internString(buf)) == NULL) {
+		LL_Free(sw_list, new_link);
 		return -11;
 	}
 
-	// At this point, new link and its member pointer vars
-	// both point to memory allocated on the heap
-
 	new_link->loc = loc;
 	new_link->pn = pn;
-	strcpy_s(new_link->vars, vars_size, buf);
 	new_link->qty = qty;
 
 	// Insert the switches in ascending order (of location)
@@ -433,7 +459,8 @@ int insertNewSW(LL* sw_list, int loc, int pn, const char* buf, int qty)
 	}
 
 	if (LL_Ins_Next(sw_list, elem_prev_tmp, new_link) != 0) {
-		freeSWLink(new_link);
+		if (sw_list->destroy)
+			sw_list->destroy(new_link);
 		return -12;
 	}
 
@@ -472,7 +499,8 @@ int removeSW(LL* sw_list, int loc, int pn)
 				return -8;
 			}
 			else {
-				freeSWLink(data);
+				if (sw_list->destroy)
+					sw_list->destroy(data);
 				return 0;
 			}
 		}
@@ -488,21 +516,17 @@ int removeSW(LL* sw_list, int loc, int pn)
 ////////////////////////////////////////////////////////////////////////////////
 // freeSWLink                                                                 //
 //                                                                            //
-// Each switch link structure has four data members: three automatic          //
-// variables and one pointer to memory on the heap. This function properly    //
-// frees the memory for each switch link, calling free() for the pointer      //
-// member, and then free() on the switch link itself.                         //
+// Each switch link structure is a single allocation: the struct, with its    //
+// list element inside it. Its vars member is a handle from the intern pool,  //
+// which isn't freed with the link. This function frees it with one call to   //
+// memFree().                                                                 //
 //                                                                            //
 // This function is called on every switch link in the linked list when it is //
-// destroyed.                                                                 //
+// destroyed. Lists that allocate from the spec arena don't use it, since     //
+// their links are released all at once when the arena is reset.              //
 ////////////////////////////////////////////////////////////////////////////////
 
 void freeSWLink(void* link)
 {
-	if (((struct sw_link*)link)->vars) {
-		free(((struct sw_link*)link)->vars);
-		((struct sw_link*)link)->vars = NULL;
-	}
-
-	free((struct sw_link*)link);
+	memFree((struct sw_link*)link);
 }
\ No newline at end of file
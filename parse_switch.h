@@ -16,12 +16,12 @@ int getSwitchLoc(const char* line);
 int getPartNum(const char* line);
 int getSWQty(const char* line);
 int getVarString(char* buf, const char* line);
-int parseCSV(LL** pSwitchList, const Variant* var_list, int num_var,
-             WORD res_ID);
+int parseCSV(LL** pSwitchList, const VAR_STORE* p_vars, WORD res_ID);
 int getLine(char* dest, int dest_size, char** src);
+int loadCSVResource(char** p_data, WORD res_ID);
 int insertNewSW(LL* sw_list, int loc, int pn, const char* buf, int qty);
 int processCSVLine(int* loc, int* pn, int* qty, char* buf, const char* line);
-int checkVarString(const Variant* var_list, int num_var, const char* sw_vars);
+int checkVarString(const VAR_STORE* p_vars, const char* sw_vars);
 int removeSW(LL* sw_list, int loc, int pn);
 void freeSWLink(void* link);
 
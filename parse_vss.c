@@ -17,10 +17,10 @@
 // spec provided in a file (terminated with 'File'), and one for a spec       //
 // pulled by the program (terminated with 'Buffer').                          //
 //                                                                            //
-// When the spec is parsed, the application populates members in an array of  //
-// (struct variant)s. The definition for struct variant is located in         //
-// ost_data.h. This list is allocated on the heap in either parseVSSFile() or //
-// parseVSSBuffer().                                                          //
+// When the spec is parsed, each line is read into a struct variant and then  //
+// stored in the spec's variant store (see var_store.c). The definitions for  //
+// both are located in ost_data.h. The store is allocated in either           //
+// parseVSSFile() or parseVSSBuffer().                                        //
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <stdlib.h>
@@ -29,6 +29,9 @@
 
 #include "parse_vss.h"
 #include "parse_order.h"   // For GetLineBuffer()
+#include "intern.h"
+#include "var_store.h"
+#include "mem_track.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // skipToVariantsFile                                                         //
@@ -72,41 +75,31 @@ static int skipToVariantsFile(FILE* fp, fpos_t* fpos)
 ////////////////////////////////////////////////////////////////////////////////
 // skipToVariantsBuffer                                                       //
 //                                                                            //
-// Same as skipToVariantsFile, but operates on a buffer that holds a          //
-// VSS spec retrieved from the internet (from EDB). Instead of moving a file  //
-// position pointer, it moves a character pointer.                            //
+// Same as skipToVariantsFile, but operates on a buffer that holds a VSS spec //
+// retrieved from the internet (from EDB), which ends at 'end'. Instead of    //
+// moving a file position pointer, it moves a character pointer.              //
 ////////////////////////////////////////////////////////////////////////////////
 
-static int skipToVariantsBuffer(char** cur_pos)
+static int skipToVariantsBuffer(char** cur_pos, const char* end)
 {
+	const char* line_end;
 	int i;
-	int count;
 	char line[LINE_LENGTH] = { 0 };
 
 	for (i = 0; i < 13; i++) {
 
-		count = 0;
-		while (**cur_pos != '\n') {
+		// In a valid spec, no line before the variants
+		// begin should be 210 characters or more in length.
+		if ((line_end = findLineEnd(*cur_pos, end, 250)) == NULL)
+			return (end - *cur_pos > 250) ? -2 : -1;
 
-			// '~' is used as the EOF marker. EOF should
-			// not be encountered at this point.
-			if (**cur_pos == '~')
-				return -1;
-
-			// In a valid spec, no line before the variants
-			// begin should be 210 characters or more in length.
-			if (++count > 250)
-				return -2;
-
-			(*cur_pos)++;
-		}
-		(*cur_pos)++;
+		*cur_pos = (char*)line_end + 1;
 	}
 
 	// Check for presence of "000  AAX PRODUCT CLASS" which should exist
 	// on the first line of the variant list. Can't use strstr()
 	// on the buffer because lines aren't null-terminated.
-	if (GetLineBuffer(*cur_pos, line, LINE_LENGTH))
+	if (GetLineBuffer(*cur_pos, end, line, LINE_LENGTH))
 		return -3;
 	if (strstr(line, "000  AAX PRODUCT CLASS") == NULL)
 		return -4;
@@ -114,6 +107,7 @@ static int skipToVariantsBuffer(char** cur_pos)
 	return 0;
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
 // countLinesFile                                                             //
 //                                                                            //
@@ -165,48 +159,39 @@ static int countLinesFile(FILE* fp)
 // VSS spec retrieved from the internet (from EDB).                           //
 ////////////////////////////////////////////////////////////////////////////////
 
-static int countLinesBuffer(char* buf)
+static int countLinesBuffer(const char* buf, const char* end)
 {
+	const char* line_end;
 	int i = 0;
-	int count;
 
 	while (i < MAX_VARIANTS) {
-		count = 0;
-
-		while (*buf != '\n') {
 
-			// '~' is used as the EOF marker. EOF should
-			// not be encountered at this point.
-			if (*buf == '~')
-				return -1;
-
-			// In a valid spec, a line containing variant data
-			// should not be 500 characters or more in length.
-			// The longest line I found in my test spec
-			// was 247 characters long.
-			if (++count > 500)
-				return -2;
-
-			buf++;
-		}
+		// In a valid spec, a line containing variant data
+		// should not be 500 characters or more in length.
+		// The longest line I found in my test spec
+		// was 247 characters long.
+		if ((line_end = findLineEnd(buf, end, 500)) == NULL)
+			return (end - buf > 500) ? -2 : -1;
 		i++;
 
 		// An empty line denotes the end of the variant list
-		if (*(buf - 1) == '\n')
+		if (line_end == buf)
 			return i - 1;
-		buf++;
+		buf = line_end + 1;
 	}
 
 	return -3;
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
 // processVSSLineFile                                                         //
 //                                                                            //
 // Reads a line with variant data and fills the struct variant fields with    //
 // family description, IDVAR6, symbol, and variant description information.   //
 // These are the four fields of the struct variant structure (see             //
-// ost_data.h). Returns a negative number if fgets fails, or 0.               //
+// ost_data.h). The descriptions are interned (see intern.c). Returns a       //
+// negative number if fgets fails or the intern pool is out of memory, or 0.  //
 ////////////////////////////////////////////////////////////////////////////////
 
 static int processVssLineFile(FILE* fp, struct variant* var)
@@ -215,6 +200,8 @@ static int processVssLineFile(FILE* fp, struct variant* var)
 	int pos;
 	char* c;
 	char line[LINE_LENGTH];
+	char fam_desc[FAM_DESC_LENGTH + 1];
+	char var_desc[VAR_DESC_LENGTH + 1];
 
 	if ((fgets(line, LINE_LENGTH, fp)) == NULL)
 		return -7;
@@ -224,9 +211,9 @@ static int processVssLineFile(FILE* fp, struct variant* var)
 
 	// Read family description
 	for (i = 0; i < FAM_DESC_LENGTH; i++)
-		*(var->fam_desc + i) = line[pos++];
+		*(fam_desc + i) = line[pos++];
 
-	*(var->fam_desc + i) = '\0';
+	*(fam_desc + i) = '\0';
 	pos++;
 
 	// Check if this line has a link. If it does, skip text to get to
@@ -266,9 +253,14 @@ static int processVssLineFile(FILE* fp, struct variant* var)
 		if (line[pos] == '\n')
 			break;
 
-		*(var->var_desc + i) = line[pos++];
+		*(var_desc + i) = line[pos++];
 	}
-	*(var->var_desc + i) = '\0';
+	*(var_desc + i) = '\0';
+
+	var->fam_desc = internString(fam_desc);
+	var->var_desc = internString(var_desc);
+	if (!var->fam_desc || !var->var_desc)
+		return -8;
 
 	return 0;
 }
@@ -276,96 +268,119 @@ static int processVssLineFile(FILE* fp, struct variant* var)
 ////////////////////////////////////////////////////////////////////////////////
 // processVssLineBuffer                                                       //
 //                                                                            //
-// Same as processVssLineFile, but operates on lines from a buffer that       //
-// holds a VSS spec retrieved from the internet (from EDB).                   //
+// Same as processVssLineFile, but operates on lines from a buffer that holds //
+// a VSS spec retrieved from the internet (from EDB), which ends at 'end'.    //
+// Returns a negative number if the line is too short for its fields or the   //
+// intern pool is out of memory, or 0.                                        //
 ////////////////////////////////////////////////////////////////////////////////
 
-static void processVssLineBuffer(char** buf_pos, struct variant* var)
+static int processVssLineBuffer(char** buf_pos, const char* end,
+                                struct variant* var)
 {
-	char* c;
-	int i;
+	const char* pos = *buf_pos;
+	const char* line_end;
+	const char* c;
+	int length;
+	char fam_desc[FAM_DESC_LENGTH + 1];
+	char var_desc[VAR_DESC_LENGTH + 1];
 
 	BOOL has_link = FALSE;
 
+	// countLinesBuffer() found the end of every line, and checked it's
+	// shorter than LINE_LENGTH
+	if ((line_end = findLineEnd(pos, end, LINE_LENGTH)) == NULL)
+		return -9;
+
+	// The fields are read from fixed positions, so the line is checked
+	// once to be long enough for them, rather than at every character
+	if (line_end - pos < 9 + FAM_DESC_LENGTH + 1)
+		return -9;
+
 	// Skip to first field to read (family description)
-	*buf_pos += 9;
+	pos += 9;
 
 	// Read family description
-	for (i = 0; i < FAM_DESC_LENGTH; i++) {
-		*(var->fam_desc + i) = **buf_pos;
-		(*buf_pos)++;
-	}
-	*(var->fam_desc + i) = '\0';
-	(*buf_pos)++;
+	memcpy(fam_desc, pos, FAM_DESC_LENGTH);
+	fam_desc[FAM_DESC_LENGTH] = '\0';
+	pos += FAM_DESC_LENGTH + 1;
 
 	// Check if this line has a link. If it does, skip text to get to
 	// the symbol field.
-	c = strstr(*buf_pos, "\">");
-	if (c != NULL && c < strchr(*buf_pos, '\n')) {
-		has_link = TRUE;
-		while ( *(*buf_pos)++ != '>') {}
+	for (c = pos; c + 1 < line_end; c++) {
+		if (c[0] == '"' && c[1] == '>') {
+			has_link = TRUE;
+			pos = (const char*)memchr(pos, '>', line_end - pos) + 1;
+			break;
+		}
 	}
 
+	// The symbol, the closing </a> tag if the line had a link, and
+	// IDVAR6, each followed by a space
+	if (line_end - pos < SYMBOL_LENGTH + 1 + (has_link ? 4 : 0) +
+	                     IDVAR6_LENGTH)
+		return -9;
+
 	// Read Symbol
-	for (i = 0; i < SYMBOL_LENGTH; i++) {
-		*(var->symbol + i) = **buf_pos;
-		(*buf_pos)++;
-	}
-	*(var->symbol + i) = '\0';
-	(*buf_pos)++;
+	memcpy(var->symbol, pos, SYMBOL_LENGTH);
+	var->symbol[SYMBOL_LENGTH] = '\0';
+	pos += SYMBOL_LENGTH + 1;
 
 	// If the line had a link, skip the closing </a> tag
 	if (has_link)
-		*buf_pos += 4;
+		pos += 4;
 
 	// Read IDVAR6
-	for (i = 0; i < 6; i++) {
-		*(var->idvar6 + i) = **buf_pos;
-		(*buf_pos)++;
-	}
-	*(var->idvar6 + i) = '\0';
-	(*buf_pos)++;
+	memcpy(var->idvar6, pos, IDVAR6_LENGTH);
+	var->idvar6[IDVAR6_LENGTH] = '\0';
+	pos += IDVAR6_LENGTH + 1;
 
-	// Read variant description
-	for (i = 0; i < 60; i++) {
-		// This if statement was added because of a bug in the
-		// input. Variant 260-006 had a variant description
-		// that was less than 60 characters (meaning it was not
-		// padded with spaces until the 60 character field was
-		// full).
-		if (**buf_pos == '\n')
-			break;
+	// Read variant description. Variant 260-006 had a variant
+	// description that was less than 60 characters (meaning it was
+	// not padded with spaces until the 60 character field was full),
+	// so it ends at the end of the line if that comes first.
+	length = (int)min(max(line_end - pos, 0), VAR_DESC_LENGTH);
+	memcpy(var_desc, pos, length);
+	var_desc[length] = '\0';
 
-		*(var->var_desc + i) = **buf_pos;
-		(*buf_pos)++;
-	}
-	*(var->var_desc + i) = '\0';
-	(*buf_pos)++;
+	*buf_pos = (char*)line_end + 1;
+
+	var->fam_desc = internString(fam_desc);
+	var->var_desc = internString(var_desc);
+	if (!var->fam_desc || !var->var_desc)
+		return -8;
+
+	return 0;
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
 // parseVssFile                                                               //
 //                                                                            //
-// This function allocates the struct variant array on the heap, and          //
-// populates it by calling processVssLineFile() for every line with variant   //
-// data in a file containing a VSS spec.                                      //
+// This function allocates the variant store from the spec arena 'p_arena'    //
+// (see spec_arena.c), or on the heap if 'p_arena' is NULL, and populates it  //
+// by calling processVssLineFile() and storeVariant() for every line with     //
+// variant data in a file containing a VSS spec. finishVarStore() then sorts  //
+// the spec's symbols.                                                        //
 //                                                                            //
-// When this function is exited, the struct variant array will hold storage   //
-// allocated on the heap. It will be up to the appliation to free this data   //
-// later. This is done every time a spec is analyzed (whether it is retrieved //
-// from the internet or from a file), if an error occurs while parsing one    //
-// of the CSV resource files, or when the application is exited.              //
+// When this function is exited, the variant store will hold storage          //
+// allocated from the arena or the heap. It will be up to the appliation to   //
+// release this data later. This is done every time a spec is analyzed        //
+// (whether it is retrieved from the internet or from a file), if an error    //
+// occurs while parsing one of the CSV resource files, or when the            //
+// application is exited.                                                     //
 //                                                                            //
 // If an error occurs, the spec analysis is stopped, and the dash is shown    //
 // blank.                                                                     //
 ////////////////////////////////////////////////////////////////////////////////
 
-struct variant* parseVssFile(const char* file_path, int* num_var)
+struct var_store* parseVssFile(const char* file_path, P_SPEC_ARENA p_arena)
 {
-	struct variant* var_list;
+	struct var_store* p_vars;
+	struct variant var;
 	FILE* fp;
 	fpos_t fpos;
 
+	int num_var;
 	int i;
 
 	if ((fopen_s(&fp, file_path, "r")) != 0)
@@ -377,60 +392,69 @@ struct variant* parseVssFile(const char* file_path, int* num_var)
 	}
 	fsetpos(fp, &fpos);
 
-	if ((*num_var = countLinesFile(fp)) < 0) {
+	if ((num_var = countLinesFile(fp)) < 0) {
 		fclose(fp);
 		return NULL;
 	}
 	fsetpos(fp, &fpos);
 
-	if ((var_list = malloc(sizeof(struct variant) * (*num_var))) == NULL) {
+	if ((p_vars = allocVarStore(num_var, p_arena)) == NULL) {
 		fclose(fp);
 		return NULL;
 	}
 
 	// !
-	// At this point, var_list points to memory on the heap
+	// At this point, p_vars points to memory in the arena or on the heap
 	// !
 	
-	for (i = 0; i < *num_var; i++)
-		if (processVssLineFile(fp, var_list + i) < 0) {
+	for (i = 0; i < num_var; i++) {
+		if (processVssLineFile(fp, &var) < 0) {
 			fclose(fp);
-			free(var_list);
+			arenaRelease(p_arena, p_vars);
 			return NULL;
 		}
+		storeVariant(p_vars, i, &var);
+	}
+	finishVarStore(p_vars);
 
-	// At this point, var_list still points to memory on the heap. It will
-	// be up to the application to ensure it is freed at some point.
+	// At this point, p_vars still points to that memory. It will be up
+	// to the application to ensure it is released at some point.
 
 	fclose(fp);
-	return var_list;
+	return p_vars;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // parseVssBuffer                                                             //
 //                                                                            //
 // Same as parseVssFile, but operates on a buffer that holds a VSS spec       //
-// retrieved from the internet (from EDB).                                    //
+// retrieved from the internet (from EDB), 'size' bytes long. Nothing marks   //
+// the end of the page, so every scan of it is bounded by its size. The       //
+// buffer itself is always on the heap, and is freed before returning.        //
 ////////////////////////////////////////////////////////////////////////////////
 
-struct variant *parseVssBuffer(char *buf_pos, int *num_var)
+struct var_store *parseVssBuffer(char *buf_pos, DWORD size,
+                                 P_SPEC_ARENA p_arena)
 {
-	struct variant *var_list;
+	struct var_store *p_vars;
+	struct variant var;
 	char* starting_pos = buf_pos;
+	const char* end = buf_pos + size;
+	int num_var;
 	int i;
 
 	if (!buf_pos) return NULL;
 
-	if (skipToVariantsBuffer(&buf_pos)) {
-		free(starting_pos);
+	if (skipToVariantsBuffer(&buf_pos, end)) {
+		memFree(starting_pos);
 		return NULL;
 	}
 
 	// At this point, this function's local copy of buf_pos points to the
 	// first line with variant data in the buffer
 
-	if ((*num_var = countLinesBuffer(buf_pos)) < 0) {
-		free(starting_pos);
+	if ((num_var = countLinesBuffer(buf_pos, end)) < 0) {
+		memFree(starting_pos);
 		return NULL;
 	}
 
@@ -438,21 +462,28 @@ struct variant *parseVssBuffer(char *buf_pos, int *num_var)
 	// first line with variant data in the buffer. countLinesBuffer()
 	// received it's own copy of buf_pos.
 
-	if ((var_list = malloc(sizeof(struct variant) * (*num_var))) == NULL) {
-		free(starting_pos);
+	if ((p_vars = allocVarStore(num_var, p_arena)) == NULL) {
+		memFree(starting_pos);
 		return NULL;
 	}
 
 	// !
-	// At this point, var_list points to memory on the heap
+	// At this point, p_vars points to memory in the arena or on the heap
 	// !
 
-	for (i = 0; i < *num_var; i++)
-		processVssLineBuffer(&buf_pos, var_list + i);
+	for (i = 0; i < num_var; i++) {
+		if (processVssLineBuffer(&buf_pos, end, &var) < 0) {
+			arenaRelease(p_arena, p_vars);
+			memFree(starting_pos);
+			return NULL;
+		}
+		storeVariant(p_vars, i, &var);
+	}
+	finishVarStore(p_vars);
 
-	// At this point, var_list still points to memory on the heap. It will
-	// be up to the application to ensure it is freed at some point.
+	// At this point, p_vars still points to that memory. It will be up
+	// to the application to ensure it is released at some point.
 
-	free(starting_pos);
-	return var_list;
+	memFree(starting_pos);
+	return p_vars;
 }
\ No newline at end of file
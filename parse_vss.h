@@ -10,12 +10,13 @@
 //int skipToVariantsFile(FILE* fp, fpos_t* fpos);
 //int countLinesFile(FILE* fp);
 //int processVssLineFile(FILE* fp, struct variant* var);
-struct variant* parseVssFile(const char* file_path, int* num_var);
+struct var_store* parseVssFile(const char* file_path, P_SPEC_ARENA p_arena);
 
 // VSS buffer functions
 //int skipToVariantsBuffer(char** cur_pos);
 //int countLinesBuffer(char* buf);
 // void processVssLineBuffer(char** buf_pos, struct variant* var);
-struct variant* parseVssBuffer(char* buf_pos, int* num_var);
+struct var_store* parseVssBuffer(char* buf_pos, DWORD size,
+                                 P_SPEC_ARENA p_arena);
 
 #endif
\ No newline at end of file
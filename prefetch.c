@@ -0,0 +1,323 @@
+////////////////////////////////////////////////////////////////////////////////
+// prefetch.c                                                                 //
+//                                                                            //
+// This TU loads a list of specs into the spec cache (see spec_cache.c), so a //
+// fleet review can look at hundreds of specs without waiting on EDB for each //
+// of them. The list is a text file of VSS and order numbers, one per line,   //
+// in the form the banner's edit box takes them. Lines that are empty or      //
+// start with '#' are skipped.                                                //
+//                                                                            //
+// Every number is loaded by a spec job (see spec_job.c), the same way the    //
+// main window loads the number typed into the banner: the URL and cache key  //
+// come from genSpecRequest(), the page comes from the cache or is            //
+// downloaded and cached, and it's parsed and matched on the job's worker as  //
+// soon as it arrives. A page that doesn't parse isn't kept in the cache.     //
+// runPrefetch() keeps up to 'num_conns' jobs running, and starts the next    //
+// number whenever one finishes, so no more than that many downloads are in   //
+// flight at once.                                                            //
+//                                                                            //
+// The jobs post WM_SPECLOADED when they're done, so runPrefetch() waits for  //
+// them on a message-only window of its own, and it can run without the main  //
+// window, from the /prefetch command line mode (see tool_mode.c).            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "prefetch.h"
+#include "banner.h"         // for checkInput() and genSpecRequest()
+#include "mem_track.h"
+
+static int startItem(P_PREFETCH_RUN p_run, int index, HWND hwnd,
+                     const struct rule_set* p_rules,
+                     const VSS_TRANSPORT* p_transport, P_SPEC_CACHE p_cache,
+                     P_SPEC_JOB* pp_job);
+static void finishItem(P_PREFETCH_RUN p_run, PREFETCH_ITEM* p_item,
+                       const SPEC_JOB* p_job);
+
+////////////////////////////////////////////////////////////////////////////////
+// readPrefetchList                                                           //
+//                                                                            //
+// Reads the list of numbers in the file 'path' into a new run, returned in   //
+// '*pp_run'. Leading and trailing blanks are dropped and letters are made    //
+// upper case, the way the banner's edit box takes them; whether a number is  //
+// valid is checked when it's loaded. Returns 0 on success, -1 if the file    //
+// can't be read, or -2 if there isn't enough memory.                         //
+////////////////////////////////////////////////////////////////////////////////
+
+int readPrefetchList(const char* path, P_PREFETCH_RUN* pp_run)
+{
+	P_PREFETCH_RUN p_run;
+	FILE* p_file;
+	char line[64];
+
+	*pp_run = NULL;
+
+	if (fopen_s(&p_file, path, "r") != 0)
+		return -1;
+
+	if ((p_run = memCalloc(MEM_NETWORK, 1, sizeof(PREFETCH_RUN))) == NULL) {
+		fclose(p_file);
+		return -2;
+	}
+
+	while (fgets(line, sizeof(line), p_file)) {
+		char* num = line;
+		size_t length;
+		size_t i;
+
+		while (isspace((unsigned char)*num))
+			num++;
+		length = strlen(num);
+		while (length && isspace((unsigned char)num[length - 1]))
+			num[--length] = '\0';
+
+		if (length == 0 || num[0] == '#')
+			continue;
+
+		for (i = 0; i < length; i++)
+			num[i] = (char)toupper((unsigned char)num[i]);
+
+		if (addPrefetchItem(p_run, num) != 0) {
+			fclose(p_file);
+			freePrefetch(p_run);
+			return -2;
+		}
+	}
+
+	fclose(p_file);
+	*pp_run = p_run;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addPrefetchItem                                                            //
+//                                                                            //
+// Appends 'num' to the run's list, which grows as needed. readPrefetchList() //
+// adds the numbers of its file with it; a run put together some other way    //
+// starts out zeroed. Returns 0 on success, or -1 if there isn't enough       //
+// memory.                                                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+int addPrefetchItem(P_PREFETCH_RUN p_run, const char* num)
+{
+	PREFETCH_ITEM* p_item;
+
+	if (p_run->num_items == p_run->max_items) {
+		int new_max = p_run->max_items ? p_run->max_items * 2 : 64;
+		PREFETCH_ITEM* p_new;
+
+		p_new = memRealloc(MEM_NETWORK, p_run->items,
+		                   new_max * sizeof(PREFETCH_ITEM));
+		if (!p_new)
+			return -1;
+
+		p_run->items = p_new;
+		p_run->max_items = new_max;
+	}
+
+	p_item = p_run->items + p_run->num_items++;
+	memset(p_item, 0, sizeof(PREFETCH_ITEM));
+	strncpy_s(p_item->num, sizeof(p_item->num), num, _TRUNCATE);
+	p_item->cache_res = SPEC_CACHE_MISS;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runPrefetch                                                                //
+//                                                                            //
+// Loads every number of 'p_run', with up to 'num_conns' spec jobs at a time, //
+// through 'p_transport' and into 'p_cache', and stores the result of each in //
+// its item and the totals in the run. 'num_conns' is clamped to 1 to         //
+// MAX_PREFETCH_CONNS. The jobs match 'p_rules' against each spec, which      //
+// checks that the page is a spec the tool can show. Returns 0 once every     //
+// number has been tried, whether it loaded or not, or -1 if the window the   //
+// jobs report to can't be created.                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+int runPrefetch(P_PREFETCH_RUN p_run, int num_conns,
+                const struct rule_set* p_rules,
+                const VSS_TRANSPORT* p_transport, P_SPEC_CACHE p_cache)
+{
+	P_SPEC_JOB jobs[MAX_PREFETCH_CONNS] = { 0 };
+	int job_items[MAX_PREFETCH_CONNS] = { 0 };
+	ULONGLONG start = GetTickCount64();
+	int num_running = 0;
+	int next = 0;
+	HWND hwnd;
+	MSG msg;
+	int i;
+
+	num_conns = max(1, min(num_conns, MAX_PREFETCH_CONNS));
+	p_run->num_conns = num_conns;
+
+	// Only receives the jobs' WM_SPECLOADED
+	hwnd = CreateWindowExA(0, "STATIC", NULL, 0, 0, 0, 0, 0, HWND_MESSAGE,
+	                       NULL, NULL, NULL);
+	if (!hwnd)
+		return -1;
+
+	while (next < p_run->num_items || num_running) {
+
+		// Fill every free slot. A number that can't be started is done
+		// straight away.
+		for (i = 0; i < num_conns && next < p_run->num_items; i++) {
+			if (jobs[i])
+				continue;
+			if (startItem(p_run, next, hwnd, p_rules, p_transport, p_cache,
+			              jobs + i) == 0) {
+				job_items[i] = next;
+				num_running++;
+			}
+			next++;
+		}
+
+		if (!num_running)
+			continue;
+
+		if (GetMessageA(&msg, hwnd, WM_SPECLOADED, WM_SPECLOADED) <= 0)
+			break;
+
+		for (i = 0; i < num_conns; i++) {
+			if (jobs[i] == (P_SPEC_JOB)msg.lParam) {
+				finishItem(p_run, p_run->items + job_items[i], jobs[i]);
+				freeSpecJob(jobs[i]);
+				jobs[i] = NULL;
+				num_running--;
+				break;
+			}
+		}
+	}
+
+	p_run->elapsed_ms = GetTickCount64() - start;
+
+	DestroyWindow(hwnd);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writePrefetchReport                                                        //
+//                                                                            //
+// Writes the results of 'p_run' to the file 'path': one line per number,     //
+// with its job result, what the cache and the download returned and how long //
+// it took, followed by the totals. The wall time against the sum of the job  //
+// times shows how much the concurrent downloads overlapped. Returns 0 on     //
+// success, or -1 if the file can't be written.                               //
+////////////////////////////////////////////////////////////////////////////////
+
+int writePrefetchReport(const PREFETCH_RUN* p_run, const char* path)
+{
+	FILE* p_file;
+	int i;
+
+	if (fopen_s(&p_file, path, "w") != 0)
+		return -1;
+
+	fprintf(p_file, "Prefetch, %d specs, %d at a time\n\n", p_run->num_items,
+	        p_run->num_conns);
+	fprintf(p_file, "%-14s %7s %6s %6s %6s %9s\n", "number", "result",
+	        "cache", "fetch", "stale", "ms");
+
+	for (i = 0; i < p_run->num_items; i++) {
+		const PREFETCH_ITEM* p_item = p_run->items + i;
+
+		fprintf(p_file, "%-14s %7d %6d %6d %6s %9llu\n", p_item->num,
+		        p_item->result, p_item->cache_res, p_item->fetch_res,
+		        p_item->stale ? "yes" : "no", p_item->elapsed_ms);
+	}
+
+	fprintf(p_file, "\n%d loaded (%d already cached, %d unchanged since "
+	        "cached), %d failed\n", p_run->num_ok, p_run->num_cached,
+	        p_run->num_revalidated, p_run->num_failed);
+	fprintf(p_file, "%llu ms in all, %llu ms of jobs", p_run->elapsed_ms,
+	        p_run->job_ms);
+	if (p_run->elapsed_ms)
+		fprintf(p_file, " (%.1f at a time on average)",
+		        (double)p_run->job_ms / (double)p_run->elapsed_ms);
+	fprintf(p_file, "\n");
+
+	fclose(p_file);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freePrefetch                                                               //
+//                                                                            //
+// Frees a run read by readPrefetchList(). 'p_run' may be NULL.               //
+////////////////////////////////////////////////////////////////////////////////
+
+void freePrefetch(P_PREFETCH_RUN p_run)
+{
+	if (!p_run)
+		return;
+
+	memFree(p_run->items);
+	memFree(p_run);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// startItem                                                                  //
+//                                                                            //
+// Starts a spec job for item 'index' of the run, which reports to 'hwnd',    //
+// and returns it in '*pp_job'. Returns 0 on success. If the number isn't     //
+// valid or the job can't be started, the item is finished with               //
+// PREFETCH_BAD_NUM or SPEC_JOB_NO_SPEC and -1 is returned.                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static int startItem(P_PREFETCH_RUN p_run, int index, HWND hwnd,
+                     const struct rule_set* p_rules,
+                     const VSS_TRANSPORT* p_transport, P_SPEC_CACHE p_cache,
+                     P_SPEC_JOB* pp_job)
+{
+	PREFETCH_ITEM* p_item = p_run->items + index;
+	struct spec spec = { 0 };
+
+	strcpy_s(spec.num, sizeof(spec.num), p_item->num);
+
+	if (checkInput(spec.num, strlen(spec.num)) != 0 ||
+	    genSpecRequest(&spec) != 0) {
+		p_item->result = PREFETCH_BAD_NUM;
+		p_run->num_failed++;
+		return -1;
+	}
+
+	*pp_job = startSpecJob(hwnd, &spec, p_rules, p_transport, p_cache,
+	                       SPEC_JOB_TIMEOUT);
+	if (!*pp_job) {
+		p_item->result = SPEC_JOB_NO_SPEC;
+		p_run->num_failed++;
+		return -1;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// finishItem                                                                 //
+//                                                                            //
+// Copies the results of a finished job to its item, and counts it in the     //
+// run's totals. The spec itself isn't kept; it's in the cache now.           //
+////////////////////////////////////////////////////////////////////////////////
+
+static void finishItem(P_PREFETCH_RUN p_run, PREFETCH_ITEM* p_item,
+                       const SPEC_JOB* p_job)
+{
+	p_item->result = p_job->result;
+	p_item->cache_res = p_job->cache_res;
+	p_item->fetch_res = p_job->fetch_res;
+	p_item->stale = p_job->stale;
+	p_item->elapsed_ms = p_job->elapsed_ms;
+
+	p_run->job_ms += p_job->elapsed_ms;
+
+	if (p_job->result != SPEC_JOB_OK)
+		p_run->num_failed++;
+	else {
+		p_run->num_ok++;
+		if (p_job->cache_res == SPEC_CACHE_HIT)
+			p_run->num_cached++;
+		else if (p_job->fetch_res == VSS_NOT_MODIFIED)
+			p_run->num_revalidated++;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef PREFETCH_H_
+#define PREFETCH_H_
+
+#include <Windows.h>
+
+#include "spec_job.h"
+
+// How many specs are downloaded at once by default, and at most
+#define PREFETCH_CONNS          4
+#define MAX_PREFETCH_CONNS      16
+
+// The result of a number in the list that isn't a VSS or order number
+#define PREFETCH_BAD_NUM        -10
+
+// One number of a prefetch list, and what loading it did
+typedef struct prefetch_item {
+	char num[14];
+	int result;                 // a SPEC_JOB result, or PREFETCH_BAD_NUM
+	int cache_res;
+	int fetch_res;
+	BOOL stale;
+	ULONGLONG elapsed_ms;
+} PREFETCH_ITEM;
+
+// A prefetch list and its results
+typedef struct prefetch_run {
+	PREFETCH_ITEM* items;
+	int num_items;
+	int max_items;
+	int num_conns;
+	int num_ok;
+	int num_cached;             // fresh pages that were already cached
+	int num_revalidated;        // stale pages EDB said hadn't changed
+	int num_failed;
+	ULONGLONG elapsed_ms;       // wall time of the whole list
+	ULONGLONG job_ms;           // sum of the times of the jobs
+} PREFETCH_RUN, * P_PREFETCH_RUN;
+
+int readPrefetchList(const char* path, P_PREFETCH_RUN* pp_run);
+int addPrefetchItem(P_PREFETCH_RUN p_run, const char* num);
+int runPrefetch(P_PREFETCH_RUN p_run, int num_conns,
+                const struct rule_set* p_rules,
+                const VSS_TRANSPORT* p_transport, P_SPEC_CACHE p_cache);
+int writePrefetchReport(const PREFETCH_RUN* p_run, const char* path);
+void freePrefetch(P_PREFETCH_RUN p_run);
+
+#endif
\ No newline at end of file
@@ -11,6 +11,9 @@
 #define IDB_BITMAP1                     127
 #define IDR_BINFONT1                    133
 #define IDR_BINFONT2                    136
+#define IDR_CSV5                        141
+#define IDR_CSV6                        142
+#define IDR_CSV7                        143
 #define IDC_VSS_EDIT2                   1002
 #define IDC_BUTTON1                     1009
 #define ID_EDIT_SCREENSHOT              40001
@@ -30,13 +33,14 @@
 #define ID_ACCEL_LGND                   40017
 #define ID_ACCEL_CLR                    40018
 #define ID_ACCEL_OPEN                   40019
+#define ID_ACCEL_MEM                    40021
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        141
-#define _APS_NEXT_COMMAND_VALUE         40021
+#define _APS_NEXT_RESOURCE_VALUE        144
+#define _APS_NEXT_COMMAND_VALUE         40022
 #define _APS_NEXT_CONTROL_VALUE         1011
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
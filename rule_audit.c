@@ -0,0 +1,481 @@
+////////////////////////////////////////////////////////////////////////////////
+// rule_audit.c                                                               //
+//                                                                            //
+// This TU checks the switch rule set itself for conflicts, without a spec.   //
+// notifyConflicts() in ostool.c only finds two switches in the same location //
+// after a spec that causes it has been loaded, which means a mistake in      //
+// SP_SWITCH_DATA.csv or CA_SWITCH_DATA.csv is only found when a quote runs   //
+// into it. The audit finds every pair of rules that can put a switch in the  //
+// same location on some spec, so these mistakes can be fixed first.          //
+//                                                                            //
+// Two rules in the same location can fire together unless their variants     //
+// can't all be on one spec. A spec has one variant of each family, so two    //
+// rules are exclusive when one needs a variant that the other can't have     //
+// because it needs a different variant of the same family. The families come //
+// from the rule set (see loadFamilies() in rule_set.c). When the family of a //
+// variant isn't known, it's assumed not to exclude anything, so the audit    //
+// can report a pair that can't really happen, but it won't miss one. Pairs   //
+// that only rely on known families are counted as confirmed, and the report  //
+// lists the variants with an unknown family for the others.                  //
+//                                                                            //
+// For every compatible pair, the witness is the union of the two rules'      //
+// variants. The whole rule set is run against the witness with               //
+// getPlacedRules(), and the pair is only reported if both rules are still    //
+// placed afterwards. This drops pairs where a CA rule with a quantity of -1  //
+// always removes one of the switches.                                        //
+//                                                                            //
+// Each location is independent of the others, so the locations are handed    //
+// out to worker threads one at a time. The results are stored per location   //
+// and put together in location order afterwards, so the report is the same   //
+// no matter how many threads ran.                                            //
+//                                                                            //
+// The report is written by writeConflictReport(), which is used by the       //
+// '/conflicts' command line mode (see tool_mode.c).                          //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rule_audit.h"
+#include "ost_shared.h"
+#include "sw_desc.h"
+#include "mem_track.h"
+
+// Shared by the worker threads. Each location's results are only written
+// by the worker that took that location.
+typedef struct audit_ctx {
+	const RULE_SET* p_rules;
+
+	int* loc_rules;                         // rules grouped by location
+	int loc_rule_start[NUM_LOC_6605 + 1];
+
+	RULE_CONFLICT* loc_conf[NUM_LOC_6605];
+	int loc_num[NUM_LOC_6605];
+
+	volatile LONG next_loc;
+	volatile LONG error;
+} AUDIT_CTX;
+
+////////////////////////////////////////////////////////////////////////////////
+// isCompatible                                                               //
+//                                                                            //
+// Returns FALSE if the witness has two different variants of the same        //
+// family, which means no spec can have all of them.                          //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL isCompatible(const RULE_SET* p_rules, const RULE_CONFLICT* p_conf)
+{
+	int i, j;
+
+	for (i = 0; i < p_conf->num_witness; i++) {
+		FAM_KEY fam = p_rules->sym_fams[p_conf->witness[i]];
+
+		if (!fam)
+			continue;
+
+		for (j = i + 1; j < p_conf->num_witness; j++)
+			if (p_rules->sym_fams[p_conf->witness[j]] == fam)
+				return FALSE;
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// isConfirmed                                                                //
+//                                                                            //
+// Returns TRUE if the family of every witness variant is known, which means  //
+// the pair really can fire together.                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL isConfirmed(const RULE_SET* p_rules, const RULE_CONFLICT* p_conf)
+{
+	int i;
+
+	for (i = 0; i < p_conf->num_witness; i++)
+		if (!p_rules->sym_fams[p_conf->witness[i]])
+			return FALSE;
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildWitness                                                               //
+//                                                                            //
+// Stores the union of the variants of rules 'a' and 'b' in the witness, in   //
+// symbol order so the report is easy to read.                                //
+////////////////////////////////////////////////////////////////////////////////
+
+static void buildWitness(const RULE_SET* p_rules, RULE_CONFLICT* p_conf,
+                         int a, int b)
+{
+	const struct sw_rule* p_a = p_rules->rules + a;
+	const struct sw_rule* p_b = p_rules->rules + b;
+	int i, j;
+
+	p_conf->rule_a = a;
+	p_conf->rule_b = b;
+	p_conf->num_witness = 0;
+
+	for (i = 0; i < p_a->num_terms; i++)
+		p_conf->witness[p_conf->num_witness++] = p_a->terms[i];
+
+	for (i = 0; i < p_b->num_terms; i++) {
+		for (j = 0; j < p_a->num_terms; j++)
+			if (p_a->terms[j] == p_b->terms[i])
+				break;
+		if (j == p_a->num_terms)
+			p_conf->witness[p_conf->num_witness++] = p_b->terms[i];
+	}
+
+	// Insertion sort, there are never more than MAX_WITNESS_TERMS
+	for (i = 1; i < p_conf->num_witness; i++) {
+		int id = p_conf->witness[i];
+
+		for (j = i; j > 0 &&
+		     p_rules->sym_keys[p_conf->witness[j - 1]] > p_rules->sym_keys[id];
+		     j--)
+			p_conf->witness[j] = p_conf->witness[j - 1];
+		p_conf->witness[j] = id;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// bothPlaced                                                                 //
+//                                                                            //
+// Runs the rule set against a spec made of only the witness variants and     //
+// returns TRUE if both rules of the pair are placed.                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL bothPlaced(const RULE_SET* p_rules, const RULE_CONFLICT* p_conf,
+                       BYTE* present, int* placed)
+{
+	BOOL found_a = FALSE;
+	BOOL found_b = FALSE;
+	int num_placed;
+	int i;
+
+	for (i = 0; i < p_conf->num_witness; i++)
+		present[p_conf->witness[i]] = 1;
+
+	num_placed = getPlacedRules(p_rules, present, placed);
+
+	for (i = 0; i < p_conf->num_witness; i++)
+		present[p_conf->witness[i]] = 0;
+
+	for (i = 0; i < num_placed; i++) {
+		if (placed[i] == p_conf->rule_a)
+			found_a = TRUE;
+		else if (placed[i] == p_conf->rule_b)
+			found_b = TRUE;
+	}
+
+	return found_a && found_b;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// auditLocation                                                              //
+//                                                                            //
+// Checks every pair of rules in location 'loc' and stores the conflicts in   //
+// the location's slot of the context. Returns 0 on success, or a negative    //
+// value if memory couldn't be allocated.                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+static int auditLocation(AUDIT_CTX* ctx, int loc, BYTE* present, int* placed)
+{
+	const RULE_SET* p_rules = ctx->p_rules;
+	int first = ctx->loc_rule_start[loc];
+	int last = ctx->loc_rule_start[loc + 1];
+	int capacity = 0;
+	int i, j;
+
+	for (i = first; i < last; i++) {
+		for (j = i + 1; j < last; j++) {
+			RULE_CONFLICT conf;
+
+			buildWitness(p_rules, &conf, ctx->loc_rules[i], ctx->loc_rules[j]);
+
+			if (!isCompatible(p_rules, &conf) ||
+			    !bothPlaced(p_rules, &conf, present, placed))
+				continue;
+
+			if (ctx->loc_num[loc] == capacity) {
+				RULE_CONFLICT* p_tmp;
+
+				capacity = capacity ? capacity * 2 : 16;
+				p_tmp = memRealloc(MEM_ANALYSIS, ctx->loc_conf[loc],
+				                   sizeof(RULE_CONFLICT) * capacity);
+				if (p_tmp == NULL)
+					return -1;
+				ctx->loc_conf[loc] = p_tmp;
+			}
+
+			ctx->loc_conf[loc][ctx->loc_num[loc]++] = conf;
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// auditWorker                                                                //
+//                                                                            //
+// Thread function. Takes locations one at a time until there are none left.  //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD WINAPI auditWorker(LPVOID param)
+{
+	AUDIT_CTX* ctx = param;
+	BYTE* present;
+	int* placed;
+	int loc;
+
+	present = memCalloc(MEM_ANALYSIS,
+	                    (size_t)ctx->p_rules->num_symbols + 1, 1);
+	placed = memAlloc(MEM_ANALYSIS, sizeof(int) *
+	                  ((size_t)ctx->p_rules->num_rules + 1));
+
+	if (!present || !placed) {
+		memFree(present); memFree(placed);
+		InterlockedExchange(&ctx->error, 1);
+		return 1;
+	}
+
+	while ((loc = InterlockedIncrement(&ctx->next_loc) - 1) < NUM_LOC_6605) {
+		if (auditLocation(ctx, loc, present, placed)) {
+			InterlockedExchange(&ctx->error, 1);
+			break;
+		}
+	}
+
+	memFree(present);
+	memFree(placed);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// groupRules                                                                 //
+//                                                                            //
+// Lists the rules that can place a switch (not plugs, covers or removals)    //
+// grouped by location, in csv order within each location.                    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int groupRules(AUDIT_CTX* ctx)
+{
+	const RULE_SET* p_rules = ctx->p_rules;
+	int p_next[NUM_LOC_6605];
+	int i;
+
+	ctx->loc_rules = memAlloc(MEM_ANALYSIS, sizeof(int) *
+	                          ((size_t)p_rules->num_rules + 1));
+	if (ctx->loc_rules == NULL)
+		return -2;
+
+	for (i = 0; i < p_rules->num_rules; i++) {
+		const struct sw_rule* p_rule = p_rules->rules + i;
+
+		if (p_rule->qty > 0 && p_rule->pn != PLUG && p_rule->pn != COVER)
+			ctx->loc_rule_start[p_rule->loc + 1]++;
+	}
+
+	for (i = 0; i < NUM_LOC_6605; i++) {
+		ctx->loc_rule_start[i + 1] += ctx->loc_rule_start[i];
+		p_next[i] = ctx->loc_rule_start[i];
+	}
+
+	for (i = 0; i < p_rules->num_rules; i++) {
+		const struct sw_rule* p_rule = p_rules->rules + i;
+
+		if (p_rule->qty > 0 && p_rule->pn != PLUG && p_rule->pn != COVER)
+			ctx->loc_rules[p_next[p_rule->loc]++] = i;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findRuleConflicts                                                          //
+//                                                                            //
+// Finds every pair of rules that can place two switches in the same          //
+// location, and stores them in a newly allocated conflict set, which must be //
+// freed with freeRuleConflicts(). The conflicts are grouped by location, and //
+// the pairs in each location are in csv order.                               //
+//                                                                            //
+// Returns 0 on success, or a negative value if memory couldn't be allocated. //
+////////////////////////////////////////////////////////////////////////////////
+
+int findRuleConflicts(const RULE_SET* p_rules, P_CONFLICT_SET* pp_set)
+{
+	P_CONFLICT_SET p_set = NULL;
+	AUDIT_CTX* ctx;
+	int res = 0;
+	int i;
+
+	*pp_set = NULL;
+
+	if (!p_rules)
+		return -1;
+
+	if ((ctx = memCalloc(MEM_ANALYSIS, 1, sizeof(AUDIT_CTX))) == NULL)
+		return -2;
+
+	ctx->p_rules = p_rules;
+
+	if ((res = groupRules(ctx)) == 0) {
+		runWorkerThreads(auditWorker, ctx, NUM_LOC_6605);
+		if (ctx->error)
+			res = -2;
+	}
+
+	if (res == 0 &&
+	    (p_set = memCalloc(MEM_ANALYSIS, 1, sizeof(CONFLICT_SET))) == NULL)
+		res = -2;
+
+	if (res == 0) {
+		for (i = 0; i < NUM_LOC_6605; i++)
+			p_set->num_conflicts += ctx->loc_num[i];
+
+		p_set->conflicts = memAlloc(MEM_ANALYSIS, sizeof(RULE_CONFLICT) *
+		                            ((size_t)p_set->num_conflicts + 1));
+		if (p_set->conflicts == NULL) {
+			memFree(p_set);
+			res = -2;
+		}
+	}
+
+	if (res == 0) {
+		for (i = 0; i < NUM_LOC_6605; i++) {
+			int j;
+
+			p_set->loc_start[i + 1] = p_set->loc_start[i] + ctx->loc_num[i];
+
+			for (j = 0; j < ctx->loc_num[i]; j++) {
+				const RULE_CONFLICT* p_conf = ctx->loc_conf[i] + j;
+
+				if (p_rules->rules[p_conf->rule_a].pn ==
+				    p_rules->rules[p_conf->rule_b].pn)
+					p_set->num_same_pn++;
+				if (isConfirmed(p_rules, p_conf))
+					p_set->num_confirmed++;
+			}
+
+			if (ctx->loc_num[i])
+				memcpy(p_set->conflicts + p_set->loc_start[i], ctx->loc_conf[i],
+				       sizeof(RULE_CONFLICT) * ctx->loc_num[i]);
+		}
+		*pp_set = p_set;
+	}
+
+	for (i = 0; i < NUM_LOC_6605; i++)
+		memFree(ctx->loc_conf[i]);
+	memFree(ctx->loc_rules);
+	memFree(ctx);
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeRuleConflicts                                                          //
+//                                                                            //
+// Frees a conflict set allocated by findRuleConflicts(). Safe to call with   //
+// NULL.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeRuleConflicts(P_CONFLICT_SET p_set)
+{
+	if (!p_set)
+		return;
+
+	memFree(p_set->conflicts);
+	memFree(p_set);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeRuleLine                                                              //
+//                                                                            //
+// Writes one rule of a conflicting pair to the report, with the description  //
+// of its switch (see sw_desc.c) if there is one.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static void writeRuleLine(FILE* fp, const RULE_SET* p_rules, int rule)
+{
+	const struct sw_rule* p_rule = p_rules->rules + rule;
+	const char* desc = findSwDesc(p_rule->pn);
+
+	fprintf(fp, "    %s  %d  qty %d  %s  (%s)\n",
+	        rule < p_rules->num_sp_rules ? "SP" : "CA",
+	        p_rule->pn, p_rule->qty, p_rule->vars, desc ? desc : "?");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeConflictReport                                                        //
+//                                                                            //
+// Writes the conflict set to a text file, one block per conflicting pair:    //
+// the two rules (which csv file they're from, the part number, quantity and  //
+// variant string) followed by the witness variants, and the witness variants //
+// whose family isn't known if there are any. Pairs that place the same part  //
+// number are marked, since they show up as a duplicate switch rather than    //
+// two different ones. Returns 0 on success or -1 if the file couldn't be     //
+// created.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeConflictReport(const RULE_SET* p_rules, const CONFLICT_SET* p_set,
+                        const char* file_path)
+{
+	FILE* fp;
+	char sym[SYMBOL_LENGTH + 1];
+	int loc, i, j;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0)
+		return -1;
+
+	fprintf(fp, "Switch rule conflicts: %d rules, %d conflicting pairs "
+	        "(%d confirmed, %d with the same part number)\n",
+	        p_rules->num_rules, p_set->num_conflicts, p_set->num_confirmed,
+	        p_set->num_same_pn);
+
+	for (loc = 0; loc < NUM_LOC_6605; loc++) {
+		if (p_set->loc_start[loc] == p_set->loc_start[loc + 1])
+			continue;
+
+		fprintf(fp, "\nLocation %d: %d pairs\n", loc,
+		        p_set->loc_start[loc + 1] - p_set->loc_start[loc]);
+
+		for (i = p_set->loc_start[loc]; i < p_set->loc_start[loc + 1]; i++) {
+			const RULE_CONFLICT* p_conf = p_set->conflicts + i;
+
+			fprintf(fp, "\n");
+			writeRuleLine(fp, p_rules, p_conf->rule_a);
+			writeRuleLine(fp, p_rules, p_conf->rule_b);
+
+			fprintf(fp, "    witness:");
+			for (j = 0; j < p_conf->num_witness; j++) {
+				unpackSymbol(p_rules->sym_keys[p_conf->witness[j]], sym,
+				             SYMBOL_LENGTH + 1);
+				fprintf(fp, " %s", sym);
+			}
+
+			if (p_rules->rules[p_conf->rule_a].pn ==
+			    p_rules->rules[p_conf->rule_b].pn)
+				fprintf(fp, "  (same part number)");
+			fprintf(fp, "\n");
+
+			if (isConfirmed(p_rules, p_conf))
+				continue;
+
+			fprintf(fp, "    unknown family:");
+			for (j = 0; j < p_conf->num_witness; j++) {
+				if (p_rules->sym_fams[p_conf->witness[j]])
+					continue;
+				unpackSymbol(p_rules->sym_keys[p_conf->witness[j]], sym,
+				             SYMBOL_LENGTH + 1);
+				fprintf(fp, " %s", sym);
+			}
+			fprintf(fp, "\n");
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
\ No newline at end of file
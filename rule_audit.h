@@ -0,0 +1,33 @@
+#ifndef RULE_AUDIT_H_
+#define RULE_AUDIT_H_
+
+#include "rule_set.h"
+
+// Two rules can't have more distinct variants than this between them
+#define MAX_WITNESS_TERMS   (2 * MAX_RULE_TERMS)
+
+// Two rules that put a switch in the same location and can fire together.
+// 'witness' is the smallest set of variants that makes both of them fire.
+typedef struct rule_conflict {
+	int rule_a;                         // rule_a < rule_b
+	int rule_b;
+	int num_witness;
+	int witness[MAX_WITNESS_TERMS];     // symbol ids, in symbol order
+} RULE_CONFLICT;
+
+// The conflicts in location 'loc' are
+// conflicts[loc_start[loc]] ... conflicts[loc_start[loc + 1] - 1]
+typedef struct conflict_set {
+	struct rule_conflict* conflicts;
+	int num_conflicts;
+	int num_confirmed;                  // pairs with no unknown families
+	int num_same_pn;                    // pairs that place the same switch
+	int loc_start[NUM_LOC_6605 + 1];
+} CONFLICT_SET, * P_CONFLICT_SET;
+
+int findRuleConflicts(const RULE_SET* p_rules, P_CONFLICT_SET* pp_set);
+void freeRuleConflicts(P_CONFLICT_SET p_set);
+int writeConflictReport(const RULE_SET* p_rules, const CONFLICT_SET* p_set,
+                        const char* file_path);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,536 @@
+////////////////////////////////////////////////////////////////////////////////
+// rule_dag.c                                                                 //
+//                                                                            //
+// This TU compiles the rules of each dash location into a decision diagram.  //
+// Even with the terms in selectivity order (see orderTerms() in rule_set.c), //
+// evalRules() still visits every rule of a location, and the rules of a      //
+// location share a lot of their terms: many of the rules in each location    //
+// test INT-GEN2, and so on. A decision diagram tests each of these symbols   //
+// once per spec and reaches the rules that fire directly.                    //
+//                                                                            //
+// Each node of the diagram tests one symbol and has two edges, one for       //
+// 'absent' and one for 'present'. Taking the 'present' edge can fire rules   //
+// (the rules whose last term is the symbol that was just found). Either edge //
+// leads to the next node, or to nowhere when no rule in the location can     //
+// fire anymore. The symbols of a location are tested in a fixed order        //
+// (rarest first, the same order the terms are sorted in), so every path      //
+// through the diagram tests each symbol at most once.                        //
+//                                                                            //
+// The diagram is built top-down. The state at a node is the set of rules     //
+// that can still fire (one bit per rule, which is why a location can have at //
+// most MAX_DAG_RULES rules) and the position of the next symbol to test.     //
+// States that are reached from more than one path are only built once, which //
+// is what turns the decision tree into a DAG and keeps it small. A location  //
+// that would need more than MAX_DAG_NODES nodes is evaluated with            //
+// evalRuleRange() instead, so a pathological set of rules can't blow up the  //
+// build.                                                                     //
+//                                                                            //
+// A diagram is only used where it pays off. With the terms in selectivity    //
+// order, evalRuleRange() already skips a whole group of rules after one      //
+// check, which is most of what a diagram saves, and visiting a node costs    //
+// more than checking a term. So the expected number of tests to walk each    //
+// diagram is computed from the symbol frequencies (see expectedDagChecks())  //
+// and compared with the expected checks of evalRuleRange() for the location, //
+// and the diagram is dropped unless it saves enough (see DAG_KEEP_RATIO in   //
+// rule_dag.h). With the 6605 csv files and the 'VSS numbers' corpus, no      //
+// location saves enough, so every location is evaluated by evalRuleRange().  //
+// That changes by itself if the rules or the frequencies do.                 //
+//                                                                            //
+// Since none of them is kept, matchRuleSet() doesn't use the diagrams, and   //
+// compileRuleSet() doesn't build them. The '/dag' command line mode (see     //
+// tool_mode.c) builds them, reports the node counts, and measures the        //
+// diagrams against evalRules() and the csv order row scan on a corpus, both  //
+// as they'd be used and with every diagram that fits kept. Should a location //
+// start to pay off, that report shows it.                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rule_dag.h"
+#include "mem_track.h"
+
+// The memo table holds every node of one location, at most half full
+#define MEMO_BITS           13
+#define MEMO_SIZE           (1 << MEMO_BITS)
+
+// Builder state for one location at a time
+typedef struct dag_build {
+	const RULE_SET* p_rules;
+	P_RULE_DAG p_dag;
+	int cap_nodes;
+	int cap_fire;
+	BOOL overflow;
+	BOOL error;
+
+	// The location's rules, and their terms as positions in 'syms'
+	int num_rules;
+	int rules[MAX_DAG_RULES];
+	int num_terms[MAX_DAG_RULES];
+	int term_pos[MAX_DAG_RULES][MAX_RULE_TERMS];
+
+	// The location's symbols, in the order they're tested
+	int num_syms;
+	int syms[MAX_DAG_RULES * MAX_RULE_TERMS];
+
+	// Nodes already built for this location, by state
+	ULONGLONG memo_alive[MEMO_SIZE];
+	int memo_pos[MEMO_SIZE];
+	int memo_node[MEMO_SIZE];
+
+	// The position of each node of this location, and the arrays used to
+	// compute the expected number of tests
+	int node_pos[MAX_DAG_NODES];
+	int order[MAX_DAG_NODES];
+	int pos_start[MAX_DAG_RULES * MAX_RULE_TERMS + 1];
+	double reach[MAX_DAG_NODES];
+} DAG_BUILD;
+
+////////////////////////////////////////////////////////////////////////////////
+// compareSyms                                                                //
+//                                                                            //
+// Returns a negative value if symbol 'a' is tested before symbol 'b'. The    //
+// order is the one orderTerms() in rule_set.c sorts the terms by: the number //
+// of corpus specs that have the symbol, then the symbol id.                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compareSyms(const RULE_SET* p_rules, int a, int b)
+{
+	if (p_rules->sym_freq[a] != p_rules->sym_freq[b])
+		return p_rules->sym_freq[a] - p_rules->sym_freq[b];
+	return a - b;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// nextPos                                                                    //
+//                                                                            //
+// Returns the position of the first symbol at or after 'pos' that one of the //
+// rules in 'alive' still has to test.                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int nextPos(const DAG_BUILD* b, ULONGLONG alive, int pos)
+{
+	int best = b->num_syms;
+	int k, t;
+
+	for (k = 0; k < b->num_rules; k++) {
+		if (!(alive & (1ULL << k)))
+			continue;
+
+		for (t = 0; t < b->num_terms[k]; t++) {
+			if (b->term_pos[k][t] >= pos) {
+				if (b->term_pos[k][t] < best)
+					best = b->term_pos[k][t];
+				break;
+			}
+		}
+	}
+
+	return best;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// memoSlot                                                                   //
+//                                                                            //
+// Returns the memo table slot for a state: either the slot that holds it, or //
+// the empty slot where it would go.                                          //
+////////////////////////////////////////////////////////////////////////////////
+
+static int memoSlot(const DAG_BUILD* b, ULONGLONG alive, int pos)
+{
+	ULONGLONG key = alive * 0x9E3779B97F4A7C15ULL + (ULONGLONG)pos;
+	int slot = (int)((key * 0x9E3779B97F4A7C15ULL) >> (64 - MEMO_BITS));
+
+	while (b->memo_node[slot] >= 0 &&
+	       (b->memo_alive[slot] != alive || b->memo_pos[slot] != pos))
+		slot = (slot + 1) & (MEMO_SIZE - 1);
+
+	return slot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// newNode                                                                    //
+//                                                                            //
+// Returns the index of a new node, growing the node array if needed, or -1   //
+// if the location has run out of nodes or memory couldn't be allocated.      //
+////////////////////////////////////////////////////////////////////////////////
+
+static int newNode(DAG_BUILD* b, int first_node)
+{
+	P_RULE_DAG p_dag = b->p_dag;
+
+	if (p_dag->num_nodes - first_node == MAX_DAG_NODES) {
+		b->overflow = TRUE;
+		return -1;
+	}
+
+	if (p_dag->num_nodes == b->cap_nodes) {
+		DAG_NODE* p_tmp;
+		int cap = b->cap_nodes ? b->cap_nodes * 2 : 256;
+
+		p_tmp = memRealloc(MEM_RULES, p_dag->nodes, sizeof(DAG_NODE) * cap);
+		if (p_tmp == NULL) {
+			b->error = TRUE;
+			return -1;
+		}
+		p_dag->nodes = p_tmp;
+		b->cap_nodes = cap;
+	}
+
+	return p_dag->num_nodes++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addFireList                                                                //
+//                                                                            //
+// Appends the rules in 'fire' to the DAG's fire list and returns where they  //
+// start, or -1 if memory couldn't be allocated.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int addFireList(DAG_BUILD* b, const int* fire, int num_fire)
+{
+	P_RULE_DAG p_dag = b->p_dag;
+	int start = p_dag->num_fire;
+
+	if (p_dag->num_fire + num_fire > b->cap_fire) {
+		int* p_tmp;
+		int cap = b->cap_fire ? b->cap_fire : 256;
+
+		while (cap < p_dag->num_fire + num_fire)
+			cap *= 2;
+
+		p_tmp = memRealloc(MEM_RULES, p_dag->fire_list, sizeof(int) * cap);
+		if (p_tmp == NULL) {
+			b->error = TRUE;
+			return -1;
+		}
+		p_dag->fire_list = p_tmp;
+		b->cap_fire = cap;
+	}
+
+	memcpy(p_dag->fire_list + start, fire, sizeof(int) * num_fire);
+	p_dag->num_fire += num_fire;
+	return start;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildNode                                                                  //
+//                                                                            //
+// Builds the node for the state (alive, pos) and everything below it, and    //
+// returns its index. Returns -1 if no rule in 'alive' can fire anymore, or   //
+// if the build was stopped (b->overflow or b->error is set in that case).    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int buildNode(DAG_BUILD* b, ULONGLONG alive, int pos, int first_node)
+{
+	ULONGLONG alive_hi = alive;
+	ULONGLONG alive_lo = alive;
+	int fire[MAX_DAG_RULES];
+	int num_fire = 0;
+	int node, slot, next_hi, next_lo, start;
+	int k, t;
+
+	if (!alive || b->overflow || b->error)
+		return -1;
+
+	pos = nextPos(b, alive, pos);
+
+	slot = memoSlot(b, alive, pos);
+	if (b->memo_node[slot] >= 0)
+		return b->memo_node[slot];
+
+	if ((node = newNode(b, first_node)) < 0)
+		return -1;
+
+	b->memo_alive[slot] = alive;
+	b->memo_pos[slot] = pos;
+	b->memo_node[slot] = node;
+	b->node_pos[node - first_node] = pos;
+
+	// Rules that test this symbol can't fire if it's absent. If it's
+	// present, the ones for which it's the last term fire.
+	for (k = 0; k < b->num_rules; k++) {
+		if (!(alive & (1ULL << k)))
+			continue;
+
+		for (t = 0; t < b->num_terms[k] && b->term_pos[k][t] < pos; t++) {}
+
+		if (t < b->num_terms[k] && b->term_pos[k][t] == pos) {
+			alive_lo &= ~(1ULL << k);
+			if (t == b->num_terms[k] - 1) {
+				alive_hi &= ~(1ULL << k);
+				fire[num_fire++] = b->rules[k];
+			}
+		}
+	}
+
+	next_hi = buildNode(b, alive_hi, pos + 1, first_node);
+	next_lo = buildNode(b, alive_lo, pos + 1, first_node);
+
+	if (b->overflow || b->error)
+		return -1;
+
+	if ((start = addFireList(b, fire, num_fire)) < 0)
+		return -1;
+
+	// The node array may have moved while the children were built
+	b->p_dag->nodes[node].sym = b->syms[pos];
+	b->p_dag->nodes[node].next[0] = next_lo;
+	b->p_dag->nodes[node].next[1] = next_hi;
+	b->p_dag->nodes[node].fire_start = start;
+	b->p_dag->nodes[node].num_fire = num_fire;
+
+	return node;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// expectedDagChecks                                                          //
+//                                                                            //
+// The expected number of symbol tests it takes to walk the diagram of the    //
+// current location, which is the sum of the probability of reaching each     //
+// node. A child always tests a later symbol than its parent, so the nodes    //
+// are visited in symbol order (with a counting sort) and each one passes its //
+// probability on to its children.                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+static double expectedDagChecks(DAG_BUILD* b, int first_node, int root)
+{
+	const DAG_NODE* nodes = b->p_dag->nodes + first_node;
+	int num_nodes = b->p_dag->num_nodes - first_node;
+	double checks = 0.0;
+	int i, pos;
+
+	memset(b->pos_start, 0, sizeof(int) * ((size_t)b->num_syms + 1));
+	for (i = 0; i < num_nodes; i++) {
+		b->pos_start[b->node_pos[i] + 1]++;
+		b->reach[i] = 0.0;
+	}
+	for (pos = 0; pos < b->num_syms; pos++)
+		b->pos_start[pos + 1] += b->pos_start[pos];
+	for (i = 0; i < num_nodes; i++)
+		b->order[b->pos_start[b->node_pos[i]]++] = i;
+
+	b->reach[root - first_node] = 1.0;
+	for (i = 0; i < num_nodes; i++) {
+		int n = b->order[i];
+		double p = symbolProb(b->p_rules, nodes[n].sym);
+
+		checks += b->reach[n];
+		if (nodes[n].next[0] >= 0)
+			b->reach[nodes[n].next[0] - first_node] += b->reach[n] * (1.0 - p);
+		if (nodes[n].next[1] >= 0)
+			b->reach[nodes[n].next[1] - first_node] += b->reach[n] * p;
+	}
+
+	return checks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setupLocation                                                              //
+//                                                                            //
+// Collects the rules and symbols of location 'loc' for the builder, and      //
+// converts each rule's terms to positions in the symbol order. Returns FALSE //
+// if the location has too many rules for a diagram.                          //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL setupLocation(DAG_BUILD* b, int loc)
+{
+	const RULE_SET* p_rules = b->p_rules;
+	const RULE_DAG* p_dag = b->p_dag;
+	int i, j, k, t;
+
+	b->num_rules = p_dag->rule_start[loc + 1] - p_dag->rule_start[loc];
+	b->num_syms = 0;
+
+	if (b->num_rules > MAX_DAG_RULES)
+		return FALSE;
+
+	for (k = 0; k < b->num_rules; k++) {
+		const struct sw_rule* p_rule;
+
+		b->rules[k] = p_rules->eval_order[p_dag->rule_start[loc] + k];
+		p_rule = p_rules->rules + b->rules[k];
+		b->num_terms[k] = p_rule->num_terms;
+
+		// Insert each new symbol in test order
+		for (t = 0; t < p_rule->num_terms; t++) {
+			int id = p_rule->terms[t];
+
+			for (i = 0; i < b->num_syms && b->syms[i] != id; i++) {}
+			if (i < b->num_syms)
+				continue;
+
+			for (i = b->num_syms;
+			     i > 0 && compareSyms(p_rules, b->syms[i - 1], id) > 0; i--)
+				b->syms[i] = b->syms[i - 1];
+			b->syms[i] = id;
+			b->num_syms++;
+		}
+	}
+
+	for (k = 0; k < b->num_rules; k++) {
+		const struct sw_rule* p_rule = p_rules->rules + b->rules[k];
+
+		for (t = 0; t < p_rule->num_terms; t++) {
+			int pos;
+
+			for (pos = 0; b->syms[pos] != p_rule->terms[t]; pos++) {}
+
+			for (j = t; j > 0 && b->term_pos[k][j - 1] > pos; j--)
+				b->term_pos[k][j] = b->term_pos[k][j - 1];
+			b->term_pos[k][j] = pos;
+		}
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildRuleDag                                                               //
+//                                                                            //
+// Builds the decision diagram of every location and stores them in a newly   //
+// allocated RULE_DAG, which must be freed with freeRuleDag(). A diagram is   //
+// used if it's expected to make at most 'keep_ratio' times the tests of      //
+// evalRuleRange() (the '/dag' mode passes DAG_KEEP_RATIO). The rule set's    //
+// eval_order must already be built. Returns 0 on success, or -21 if memory   //
+// couldn't be allocated.                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+int buildRuleDag(const RULE_SET* p_rules, double keep_ratio,
+                 P_RULE_DAG* pp_dag)
+{
+	P_RULE_DAG p_dag;
+	DAG_BUILD* b;
+	int loc;
+
+	*pp_dag = NULL;
+
+	if ((p_dag = memCalloc(MEM_RULES, 1, sizeof(RULE_DAG))) == NULL)
+		return -21;
+
+	if ((b = memCalloc(MEM_RULES, 1, sizeof(DAG_BUILD))) == NULL) {
+		memFree(p_dag);
+		return -21;
+	}
+
+	b->p_rules = p_rules;
+	b->p_dag = p_dag;
+
+	// The rules are already grouped by location in eval_order
+	for (loc = 0; loc < p_rules->num_rules; loc++)
+		p_dag->rule_start[p_rules->rules[loc].loc + 1]++;
+	for (loc = 0; loc < NUM_LOC_6605; loc++)
+		p_dag->rule_start[loc + 1] += p_dag->rule_start[loc];
+
+	for (loc = 0; loc < NUM_LOC_6605 && !b->error; loc++) {
+		int first_node = p_dag->num_nodes;
+		int first_fire = p_dag->num_fire;
+		ULONGLONG all;
+		int root;
+
+		p_dag->root[loc] = -1;
+		p_dag->row_scan[loc] = TRUE;
+		p_dag->loc_rules[loc] = p_dag->rule_start[loc + 1] -
+		                        p_dag->rule_start[loc];
+		p_dag->loc_exp_rows[loc] = expectedRangeChecks(p_rules,
+		                                               p_dag->rule_start[loc],
+		                                               p_dag->rule_start[loc + 1]);
+
+		if (!p_dag->loc_rules[loc] || !setupLocation(b, loc))
+			continue;
+		p_dag->loc_syms[loc] = b->num_syms;
+
+		memset(b->memo_node, 0xFF, sizeof(b->memo_node));
+		b->overflow = FALSE;
+
+		all = b->num_rules == 64 ? ~0ULL : (1ULL << b->num_rules) - 1;
+		root = buildNode(b, all, 0, first_node);
+
+		if (!b->overflow && !b->error) {
+			p_dag->loc_nodes[loc] = p_dag->num_nodes - first_node;
+			p_dag->loc_exp_dag[loc] = expectedDagChecks(b, first_node, root);
+
+			if (p_dag->loc_exp_dag[loc] <=
+			    keep_ratio * p_dag->loc_exp_rows[loc]) {
+				p_dag->root[loc] = root;
+				p_dag->row_scan[loc] = FALSE;
+				continue;
+			}
+		}
+
+		// Too big, or not worth it
+		p_dag->num_nodes = first_node;
+		p_dag->num_fire = first_fire;
+	}
+
+	if (b->error) {
+		memFree(b);
+		freeRuleDag(p_dag);
+		return -21;
+	}
+
+	memFree(b);
+	*pp_dag = p_dag;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeRuleDag                                                                //
+//                                                                            //
+// Frees a DAG built by buildRuleDag(). Safe to call with NULL.               //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeRuleDag(P_RULE_DAG p_dag)
+{
+	if (!p_dag)
+		return;
+
+	memFree(p_dag->nodes);
+	memFree(p_dag->fire_list);
+	memFree(p_dag);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// evalRuleDag                                                                //
+//                                                                            //
+// Sets fired[i] to 1 for every rule whose terms are all in the spec, and to  //
+// 0 for every other rule, like evalRules(). Each location's diagram is       //
+// walked from its root, so every symbol is tested at most once per location. //
+// Returns the number of symbol tests made.                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int evalRuleDag(const RULE_SET* p_rules, const RULE_DAG* p_dag,
+                const BYTE* present, BYTE* fired)
+{
+	int checks = 0;
+	int loc, j;
+
+	memset(fired, 0, (size_t)p_rules->num_rules);
+
+	for (loc = 0; loc < NUM_LOC_6605; loc++) {
+		int node = p_dag->root[loc];
+
+		if (p_dag->row_scan[loc]) {
+			checks += evalRuleRange(p_rules, present, fired,
+			                        p_dag->rule_start[loc],
+			                        p_dag->rule_start[loc + 1]);
+			continue;
+		}
+
+		while (node >= 0) {
+			const DAG_NODE* p_node = p_dag->nodes + node;
+
+			checks++;
+			if (!present[p_node->sym]) {
+				node = p_node->next[0];
+				continue;
+			}
+
+			for (j = 0; j < p_node->num_fire; j++)
+				fired[p_dag->fire_list[p_node->fire_start + j]] = 1;
+			node = p_node->next[1];
+		}
+	}
+
+	return checks;
+}
\ No newline at end of file
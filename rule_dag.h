@@ -0,0 +1,55 @@
+#ifndef RULE_DAG_H_
+#define RULE_DAG_H_
+
+#include "rule_set.h"
+
+// A location's decision diagram is only built if it has at most this many
+// rules (one bit per rule) and needs at most this many nodes, and it's only
+// used if it's expected to make at most DAG_KEEP_RATIO times the symbol
+// tests of evalRuleRange(). A node costs more to visit than a term check,
+// so a diagram that saves only a few tests is slower. Locations without a
+// diagram are evaluated with evalRuleRange().
+#define MAX_DAG_RULES       64
+#define MAX_DAG_NODES       4096
+#define DAG_KEEP_RATIO      0.75
+
+// Tests symbol 'sym'. Edge 0 is taken when the symbol isn't in the spec,
+// edge 1 when it is. Taking edge 1 fires the rules listed for the node. A
+// next node of -1 means no rule in the location can fire anymore.
+typedef struct dag_node {
+	int sym;
+	int next[2];
+	int fire_start;        // index into fire_list
+	int num_fire;
+} DAG_NODE;
+
+typedef struct rule_dag {
+	struct dag_node* nodes;
+	int num_nodes;
+	int* fire_list;
+	int num_fire;
+
+	int root[NUM_LOC_6605];         // -1 if no rule in the location can fire
+	BOOL row_scan[NUM_LOC_6605];    // no diagram, use evalRuleRange()
+
+	// Statistics for the '/dag' report. loc_nodes is the size of the
+	// diagram that was built, even if it isn't used, or 0 if it was too
+	// big. The expected tests are per spec, see symbolProb().
+	int loc_rules[NUM_LOC_6605];
+	int loc_syms[NUM_LOC_6605];
+	int loc_nodes[NUM_LOC_6605];
+	double loc_exp_rows[NUM_LOC_6605];
+	double loc_exp_dag[NUM_LOC_6605];
+
+	// The rules of location 'loc' are eval_order[rule_start[loc]] ...
+	// eval_order[rule_start[loc + 1] - 1] in the rule set
+	int rule_start[NUM_LOC_6605 + 1];
+} RULE_DAG, * P_RULE_DAG;
+
+int buildRuleDag(const RULE_SET* p_rules, double keep_ratio,
+                 P_RULE_DAG* pp_dag);
+void freeRuleDag(P_RULE_DAG p_dag);
+int evalRuleDag(const RULE_SET* p_rules, const RULE_DAG* p_dag,
+                const BYTE* present, BYTE* fired);
+
+#endif
\ No newline at end of file
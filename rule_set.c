@@ -0,0 +1,1017 @@
+////////////////////////////////////////////////////////////////////////////////
+// rule_set.c                                                                 //
+//                                                                            //
+// This TU compiles SP_SWITCH_DATA.csv and CA_SWITCH_DATA.csv into a rule set //
+// that can be queried without re-reading the csv text. parseCSV() in         //
+// parse_switch.c reads the csv files line by line every time a spec is       //
+// analyzed, which is fine for drawing a single dash, but anything that needs //
+// to ask questions about the whole rule set (for example, "which rules are   //
+// one variant away from firing?") would have to re-parse and re-match every  //
+// line for every question.                                                   //
+//                                                                            //
+// Each line of the csv files becomes one struct sw_rule (see rule_set.h).    //
+// The variants in the variant string of each rule are called 'terms'. Every  //
+// distinct symbol used in a term is given a small integer id, and the terms  //
+// of each rule are stored as these ids. The symbols themselves are packed    //
+// into 64-bit keys: a symbol is at most 8 characters long, so each character //
+// occupies one byte of the key, with the first character in the most         //
+// significant byte. This means comparing two keys gives the same result as   //
+// comparing the symbols with strcmp, and looking up a symbol is a single     //
+// integer comparison instead of a strncmp.                                   //
+//                                                                            //
+// Three lookup structures are built along with the rules:                    //
+//                                                                            //
+// 1) A hash table that maps a packed symbol to its id.                       //
+// 2) An inverted index that lists, for each symbol id, every rule that has   //
+//    that symbol as a term.                                                  //
+// 3) The symbol ids in packed symbol order, so the rule symbols of a spec    //
+//    can be found by merging them with its sorted symbol set.                //
+//                                                                            //
+// Each symbol also has a variant family, when it's known. Only one variant   //
+// of each family can be on a spec, so two rules that need different variants //
+// of the same family can never fire together. The csv files don't say which  //
+// family a variant belongs to, so that information comes from a third        //
+// resource, sym_fam_6605.txt. It was generated from the specs in the 'VSS    //
+// numbers' directory, and lists the family code of every rule symbol that    //
+// appears in one of them. Symbols that aren't listed have a family of 0      //
+// (unknown) and are treated as if they don't exclude anything.               //
+//                                                                            //
+// Rules are evaluated rarest term first. sym_freq_6605.txt lists how many    //
+// specs in a corpus (the 'VSS numbers' directory) have each rule symbol.     //
+// Most rules start with a symbol that's on nearly every spec, like INT-GEN2, //
+// so checking the terms in csv order means the term most likely to fail is   //
+// checked last. When the rule set is compiled, the terms of each rule are    //
+// sorted by that count, and evalRules() visits the rules of each location    //
+// grouped by their rarest term: when that term isn't in the spec, the whole  //
+// group is skipped after one check. The expected number of term checks per   //
+// spec, before and after the reordering, is computed from the same counts    //
+// and kept in the rule set (see the '/selectivity' command line mode in      //
+// tool_mode.c). The order the rules are evaluated in doesn't change the      //
+// result, because the switches are still placed and removed in csv order     //
+// afterwards.                                                                //
+//                                                                            //
+// The rules of each location can also be compiled into a decision diagram    //
+// (see rule_dag.c), which tests each symbol at most once per location. No    //
+// location's diagram pays off on the 6605 data, so matchRuleSet() evaluates  //
+// a spec with evalRules(), and the diagrams are only built by the '/dag'     //
+// command line mode, which measures them against it.                         //
+//                                                                            //
+// The rule set only depends on the embedded resources, so it's compiled once //
+// when the main window is created and freed when the program exits.          //
+//                                                                            //
+// The same lines parseCSV() skips are left out of the rule set: locations    //
+// that aren't dash switches, and rules with a variant longer than 8          //
+// characters (checkVarString() can never match these). Plugs and covers are  //
+// kept because they mark a location as intentionally empty, and rules with a //
+// quantity of -1 are kept because they remove switches placed by the SP      //
+// file.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rule_set.h"
+#include "rule_dag.h"
+#include "var_store.h"
+#include "intern.h"
+#include "resource.h"
+#include "mem_track.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// packSymbol                                                                 //
+//                                                                            //
+// Packs the first 'length' characters of a symbol into a SYM_KEY. Unused     //
+// bytes are zero, so "12V" and "12V     " (a symbol padded with spaces, the  //
+// way they are stored in struct variant) pack to the same key if the caller  //
+// passes the trimmed length. Returns 0 if the symbol is empty or too long to //
+// be packed.                                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+SYM_KEY packSymbol(const char* symbol, int length)
+{
+	SYM_KEY key = 0;
+	int i;
+
+	if (length <= 0 || length > SYMBOL_LENGTH)
+		return 0;
+
+	for (i = 0; i < SYMBOL_LENGTH; i++) {
+		key <<= 8;
+		if (i < length)
+			key |= (unsigned char)symbol[i];
+	}
+
+	return key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// variantKey                                                                 //
+//                                                                            //
+// Returns the packed symbol of a variant from a parsed spec. The symbol      //
+// field is padded with spaces (see processVssLineFile() in parse_vss.c), so  //
+// it is trimmed at the first space before it's packed.                       //
+////////////////////////////////////////////////////////////////////////////////
+
+SYM_KEY variantKey(const Variant* var)
+{
+	int length = 0;
+
+	while (length < SYMBOL_LENGTH && var->symbol[length] != ' ' &&
+	       var->symbol[length] != '\0')
+		length++;
+
+	return packSymbol(var->symbol, length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// unpackSymbol                                                               //
+//                                                                            //
+// Reverses packSymbol(). 'dest' must be able to hold SYMBOL_LENGTH + 1       //
+// characters.                                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void unpackSymbol(SYM_KEY key, char* dest, int dest_size)
+{
+	int i;
+	int j = 0;
+
+	if (dest_size < SYMBOL_LENGTH + 1)
+		return;
+
+	for (i = SYMBOL_LENGTH - 1; i >= 0; i--) {
+		char c = (char)((key >> (8 * i)) & 0xFF);
+		if (c == '\0')
+			break;
+		dest[j++] = c;
+	}
+	dest[j] = '\0';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// packFamily                                                                 //
+//                                                                            //
+// Packs a 3-character family code into a FAM_KEY. The code doesn't have to   //
+// be null terminated.                                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+FAM_KEY packFamily(const char* code)
+{
+	return ((FAM_KEY)(BYTE)code[0] << 16) | ((FAM_KEY)(BYTE)code[1] << 8) |
+	       (FAM_KEY)(BYTE)code[2];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// variantFamily                                                              //
+//                                                                            //
+// Returns the family of a variant read from a spec. The first three          //
+// characters of the IDVAR6 are the family code.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+FAM_KEY variantFamily(const Variant* var)
+{
+	return packFamily(var->idvar6);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// hashSlot                                                                   //
+//                                                                            //
+// Multiplicative (Fibonacci) hash of a packed symbol. The top 'bits' bits of //
+// the product are used as the starting slot in the hash table.               //
+////////////////////////////////////////////////////////////////////////////////
+
+static int hashSlot(SYM_KEY key, int bits)
+{
+	return (int)((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findSymbol                                                                 //
+//                                                                            //
+// Returns the id of a packed symbol, or -1 if no rule uses that symbol.      //
+////////////////////////////////////////////////////////////////////////////////
+
+int findSymbol(const RULE_SET* p_rules, SYM_KEY key)
+{
+	int mask = (1 << p_rules->hash_bits) - 1;
+	int slot = hashSlot(key, p_rules->hash_bits);
+
+	while (p_rules->sym_hash[slot] >= 0) {
+		if (p_rules->sym_keys[p_rules->sym_hash[slot]] == key)
+			return p_rules->sym_hash[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// markSpecSymbols                                                            //
+//                                                                            //
+// Sets present[id] for every rule symbol that's on the spec and returns how  //
+// many there are. 'present' is only ever set, so it must start out all       //
+// zeros.                                                                     //
+//                                                                            //
+// Both the rule symbols and the symbol set of the spec are sorted, so this   //
+// is a merge join: each rule symbol gallops forward from where the last one  //
+// was found (see gallopSymbol() in var_store.c) instead of being hashed.     //
+// Most of a spec isn't rule symbols, so the gallop skips over long runs of   //
+// it in a few comparisons.                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int markSpecSymbols(const RULE_SET* p_rules, const VAR_STORE* p_vars,
+                    BYTE* present)
+{
+	int num_found = 0;
+	int pos = 0;
+	int i;
+
+	for (i = 0; i < p_rules->num_symbols && pos < p_vars->num_set; i++) {
+		int id = p_rules->sym_order[i];
+		SYM_KEY key = p_rules->sym_keys[id];
+
+		pos = gallopSymbol(p_vars->sym_set, p_vars->num_set, pos, key);
+		if (pos < p_vars->num_set && p_vars->sym_set[pos] == key) {
+			present[id] = 1;
+			num_found++;
+			pos++;
+		}
+	}
+
+	return num_found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addSymbol                                                                  //
+//                                                                            //
+// Returns the id of a packed symbol, giving it a new id if this is the first //
+// time it has been seen. The hash table is sized in compileRuleSet() so it   //
+// can never fill up.                                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static int addSymbol(P_RULE_SET p_rules, SYM_KEY key)
+{
+	int mask = (1 << p_rules->hash_bits) - 1;
+	int slot = hashSlot(key, p_rules->hash_bits);
+
+	while (p_rules->sym_hash[slot] >= 0) {
+		if (p_rules->sym_keys[p_rules->sym_hash[slot]] == key)
+			return p_rules->sym_hash[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	p_rules->sym_keys[p_rules->num_symbols] = key;
+	p_rules->sym_hash[slot] = p_rules->num_symbols;
+
+	return p_rules->num_symbols++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// countCSVLines                                                              //
+//                                                                            //
+// Counts the lines with switch data in one of the csv resources, and the     //
+// total number of variants in them. The variants are counted by counting     //
+// commas (plus one per line), which can only over-estimate. Both counts are  //
+// used to size the arrays in compileRuleSet().                               //
+////////////////////////////////////////////////////////////////////////////////
+
+static int countCSVLines(WORD res_ID, int* num_lines, int* num_terms)
+{
+	char* csv;
+	int res;
+
+	if ((res = loadCSVResource(&csv, res_ID)) != 0)
+		return res;
+
+	while (*csv != '~') {
+		(*num_lines)++;
+		(*num_terms)++;
+
+		while (*csv != '\n') {
+			if (*csv == ',')
+				(*num_terms)++;
+			csv++;
+		}
+		csv++;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// compileTerms                                                               //
+//                                                                            //
+// Splits a variant string into its variants and stores their symbol ids in   //
+// the rule. Returns -1 if one of the variants is longer than SYMBOL_LENGTH   //
+// (such a rule can never match a spec), or -2 if the rule has more than      //
+// MAX_RULE_TERMS variants.                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compileTerms(P_RULE_SET p_rules, struct sw_rule* p_rule)
+{
+	const char* c = p_rule->vars;
+	const char* start = c;
+
+	p_rule->num_terms = 0;
+
+	for (;;) {
+		if (*c == ',' || *c == '\0') {
+			SYM_KEY key = packSymbol(start, (int)(c - start));
+			int id, i;
+
+			if (key == 0)
+				return -1;
+
+			id = addSymbol(p_rules, key);
+
+			// A variant listed twice only needs to be matched once
+			for (i = 0; i < p_rule->num_terms; i++)
+				if (p_rule->terms[i] == id)
+					break;
+
+			if (i == p_rule->num_terms) {
+				if (p_rule->num_terms == MAX_RULE_TERMS)
+					return -2;
+				p_rule->terms[p_rule->num_terms++] = id;
+			}
+
+			if (*c == '\0')
+				break;
+			start = c + 1;
+		}
+		c++;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// compileCSV                                                                 //
+//                                                                            //
+// Compiles every relevant line of one csv resource and appends the rules to  //
+// the rule set. The csv line parsing is done by the same functions that      //
+// parseCSV() uses. Each rule's variant string is interned (see intern.c).    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compileCSV(P_RULE_SET p_rules, WORD res_ID)
+{
+	char* csv;
+	char line[LINE_LENGTH];
+	char vars[VAR_STR_LENGTH];
+	int res;
+
+	if ((res = loadCSVResource(&csv, res_ID)) != 0)
+		return res;
+
+	while (!getLine(line, LINE_LENGTH, &csv)) {
+		struct sw_rule* p_rule = p_rules->rules + p_rules->num_rules;
+
+		if (processCSVLine(&p_rule->loc, &p_rule->pn, &p_rule->qty,
+		                   vars, line) == -1)
+			return -6;
+
+		// Same locations skipped by parseCSV()
+		if ((p_rule->loc > 30 && p_rule->loc < 35) || p_rule->loc > 38)
+			continue;
+
+		// The switches matched with this rule share its handle
+		if ((p_rule->vars = internString(vars)) == NULL)
+			return -22;
+
+		if ((res = compileTerms(p_rules, p_rule)) == -1)
+			continue;
+		else if (res)
+			return -7;
+
+		p_rules->num_rules++;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildInvertedIndex                                                         //
+//                                                                            //
+// Builds the symbol id -> rules index with a counting sort: count the uses   //
+// of each symbol, turn the counts into starting offsets, then place each     //
+// rule. Rules are placed in ascending order, so the list for each symbol is  //
+// in csv order as well.                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static int buildInvertedIndex(P_RULE_SET p_rules)
+{
+	int total = 0;
+	int* p_next;
+	int i, j;
+
+	p_rules->rule_start = memCalloc(MEM_RULES, (size_t)p_rules->num_symbols + 1,
+	                                sizeof(int));
+	if (p_rules->rule_start == NULL)
+		return -8;
+
+	for (i = 0; i < p_rules->num_rules; i++)
+		for (j = 0; j < p_rules->rules[i].num_terms; j++)
+			p_rules->rule_start[p_rules->rules[i].terms[j] + 1]++;
+
+	for (i = 0; i < p_rules->num_symbols; i++) {
+		total += p_rules->rule_start[i + 1];
+		p_rules->rule_start[i + 1] = total;
+	}
+
+	p_rules->rule_index = memAlloc(MEM_RULES, sizeof(int) * (total + 1));
+	if (p_rules->rule_index == NULL)
+		return -9;
+
+	p_next = memAlloc(MEM_RULES, sizeof(int) * (p_rules->num_symbols + 1));
+	if (p_next == NULL)
+		return -10;
+
+	memcpy(p_next, p_rules->rule_start, sizeof(int) * p_rules->num_symbols);
+
+	for (i = 0; i < p_rules->num_rules; i++)
+		for (j = 0; j < p_rules->rules[i].num_terms; j++)
+			p_rules->rule_index[p_next[p_rules->rules[i].terms[j]]++] = i;
+
+	memFree(p_next);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildSymbolOrder                                                           //
+//                                                                            //
+// Lists the symbol ids in packed symbol order, which is the order of the     //
+// symbol set of a spec (see var_store.c). Returns 0 on success or -21 if     //
+// memory couldn't be allocated.                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int buildSymbolOrder(P_RULE_SET p_rules)
+{
+	int* order;
+	int i, j;
+
+	order = memAlloc(MEM_RULES,
+	                 sizeof(int) * ((size_t)p_rules->num_symbols + 1));
+	if ((p_rules->sym_order = order) == NULL)
+		return -21;
+
+	// Insertion sort; there are only a few hundred symbols
+	for (i = 0; i < p_rules->num_symbols; i++) {
+		SYM_KEY key = p_rules->sym_keys[i];
+
+		for (j = i; j > 0 && p_rules->sym_keys[order[j - 1]] > key; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadFamilies                                                               //
+//                                                                            //
+// Reads sym_fam_6605.txt and stores the family of every listed symbol that   //
+// is used by a rule. Each line is 'SYMBOL;FAM'. Symbols that no rule uses    //
+// are ignored, so the file can be regenerated from a newer set of specs      //
+// without having to match the csv files exactly.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static int loadFamilies(P_RULE_SET p_rules)
+{
+	HRSRC hrsrc;
+	HGLOBAL hglobal;
+	char* txt;
+
+	p_rules->sym_fams = memCalloc(MEM_RULES, (size_t)p_rules->num_symbols + 1,
+	                              sizeof(FAM_KEY));
+	if (p_rules->sym_fams == NULL)
+		return -11;
+
+	hrsrc = FindResourceA(NULL, MAKEINTRESOURCEA(IDR_CSV5), "CSV");
+	if (hrsrc == NULL)
+		return -12;
+	if ((hglobal = LoadResource(NULL, hrsrc)) == NULL)
+		return -13;
+	if ((txt = LockResource(hglobal)) == NULL)
+		return -14;
+
+	while (*txt != '~') {
+		const char* start = txt;
+		int id;
+
+		while (*txt != ';' && *txt != '\n' && *txt != '~')
+			txt++;
+		if (*txt != ';')
+			return -15;
+
+		id = findSymbol(p_rules, packSymbol(start, (int)(txt - start)));
+		txt++;
+
+		if (id >= 0 && txt[0] && txt[1] && txt[2])
+			p_rules->sym_fams[id] = packFamily(txt);
+
+		while (*txt != '\n' && *txt != '~')
+			txt++;
+		if (*txt == '\n')
+			txt++;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getPlacedRules                                                             //
+//                                                                            //
+// Lists the rules that fire for a spec and are still in effect after the CA  //
+// removals (quantity -1) are applied, the same way insertNewSW() and         //
+// removeSW() build the switch list. 'present' is indexed by symbol id and is //
+// non-zero for every symbol in the spec. Plugs and covers are left out.      //
+//                                                                            //
+// The rules are stored in 'placed' in csv order, which must be able to hold  //
+// one index per rule. Returns the number of rules stored.                    //
+////////////////////////////////////////////////////////////////////////////////
+
+int getPlacedRules(const RULE_SET* p_rules, const BYTE* present, int* placed)
+{
+	int num_placed = 0;
+	int i, j;
+
+	for (i = 0; i < p_rules->num_rules; i++) {
+		const struct sw_rule* p_rule = p_rules->rules + i;
+
+		if (p_rule->pn == PLUG || p_rule->pn == COVER)
+			continue;
+
+		for (j = 0; j < p_rule->num_terms; j++)
+			if (!present[p_rule->terms[j]])
+				break;
+		if (j < p_rule->num_terms)
+			continue;
+
+		if (p_rule->qty != -1) {
+			placed[num_placed++] = i;
+			continue;
+		}
+
+		for (j = 0; j < num_placed; j++) {
+			if (p_rules->rules[placed[j]].loc == p_rule->loc &&
+			    p_rules->rules[placed[j]].pn == p_rule->pn) {
+				memmove(placed + j, placed + j + 1,
+				        sizeof(int) * (num_placed - j - 1));
+				num_placed--;
+				break;
+			}
+		}
+	}
+
+	return num_placed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadFrequencies                                                            //
+//                                                                            //
+// Reads sym_freq_6605.txt. The first line is the number of specs in the      //
+// corpus, and each line after it is 'SYMBOL;COUNT'. Symbols that no rule     //
+// uses are ignored, and symbols that aren't listed keep a count of 0.        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int loadFrequencies(P_RULE_SET p_rules)
+{
+	HRSRC hrsrc;
+	HGLOBAL hglobal;
+	char* txt;
+
+	p_rules->sym_freq = memCalloc(MEM_RULES, (size_t)p_rules->num_symbols + 1,
+	                              sizeof(int));
+	if (p_rules->sym_freq == NULL)
+		return -16;
+
+	hrsrc = FindResourceA(NULL, MAKEINTRESOURCEA(IDR_CSV6), "CSV");
+	if (hrsrc == NULL)
+		return -17;
+	if ((hglobal = LoadResource(NULL, hrsrc)) == NULL)
+		return -18;
+	if ((txt = LockResource(hglobal)) == NULL)
+		return -19;
+
+	p_rules->corpus_size = atoi(txt);
+	while (*txt != '\n' && *txt != '~')
+		txt++;
+
+	while (*txt == '\n') {
+		const char* start = ++txt;
+		int id;
+
+		while (*txt != ';' && *txt != '\n' && *txt != '~')
+			txt++;
+		if (*txt != ';')
+			break;
+
+		id = findSymbol(p_rules, packSymbol(start, (int)(txt - start)));
+		if (id >= 0)
+			p_rules->sym_freq[id] = atoi(txt + 1);
+
+		while (*txt != '\n' && *txt != '~')
+			txt++;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// symbolProb                                                                 //
+//                                                                            //
+// The estimated probability that a spec has symbol 'id'. The +1/+2 keeps     //
+// symbols that weren't seen in the corpus from counting as impossible.       //
+////////////////////////////////////////////////////////////////////////////////
+
+double symbolProb(const RULE_SET* p_rules, int id)
+{
+	return (p_rules->sym_freq[id] + 1.0) / (p_rules->corpus_size + 2.0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// expectedRowChecks                                                          //
+//                                                                            //
+// The expected number of term checks it takes to evaluate terms 'first' and  //
+// up of one rule, in the order they're stored. A term is only checked if     //
+// every term before it was in the spec.                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static double expectedRowChecks(const RULE_SET* p_rules,
+                                const struct sw_rule* p_rule, int first)
+{
+	double checks = 0.0;
+	double reach = 1.0;
+	int i;
+
+	for (i = first; i < p_rule->num_terms; i++) {
+		checks += reach;
+		reach *= symbolProb(p_rules, p_rule->terms[i]);
+	}
+
+	return checks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// compareTerms                                                               //
+//                                                                            //
+// Orders two symbol ids by how many specs in the corpus have them (rarest    //
+// first). Ties are broken by id so the order is always the same.             //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compareTerms(const RULE_SET* p_rules, int a, int b)
+{
+	if (p_rules->sym_freq[a] != p_rules->sym_freq[b])
+		return p_rules->sym_freq[a] - p_rules->sym_freq[b];
+	return a - b;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// orderTerms                                                                 //
+//                                                                            //
+// Sorts the terms of every rule, rarest first. Before each rule is sorted,   //
+// its expected number of term checks in csv order (the order                 //
+// checkVarString() uses) is added to 'exp_checks_csv'. The expected checks   //
+// after the reordering are computed in buildEvalOrder().                     //
+////////////////////////////////////////////////////////////////////////////////
+
+static void orderTerms(P_RULE_SET p_rules)
+{
+	int i, j, k;
+
+	p_rules->exp_checks_csv = 0.0;
+
+	for (i = 0; i < p_rules->num_rules; i++) {
+		struct sw_rule* p_rule = p_rules->rules + i;
+
+		p_rules->exp_checks_csv += expectedRowChecks(p_rules, p_rule, 0);
+
+		// Insertion sort, there are never more than MAX_RULE_TERMS
+		for (j = 1; j < p_rule->num_terms; j++) {
+			int id = p_rule->terms[j];
+
+			for (k = j; k > 0 &&
+			     compareTerms(p_rules, p_rule->terms[k - 1], id) > 0; k--)
+				p_rule->terms[k] = p_rule->terms[k - 1];
+			p_rule->terms[k] = id;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// expectedRangeChecks                                                        //
+//                                                                            //
+// The expected number of term checks evalRuleRange() makes for the rules in  //
+// eval_order[first] ... eval_order[last - 1]: one check per group, then the  //
+// rest of each row if the group's first term is in the spec.                 //
+////////////////////////////////////////////////////////////////////////////////
+
+double expectedRangeChecks(const RULE_SET* p_rules, int first, int last)
+{
+	double checks = 0.0;
+	int i, j;
+
+	for (i = first; i < last; i = p_rules->eval_skip[i]) {
+		int term = p_rules->rules[p_rules->eval_order[i]].terms[0];
+		double rest = 0.0;
+
+		for (j = i; j < p_rules->eval_skip[i]; j++)
+			rest += expectedRowChecks(p_rules,
+			                          p_rules->rules + p_rules->eval_order[j], 1);
+
+		checks += 1.0 + symbolProb(p_rules, term) * rest;
+	}
+
+	return checks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildEvalOrder                                                             //
+//                                                                            //
+// Sorts the rules by location, then by their first (rarest) term, and        //
+// records where each group of rules with the same first term ends. The sort  //
+// is a counting sort by location followed by an insertion sort inside each   //
+// location, which is fine for the few dozen rules a location has.            //
+////////////////////////////////////////////////////////////////////////////////
+
+static int buildEvalOrder(P_RULE_SET p_rules)
+{
+	int loc_start[NUM_LOC_6605 + 1] = { 0 };
+	int i, j;
+
+	p_rules->eval_order = memAlloc(MEM_RULES, sizeof(int) *
+	                               ((size_t)p_rules->num_rules + 1));
+	p_rules->eval_skip = memAlloc(MEM_RULES, sizeof(int) *
+	                              ((size_t)p_rules->num_rules + 1));
+	if (!p_rules->eval_order || !p_rules->eval_skip)
+		return -20;
+
+	for (i = 0; i < p_rules->num_rules; i++)
+		loc_start[p_rules->rules[i].loc]++;
+	for (i = 0, j = 0; i <= NUM_LOC_6605; i++) {
+		int count = loc_start[i];
+		loc_start[i] = j;
+		j += count;
+	}
+	for (i = 0; i < p_rules->num_rules; i++)
+		p_rules->eval_order[loc_start[p_rules->rules[i].loc]++] = i;
+
+	// loc_start[loc] is now the end of each location
+	for (i = 0; i <= NUM_LOC_6605; i++) {
+		int first = i ? loc_start[i - 1] : 0;
+		int k;
+
+		for (j = first + 1; j < loc_start[i]; j++) {
+			int rule = p_rules->eval_order[j];
+			int term = p_rules->rules[rule].terms[0];
+
+			for (k = j; k > first; k--) {
+				int prev = p_rules->eval_order[k - 1];
+				int cmp = compareTerms(p_rules, p_rules->rules[prev].terms[0], term);
+
+				if (cmp < 0 || (cmp == 0 && prev < rule))
+					break;
+				p_rules->eval_order[k] = prev;
+			}
+			p_rules->eval_order[k] = rule;
+		}
+	}
+
+	// A group ends where the first term or the location changes
+	for (i = p_rules->num_rules - 1; i >= 0; i--) {
+		const struct sw_rule* p_rule = p_rules->rules + p_rules->eval_order[i];
+		const struct sw_rule* p_next;
+
+		if (i == p_rules->num_rules - 1) {
+			p_rules->eval_skip[i] = p_rules->num_rules;
+			continue;
+		}
+
+		p_next = p_rules->rules + p_rules->eval_order[i + 1];
+		if (p_next->terms[0] == p_rule->terms[0] && p_next->loc == p_rule->loc)
+			p_rules->eval_skip[i] = p_rules->eval_skip[i + 1];
+		else
+			p_rules->eval_skip[i] = i + 1;
+	}
+
+	p_rules->exp_checks = expectedRangeChecks(p_rules, 0, p_rules->num_rules);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// evalRuleRange                                                              //
+//                                                                            //
+// Sets fired[i] to 1 for every rule in eval_order[first] ... eval_order[last //
+// - 1] whose terms are all in the spec, and to 0 for the other rules in that //
+// range. 'present' is indexed by symbol id. A group of rules whose rarest    //
+// term isn't in the spec costs a single check. 'first' and 'last' must be    //
+// group boundaries, such as the start and end of a location. Returns the     //
+// number of term checks made.                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+int evalRuleRange(const RULE_SET* p_rules, const BYTE* present, BYTE* fired,
+                  int first, int last)
+{
+	int checks = 0;
+	int i, j, k;
+
+	for (i = first; i < last; i = p_rules->eval_skip[i]) {
+		checks++;
+
+		if (!present[p_rules->rules[p_rules->eval_order[i]].terms[0]]) {
+			for (j = i; j < p_rules->eval_skip[i]; j++)
+				fired[p_rules->eval_order[j]] = 0;
+			continue;
+		}
+
+		for (j = i; j < p_rules->eval_skip[i]; j++) {
+			const struct sw_rule* p_rule = p_rules->rules + p_rules->eval_order[j];
+
+			for (k = 1; k < p_rule->num_terms; k++) {
+				checks++;
+				if (!present[p_rule->terms[k]])
+					break;
+			}
+			fired[p_rules->eval_order[j]] = (BYTE)(k == p_rule->num_terms);
+		}
+	}
+
+	return checks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// evalRules                                                                  //
+//                                                                            //
+// Evaluates every rule with evalRuleRange(). This is what matchRuleSet()     //
+// uses, and the reference the decision diagrams in rule_dag.c are checked    //
+// against.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int evalRules(const RULE_SET* p_rules, const BYTE* present, BYTE* fired)
+{
+	return evalRuleRange(p_rules, present, fired, 0, p_rules->num_rules);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// matchRuleSet                                                               //
+//                                                                            //
+// The compiled equivalent of calling parseCSV() for SP_SWITCH_DATA and then  //
+// CA_SWITCH_DATA. The rule symbols on the spec are found by merging the      //
+// symbol set of the spec with the rule symbols (see markSpecSymbols()),      //
+// evalRules() finds the rules that fire, and the switches are inserted       //
+// into (or removed from) the switch list in csv order with insertNewSW(), so //
+// the list is exactly the one parseCSV() would build. Plugs and covers are   //
+// left out, the same as in parseCSV().                                       //
+//                                                                            //
+// The list is allocated if '*pSwitchList' is NULL. If 'p_arena' isn't NULL,  //
+// the list, its switch links and the scratch arrays all come from the spec   //
+// arena, and are released when it's reset (see freeMemory() in ostool.c).    //
+// Otherwise they're on the heap, and the list frees its links with           //
+// freeSWLink(). Returns 0 on success, or a negative value on error (the      //
+// insertNewSW() values, or -1 if memory couldn't be allocated).              //
+////////////////////////////////////////////////////////////////////////////////
+
+int matchRuleSet(LL** pSwitchList, const RULE_SET* p_rules,
+                 const VAR_STORE* p_vars, P_SPEC_ARENA p_arena)
+{
+	BYTE* present;
+	BYTE* fired;
+	int res = 0;
+	int i;
+
+	if (*pSwitchList == NULL) {
+		if ((*pSwitchList = arenaAlloc(p_arena, sizeof(LL))) == NULL)
+			return -1;
+
+		if (p_arena)
+			LL_Init_Intrusive(*pSwitchList, offsetof(struct sw_link, link),
+			                  NULL, arenaAllocHook, p_arena);
+		else
+			LL_Init_Intrusive(*pSwitchList, offsetof(struct sw_link, link),
+			                  freeSWLink, NULL, NULL);
+	}
+
+	present = arenaAlloc(p_arena, (size_t)p_rules->num_symbols + 1);
+	fired = arenaAlloc(p_arena, (size_t)p_rules->num_rules + 1);
+	if (!present || !fired) {
+		arenaRelease(p_arena, present);
+		arenaRelease(p_arena, fired);
+		return -1;
+	}
+	memset(present, 0, (size_t)p_rules->num_symbols + 1);
+	markSpecSymbols(p_rules, p_vars, present);
+
+	evalRules(p_rules, present, fired);
+
+	for (i = 0; i < p_rules->num_rules && res == 0; i++) {
+		const struct sw_rule* p_rule = p_rules->rules + i;
+
+		if (!fired[i] || p_rule->pn == PLUG || p_rule->pn == COVER)
+			continue;
+
+		res = insertNewSW(*pSwitchList, p_rule->loc, p_rule->pn,
+		                  p_rule->vars, p_rule->qty);
+	}
+
+	arenaRelease(p_arena, present);
+	arenaRelease(p_arena, fired);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// compileRuleSet                                                             //
+//                                                                            //
+// Allocates and builds the rule set from the SP and CA csv resources, the    //
+// symbol family list and the symbol frequencies. The decision diagrams       //
+// aren't built (see the top of this file). The SP rules are compiled first,  //
+// followed by the CA rules, which is the same order parseCSV() is called in. //
+// If an error occurs, everything allocated so far is freed and a negative    //
+// value is returned.                                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+int compileRuleSet(P_RULE_SET* pp_rules)
+{
+	P_RULE_SET p_rules;
+	int num_lines = 0;
+	int num_terms = 0;
+	int res = 0;
+
+	*pp_rules = NULL;
+
+	if ((res = countCSVLines(IDR_CSV3, &num_lines, &num_terms)) != 0)
+		return res;
+	if ((res = countCSVLines(IDR_CSV4, &num_lines, &num_terms)) != 0)
+		return res;
+
+	if ((p_rules = memCalloc(MEM_RULES, 1, sizeof(RULE_SET))) == NULL)
+		return -1;
+
+	// Keep the hash table at most half full
+	p_rules->hash_bits = 4;
+	while ((1 << p_rules->hash_bits) < num_terms * 2)
+		p_rules->hash_bits++;
+
+	p_rules->rules = memAlloc(MEM_RULES, sizeof(struct sw_rule) * num_lines);
+	p_rules->sym_keys = memAlloc(MEM_RULES, sizeof(SYM_KEY) * num_terms);
+	p_rules->sym_hash = memAlloc(MEM_RULES, sizeof(int) *
+	                             ((size_t)1 << p_rules->hash_bits));
+
+	if (!p_rules->rules || !p_rules->sym_keys || !p_rules->sym_hash) {
+		freeRuleSet(p_rules);
+		return -1;
+	}
+
+	// -1 marks an empty slot
+	memset(p_rules->sym_hash, 0xFF,
+	       sizeof(int) * ((size_t)1 << p_rules->hash_bits));
+
+	if ((res = compileCSV(p_rules, IDR_CSV3)) == 0) {
+		p_rules->num_sp_rules = p_rules->num_rules;
+		if ((res = compileCSV(p_rules, IDR_CSV4)) == 0)
+			res = buildInvertedIndex(p_rules);
+		if (res == 0)
+			res = buildSymbolOrder(p_rules);
+		if (res == 0)
+			res = loadFamilies(p_rules);
+		if (res == 0)
+			res = loadFrequencies(p_rules);
+		if (res == 0) {
+			orderTerms(p_rules);
+			res = buildEvalOrder(p_rules);
+		}
+	}
+
+	if (res) {
+		freeRuleSet(p_rules);
+		return res;
+	}
+
+	*pp_rules = p_rules;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeRuleSet                                                                //
+//                                                                            //
+// Frees the rule set and every array it owns. Safe to call with NULL or with //
+// a partially built rule set.                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeRuleSet(P_RULE_SET p_rules)
+{
+	if (!p_rules)
+		return;
+
+	memFree(p_rules->rules);
+	memFree(p_rules->sym_keys);
+	memFree(p_rules->sym_fams);
+	memFree(p_rules->sym_freq);
+	memFree(p_rules->eval_order);
+	memFree(p_rules->eval_skip);
+	memFree(p_rules->sym_hash);
+	memFree(p_rules->rule_start);
+	memFree(p_rules->rule_index);
+	memFree(p_rules->sym_order);
+	freeRuleDag(p_rules->p_dag);
+	memFree(p_rules);
+}
\ No newline at end of file
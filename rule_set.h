@@ -0,0 +1,79 @@
+#ifndef RULE_SET_H_
+#define RULE_SET_H_
+
+#include <Windows.h>
+#include "ost_data.h"
+#include "parse_switch.h"
+
+// A rule never has more than 7 variants in the 6605 csv files
+#define MAX_RULE_TERMS      8
+
+// One line of SP_SWITCH_DATA.csv or CA_SWITCH_DATA.csv, compiled. The
+// variants in the variant string are stored as symbol ids (indices into
+// the sym_keys array of the rule set).
+typedef struct sw_rule {
+	int loc;
+	int pn;
+	int qty;
+	int num_terms;
+	int terms[MAX_RULE_TERMS];
+	const char* vars;    // handle from the intern pool (see intern.c)
+} SW_Rule;
+
+typedef struct rule_set {
+	struct sw_rule* rules;
+	int num_rules;
+	int num_sp_rules;    // rules [0, num_sp_rules) are from SP_SWITCH_DATA
+
+	SYM_KEY* sym_keys;   // symbol id -> packed symbol
+	FAM_KEY* sym_fams;   // symbol id -> family, from sym_fam_6605.txt
+	int num_symbols;
+
+	int* sym_hash;       // open-addressed table of symbol ids
+	int hash_bits;
+
+	// Inverted index: the rules that use symbol id 's' are
+	// rule_index[rule_start[s]] ... rule_index[rule_start[s + 1] - 1]
+	int* rule_start;
+	int* rule_index;
+
+	// The symbol ids sorted by packed symbol, for merging with the symbol
+	// set of a spec (see markSpecSymbols())
+	int* sym_order;
+
+	// Selectivity, from sym_freq_6605.txt. The terms of each rule are
+	// sorted rarest first. evalRules() visits the rules in eval_order, and
+	// eval_skip[i] is the position of the next rule in eval_order whose
+	// first term is different, so a missing first term skips the group.
+	int* sym_freq;       // symbol id -> specs in the corpus that have it
+	int corpus_size;
+	int* eval_order;
+	int* eval_skip;
+	double exp_checks_csv;   // expected term checks per spec, csv order
+	double exp_checks;       // expected term checks per spec, evalRules()
+
+	// Per-location decision diagrams, see rule_dag.c. NULL unless the
+	// '/dag' mode has built them; matchRuleSet() doesn't use them.
+	struct rule_dag* p_dag;
+} RULE_SET, * P_RULE_SET;
+
+SYM_KEY packSymbol(const char* symbol, int length);
+SYM_KEY variantKey(const Variant* var);
+void unpackSymbol(SYM_KEY key, char* dest, int dest_size);
+int findSymbol(const RULE_SET* p_rules, SYM_KEY key);
+int markSpecSymbols(const RULE_SET* p_rules, const VAR_STORE* p_vars,
+                    BYTE* present);
+FAM_KEY packFamily(const char* code);
+FAM_KEY variantFamily(const Variant* var);
+double symbolProb(const RULE_SET* p_rules, int id);
+double expectedRangeChecks(const RULE_SET* p_rules, int first, int last);
+int getPlacedRules(const RULE_SET* p_rules, const BYTE* present, int* placed);
+int evalRuleRange(const RULE_SET* p_rules, const BYTE* present, BYTE* fired,
+                  int first, int last);
+int evalRules(const RULE_SET* p_rules, const BYTE* present, BYTE* fired);
+int matchRuleSet(LL** pSwitchList, const RULE_SET* p_rules,
+                 const VAR_STORE* p_vars, P_SPEC_ARENA p_arena);
+int compileRuleSet(P_RULE_SET* pp_rules);
+void freeRuleSet(P_RULE_SET p_rules);
+
+#endif
\ No newline at end of file
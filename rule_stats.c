@@ -0,0 +1,723 @@
+////////////////////////////////////////////////////////////////////////////////
+// rule_stats.c                                                               //
+//                                                                            //
+// This TU measures the compiled rule set (see rule_set.c) against a corpus   //
+// of spec files, such as the ones in the 'VSS numbers' directory. It's used  //
+// by the command line modes in tool_mode.c, not by the main window.          //
+//                                                                            //
+// For every spec in the corpus, the switch list is built twice: once with    //
+// parseCSV(), the way the program always has, and once with matchRuleSet().  //
+// The two lists are compared, so the compiled rules are checked against the  //
+// original csv matching on real specs, and the time taken by each is added   //
+// up. evalRules() is run on every spec as well, and so are the decision      //
+// diagrams (see rule_dag.c) when the rule set has them, which must fire the  //
+// same rules. The number of specs each rule symbol appears in is counted as  //
+// well; writeSymbolFrequencies() writes these counts in the format of        //
+// sym_freq_6605.txt, so the embedded selectivity data can be regenerated     //
+// from a newer set of specs. The same goes for the variant families in the   //
+// corpus and fam_codes_6605.txt (see writeFamilyCodes()).                    //
+//                                                                            //
+// measureLoads() times loading and releasing every spec in the corpus from   //
+// the heap and from a spec arena (see spec_arena.c), and counts the          //
+// allocations each one makes, and the strings it interns (see intern.c).     //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rule_stats.h"
+#include "parse_vss.h"
+#include "var_store.h"
+#include "resource.h"
+#include "vss_connect.h"	// for nowMs()
+#include "mem_track.h"
+
+// The rule evaluations take a few microseconds, so each one is timed over
+// this many evaluations of the same spec
+#define EVAL_REPEATS        100
+
+// Each spec is loaded this many times from the heap and from the arena
+#define LOAD_REPEATS        20
+
+////////////////////////////////////////////////////////////////////////////////
+// csvOrderChecks                                                             //
+//                                                                            //
+// Returns the number of term checks it takes to evaluate every rule with its //
+// terms in csv order (the order of the variant string), stopping at the      //
+// first term that isn't in the spec. This is the order checkVarString()      //
+// uses.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+static int csvOrderChecks(const RULE_SET* p_rules, const BYTE* present)
+{
+	int checks = 0;
+	int i;
+
+	for (i = 0; i < p_rules->num_rules; i++) {
+		const char* c = p_rules->rules[i].vars;
+		const char* start = c;
+
+		for (;;) {
+			if (*c == ',' || *c == '\0') {
+				checks++;
+				if (!present[findSymbol(p_rules,
+				                        packSymbol(start, (int)(c - start)))])
+					break;
+				if (*c == '\0')
+					break;
+				start = c + 1;
+			}
+			c++;
+		}
+	}
+
+	return checks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// sameSwitchList                                                             //
+//                                                                            //
+// Returns TRUE if two switch lists have the same switches in the same order. //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL sameSwitchList(LL* p_a, LL* p_b)
+{
+	LL_elem* p_ea = p_a->head;
+	LL_elem* p_eb = p_b->head;
+
+	while (p_ea && p_eb) {
+		const struct sw_link* p_la = p_ea->data;
+		const struct sw_link* p_lb = p_eb->data;
+
+		if (p_la->loc != p_lb->loc || p_la->pn != p_lb->pn ||
+		    p_la->qty != p_lb->qty)
+			return FALSE;
+
+		p_ea = p_ea->next;
+		p_eb = p_eb->next;
+	}
+
+	return p_ea == NULL && p_eb == NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// measureSpec                                                                //
+//                                                                            //
+// Adds one spec to the corpus statistics. 'present' must be all zeros and is //
+// left that way. 'fired' must have room for two sets of fired rules, one for //
+// evalRules() and one for evalRuleDag(), which is only run if the rule set   //
+// has diagrams.                                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int measureSpec(const RULE_SET* p_rules, P_CORPUS_STATS p_stats,
+                       const VAR_STORE* p_vars, BYTE* present, BYTE* fired)
+{
+	LL* p_csv_list = NULL;
+	LL* p_match_list = NULL;
+	BYTE* fired_dag = fired + p_rules->num_rules;
+	double t0, t1, t2;
+	int res;
+	int i;
+
+	markSpecSymbols(p_rules, p_vars, present);
+	for (i = 0; i < p_rules->num_symbols; i++)
+		p_stats->sym_count[i] += present[i];
+
+	p_stats->checks_csv += csvOrderChecks(p_rules, present);
+	p_stats->checks_eval += evalRules(p_rules, present, fired);
+	if (p_rules->p_dag) {
+		p_stats->checks_dag += evalRuleDag(p_rules, p_rules->p_dag, present,
+		                                   fired_dag);
+		if (memcmp(fired, fired_dag, (size_t)p_rules->num_rules) != 0)
+			p_stats->num_dag_mismatches++;
+	}
+
+	t0 = nowMs();
+	for (i = 0; i < EVAL_REPEATS; i++)
+		csvOrderChecks(p_rules, present);
+	t1 = nowMs();
+	p_stats->ms_csv_rows += (t1 - t0) / EVAL_REPEATS;
+
+	t0 = nowMs();
+	for (i = 0; i < EVAL_REPEATS; i++)
+		evalRules(p_rules, present, fired);
+	t1 = nowMs();
+	for (i = 0; p_rules->p_dag && i < EVAL_REPEATS; i++)
+		evalRuleDag(p_rules, p_rules->p_dag, present, fired_dag);
+	t2 = nowMs();
+
+	p_stats->ms_rows += (t1 - t0) / EVAL_REPEATS;
+	p_stats->ms_dag += (t2 - t1) / EVAL_REPEATS;
+
+	t0 = nowMs();
+	if ((res = parseCSV(&p_csv_list, p_vars, IDR_CSV3)) == 0)
+		res = parseCSV(&p_csv_list, p_vars, IDR_CSV4);
+	t1 = nowMs();
+	if (res == 0)
+		res = matchRuleSet(&p_match_list, p_rules, p_vars, NULL);
+	t2 = nowMs();
+
+	if (res == 0) {
+		p_stats->ms_parse_csv += t1 - t0;
+		p_stats->ms_match += t2 - t1;
+		if (!sameSwitchList(p_csv_list, p_match_list))
+			p_stats->num_mismatches++;
+	}
+
+	if (p_csv_list)
+		LL_Destroy(p_csv_list);
+	if (p_match_list)
+		LL_Destroy(p_match_list);
+
+	memset(present, 0, (size_t)p_rules->num_symbols);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// compareFamKeys                                                             //
+//                                                                            //
+// qsort() comparison function for FAM_KEYs.                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compareFamKeys(const void* a, const void* b)
+{
+	FAM_KEY fam_a = *(const FAM_KEY*)a;
+	FAM_KEY fam_b = *(const FAM_KEY*)b;
+
+	return (fam_a > fam_b) - (fam_a < fam_b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addFamilies                                                                //
+//                                                                            //
+// Merges the families of one spec into the sorted, distinct families of the  //
+// corpus. Returns 0 on success, or -2 if memory couldn't be allocated.       //
+////////////////////////////////////////////////////////////////////////////////
+
+static int addFamilies(P_CORPUS_STATS p_stats, const VAR_STORE* p_vars)
+{
+	FAM_KEY* fams;
+	int num_fams = p_stats->num_fams;
+	int i;
+
+	fams = memRealloc(MEM_ANALYSIS, p_stats->fams, sizeof(FAM_KEY) *
+	                  ((size_t)num_fams + p_vars->num_var + 1));
+	if (fams == NULL)
+		return -2;
+	p_stats->fams = fams;
+
+	for (i = 0; i < p_vars->num_var; i++)
+		if (p_vars->fam_keys[i])
+			fams[num_fams++] = p_vars->fam_keys[i];
+
+	qsort(fams, num_fams, sizeof(FAM_KEY), compareFamKeys);
+	for (i = 0, p_stats->num_fams = 0; i < num_fams; i++)
+		if (p_stats->num_fams == 0 || fams[i] != fams[p_stats->num_fams - 1])
+			fams[p_stats->num_fams++] = fams[i];
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addSymbolSet                                                               //
+//                                                                            //
+// Merges the symbol set of one spec into the symbols of the corpus: the      //
+// union into a new array, since it can grow, and the intersection in place.  //
+// The first spec starts the intersection off. Returns 0 on success, or -2 if //
+// memory couldn't be allocated.                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int addSymbolSet(P_CORPUS_STATS p_stats, const VAR_STORE* p_vars)
+{
+	SYM_KEY* all_syms;
+
+	all_syms = memAlloc(MEM_ANALYSIS, sizeof(SYM_KEY) *
+	                    ((size_t)p_stats->num_all_syms + p_vars->num_set + 1));
+	if (all_syms == NULL)
+		return -2;
+
+	p_stats->num_all_syms = mergeSymbols(p_stats->all_syms,
+	                                     p_stats->num_all_syms,
+	                                     p_vars->sym_set, p_vars->num_set,
+	                                     all_syms, SYM_UNION);
+	memFree(p_stats->all_syms);
+	p_stats->all_syms = all_syms;
+
+	if (p_stats->common_syms == NULL) {
+		p_stats->common_syms = memAlloc(MEM_ANALYSIS, sizeof(SYM_KEY) *
+		                                ((size_t)p_vars->num_set + 1));
+		if (p_stats->common_syms == NULL)
+			return -2;
+		memcpy(p_stats->common_syms, p_vars->sym_set,
+		       sizeof(SYM_KEY) * p_vars->num_set);
+		p_stats->num_common_syms = p_vars->num_set;
+	}
+	else
+		p_stats->num_common_syms = mergeSymbols(p_stats->common_syms,
+		                                        p_stats->num_common_syms,
+		                                        p_vars->sym_set,
+		                                        p_vars->num_set,
+		                                        p_stats->common_syms,
+		                                        SYM_INTERSECT);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// measureCorpus                                                              //
+//                                                                            //
+// Reads every .txt spec file in 'dir_path' and stores the statistics in a    //
+// newly allocated CORPUS_STATS, which must be freed with freeCorpusStats().  //
+// Files that can't be parsed as a spec are skipped.                          //
+//                                                                            //
+// Returns 0 on success, -1 if the directory has no .txt files, -2 if memory  //
+// couldn't be allocated, or the error value of parseCSV()/matchRuleSet().    //
+////////////////////////////////////////////////////////////////////////////////
+
+int measureCorpus(const RULE_SET* p_rules, const char* dir_path,
+                  P_CORPUS_STATS* pp_stats)
+{
+	P_CORPUS_STATS p_stats;
+	WIN32_FIND_DATAA find_data;
+	HANDLE h_find;
+	char path[MAX_PATH];
+	BYTE* present;
+	BYTE* fired;
+	int res = 0;
+
+	*pp_stats = NULL;
+
+	sprintf_s(path, MAX_PATH, "%s\\*.txt", dir_path);
+	if ((h_find = FindFirstFileA(path, &find_data)) == INVALID_HANDLE_VALUE)
+		return -1;
+
+	p_stats = memCalloc(MEM_ANALYSIS, 1, sizeof(CORPUS_STATS));
+	present = memCalloc(MEM_ANALYSIS, (size_t)p_rules->num_symbols + 1, 1);
+	fired = memAlloc(MEM_ANALYSIS, (size_t)p_rules->num_rules * 2 + 1);
+	if (p_stats)
+		p_stats->sym_count = memCalloc(MEM_ANALYSIS,
+		                               (size_t)p_rules->num_symbols + 1,
+		                               sizeof(int));
+
+	if (!p_stats || !p_stats->sym_count || !present || !fired) {
+		FindClose(h_find);
+		freeCorpusStats(p_stats);
+		memFree(present); memFree(fired);
+		return -2;
+	}
+
+	do {
+		P_VAR_STORE p_vars;
+
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		sprintf_s(path, MAX_PATH, "%s\\%s", dir_path, find_data.cFileName);
+		if ((p_vars = parseVssFile(path, NULL)) == NULL)
+			continue;
+
+		if ((res = measureSpec(p_rules, p_stats, p_vars, present, fired)) == 0)
+			res = addFamilies(p_stats, p_vars);
+		if (res == 0)
+			res = addSymbolSet(p_stats, p_vars);
+		memFree(p_vars);
+		p_stats->num_specs++;
+	} while (res == 0 && FindNextFileA(h_find, &find_data));
+
+	FindClose(h_find);
+	memFree(present);
+	memFree(fired);
+
+	if (res) {
+		freeCorpusStats(p_stats);
+		return res;
+	}
+
+	*pp_stats = p_stats;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeCorpusStats                                                            //
+//                                                                            //
+// Frees statistics allocated by measureCorpus(). Safe to call with NULL.     //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeCorpusStats(P_CORPUS_STATS p_stats)
+{
+	if (!p_stats)
+		return;
+
+	memFree(p_stats->sym_count);
+	memFree(p_stats->fams);
+	memFree(p_stats->all_syms);
+	memFree(p_stats->common_syms);
+	memFree(p_stats);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeSymbolFrequencies                                                     //
+//                                                                            //
+// Writes the symbol counts in the format of sym_freq_6605.txt: the number of //
+// specs on the first line, then 'SYMBOL;COUNT' for every rule symbol in      //
+// symbol order, and the '~' eof marker. Returns 0 on success or -1 if the    //
+// file couldn't be created.                                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeSymbolFrequencies(const RULE_SET* p_rules,
+                           const CORPUS_STATS* p_stats, const char* file_path)
+{
+	const int* order = p_rules->sym_order;
+	FILE* fp;
+	char sym[SYMBOL_LENGTH + 1];
+	int i;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0)
+		return -1;
+
+	fprintf(fp, "%d", p_stats->num_specs);
+	for (i = 0; i < p_rules->num_symbols; i++) {
+		unpackSymbol(p_rules->sym_keys[order[i]], sym, SYMBOL_LENGTH + 1);
+		fprintf(fp, "\n%s;%d", sym, p_stats->sym_count[order[i]]);
+	}
+	fprintf(fp, "~");
+
+	fclose(fp);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeFamilyCodes                                                           //
+//                                                                            //
+// Writes the families of the corpus in the format of fam_codes_6605.txt: one //
+// 3-character code per line, in order, and the '~' eof marker. Returns 0 on  //
+// success or -1 if the file couldn't be created.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeFamilyCodes(const CORPUS_STATS* p_stats, const char* file_path)
+{
+	FILE* fp;
+	int i;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0)
+		return -1;
+
+	for (i = 0; i < p_stats->num_fams; i++) {
+		FAM_KEY fam = p_stats->fams[i];
+
+		fprintf(fp, "%c%c%c\n", (char)(fam >> 16), (char)(fam >> 8),
+		        (char)fam);
+	}
+	fprintf(fp, "~");
+
+	fclose(fp);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeSelectivityReport                                                     //
+//                                                                            //
+// Writes the number of distinct symbols in the corpus and on every spec, the //
+// expected term checks per spec computed when the rule set was compiled, the //
+// checks measured over the corpus in csv order and with evalRules(), the     //
+// time taken by parseCSV() and matchRuleSet(), the number of specs where     //
+// their switch lists didn't match, and the allocator's counters since the    //
+// program started. Returns 0 on success or -1 if the file couldn't be        //
+// created.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeSelectivityReport(const RULE_SET* p_rules,
+                           const CORPUS_STATS* p_stats, const char* file_path)
+{
+	MEM_STATS mem;
+	FILE* fp;
+	double specs = p_stats->num_specs ? p_stats->num_specs : 1;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0)
+		return -1;
+
+	fprintf(fp, "Rule set: %d rules, %d symbols, selectivity from %d specs\n",
+	        p_rules->num_rules, p_rules->num_symbols, p_rules->corpus_size);
+	fprintf(fp, "Corpus: %d specs\n", p_stats->num_specs);
+	fprintf(fp, "Symbols: %d distinct in the corpus, %d on every spec\n\n",
+	        p_stats->num_all_syms, p_stats->num_common_syms);
+
+	fprintf(fp, "Term checks per spec    csv order  selectivity order  "
+	        "reduction\n");
+	fprintf(fp, "  expected (compiled)  %11.1f  %17.1f  %8.1f%%\n",
+	        p_rules->exp_checks_csv, p_rules->exp_checks,
+	        100.0 * (1.0 - p_rules->exp_checks / p_rules->exp_checks_csv));
+	fprintf(fp, "  measured (corpus)    %11.1f  %17.1f  %8.1f%%\n\n",
+	        p_stats->checks_csv / specs, p_stats->checks_eval / specs,
+	        100.0 * (1.0 - (double)p_stats->checks_eval /
+	                       (p_stats->checks_csv ? p_stats->checks_csv : 1)));
+
+	fprintf(fp, "Time per spec: parseCSV() %.3f ms, matchRuleSet() %.3f ms\n",
+	        p_stats->ms_parse_csv / specs, p_stats->ms_match / specs);
+	fprintf(fp, "Switch lists that differ: %d\n", p_stats->num_mismatches);
+
+	getMemStats(&mem);
+	fprintf(fp, "\n");
+	writeMemStats(fp, NULL, &mem);
+
+	fclose(fp);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeDagReport                                                             //
+//                                                                            //
+// Writes the diagram of every location in 'p_all_dag': its size, the         //
+// expected tests per spec with and without it, and whether it pays off, i.e. //
+// whether it's in the rule set's diagrams, which must have been built (see   //
+// runDagReport() in tool_mode.c). Then compares, over the corpus, the csv    //
+// order row scan, evalRules(), the rule set's evalRuleDag() ('p_stats') and  //
+// evalRuleDag() with 'p_all_dag' ('p_all_stats'), which keeps every diagram  //
+// that fits. Returns 0 on success or -1 if the file couldn't be created.     //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeDagReport(const RULE_SET* p_rules, const CORPUS_STATS* p_stats,
+                   const RULE_DAG* p_all_dag, const CORPUS_STATS* p_all_stats,
+                   const char* file_path)
+{
+	const RULE_DAG* p_dag = p_rules->p_dag;
+	FILE* fp;
+	double specs = p_stats->num_specs ? p_stats->num_specs : 1;
+	double us_csv = 1000.0 * p_stats->ms_csv_rows / specs;
+	double us_rows = 1000.0 * p_stats->ms_rows / specs;
+	double us_dag = 1000.0 * p_stats->ms_dag / specs;
+	double us_all = 1000.0 * p_all_stats->ms_dag / specs;
+	int loc;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0)
+		return -1;
+
+	fprintf(fp, "Rule set: %d rules, %d symbols, selectivity from %d specs\n",
+	        p_rules->num_rules, p_rules->num_symbols, p_rules->corpus_size);
+	fprintf(fp, "Corpus: %d specs\n\n", p_stats->num_specs);
+
+	fprintf(fp, "Location  Rules  Symbols  Nodes  Expected tests: rows  diagram"
+	        "  Kept\n");
+	for (loc = 0; loc < NUM_LOC_6605; loc++) {
+		if (!p_all_dag->loc_rules[loc])
+			continue;
+
+		fprintf(fp, "%8d  %5d  %7d  ", loc, p_all_dag->loc_rules[loc],
+		        p_all_dag->loc_syms[loc]);
+		if (p_all_dag->loc_nodes[loc])
+			fprintf(fp, "%5d  %20.1f  %7.1f  %s\n", p_all_dag->loc_nodes[loc],
+			        p_all_dag->loc_exp_rows[loc], p_all_dag->loc_exp_dag[loc],
+			        p_dag->row_scan[loc] ? "no" : "yes");
+		else
+			fprintf(fp, "    -  %20.1f        -  too big\n",
+			        p_all_dag->loc_exp_rows[loc]);
+	}
+	fprintf(fp, "Total: %d nodes built, %d kept\n\n",
+	        p_all_dag->num_nodes, p_dag->num_nodes);
+
+	fprintf(fp, "Per spec                  tests  time (us)  speedup\n");
+	fprintf(fp, "  csv order row scan  %9.1f  %9.2f  %6.2fx\n",
+	        p_stats->checks_csv / specs, us_csv, 1.0);
+	fprintf(fp, "  evalRules()         %9.1f  %9.2f  %6.2fx\n",
+	        p_stats->checks_eval / specs, us_rows,
+	        us_rows > 0.0 ? us_csv / us_rows : 0.0);
+	fprintf(fp, "  evalRuleDag()       %9.1f  %9.2f  %6.2fx\n",
+	        p_stats->checks_dag / specs, us_dag,
+	        us_dag > 0.0 ? us_csv / us_dag : 0.0);
+	fprintf(fp, "  every diagram       %9.1f  %9.2f  %6.2fx\n\n",
+	        p_all_stats->checks_dag / specs, us_all,
+	        us_all > 0.0 ? us_csv / us_all : 0.0);
+
+	fprintf(fp, "Specs where the fired rules differ from evalRules(): %d, %d\n",
+	        p_stats->num_dag_mismatches, p_all_stats->num_dag_mismatches);
+
+	fclose(fp);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadSpec                                                                   //
+//                                                                            //
+// Loads one spec the way the main window does: parses the spec file, then    //
+// builds its switch list with matchRuleSet(). Everything comes from          //
+// 'p_arena', or from the heap if it's NULL. Returns 0 on success, -1 if the  //
+// file couldn't be parsed, or the error value of matchRuleSet().             //
+////////////////////////////////////////////////////////////////////////////////
+
+static int loadSpec(const RULE_SET* p_rules, const char* path,
+                    P_SPEC_ARENA p_arena, P_VAR_STORE* pp_vars, LL** p_sw_list)
+{
+	*p_sw_list = NULL;
+	if ((*pp_vars = parseVssFile(path, p_arena)) == NULL)
+		return -1;
+
+	return matchRuleSet(p_sw_list, p_rules, *pp_vars, p_arena);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// measureLoads                                                               //
+//                                                                            //
+// Loads every .txt spec file in 'dir_path' LOAD_REPEATS times from the heap  //
+// and LOAD_REPEATS times from one spec arena, timing the load and the        //
+// release that follows it separately, and stores the totals in '*p_stats'.   //
+// The heap path releases a spec like freeMemory() used to (free() and        //
+// LL_Destroy()), and the arena path like it does now (arenaReset()).         //
+//                                                                            //
+// Both paths make the same allocation requests, so the arena's request count //
+// is also the number of malloc() calls (and free() calls) the heap path      //
+// makes. On the arena path, the only malloc() calls are for the arena's      //
+// blocks.                                                                    //
+//                                                                            //
+// The variant strings and descriptions of a spec go to the intern pool on    //
+// both paths. The pool isn't reset between loads, so only the first load of  //
+// a spec can add strings to it; the pool's counters before and after all the //
+// loads are stored as well, and so are the allocator's (see mem_track.c).    //
+//                                                                            //
+// Returns 0 on success, -1 if the directory has no .txt files, or the error  //
+// value of matchRuleSet().                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int measureLoads(const RULE_SET* p_rules, const char* dir_path,
+                 P_LOAD_STATS p_stats)
+{
+	SPEC_ARENA arena;
+	WIN32_FIND_DATAA find_data;
+	HANDLE h_find;
+	char path[MAX_PATH];
+	int res = 0;
+
+	memset(p_stats, 0, sizeof(LOAD_STATS));
+	getInternStats(&p_stats->intern_before);
+	getMemStats(&p_stats->mem_before);
+
+	sprintf_s(path, MAX_PATH, "%s\\*.txt", dir_path);
+	if ((h_find = FindFirstFileA(path, &find_data)) == INVALID_HANDLE_VALUE)
+		return -1;
+
+	arenaInit(&arena);
+
+	do {
+		double t0, t1, t2;
+		P_VAR_STORE p_vars;
+		LL* sw_list;
+		long long allocs = arena.num_allocs;
+		int i;
+
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		sprintf_s(path, MAX_PATH, "%s\\%s", dir_path, find_data.cFileName);
+
+		for (i = 0; i < LOAD_REPEATS && res == 0; i++) {
+			t0 = nowMs();
+			res = loadSpec(p_rules, path, NULL, &p_vars, &sw_list);
+			t1 = nowMs();
+			memFree(p_vars);
+			if (sw_list)
+				LL_Destroy(sw_list);
+			t2 = nowMs();
+
+			p_stats->ms_heap_load += t1 - t0;
+			p_stats->ms_heap_free += t2 - t1;
+		}
+
+		for (i = 0; i < LOAD_REPEATS && res == 0; i++) {
+			t0 = nowMs();
+			res = loadSpec(p_rules, path, &arena, &p_vars, &sw_list);
+			t1 = nowMs();
+			arenaReset(&arena);
+			t2 = nowMs();
+
+			p_stats->ms_arena_load += t1 - t0;
+			p_stats->ms_arena_free += t2 - t1;
+		}
+
+		// A file that isn't a spec is skipped, the same as in measureCorpus()
+		if (res == -1) {
+			res = 0;
+			continue;
+		}
+
+		p_stats->num_allocs += (arena.num_allocs - allocs) / LOAD_REPEATS;
+		p_stats->num_specs++;
+	} while (res == 0 && FindNextFileA(h_find, &find_data));
+
+	FindClose(h_find);
+
+	p_stats->arena_blocks = arena.num_blocks;
+	p_stats->arena_peak = arena.peak_used;
+	p_stats->arena_reserved = arena.reserved;
+	arenaFree(&arena);
+	getInternStats(&p_stats->intern_after);
+	getMemStats(&p_stats->mem_after);
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeLoadReport                                                            //
+//                                                                            //
+// Writes the allocation counts and times measured by measureLoads(), per     //
+// spec, for the heap and for the spec arena, followed by what the intern     //
+// pool took for one batch of the corpus (every spec loaded once), and the    //
+// allocator's calls over all the loads by subsystem. Returns 0 on success or //
+// -1 if the file couldn't be created.                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeLoadReport(const LOAD_STATS* p_stats, const char* file_path)
+{
+	FILE* fp;
+	const INTERN_STATS* p_before = &p_stats->intern_before;
+	const INTERN_STATS* p_after = &p_stats->intern_after;
+	double specs = p_stats->num_specs ? p_stats->num_specs : 1;
+	double loads = specs * LOAD_REPEATS;
+	// Both paths load every spec LOAD_REPEATS times
+	double batches = 2.0 * LOAD_REPEATS;
+
+	if ((fopen_s(&fp, file_path, "w")) != 0)
+		return -1;
+
+	fprintf(fp, "Corpus: %d specs, each loaded %d times per path\n\n",
+	        p_stats->num_specs, LOAD_REPEATS);
+
+	fprintf(fp, "Per spec            requests  malloc()  free()  load (us)"
+	        "  release (us)\n");
+	fprintf(fp, "  heap (before)     %8.1f  %8.1f  %6.1f  %9.2f  %12.2f\n",
+	        p_stats->num_allocs / specs, p_stats->num_allocs / specs,
+	        p_stats->num_allocs / specs,
+	        1000.0 * p_stats->ms_heap_load / loads,
+	        1000.0 * p_stats->ms_heap_free / loads);
+	fprintf(fp, "  arena (after)     %8.1f  %8.3f  %6.1f  %9.2f  %12.2f\n\n",
+	        p_stats->num_allocs / specs, p_stats->arena_blocks / loads, 0.0,
+	        1000.0 * p_stats->ms_arena_load / loads,
+	        1000.0 * p_stats->ms_arena_free / loads);
+
+	fprintf(fp, "Arena: %lld blocks, %zu bytes reserved, %zu bytes peak per "
+	        "spec\n", p_stats->arena_blocks, p_stats->arena_reserved,
+	        p_stats->arena_peak);
+
+	fprintf(fp, "\nIntern pool, per corpus batch\n");
+	fprintf(fp, "  requests          %10.0f\n",
+	        (p_after->num_requests - p_before->num_requests) / batches);
+	fprintf(fp, "  bytes as copies   %10.0f\n",
+	        (p_after->bytes_requested - p_before->bytes_requested) / batches);
+	fprintf(fp, "  new strings       %10lld  (first batch only)\n",
+	        p_after->num_strings - p_before->num_strings);
+	fprintf(fp, "  new bytes stored  %10lld\n",
+	        p_after->bytes_stored - p_before->bytes_stored);
+	fprintf(fp, "  malloc()          %10lld  (all batches)\n",
+	        p_after->num_mallocs - p_before->num_mallocs);
+
+	fprintf(fp, "\nIntern pool, whole process: %lld strings, "
+	        "%lld bytes stored, %lld bytes reserved, %lld malloc() calls\n",
+	        p_after->num_strings, p_after->bytes_stored,
+	        p_after->bytes_reserved, p_after->num_mallocs);
+
+	fprintf(fp, "\nAllocator, all loads (live and peak bytes for the whole "
+	        "process)\n");
+	writeMemStats(fp, &p_stats->mem_before, &p_stats->mem_after);
+
+	fclose(fp);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef RULE_STATS_H_
+#define RULE_STATS_H_
+
+#include "rule_set.h"
+#include "rule_dag.h"
+#include "intern.h"
+#include "mem_track.h"
+
+// Measurements over a directory of spec files. The term checks count how
+// many times a rule's term is looked up in a spec, which is the unit the
+// expected checks in the rule set are given in.
+typedef struct corpus_stats {
+	int num_specs;
+	int* sym_count;            // symbol id -> specs that have it
+	long long checks_csv;      // terms in csv order, like checkVarString()
+	long long checks_eval;     // evalRules()
+	long long checks_dag;      // evalRuleDag() with the rule set's diagrams
+	double ms_parse_csv;       // parseCSV() for SP and CA
+	double ms_match;           // matchRuleSet()
+	double ms_csv_rows;        // csv order row scan, per evaluation
+	double ms_rows;            // evalRules(), per evaluation
+	double ms_dag;             // evalRuleDag(), per evaluation
+	int num_mismatches;        // specs where the two switch lists differ
+	int num_dag_mismatches;    // specs where the two sets of fired rules differ
+	FAM_KEY* fams;             // every family in the corpus, sorted
+	int num_fams;
+	SYM_KEY* all_syms;         // symbols on any spec, sorted
+	int num_all_syms;
+	SYM_KEY* common_syms;      // symbols on every spec, sorted
+	int num_common_syms;
+
+} CORPUS_STATS, * P_CORPUS_STATS;
+
+// Allocations and times for loading the specs in a directory and releasing
+// them again, from the heap and from a spec arena (see spec_arena.c).
+// The counts are totals over one load of every spec, and the times are
+// totals over LOAD_REPEATS loads. The intern pool counters (see intern.c)
+// and the allocator's (see mem_track.c) are taken before and after all the
+// loads.
+typedef struct load_stats {
+	int num_specs;
+	long long num_allocs;      // allocation requests, the same for both
+	long long arena_blocks;    // malloc() calls made by the arena
+	size_t arena_peak;         // most arena memory used by one spec
+	size_t arena_reserved;     // bytes in the arena's blocks
+	double ms_heap_load;       // parseVssFile() and matchRuleSet()
+	double ms_heap_free;       // free() and LL_Destroy()
+	double ms_arena_load;
+	double ms_arena_free;      // arenaReset()
+	INTERN_STATS intern_before;
+	INTERN_STATS intern_after;
+	MEM_STATS mem_before;
+	MEM_STATS mem_after;
+} LOAD_STATS, * P_LOAD_STATS;
+
+int measureCorpus(const RULE_SET* p_rules, const char* dir_path,
+                  P_CORPUS_STATS* pp_stats);
+void freeCorpusStats(P_CORPUS_STATS p_stats);
+int writeSymbolFrequencies(const RULE_SET* p_rules,
+                           const CORPUS_STATS* p_stats, const char* file_path);
+int writeFamilyCodes(const CORPUS_STATS* p_stats, const char* file_path);
+int writeSelectivityReport(const RULE_SET* p_rules,
+                           const CORPUS_STATS* p_stats, const char* file_path);
+int writeDagReport(const RULE_SET* p_rules, const CORPUS_STATS* p_stats,
+                   const RULE_DAG* p_all_dag,
+                   const CORPUS_STATS* p_all_stats, const char* file_path);
+int measureLoads(const RULE_SET* p_rules, const char* dir_path,
+                 P_LOAD_STATS p_stats);
+int writeLoadReport(const LOAD_STATS* p_stats, const char* file_path);
+
+#endif
\ No newline at end of file
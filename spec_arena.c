@@ -0,0 +1,216 @@
+////////////////////////////////////////////////////////////////////////////////
+// spec_arena.c                                                               //
+//                                                                            //
+// This TU contains the arena that holds the memory for the spec being        //
+// displayed. Loading a spec used to make one malloc() for the variant list   //
+// (see parse_vss.c) and three for every switch that's matched: the struct    //
+// sw_link, its copy of the variant string (see insertNewSW() in              //
+// parse_switch.c), and the list element (see LL_Ins_Next() in andrewll.c).   //
+// Clearing the spec freed every one of these again, one at a time.           //
+//                                                                            //
+// All of that memory now comes from the arena instead. The arena is a chain  //
+// of large blocks, and an allocation just moves a pointer forward in the     //
+// current block. Nothing is freed on its own; freeMemory() in ostool.c calls //
+// arenaReset(), which rewinds the arena to the start of its first block in   //
+// constant time, and the blocks are reused for the next spec. The blocks are //
+// only freed when the program exits.                                         //
+//                                                                            //
+// Functions that take an arena also accept NULL, in which case the memory    //
+// comes from memAlloc() (see mem_track.c) and is freed with memFree(). The   //
+// command line modes (see tool_mode.c) use this, and '/loadbench' compares   //
+// the two. The arena's blocks come from memAlloc() as well, so either way a  //
+// spec's memory is counted under MEM_SPEC.                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "spec_arena.h"
+#include "mem_track.h"
+
+// The block header is followed by the block's memory. The header is
+// padded so the memory starts on an ARENA_ALIGN boundary.
+typedef struct arena_block {
+	struct arena_block* next;
+	size_t size;
+	size_t used;
+	size_t pad;
+} ARENA_BLOCK;
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaInit                                                                  //
+//                                                                            //
+// Sets up an empty arena. No memory is allocated until the first call to     //
+// arenaAlloc().                                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+void arenaInit(P_SPEC_ARENA p_arena)
+{
+	memset(p_arena, 0, sizeof(SPEC_ARENA));
+	p_arena->block_size = ARENA_BLOCK_SIZE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaAlloc                                                                 //
+//                                                                            //
+// Returns 'size' bytes from the arena, aligned to ARENA_ALIGN, or NULL if a  //
+// new block was needed and couldn't be allocated. If the current block is    //
+// full, the next block in the chain is used (blocks are kept when the arena  //
+// is reset). A new block is only allocated at the end of the chain, and is   //
+// twice the size of the previous one, or big enough for 'size'.              //
+//                                                                            //
+// If 'p_arena' is NULL, the memory comes from memAlloc().                    //
+////////////////////////////////////////////////////////////////////////////////
+
+void* arenaAlloc(P_SPEC_ARENA p_arena, size_t size)
+{
+	ARENA_BLOCK* p_block;
+	void* p;
+
+	if (!p_arena)
+		return memAlloc(MEM_SPEC, size);
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	p_block = p_arena->cur;
+
+	while (!p_block || p_block->size - p_block->used < size) {
+		size_t block_size = p_arena->block_size;
+		ARENA_BLOCK* p_new;
+
+		if (p_block && p_block->next) {
+			// A block from before the last reset
+			p_block = p_block->next;
+			p_block->used = 0;
+			continue;
+		}
+
+		while (block_size < size)
+			block_size *= 2;
+
+		p_new = memAlloc(MEM_SPEC, sizeof(ARENA_BLOCK) + block_size);
+		if (p_new == NULL)
+			return NULL;
+
+		p_new->next = NULL;
+		p_new->size = block_size;
+		p_new->used = 0;
+
+		if (p_block)
+			p_block->next = p_new;
+		else
+			p_arena->first = p_new;
+		p_block = p_new;
+
+		p_arena->block_size = block_size * 2;
+		p_arena->reserved += block_size;
+		p_arena->num_blocks++;
+	}
+
+	p_arena->cur = p_block;
+	p = (char*)(p_block + 1) + p_block->used;
+	p_block->used += size;
+
+	p_arena->used += size;
+	if (p_arena->used > p_arena->peak_used)
+		p_arena->peak_used = p_arena->used;
+	p_arena->num_allocs++;
+
+	return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaAllocHook                                                             //
+//                                                                            //
+// arenaAlloc() with the signature of the allocator hook in andrewll.h, so a  //
+// linked list can allocate its elements from an arena.                       //
+////////////////////////////////////////////////////////////////////////////////
+
+void* arenaAllocHook(void* p_arena, size_t size)
+{
+	return arenaAlloc((P_SPEC_ARENA)p_arena, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaRelease                                                               //
+//                                                                            //
+// Gives back memory from arenaAlloc() on an error path. Arena memory is only //
+// reclaimed by arenaReset(), so this only calls memFree() if 'p_arena' is    //
+// NULL.                                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+void arenaRelease(P_SPEC_ARENA p_arena, void* p)
+{
+	if (!p_arena)
+		memFree(p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaReset                                                                 //
+//                                                                            //
+// Releases everything allocated from the arena since the last reset, in      //
+// constant time. The blocks are kept for the next spec.                      //
+////////////////////////////////////////////////////////////////////////////////
+
+void arenaReset(P_SPEC_ARENA p_arena)
+{
+	p_arena->cur = p_arena->first;
+	if (p_arena->first)
+		p_arena->first->used = 0;
+
+	p_arena->used = 0;
+	p_arena->num_resets++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaFree                                                                  //
+//                                                                            //
+// Frees every block of the arena. The arena is empty afterwards, and can be  //
+// used again.                                                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void arenaFree(P_SPEC_ARENA p_arena)
+{
+	ARENA_BLOCK* p_block = p_arena->first;
+
+	while (p_block) {
+		ARENA_BLOCK* p_next = p_block->next;
+
+		memFree(p_block);
+		p_block = p_next;
+	}
+
+	arenaInit(p_arena);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaCreate                                                                //
+//                                                                            //
+// Allocates an empty arena on the heap. The main window's arena is one of    //
+// these, so that it can trade it for the arena a spec was loaded into on a   //
+// worker thread (see adoptSpecJob() in spec_job.c). Returns NULL if memory   //
+// couldn't be allocated.                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+P_SPEC_ARENA arenaCreate(void)
+{
+	P_SPEC_ARENA p_arena = memAlloc(MEM_SPEC, sizeof(SPEC_ARENA));
+
+	if (p_arena)
+		arenaInit(p_arena);
+
+	return p_arena;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// arenaDestroy                                                               //
+//                                                                            //
+// Frees an arena from arenaCreate(), and its blocks. 'p_arena' may be NULL.  //
+////////////////////////////////////////////////////////////////////////////////
+
+void arenaDestroy(P_SPEC_ARENA p_arena)
+{
+	if (!p_arena)
+		return;
+
+	arenaFree(p_arena);
+	memFree(p_arena);
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef SPEC_ARENA_H_
+#define SPEC_ARENA_H_
+
+#include <stdlib.h>
+
+// Size of the first block. A spec's variant store is the largest
+// allocation, at most MAX_VARIANTS * VAR_STORE_ROW_SIZE (about 54 KB) plus
+// its family index (4 KB).
+#define ARENA_BLOCK_SIZE    (64 * 1024)
+
+// Every allocation is rounded up to a multiple of this
+#define ARENA_ALIGN         16
+
+struct arena_block;
+
+// The memory for one spec: its variant store and switch list. Blocks are
+// kept when the arena is reset, so after the first few specs, loading a
+// spec doesn't call malloc() at all.
+typedef struct spec_arena {
+	struct arena_block* first;
+	struct arena_block* cur;
+	size_t block_size;          // size of the next new block
+	size_t used;                // bytes handed out since the last reset
+
+	// Statistics, since arenaInit()
+	long long num_allocs;       // allocations served
+	long long num_blocks;       // blocks allocated with malloc()
+	long long num_resets;
+	size_t peak_used;           // most bytes used by one spec
+	size_t reserved;            // bytes in all blocks
+} SPEC_ARENA, * P_SPEC_ARENA;
+
+void arenaInit(P_SPEC_ARENA p_arena);
+void* arenaAlloc(P_SPEC_ARENA p_arena, size_t size);
+void* arenaAllocHook(void* p_arena, size_t size);
+void arenaRelease(P_SPEC_ARENA p_arena, void* p);
+void arenaReset(P_SPEC_ARENA p_arena);
+void arenaFree(P_SPEC_ARENA p_arena);
+P_SPEC_ARENA arenaCreate(void);
+void arenaDestroy(P_SPEC_ARENA p_arena);
+
+#endif
\ No newline at end of file
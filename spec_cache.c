@@ -0,0 +1,636 @@
+////////////////////////////////////////////////////////////////////////////////
+// spec_cache.c                                                               //
+//                                                                            //
+// This TU keeps the spec pages downloaded from EDB on disk, so a spec that's //
+// looked up again is read from a file instead of downloaded. Engineers       //
+// reopen the same quotes many times a day, and each download is a ~200 KiB   //
+// page over the VPN.                                                         //
+//                                                                            //
+// A page is cached under a key made of the product class and the spec number //
+// (see struct spec in ost_data.h), e.g. "04/VSS-21-836303". The pages        //
+// themselves are stored by content: each is a file named by the 64 bit       //
+// FNV-1a hash of its bytes, so two keys with the same page share one file,   //
+// and a page that's read back is checked against its name before it's used.  //
+// The keys are listed in an index file in the same directory, with the hash, //
+// size, the time each page was downloaded and the time it was last used.     //
+//                                                                            //
+// The cache is bounded in size. When the pages add up to more than           //
+// 'max_bytes', the least recently used keys are dropped, and their files     //
+// deleted once no other key uses them. A page is fresh for 'max_age' seconds //
+// after it was downloaded; after that readSpecCache() still returns it,      //
+// marked stale, so the caller can download it again, and use the old page if //
+// that fails (see runSpecJob() in spec_job.c).                               //
+//                                                                            //
+// Each entry also keeps the ETag and Last-Modified time EDB sent with its    //
+// page (see PAGE_VALIDATORS in vss_connect.h). A stale page isn't downloaded //
+// again outright: the request carries them, and if EDB answers that the page //
+// hasn't changed, refreshSpecCache() makes the entry fresh again, and the    //
+// cached page is used, after a single round trip that transfers no page.     //
+// Without validators from EDB the page is downloaded in full, but if it      //
+// hasn't changed it hashes to the same file, which isn't written again.      //
+//                                                                            //
+// Specs are loaded on worker threads, so every function takes the cache's    //
+// lock. The cache only holds raw pages; parsing a page takes a fraction of a //
+// millisecond (see '/selectivity'), so parsed results aren't kept, and a     //
+// revalidated page is parsed again like any other cached one.                //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "spec_cache.h"
+#include "mem_track.h"
+
+static unsigned long long hashPage(const char* data, DWORD size);
+static void getCachePath(const SPEC_CACHE* p_cache, const char* name,
+                         char* path);
+static void getPagePath(const SPEC_CACHE* p_cache, unsigned long long hash,
+                        const char* ext, char* path);
+static int findEntry(const SPEC_CACHE* p_cache, const char* key);
+static int countPageUsers(const SPEC_CACHE* p_cache, unsigned long long hash);
+static int addEntry(P_SPEC_CACHE p_cache, const SPEC_CACHE_ENTRY* p_entry);
+static void removeEntry(P_SPEC_CACHE p_cache, int index);
+static void evictEntries(P_SPEC_CACHE p_cache);
+static int readPage(const SPEC_CACHE* p_cache, const SPEC_CACHE_ENTRY* p_entry,
+                    char** p_data);
+static int writePage(const SPEC_CACHE* p_cache, unsigned long long hash,
+                     const char* data, DWORD size);
+static int loadIndex(P_SPEC_CACHE p_cache);
+static int saveIndex(P_SPEC_CACHE p_cache);
+
+////////////////////////////////////////////////////////////////////////////////
+// getSpecCacheDefaults                                                       //
+//                                                                            //
+// Fills 'p_config' with the settings the main window uses: the cache is the  //
+// directory SPEC_CACHE_DIR in the current directory, and holds               //
+// SPEC_CACHE_MAX_BYTES of pages that are fresh for SPEC_CACHE_MAX_AGE, with  //
+// stale pages used when EDB can't be reached.                                //
+////////////////////////////////////////////////////////////////////////////////
+
+void getSpecCacheDefaults(SPEC_CACHE_CONFIG* p_config)
+{
+	memset(p_config, 0, sizeof(SPEC_CACHE_CONFIG));
+	strcpy_s(p_config->dir, MAX_PATH, SPEC_CACHE_DIR);
+	p_config->max_bytes = SPEC_CACHE_MAX_BYTES;
+	p_config->max_age = SPEC_CACHE_MAX_AGE;
+	p_config->use_stale = TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// openSpecCache                                                              //
+//                                                                            //
+// Opens the cache described by 'p_config', or by getSpecCacheDefaults() if   //
+// it's NULL, creating its directory if it doesn't exist, and reads its       //
+// index. A missing index is an empty cache. Returns 0 on success, -1 if      //
+// memory couldn't be allocated, or -2 if the directory couldn't be created.  //
+////////////////////////////////////////////////////////////////////////////////
+
+int openSpecCache(const SPEC_CACHE_CONFIG* p_config, P_SPEC_CACHE* pp_cache)
+{
+	P_SPEC_CACHE p_cache;
+
+	*pp_cache = NULL;
+
+	if ((p_cache = memCalloc(MEM_NETWORK, 1, sizeof(SPEC_CACHE))) == NULL)
+		return -1;
+
+	if (p_config)
+		p_cache->config = *p_config;
+	else
+		getSpecCacheDefaults(&(p_cache->config));
+
+	InitializeSRWLock(&(p_cache->lock));
+
+	if (!CreateDirectoryA(p_cache->config.dir, NULL) &&
+	    GetLastError() != ERROR_ALREADY_EXISTS) {
+		memFree(p_cache);
+		return -2;
+	}
+
+	if (loadIndex(p_cache) != 0) {
+		memFree(p_cache->entries);
+		memFree(p_cache);
+		return -1;
+	}
+
+	// The limit may be lower than when the index was written
+	evictEntries(p_cache);
+
+	*pp_cache = p_cache;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// readSpecCache                                                              //
+//                                                                            //
+// Looks up the page cached under 'key'. If it's there, '*p_data' is set to a //
+// heap buffer holding it and '*p_size' to its length, the same as            //
+// connectToEDB() returns them, and the caller frees the buffer. Its          //
+// validators are copied to '*p_validators', if it isn't NULL, which is       //
+// cleared if there's no page. Returns SPEC_CACHE_HIT for a fresh page,       //
+// SPEC_CACHE_STALE for one older than 'max_age', or SPEC_CACHE_MISS if       //
+// there's no page, or its file is missing or doesn't match its hash. A page  //
+// that can't be read is dropped from the cache.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+int readSpecCache(P_SPEC_CACHE p_cache, const char* key, char** p_data,
+                  DWORD* p_size, PAGE_VALIDATORS* p_validators)
+{
+	long long now = (long long)time(NULL);
+	int res = SPEC_CACHE_MISS;
+	int i;
+
+	*p_data = NULL;
+	*p_size = 0;
+	if (p_validators)
+		memset(p_validators, 0, sizeof(PAGE_VALIDATORS));
+
+	AcquireSRWLockExclusive(&(p_cache->lock));
+
+	if ((i = findEntry(p_cache, key)) >= 0) {
+		SPEC_CACHE_ENTRY* p_entry = p_cache->entries + i;
+
+		if (readPage(p_cache, p_entry, p_data) == 0) {
+			*p_size = p_entry->size;
+			if (p_validators)
+				*p_validators = p_entry->validators;
+			res = (now - p_entry->fetched > p_cache->config.max_age) ?
+			      SPEC_CACHE_STALE : SPEC_CACHE_HIT;
+			p_entry->used = now;
+		}
+		else {
+			removeEntry(p_cache, i);
+		}
+		p_cache->dirty = TRUE;
+	}
+
+	if (res == SPEC_CACHE_HIT)
+		p_cache->num_hits++;
+	else if (res == SPEC_CACHE_STALE)
+		p_cache->num_stale++;
+	else
+		p_cache->num_misses++;
+
+	ReleaseSRWLockExclusive(&(p_cache->lock));
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeSpecCache                                                             //
+//                                                                            //
+// Caches the 'size' bytes of 'data' under 'key', with the validators EDB     //
+// sent with them ('p_validators' may be NULL if there are none), replacing   //
+// what was cached under it before, and evicts the least recently used pages  //
+// if the cache is over its limit. The page file is written before the index  //
+// refers to it, and both are written to a temporary file first and then      //
+// renamed, so a cache that's interrupted halfway is still consistent.        //
+// Returns 0 on success, or a negative value if the page couldn't be stored,  //
+// in which case the cache is unchanged.                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeSpecCache(P_SPEC_CACHE p_cache, const char* key, const char* data,
+                   DWORD size, const PAGE_VALIDATORS* p_validators)
+{
+	SPEC_CACHE_ENTRY entry = { 0 };
+	int res = 0;
+	int i;
+
+	if (strlen(key) >= SPEC_CACHE_KEY_LENGTH)
+		return -1;
+
+	strcpy_s(entry.key, SPEC_CACHE_KEY_LENGTH, key);
+	entry.hash = hashPage(data, size);
+	entry.size = size;
+	entry.fetched = entry.used = (long long)time(NULL);
+	if (p_validators)
+		entry.validators = *p_validators;
+
+	AcquireSRWLockExclusive(&(p_cache->lock));
+
+	// Another key may already have the same page
+	if (countPageUsers(p_cache, entry.hash) == 0)
+		res = writePage(p_cache, entry.hash, data, size);
+
+	if (res == 0) {
+		if ((i = findEntry(p_cache, key)) >= 0) {
+			if (p_cache->entries[i].hash == entry.hash) {
+				p_cache->entries[i].fetched = entry.fetched;
+				p_cache->entries[i].used = entry.used;
+				p_cache->entries[i].validators = entry.validators;
+			}
+			else {
+				removeEntry(p_cache, i);
+				res = addEntry(p_cache, &entry);
+			}
+		}
+		else {
+			res = addEntry(p_cache, &entry);
+		}
+	}
+
+	if (res == 0) {
+		p_cache->num_stores++;
+		evictEntries(p_cache);
+		res = saveIndex(p_cache);
+	}
+
+	ReleaseSRWLockExclusive(&(p_cache->lock));
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// refreshSpecCache                                                           //
+//                                                                            //
+// Marks the page cached under 'key' as downloaded just now, after EDB        //
+// answered a request conditional on its validators that it hasn't changed,   //
+// and replaces the validators with 'p_validators', which holds the ones sent //
+// with the request, updated with any in the answer. Returns 0 on success,    //
+// SPEC_CACHE_MISS if nothing is cached under 'key' any more (e.g. it was     //
+// evicted while the request was made), or -1 if the index couldn't be        //
+// written.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int refreshSpecCache(P_SPEC_CACHE p_cache, const char* key,
+                     const PAGE_VALIDATORS* p_validators)
+{
+	long long now = (long long)time(NULL);
+	int res = SPEC_CACHE_MISS;
+	int i;
+
+	AcquireSRWLockExclusive(&(p_cache->lock));
+
+	if ((i = findEntry(p_cache, key)) >= 0) {
+		p_cache->entries[i].fetched = now;
+		p_cache->entries[i].used = now;
+		p_cache->entries[i].validators = *p_validators;
+		p_cache->num_revalidated++;
+		res = saveIndex(p_cache);
+	}
+
+	ReleaseSRWLockExclusive(&(p_cache->lock));
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// removeSpecCache                                                            //
+//                                                                            //
+// Drops the page cached under 'key', if there is one. The download pipeline  //
+// calls this when a page it just cached turns out not to be a spec (see      //
+// runSpecJob() in spec_job.c), e.g. EDB's page for a number it doesn't know, //
+// so the next lookup asks EDB again.                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+void removeSpecCache(P_SPEC_CACHE p_cache, const char* key)
+{
+	int i;
+
+	AcquireSRWLockExclusive(&(p_cache->lock));
+
+	if ((i = findEntry(p_cache, key)) >= 0) {
+		removeEntry(p_cache, i);
+		saveIndex(p_cache);
+	}
+
+	ReleaseSRWLockExclusive(&(p_cache->lock));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// closeSpecCache                                                             //
+//                                                                            //
+// Writes the index if it's changed, e.g. by a read that made a page the most //
+// recently used, and frees the cache. 'p_cache' may be NULL.                 //
+////////////////////////////////////////////////////////////////////////////////
+
+void closeSpecCache(P_SPEC_CACHE p_cache)
+{
+	if (!p_cache)
+		return;
+
+	if (p_cache->dirty)
+		saveIndex(p_cache);
+
+	memFree(p_cache->entries);
+	memFree(p_cache);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// hashPage                                                                   //
+//                                                                            //
+// 64 bit FNV-1a hash of a page, which names its file.                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static unsigned long long hashPage(const char* data, DWORD size)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	DWORD i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getCachePath                                                               //
+//                                                                            //
+// Builds the path of the file called 'name' in the cache directory into      //
+// 'path', which holds MAX_PATH characters.                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static void getCachePath(const SPEC_CACHE* p_cache, const char* name,
+                         char* path)
+{
+	sprintf_s(path, MAX_PATH, "%s\\%s", p_cache->config.dir, name);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getPagePath                                                                //
+//                                                                            //
+// Builds the path of the page with hash 'hash' into 'path', with the         //
+// extension 'ext' ("txt", or "tmp" while it's being written).                //
+////////////////////////////////////////////////////////////////////////////////
+
+static void getPagePath(const SPEC_CACHE* p_cache, unsigned long long hash,
+                        const char* ext, char* path)
+{
+	sprintf_s(path, MAX_PATH, "%s\\%016llx.%s", p_cache->config.dir, hash,
+	          ext);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findEntry                                                                  //
+//                                                                            //
+// Returns the index of the entry for 'key', or -1 if there isn't one.        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int findEntry(const SPEC_CACHE* p_cache, const char* key)
+{
+	int i;
+
+	for (i = 0; i < p_cache->num_entries; i++)
+		if (strcmp(p_cache->entries[i].key, key) == 0)
+			return i;
+
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// countPageUsers                                                             //
+//                                                                            //
+// Returns the number of entries whose page has hash 'hash'.                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int countPageUsers(const SPEC_CACHE* p_cache, unsigned long long hash)
+{
+	int num = 0;
+	int i;
+
+	for (i = 0; i < p_cache->num_entries; i++)
+		if (p_cache->entries[i].hash == hash)
+			num++;
+
+	return num;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addEntry                                                                   //
+//                                                                            //
+// Appends a copy of '*p_entry', growing the entry array if it's full.        //
+// Returns 0 on success, or -1 if memory couldn't be allocated.               //
+////////////////////////////////////////////////////////////////////////////////
+
+static int addEntry(P_SPEC_CACHE p_cache, const SPEC_CACHE_ENTRY* p_entry)
+{
+	if (p_cache->num_entries == p_cache->max_entries) {
+		int new_max = p_cache->max_entries ? p_cache->max_entries * 2 : 64;
+		SPEC_CACHE_ENTRY* p_new;
+
+		p_new = memRealloc(MEM_NETWORK, p_cache->entries,
+		                   sizeof(SPEC_CACHE_ENTRY) * (size_t)new_max);
+		if (!p_new)
+			return -1;
+
+		p_cache->entries = p_new;
+		p_cache->max_entries = new_max;
+	}
+
+	p_cache->entries[p_cache->num_entries++] = *p_entry;
+	p_cache->num_bytes += p_entry->size;
+	p_cache->dirty = TRUE;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// removeEntry                                                                //
+//                                                                            //
+// Removes the entry at 'index', and deletes its page file if no other entry  //
+// uses it. The last entry is moved into its place.                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static void removeEntry(P_SPEC_CACHE p_cache, int index)
+{
+	SPEC_CACHE_ENTRY* p_entry = p_cache->entries + index;
+	char path[MAX_PATH];
+
+	if (countPageUsers(p_cache, p_entry->hash) == 1) {
+		getPagePath(p_cache, p_entry->hash, "txt", path);
+		DeleteFileA(path);
+	}
+
+	p_cache->num_bytes -= p_entry->size;
+	*p_entry = p_cache->entries[--p_cache->num_entries];
+	p_cache->dirty = TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// evictEntries                                                               //
+//                                                                            //
+// Removes the least recently used entries until the pages add up to no more  //
+// than 'max_bytes'. The most recently used entry is always kept, even if     //
+// it's bigger than that on its own. Pages shared by two keys are counted     //
+// twice, so the limit errs on the side of evicting.                          //
+////////////////////////////////////////////////////////////////////////////////
+
+static void evictEntries(P_SPEC_CACHE p_cache)
+{
+	while (p_cache->num_bytes > p_cache->config.max_bytes &&
+	       p_cache->num_entries > 1) {
+		int lru = 0;
+		int i;
+
+		for (i = 1; i < p_cache->num_entries; i++)
+			if (p_cache->entries[i].used < p_cache->entries[lru].used)
+				lru = i;
+
+		removeEntry(p_cache, lru);
+		p_cache->num_evictions++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// readPage                                                                   //
+//                                                                            //
+// Reads the page of '*p_entry' into a new heap buffer of its size. Returns 0 //
+// on success, or a negative value if memory couldn't be allocated, or the    //
+// file is missing, short, or doesn't match the entry's hash.                 //
+////////////////////////////////////////////////////////////////////////////////
+
+static int readPage(const SPEC_CACHE* p_cache, const SPEC_CACHE_ENTRY* p_entry,
+                    char** p_data)
+{
+	char path[MAX_PATH];
+	FILE* fp;
+	char* data;
+	size_t num_read;
+
+	// An empty page still gets a buffer, so NULL always means a miss
+	if ((data = memAlloc(MEM_NETWORK, max(p_entry->size, 1))) == NULL)
+		return -2;
+
+	getPagePath(p_cache, p_entry->hash, "txt", path);
+	if ((fopen_s(&fp, path, "rb")) != 0) {
+		memFree(data);
+		return -3;
+	}
+
+	num_read = fread(data, 1, p_entry->size, fp);
+	fclose(fp);
+
+	if (num_read != p_entry->size ||
+	    hashPage(data, p_entry->size) != p_entry->hash) {
+		memFree(data);
+		return -4;
+	}
+
+	*p_data = data;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writePage                                                                  //
+//                                                                            //
+// Writes a page to the file named by its hash, through a temporary file.     //
+// Returns 0 on success, or a negative value if the file couldn't be written. //
+////////////////////////////////////////////////////////////////////////////////
+
+static int writePage(const SPEC_CACHE* p_cache, unsigned long long hash,
+                     const char* data, DWORD size)
+{
+	char tmp_path[MAX_PATH];
+	char path[MAX_PATH];
+	FILE* fp;
+	size_t num_written;
+
+	getPagePath(p_cache, hash, "tmp", tmp_path);
+	getPagePath(p_cache, hash, "txt", path);
+
+	if ((fopen_s(&fp, tmp_path, "wb")) != 0)
+		return -2;
+
+	num_written = fwrite(data, 1, size, fp);
+	if (fclose(fp) != 0 || num_written != size ||
+	    !MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileA(tmp_path);
+		return -3;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadIndex                                                                  //
+//                                                                            //
+// Reads the index file, one entry per line: the key, the page's hash in hex, //
+// its size, the times it was downloaded and last used, and its validators,   //
+// the Last-Modified time (0 if there's none) and the ETag ("-" if there's    //
+// none). Lines starting with '#' and lines that don't parse are skipped.     //
+// Returns 0 if the index was read or doesn't exist, or -1 if memory couldn't //
+// be allocated.                                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int loadIndex(P_SPEC_CACHE p_cache)
+{
+	char path[MAX_PATH];
+	char line[256];
+	FILE* fp;
+
+	getCachePath(p_cache, "index.txt", path);
+	if ((fopen_s(&fp, path, "r")) != 0)
+		return 0;
+
+	while (fgets(line, sizeof(line), fp)) {
+		SPEC_CACHE_ENTRY entry = { 0 };
+		PAGE_VALIDATORS* p_valid = &(entry.validators);
+
+		if (line[0] == '#')
+			continue;
+
+		// Indexes written before the validators were kept end at 'used'
+		if (sscanf_s(line, "%23s %llx %lu %lld %lld %lld %63s", entry.key,
+		             (unsigned)SPEC_CACHE_KEY_LENGTH, &(entry.hash),
+		             &(entry.size), &(entry.fetched), &(entry.used),
+		             &(p_valid->modified), p_valid->etag,
+		             (unsigned)VSS_ETAG_LENGTH) < 5)
+			continue;
+
+		if (strcmp(p_valid->etag, "-") == 0)
+			p_valid->etag[0] = '\0';
+
+		if (addEntry(p_cache, &entry) != 0) {
+			fclose(fp);
+			return -1;
+		}
+	}
+
+	fclose(fp);
+	p_cache->dirty = FALSE;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// saveIndex                                                                  //
+//                                                                            //
+// Writes the index file (see loadIndex()) through a temporary file. Returns  //
+// 0 on success, or -1 if it couldn't be written, in which case the old index //
+// is left as it was.                                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static int saveIndex(P_SPEC_CACHE p_cache)
+{
+	char tmp_path[MAX_PATH];
+	char path[MAX_PATH];
+	FILE* fp;
+	int res = 0;
+	int i;
+
+	getCachePath(p_cache, "index.tmp", tmp_path);
+	getCachePath(p_cache, "index.txt", path);
+
+	if ((fopen_s(&fp, tmp_path, "w")) != 0)
+		return -1;
+
+	fprintf(fp, "# key hash size fetched used modified etag\n");
+	for (i = 0; i < p_cache->num_entries; i++) {
+		const SPEC_CACHE_ENTRY* p_entry = p_cache->entries + i;
+		const PAGE_VALIDATORS* p_valid = &(p_entry->validators);
+
+		fprintf(fp, "%s %016llx %lu %lld %lld %lld %s\n", p_entry->key,
+		        p_entry->hash, p_entry->size, p_entry->fetched,
+		        p_entry->used, p_valid->modified,
+		        p_valid->etag[0] ? p_valid->etag : "-");
+	}
+
+	if (fclose(fp) != 0 ||
+	    !MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileA(tmp_path);
+		res = -1;
+	}
+	else {
+		p_cache->dirty = FALSE;
+	}
+
+	return res;
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef SPEC_CACHE_H_
+#define SPEC_CACHE_H_
+
+#include <Windows.h>
+
+#include "vss_connect.h"
+
+// Defaults for SPEC_CACHE_CONFIG
+#define SPEC_CACHE_DIR          "spec_cache"
+#define SPEC_CACHE_MAX_BYTES    (64LL * 1024 * 1024)
+#define SPEC_CACHE_MAX_AGE      (7LL * 24 * 60 * 60)    // seconds
+
+// Longest key, including the terminating null (see struct spec)
+#define SPEC_CACHE_KEY_LENGTH   24
+
+// readSpecCache() results
+#define SPEC_CACHE_HIT           0
+#define SPEC_CACHE_STALE         1  // found, but older than 'max_age'
+#define SPEC_CACHE_MISS         -1
+
+// Where the cache is kept and how much of it is kept. A page older than
+// 'max_age' is downloaded again, but if that fails and 'use_stale' is set,
+// the old page is used instead.
+typedef struct spec_cache_config {
+	char dir[MAX_PATH];
+	long long max_bytes;        // pages are evicted past this, LRU first
+	long long max_age;          // seconds
+	BOOL use_stale;
+} SPEC_CACHE_CONFIG;
+
+// One cached page. Pages are stored by the hash of their contents, so keys
+// with the same page share one file.
+typedef struct spec_cache_entry {
+	char key[SPEC_CACHE_KEY_LENGTH];
+	unsigned long long hash;
+	DWORD size;
+	long long fetched;          // time() when it was downloaded or revalidated
+	long long used;             // time() when it was last read or stored
+	PAGE_VALIDATORS validators; // what EDB sent with the page
+} SPEC_CACHE_ENTRY;
+
+typedef struct spec_cache {
+	SPEC_CACHE_CONFIG config;
+	SRWLOCK lock;
+	SPEC_CACHE_ENTRY* entries;
+	int num_entries;
+	int max_entries;
+	long long num_bytes;        // sum of the entries' sizes
+	BOOL dirty;                 // the index file is out of date
+
+	// Counters, since the cache was opened
+	long long num_hits;
+	long long num_stale;
+	long long num_misses;
+	long long num_stores;
+	long long num_revalidated;  // stale pages EDB said hadn't changed
+	long long num_evictions;
+} SPEC_CACHE, * P_SPEC_CACHE;
+
+void getSpecCacheDefaults(SPEC_CACHE_CONFIG* p_config);
+int openSpecCache(const SPEC_CACHE_CONFIG* p_config, P_SPEC_CACHE* pp_cache);
+int readSpecCache(P_SPEC_CACHE p_cache, const char* key, char** p_data,
+                  DWORD* p_size, PAGE_VALIDATORS* p_validators);
+int writeSpecCache(P_SPEC_CACHE p_cache, const char* key, const char* data,
+                   DWORD size, const PAGE_VALIDATORS* p_validators);
+int refreshSpecCache(P_SPEC_CACHE p_cache, const char* key,
+                     const PAGE_VALIDATORS* p_validators);
+void removeSpecCache(P_SPEC_CACHE p_cache, const char* key);
+void closeSpecCache(P_SPEC_CACHE p_cache);
+
+#endif
\ No newline at end of file
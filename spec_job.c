@@ -0,0 +1,350 @@
+////////////////////////////////////////////////////////////////////////////////
+// spec_job.c                                                                 //
+//                                                                            //
+// This TU loads a spec from EDB on a worker thread. The whole of it used to  //
+// run in the main window's BTN_ID_ARROW processing: connectToEDB()           //
+// downloaded the page, the parser read it into the spec arena, and the rule  //
+// set was matched against it and the layout built, while the window stopped  //
+// responding until the download was done or had failed.                      //
+//                                                                            //
+// startSpecJob() now copies the request into a job and starts a thread for   //
+// it, and returns right away. The worker gets the page from the spec cache   //
+// (see spec_cache.c), or downloads it through a VSS_TRANSPORT (see           //
+// vss_connect.h) and caches it. It parses the page into an arena of its own, //
+// matches the rule set and builds the layout, which is everything the window //
+// did up to drawing the spec. It then posts WM_SPECLOADED to the window with //
+// the job. Nothing the worker touches is shared with the window except the   //
+// rule set, the family hash, the switch descriptions, the intern pool and    //
+// the cache, which are read-only while a spec is loaded or locked (see       //
+// intern.c and spec_cache.c).                                                //
+//                                                                            //
+// When WM_SPECLOADED arrives, adoptSpecJob() hands the window the job's      //
+// results, and trades the window's arena for the job's, so the spec is shown //
+// without copying anything. A job is cancelled by setting its flag, which    //
+// the transport polls between reads and the worker checks between steps; the //
+// window doesn't wait for it, it just frees the job when its WM_SPECLOADED   //
+// arrives. The transport is also given a timeout, after which the job gives  //
+// up.                                                                        //
+//                                                                            //
+// Arenas are handed between jobs and the window, so they're allocated with   //
+// arenaCreate(). The arena the window trades away is kept as a spare for the //
+// next job, so as before, loading a spec doesn't usually allocate any arena  //
+// blocks.                                                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "spec_job.h"
+#include "ostool.h"         // for getSwPanel() and getSrcBitmapPos()
+#include "mem_track.h"
+
+static DWORD WINAPI specJobWorker(LPVOID param);
+static int runSpecJob(P_SPEC_JOB p_job);
+static int getSpecPage(P_SPEC_JOB p_job, char** p_buf, DWORD* p_size);
+
+// Jobs whose worker hasn't finished yet
+static volatile LONG num_running = 0;
+
+// An arena left over from an earlier job, or NULL
+static P_SPEC_ARENA volatile p_spare_arena = NULL;
+
+////////////////////////////////////////////////////////////////////////////////
+// startSpecJob                                                               //
+//                                                                            //
+// Starts loading the spec described by 'p_spec' on a worker thread, from     //
+// 'p_cache' or with 'p_transport', and returns the job. 'p_cache' may be     //
+// NULL, and isn't used if the spec has no key. WM_SPECLOADED is posted to    //
+// 'hwnd' when the job is done, whether it succeeded, failed or was           //
+// cancelled. 'p_rules' and 'p_cache' must not be freed until then.           //
+//                                                                            //
+// Returns NULL if the job couldn't be allocated or its thread couldn't be    //
+// started, in which case no message is posted.                               //
+////////////////////////////////////////////////////////////////////////////////
+
+P_SPEC_JOB startSpecJob(HWND hwnd, const struct spec* p_spec,
+                        const struct rule_set* p_rules,
+                        const VSS_TRANSPORT* p_transport,
+                        P_SPEC_CACHE p_cache, DWORD timeout_ms)
+{
+	P_SPEC_JOB p_job;
+	HANDLE h_thread;
+
+	if ((p_job = memCalloc(MEM_NETWORK, 1, sizeof(SPEC_JOB))) == NULL)
+		return NULL;
+
+	p_job->hwnd = hwnd;
+	p_job->spec = *p_spec;
+	p_job->p_rules = p_rules;
+	p_job->p_transport = p_transport;
+	p_job->p_cache = p_spec->key[0] ? p_cache : NULL;
+	p_job->timeout_ms = timeout_ms;
+	clearSrcBitmapPos(p_job->src_bitmap_pos);
+
+	p_job->p_arena = InterlockedExchangePointer((PVOID volatile*)&p_spare_arena,
+	                                            NULL);
+	if (!p_job->p_arena && (p_job->p_arena = arenaCreate()) == NULL) {
+		memFree(p_job);
+		return NULL;
+	}
+
+	InterlockedIncrement(&num_running);
+
+	h_thread = CreateThread(NULL, 0, specJobWorker, p_job, 0, NULL);
+	if (!h_thread) {
+		InterlockedDecrement(&num_running);
+		freeSpecJob(p_job);
+		return NULL;
+	}
+
+	// Nothing waits on the thread itself; see waitSpecJobs()
+	CloseHandle(h_thread);
+	return p_job;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cancelSpecJob                                                              //
+//                                                                            //
+// Asks the job to stop. The worker stops at the next read of the download,   //
+// or before its next step, and posts WM_SPECLOADED with SPEC_JOB_CANCELLED.  //
+// If it had already finished, the message is on its way with the job's       //
+// results, which the window should throw away.                               //
+////////////////////////////////////////////////////////////////////////////////
+
+void cancelSpecJob(P_SPEC_JOB p_job)
+{
+	if (p_job)
+		InterlockedExchange(&p_job->cancelled, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// adoptSpecJob                                                               //
+//                                                                            //
+// Gives the results of a finished job to the window: the variant store,      //
+// switch list, layout and bitmap positions go to '*pp_vars' and 'p_data',    //
+// and the job's arena, which holds them, is traded for '*pp_arena'. The      //
+// window's spec must have been cleared with freeMemory() first. The job      //
+// still has to be freed with freeSpecJob(), which keeps the traded arena for //
+// the next job.                                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+void adoptSpecJob(P_SPEC_JOB p_job, P_SPEC_ARENA* pp_arena,
+                  P_VAR_STORE* pp_vars, P_STATE_DATA p_data)
+{
+	P_SPEC_ARENA p_arena = *pp_arena;
+
+	*pp_arena = p_job->p_arena;
+	p_job->p_arena = p_arena;
+
+	*pp_vars = p_job->p_vars;
+	p_data->p_sw_list = p_job->p_sw_list;
+	p_data->p_layout = p_job->p_layout;
+	memcpy(p_data->src_bitmap_pos, p_job->src_bitmap_pos,
+	       sizeof(p_data->src_bitmap_pos));
+
+	p_job->p_vars = NULL;
+	p_job->p_sw_list = NULL;
+	p_job->p_layout = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeSpecJob                                                                //
+//                                                                            //
+// Frees a job and whatever results it still has. Its arena is reset and kept //
+// as the spare, unless there already is one. 'p_job' may be NULL.            //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeSpecJob(P_SPEC_JOB p_job)
+{
+	if (!p_job)
+		return;
+
+	if (p_job->p_arena) {
+		arenaReset(p_job->p_arena);
+		if (InterlockedCompareExchangePointer((PVOID volatile*)&p_spare_arena,
+		                                      p_job->p_arena, NULL) != NULL)
+			arenaDestroy(p_job->p_arena);
+	}
+
+	memFree(p_job);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// waitSpecJobs                                                               //
+//                                                                            //
+// Waits up to 'timeout_ms' for every job's worker to finish, and then frees  //
+// the spare arena. The window calls this when it's destroyed, after          //
+// cancelling its job, so the rule set isn't freed while a worker is matching //
+// it; a cancelled worker that's still waiting on the network only touches    //
+// its own job. Returns the number of workers still running.                  //
+////////////////////////////////////////////////////////////////////////////////
+
+int waitSpecJobs(DWORD timeout_ms)
+{
+	ULONGLONG start = GetTickCount64();
+
+	while (num_running && GetTickCount64() - start < timeout_ms)
+		Sleep(10);
+
+	arenaDestroy(InterlockedExchangePointer((PVOID volatile*)&p_spare_arena,
+	                                        NULL));
+
+	return (int)num_running;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// specJobWorker                                                              //
+//                                                                            //
+// The worker thread of a job. Runs the job and posts WM_SPECLOADED with it.  //
+// If the window is already gone, the post fails and the job is freed here    //
+// instead. The job belongs to the window once it's posted, so it isn't       //
+// touched afterwards.                                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD WINAPI specJobWorker(LPVOID param)
+{
+	P_SPEC_JOB p_job = param;
+	ULONGLONG start = GetTickCount64();
+
+	p_job->result = runSpecJob(p_job);
+	p_job->elapsed_ms = GetTickCount64() - start;
+
+	if (!PostMessageA(p_job->hwnd, WM_SPECLOADED, 0, (LPARAM)p_job))
+		freeSpecJob(p_job);
+
+	InterlockedDecrement(&num_running);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runSpecJob                                                                 //
+//                                                                            //
+// Gets the job's page (see getSpecPage()), parses and matches it and builds  //
+// its layout, the same steps the BTN_ID_ARROW processing in ostool.c used to //
+// take, and returns one of the SPEC_JOB results. The cancel flag is checked  //
+// between the steps.                                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runSpecJob(P_SPEC_JOB p_job)
+{
+	STATE_DATA data = { 0 };
+	char* buf = NULL;
+	DWORD size = 0;
+	int res;
+
+	if ((res = getSpecPage(p_job, &buf, &size)) != SPEC_JOB_OK)
+		return res;
+
+	if (p_job->cancelled) {
+		memFree(buf);
+		return SPEC_JOB_CANCELLED;
+	}
+
+	// The parser frees the buffer. A page that isn't a spec shouldn't be
+	// served from the cache next time.
+	p_job->p_vars = p_job->spec.parse(buf, size, p_job->p_arena);
+	if (!p_job->p_vars) {
+		if (p_job->p_cache)
+			removeSpecCache(p_job->p_cache, p_job->spec.key);
+		return SPEC_JOB_BAD_SPEC;
+	}
+
+	if (p_job->cancelled)
+		return SPEC_JOB_CANCELLED;
+
+	p_job->match_res = matchRuleSet(&(p_job->p_sw_list), p_job->p_rules,
+	                                p_job->p_vars, p_job->p_arena);
+	if (p_job->match_res)
+		return SPEC_JOB_NO_MATCH;
+
+	// buildSwLayout() reads the list and the zone 4 panel from the state
+	// data, so the job's are put in one of its own
+	p_job->src_bitmap_pos[0] = getSwPanel(p_job->p_vars);
+	data.p_sw_list = p_job->p_sw_list;
+	memcpy(data.src_bitmap_pos, p_job->src_bitmap_pos,
+	       sizeof(data.src_bitmap_pos));
+
+	if (buildSwLayout(&data, p_job->p_arena, &(p_job->p_layout)) != 0)
+		return SPEC_JOB_NO_LAYOUT;
+
+	getSrcBitmapPos(p_job->p_layout, p_job->src_bitmap_pos);
+
+	return SPEC_JOB_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getSpecPage                                                                //
+//                                                                            //
+// Gets the job's page into '*p_buf' and its length into '*p_size', in the    //
+// form connectToEDB() returns them. A fresh page from the cache is used as   //
+// it is. Otherwise the page is downloaded, and cached if that succeeds. A    //
+// stale page's validators make the download conditional; if EDB answers that //
+// the page hasn't changed (VSS_NOT_MODIFIED), the stale page is used and     //
+// made fresh again. If the download fails and the cache had a stale page,    //
+// that page is used instead, and 'stale' is set, unless the job was          //
+// cancelled or the cache is set not to. Returns SPEC_JOB_OK, or the result   //
+// the job fails with.                                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int getSpecPage(P_SPEC_JOB p_job, char** p_buf, DWORD* p_size)
+{
+	const VSS_TRANSPORT* p_transport = p_job->p_transport;
+	FETCH_CTL ctl;
+	PAGE_VALIDATORS validators = { 0 };
+	char* cached = NULL;
+	DWORD cached_size = 0;
+
+	*p_buf = NULL;
+	*p_size = 0;
+
+	p_job->cache_res = SPEC_CACHE_MISS;
+	if (p_job->p_cache)
+		p_job->cache_res = readSpecCache(p_job->p_cache, p_job->spec.key,
+		                                 &cached, &cached_size, &validators);
+
+	if (p_job->cache_res == SPEC_CACHE_HIT) {
+		*p_buf = cached;
+		*p_size = cached_size;
+		return SPEC_JOB_OK;
+	}
+
+	// Without a stale page, there are no validators, and the request
+	// isn't conditional
+	ctl.p_cancel = &p_job->cancelled;
+	ctl.timeout_ms = p_job->timeout_ms;
+	ctl.p_validators = &validators;
+	ctl.p_abort = NULL;
+
+	p_job->fetch_res = p_transport->fetch(p_transport->ctx, p_job->spec.url,
+	                                      &ctl, p_buf, p_size);
+
+	if (p_job->fetch_res == 0) {
+		memFree(cached);
+		if (p_job->p_cache)
+			writeSpecCache(p_job->p_cache, p_job->spec.key, *p_buf,
+			               *p_size, &validators);
+		return SPEC_JOB_OK;
+	}
+
+	if (p_job->fetch_res == VSS_NOT_MODIFIED && cached) {
+		refreshSpecCache(p_job->p_cache, p_job->spec.key, &validators);
+		*p_buf = cached;
+		*p_size = cached_size;
+		return SPEC_JOB_OK;
+	}
+
+	if (cached && p_job->fetch_res != VSS_CANCELLED &&
+	    p_job->p_cache->config.use_stale) {
+		*p_buf = cached;
+		*p_size = cached_size;
+		p_job->stale = TRUE;
+		return SPEC_JOB_OK;
+	}
+
+	memFree(cached);
+
+	if (p_job->fetch_res == VSS_CANCELLED)
+		return SPEC_JOB_CANCELLED;
+	if (p_job->fetch_res == VSS_TIMED_OUT)
+		return SPEC_JOB_TIMED_OUT;
+	return SPEC_JOB_NO_SPEC;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef SPEC_JOB_H_
+#define SPEC_JOB_H_
+
+#include <Windows.h>
+
+#include "ost_data.h"
+#include "spec_arena.h"
+#include "vss_connect.h"
+#include "spec_cache.h"
+#include "sw_layout.h"
+
+// How long a download may take before the job gives up, in ms
+#define SPEC_JOB_TIMEOUT    30000
+
+// How long the window waits for its jobs to stop once it has cancelled
+// them, when it's closed, in ms. A cancelled job gives up on its download
+// at once, but waits up to FLIGHT_GRACE_MS for the download to be joined
+// (see fetch_coalesce.c), which is then cancelled and aborted.
+#define SPEC_JOB_CLOSE_MS   1000
+
+// Job results
+#define SPEC_JOB_OK          0
+#define SPEC_JOB_NO_SPEC    -1  // the download failed; see 'fetch_res'
+#define SPEC_JOB_BAD_SPEC   -2  // the page couldn't be parsed
+#define SPEC_JOB_NO_MATCH   -3  // matchRuleSet() failed; see 'match_res'
+#define SPEC_JOB_NO_LAYOUT  -4  // not enough memory for the layout
+#define SPEC_JOB_CANCELLED  -5
+#define SPEC_JOB_TIMED_OUT  -6
+
+// One spec being loaded on a worker thread. The inputs are copied when the
+// job starts; the results belong to the worker until WM_SPECLOADED (see
+// ost_shared.h) is posted, and to the window afterwards.
+typedef struct spec_job {
+	HWND hwnd;
+	struct spec spec;
+	const struct rule_set* p_rules;
+	const VSS_TRANSPORT* p_transport;
+	P_SPEC_CACHE p_cache;       // NULL to always download
+	DWORD timeout_ms;
+	volatile LONG cancelled;
+
+	int result;
+	int cache_res;              // what readSpecCache() returned
+	int fetch_res;              // what the transport returned
+	BOOL stale;                 // used a stale page, EDB was unreachable
+	int match_res;              // what matchRuleSet() returned
+	ULONGLONG elapsed_ms;
+	P_SPEC_ARENA p_arena;       // holds the store, list and layout
+	P_VAR_STORE p_vars;
+	LL* p_sw_list;
+	const struct sw_layout* p_layout;
+	int src_bitmap_pos[14];
+} SPEC_JOB, * P_SPEC_JOB;
+
+P_SPEC_JOB startSpecJob(HWND hwnd, const struct spec* p_spec,
+                        const struct rule_set* p_rules,
+                        const VSS_TRANSPORT* p_transport,
+                        P_SPEC_CACHE p_cache, DWORD timeout_ms);
+void cancelSpecJob(P_SPEC_JOB p_job);
+void adoptSpecJob(P_SPEC_JOB p_job, P_SPEC_ARENA* pp_arena,
+                  P_VAR_STORE* pp_vars, P_STATE_DATA p_data);
+void freeSpecJob(P_SPEC_JOB p_job);
+int waitSpecJobs(DWORD timeout_ms);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+// sw_desc.c                                                                  //
+//                                                                            //
+// This TU holds the switch descriptions shown in the list view, the conflict //
+// message boxes and the reports written by the command line modes. They come //
+// from the sw_desc_6605.txt resource, a table of part numbers and            //
+// descriptions separated by ';', one per line, ending with the '~' eof       //
+// marker.                                                                    //
+//                                                                            //
+// getSWDesc() used to scan the resource from the top for every lookup,       //
+// copying each line into a buffer and running atoi() on it. Now the resource //
+// is parsed once, when the program starts (see WM_CREATE in ostool.c, and    //
+// tool_mode.c), into a table sorted by part number, and a lookup is a binary //
+// search. The table is process-wide and isn't changed after it's loaded.     //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sw_desc.h"
+#include "resource.h"
+#include "mem_track.h"
+
+static SW_DESC_TABLE desc_table;
+
+////////////////////////////////////////////////////////////////////////////////
+// compareDescs                                                               //
+//                                                                            //
+// qsort() comparison function for SW_DESC entries, by part number.           //
+////////////////////////////////////////////////////////////////////////////////
+
+static int compareDescs(const void* a, const void* b)
+{
+	int pn_a = ((const SW_DESC*)a)->pn;
+	int pn_b = ((const SW_DESC*)b)->pn;
+
+	return (pn_a > pn_b) - (pn_a < pn_b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loadSwDescs                                                                //
+//                                                                            //
+// Parses the description resource into the process-wide table. The text is   //
+// copied once, with each line's '\n' replaced by '\0', and each entry points //
+// into the copy. Calling it again once the table is loaded does nothing.     //
+//                                                                            //
+// Returns 0 on success, -1 if memory couldn't be allocated, -2 if the        //
+// resource couldn't be loaded, or -3 if a line has no ';'.                   //
+////////////////////////////////////////////////////////////////////////////////
+
+int loadSwDescs(void)
+{
+	HRSRC hrsrc;
+	HGLOBAL hglobal;
+	const char* res;
+	const char* end;
+	char* c;
+	int num_lines = 0;
+	int n = 0;
+
+	if (desc_table.entries)
+		return 0;
+
+	hrsrc = FindResourceA(NULL, MAKEINTRESOURCEA(IDR_CSV1), "CSV");
+	if (hrsrc == NULL)
+		return -2;
+	if ((hglobal = LoadResource(NULL, hrsrc)) == NULL)
+		return -2;
+	if ((res = LockResource(hglobal)) == NULL)
+		return -2;
+
+	for (end = res; *end != '~'; end++)
+		if (*end == '\n')
+			num_lines++;
+
+	desc_table.text = memAlloc(MEM_RULES, (size_t)(end - res) + 1);
+	desc_table.entries = memAlloc(MEM_RULES, sizeof(SW_DESC) *
+	                              ((size_t)num_lines + 1));
+	if (!desc_table.text || !desc_table.entries) {
+		freeSwDescs();
+		return -1;
+	}
+
+	memcpy(desc_table.text, res, (size_t)(end - res));
+	desc_table.text[end - res] = '\0';
+
+	c = desc_table.text;
+	while (*c) {
+		char* line = c;
+
+		while (*c && *c != '\n')
+			c++;
+		if (c > line && c[-1] == '\r')
+			c[-1] = '\0';
+		if (*c)
+			*c++ = '\0';
+
+		// Skip blank lines, such as one before the eof marker
+		if (*line == '\0')
+			continue;
+
+		if (strchr(line, ';') == NULL) {
+			freeSwDescs();
+			return -3;
+		}
+
+		desc_table.entries[n].pn = atoi(line);
+		desc_table.entries[n].desc = strchr(line, ';') + 1;
+		n++;
+	}
+
+	desc_table.num_entries = n;
+	qsort(desc_table.entries, n, sizeof(SW_DESC), compareDescs);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// freeSwDescs                                                                //
+//                                                                            //
+// Frees the description table. Safe to call if it was never loaded.          //
+////////////////////////////////////////////////////////////////////////////////
+
+void freeSwDescs(void)
+{
+	memFree(desc_table.entries);
+	memFree(desc_table.text);
+	memset(&desc_table, 0, sizeof(SW_DESC_TABLE));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findSwDesc                                                                 //
+//                                                                            //
+// Returns the description of part number 'pn', or NULL if it isn't in the    //
+// table (or the table isn't loaded).                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+const char* findSwDesc(int pn)
+{
+	int lo = 0;
+	int hi = desc_table.num_entries - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		int mid_pn = desc_table.entries[mid].pn;
+
+		if (mid_pn == pn)
+			return desc_table.entries[mid].desc;
+
+		if (mid_pn < pn)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getSWDesc                                                                  //
+//                                                                            //
+// Copies the description of part number 'pn' into the buffer pointed to by   //
+// desc. If there's no description for it, desc is set to an empty string.    //
+////////////////////////////////////////////////////////////////////////////////
+
+void getSWDesc(char* desc, int desc_size, int pn)
+{
+	const char* p_desc;
+
+	if (!desc || desc_size <= 0)
+		return;
+
+	*desc = '\0';
+
+	if ((p_desc = findSwDesc(pn)) != NULL)
+		strncpy_s(desc, desc_size, p_desc, _TRUNCATE);
+}
\ No newline at end of file
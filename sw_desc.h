@@ -0,0 +1,25 @@
+#ifndef SW_DESC_H_
+#define SW_DESC_H_
+
+#include <Windows.h>
+
+// A switch part number and its description from sw_desc_6605.txt
+typedef struct sw_desc {
+	int pn;
+	const char* desc;
+} SW_DESC;
+
+// The parsed description resource, sorted by part number. 'text' holds
+// every description, each terminated with '\0'.
+typedef struct sw_desc_table {
+	struct sw_desc* entries;
+	int num_entries;
+	char* text;
+} SW_DESC_TABLE, * P_SW_DESC_TABLE;
+
+int loadSwDescs(void);
+void freeSwDescs(void);
+const char* findSwDesc(int pn);
+void getSWDesc(char* desc, int desc_size, int pn);
+
+#endif
\ No newline at end of file
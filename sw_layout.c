@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////////////
+// sw_layout.c                                                                //
+//                                                                            //
+// This TU builds the layout snapshot of the spec being displayed. The switch //
+// list (see parse_switch.c) is a linked list, which is the right shape for   //
+// building it, since switches are inserted in location order and removed     //
+// again by later csv lines. It's the wrong shape for reading it: the list    //
+// view used to walk it to fill the list box, then read the list box text     //
+// back to flag conflicts, and the main window walked it again on every       //
+// selection to find the selected switch's location.                          //
+//                                                                            //
+// Once a spec is matched, buildSwLayout() copies the list into an array, in  //
+// list order, with everything the views need already worked out: the         //
+// description of each switch, its list box text, and whether it conflicts    //
+// with a neighbor or the zone 4 panel. The array is indexed the same way as //
+// the list box, so a selection or a repaint is a single lookup. The snapshot //
+// is allocated from the spec arena (see spec_arena.c), so it's released with //
+// the rest of the spec, and nothing changes it in between.                   //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+
+#include "sw_layout.h"
+#include "sw_desc.h"       // For getSWDesc()
+#include "ost_shared.h"    // For panelConflict()
+
+////////////////////////////////////////////////////////////////////////////////
+// buildSwLayout                                                              //
+//                                                                            //
+// Builds the layout snapshot of 'p_data->p_sw_list' in 'p_arena'. The zone 4 //
+// panel ('p_data->src_bitmap_pos[0]') must already be set, since the         //
+// conflict flags depend on it.                                               //
+//                                                                            //
+// Two switches conflict if they're in the same location; since the list is   //
+// in location order, those are always neighbors. A switch also conflicts if //
+// panelConflict() says it can't be placed with the zone 4 panel.             //
+//                                                                            //
+// Returns 0 on success, -1 if there's no switch list, or -2 if memory        //
+// couldn't be allocated.                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+int buildSwLayout(P_STATE_DATA p_data, P_SPEC_ARENA p_arena,
+                  const SW_LAYOUT** pp_layout)
+{
+	P_SW_LAYOUT p_layout;
+	LL_elem* p_elem;
+	int i;
+
+	*pp_layout = NULL;
+
+	if (!p_data->p_sw_list)
+		return -1;
+
+	if ((p_layout = arenaAlloc(p_arena, sizeof(SW_LAYOUT))) == NULL)
+		return -2;
+
+	p_layout->num_entries = LL_Size(p_data->p_sw_list);
+	p_layout->entries = arenaAlloc(p_arena, sizeof(SW_ENTRY) *
+	                               ((size_t)p_layout->num_entries + 1));
+	if (!p_layout->entries) {
+		arenaRelease(p_arena, p_layout);
+		return -2;
+	}
+
+	p_elem = LL_Head(p_data->p_sw_list);
+	for (i = 0; i < p_layout->num_entries; i++) {
+		const SW_link* p_link = LL_Data(p_elem);
+		SW_ENTRY* p_entry = p_layout->entries + i;
+
+		p_entry->loc = p_link->loc;
+		p_entry->pn = p_link->pn;
+		p_entry->vars = p_link->vars;
+		p_entry->conflict = panelConflict(p_link->loc, p_data);
+
+		getSWDesc(p_entry->desc, SW_DESC_LENGTH, p_link->pn);
+		sprintf_s(p_entry->text, SW_TEXT_LENGTH, "%d\t%s", p_entry->loc,
+		          p_entry->desc);
+
+		if (i > 0 && p_entry[-1].loc == p_entry->loc)
+			p_entry[-1].conflict = p_entry->conflict = TRUE;
+
+		p_elem = LL_Next(p_elem);
+	}
+
+	*pp_layout = p_layout;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getSwEntry                                                                 //
+//                                                                            //
+// Returns the switch at list box index 'index', or NULL if there's no layout //
+// or no such switch.                                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+const SW_ENTRY* getSwEntry(const SW_LAYOUT* p_layout, int index)
+{
+	if (!p_layout || index < 0 || index >= p_layout->num_entries)
+		return NULL;
+
+	return p_layout->entries + index;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef SW_LAYOUT_H_
+#define SW_LAYOUT_H_
+
+#include "ost_data.h"
+#include "spec_arena.h"
+
+#define SW_DESC_LENGTH      50
+#define SW_TEXT_LENGTH      60
+
+// One switch of the layout, in switch list order (ascending location).
+// 'text' is the list box line: the location and description, separated
+// by a tab.
+typedef struct sw_entry {
+	int loc;
+	int pn;
+	const char* vars;
+	BOOL conflict;    // shares its location, or doesn't fit the panel
+	char desc[SW_DESC_LENGTH];
+	char text[SW_TEXT_LENGTH];
+} SW_ENTRY;
+
+// The switches of the spec being displayed, indexed the same way as the
+// list box. Built once when the spec is matched, and never changed after.
+typedef struct sw_layout {
+	int num_entries;
+	struct sw_entry* entries;
+} SW_LAYOUT, * P_SW_LAYOUT;
+
+int buildSwLayout(P_STATE_DATA p_data, P_SPEC_ARENA p_arena,
+                  const SW_LAYOUT** pp_layout);
+const SW_ENTRY* getSwEntry(const SW_LAYOUT* p_layout, int index);
+
+#endif
\ No newline at end of file
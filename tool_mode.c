@@ -0,0 +1,719 @@
+////////////////////////////////////////////////////////////////////////////////
+// tool_mode.c                                                                //
+//                                                                            //
+// This TU contains the command line modes of the program. When OSTool.exe is //
+// started with a command line, WinMain() hands it to runToolMode() instead   //
+// of creating the main window. The command line modes check the embedded     //
+// resource files and the compiled switch rules offline, e.g.:                //
+//                                                                            //
+// OSTool.exe /conflicts rule_conflicts.txt                                   //
+// OSTool.exe /nearmiss "VSS numbers"                                         //
+// OSTool.exe /solve solve_query.txt                                          //
+// OSTool.exe /selectivity "VSS numbers"                                      //
+// OSTool.exe /dag "VSS numbers"                                              //
+// OSTool.exe /loadbench "VSS numbers"                                        //
+// OSTool.exe /fetchbench fetch_urls.txt                                      //
+// OSTool.exe /prefetch prefetch_list.txt 8                                   //
+// OSTool.exe /record prefetch_list.txt                                       //
+// OSTool.exe /replaybench prefetch_list.txt                                  //
+// OSTool.exe /faultcheck fault_check.txt                                     //
+// OSTool.exe /httpcheck "VSS numbers"                                        //
+//                                                                            //
+// Each mode is an entry in the 'tool_modes' table below: its name, the       //
+// argument it uses when none is given, and the function that runs it. The    //
+// function returns 0 on success, which becomes the exit code of the program. //
+// Errors are reported with a message box, the same way the main window       //
+// reports them.                                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tool_mode.h"
+#include "rule_set.h"
+#include "rule_audit.h"
+#include "rule_stats.h"
+#include "rule_dag.h"
+#include "near_miss.h"
+#include "layout_solver.h"
+#include "sw_desc.h"
+#include "intern.h"
+#include "fam_hash.h"
+#include "vss_connect.h"
+#include "spec_job.h"
+#include "spec_cache.h"
+#include "prefetch.h"
+#include "fetch_replay.h"
+#include "fetch_coalesce.h"
+#include "fetch_fault.h"
+#include "http_server.h"
+
+static int runConflictAudit(const char* arg, const char* opt);
+static int runNearMissReport(const char* arg, const char* opt);
+static int runSolveQuery(const char* arg, const char* opt);
+static int runSelectivity(const char* arg, const char* opt);
+static int runDagReport(const char* arg, const char* opt);
+static int runLoadBench(const char* arg, const char* opt);
+static int runFetchBench(const char* arg, const char* opt);
+static int runPrefetchList(const char* arg, const char* opt);
+static int runRecordList(const char* arg, const char* opt);
+static int runReplayBench(const char* arg, const char* opt);
+static int runFaultCheck(const char* arg, const char* opt);
+static int runHttpCheck(const char* arg, const char* opt);
+
+static const struct tool_mode tool_modes[] = {
+	{ "conflicts",   "rule_conflicts.txt", runConflictAudit },
+	{ "nearmiss",    "VSS numbers",        runNearMissReport },
+	{ "solve",       "solve_query.txt",    runSolveQuery },
+	{ "selectivity", "VSS numbers",        runSelectivity },
+	{ "dag",         "VSS numbers",        runDagReport },
+	{ "loadbench",   "VSS numbers",        runLoadBench },
+	{ "fetchbench",  "fetch_urls.txt",     runFetchBench },
+	{ "prefetch",    "prefetch_list.txt",  runPrefetchList },
+	{ "record",      "prefetch_list.txt",  runRecordList },
+	{ "replaybench", "prefetch_list.txt",  runReplayBench },
+	{ "faultcheck",  "fault_check.txt",    runFaultCheck },
+	{ "httpcheck",   "VSS numbers",        runHttpCheck },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// runConflictAudit                                                           //
+//                                                                            //
+// Finds every pair of switch rules that can put two switches in the same     //
+// location (see rule_audit.c) and writes them to the file named by 'arg'.    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runConflictAudit(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	P_CONFLICT_SET p_set = NULL;
+	int res;
+
+	(void)opt;
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Rule Conflicts", MB_ICONERROR);
+		return res;
+	}
+
+	// The report lists each switch's description; without them it's
+	// still complete, so a failure here isn't an error
+	loadSwDescs();
+
+	if ((res = findRuleConflicts(p_rules, &p_set)) != 0) {
+		MessageBoxA(NULL, "Not enough memory to check the switch rules!",
+		            "Rule Conflicts", MB_ICONERROR);
+		freeRuleSet(p_rules);
+		return res;
+	}
+
+	if ((res = writeConflictReport(p_rules, p_set, arg)) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Rule Conflicts", MB_ICONERROR);
+
+	freeRuleConflicts(p_set);
+	freeSwDescs();
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runNearMissReport                                                          //
+//                                                                            //
+// Finds the rules that are one or two variants from firing (see near_miss.c) //
+// for the spec file named by 'arg', or for each spec file in it if it's a    //
+// directory, and writes them to near_miss.txt in the current directory.      //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runNearMissReport(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	int res;
+
+	(void)opt;
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Near Misses", MB_ICONERROR);
+		return res;
+	}
+
+	// As with the conflicts, the descriptions are only a help
+	loadSwDescs();
+
+	if ((res = writeNearMissReport(p_rules, arg, "near_miss.txt")) == -1)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Near Misses", MB_ICONERROR);
+	else if (res == -2)
+		MessageBoxA(NULL, "Couldn't read the spec files!",
+		            "Near Misses", MB_ICONERROR);
+	else if (res != 0)
+		MessageBoxA(NULL, "Not enough memory to find the near misses!",
+		            "Near Misses", MB_ICONERROR);
+
+	freeSwDescs();
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runSolveQuery                                                              //
+//                                                                            //
+// Reads a layout query from the file named by 'arg' (see readSolveQuery()),  //
+// solves it for each spec it names (see layout_solver.c), and writes the     //
+// variants each spec needs and the time it took to solve_report.txt in the   //
+// current directory.                                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runSolveQuery(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	LAYOUT_QUERY query;
+	int res;
+
+	(void)opt;
+
+	if ((res = readSolveQuery(arg, &query)) != 0) {
+		MessageBoxA(NULL, res == -1 ? "Couldn't read the query file!" :
+		            "Couldn't read the targets in the query file!",
+		            "Layout Solver", MB_ICONERROR);
+		return res;
+	}
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Layout Solver", MB_ICONERROR);
+		return res;
+	}
+
+	loadSwDescs();
+
+	if ((res = writeSolveReport(p_rules, &query, "solve_report.txt")) == -1)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Layout Solver", MB_ICONERROR);
+	else if (res == -2)
+		MessageBoxA(NULL, "Couldn't read the spec files!",
+		            "Layout Solver", MB_ICONERROR);
+	else if (res != 0)
+		MessageBoxA(NULL, "Not enough memory to solve the query!",
+		            "Layout Solver", MB_ICONERROR);
+
+	freeSwDescs();
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runSelectivity                                                             //
+//                                                                            //
+// Measures the rule set over the spec files in the directory named by 'arg'  //
+// (see rule_stats.c). Three files are written to the current directory:      //
+// selectivity.txt, with the expected and measured term checks per spec and   //
+// the time per spec, sym_freq_6605.txt, with the symbol counts of the        //
+// corpus, and fam_codes_6605.txt, with its variant families. Copying the     //
+// latter two over the files in the resource directory and rebuilding updates //
+// the term order the rule set is compiled with and the families the family   //
+// hash is built from (see fam_hash.c).                                       //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runSelectivity(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	P_CORPUS_STATS p_stats = NULL;
+	int res;
+
+	(void)opt;
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Selectivity", MB_ICONERROR);
+		return res;
+	}
+
+	if ((res = measureCorpus(p_rules, arg, &p_stats)) != 0) {
+		MessageBoxA(NULL, "Couldn't read the spec files!",
+		            "Selectivity", MB_ICONERROR);
+		freeRuleSet(p_rules);
+		return res;
+	}
+
+	if ((res = writeSelectivityReport(p_rules, p_stats, "selectivity.txt")) != 0 ||
+	    (res = writeSymbolFrequencies(p_rules, p_stats, "sym_freq_6605.txt")) != 0 ||
+	    (res = writeFamilyCodes(p_stats, "fam_codes_6605.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report files!",
+		            "Selectivity", MB_ICONERROR);
+
+	freeCorpusStats(p_stats);
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runDagReport                                                               //
+//                                                                            //
+// Builds the decision diagrams (see rule_dag.c) and measures them over the   //
+// spec files in the directory named by 'arg', twice: once with the diagrams  //
+// that pay off, the ones matchRuleSet() would use, and once with every       //
+// diagram that fits, whether it pays off or not. The node counts, the symbol //
+// tests and time per spec of each, and the number of specs where a diagram   //
+// fires different rules than evalRules() are written to rule_dag.txt in the  //
+// current directory. Returns 1 if there are any such specs.                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runDagReport(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	P_RULE_DAG p_dag;
+	P_RULE_DAG p_all_dag = NULL;
+	P_CORPUS_STATS p_stats = NULL;
+	P_CORPUS_STATS p_all_stats = NULL;
+	int res;
+
+	(void)opt;
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Rule DAG", MB_ICONERROR);
+		return res;
+	}
+
+	// The rule set frees its diagrams. A keep ratio this large keeps
+	// every diagram that fits.
+	if ((res = buildRuleDag(p_rules, DAG_KEEP_RATIO, &p_rules->p_dag)) != 0 ||
+	    (res = buildRuleDag(p_rules, 1e9, &p_all_dag)) != 0) {
+		MessageBoxA(NULL, "Not enough memory to build the diagrams!",
+		            "Rule DAG", MB_ICONERROR);
+		freeRuleSet(p_rules);
+		return res;
+	}
+
+	// The second pass swaps the diagrams into the rule set
+	p_dag = p_rules->p_dag;
+	if ((res = measureCorpus(p_rules, arg, &p_stats)) == 0) {
+		p_rules->p_dag = p_all_dag;
+		res = measureCorpus(p_rules, arg, &p_all_stats);
+		p_rules->p_dag = p_dag;
+	}
+
+	if (res)
+		MessageBoxA(NULL, "Couldn't read the spec files!",
+		            "Rule DAG", MB_ICONERROR);
+	else if ((res = writeDagReport(p_rules, p_stats, p_all_dag, p_all_stats,
+	                               "rule_dag.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Rule DAG", MB_ICONERROR);
+
+	// A diagram that fires different rules is a bug, not a statistic
+	if (res == 0 && (p_stats->num_dag_mismatches ||
+	                 p_all_stats->num_dag_mismatches))
+		res = 1;
+
+	freeCorpusStats(p_stats);
+	freeCorpusStats(p_all_stats);
+	freeRuleDag(p_all_dag);
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runLoadBench                                                               //
+//                                                                            //
+// Loads every spec file in the directory named by 'arg' from the heap and    //
+// from a spec arena (see measureLoads() in rule_stats.c), and writes the     //
+// allocation counts and times of both to load_bench.txt in the current       //
+// directory.                                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runLoadBench(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	LOAD_STATS stats;
+	int res;
+
+	(void)opt;
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Load Benchmark", MB_ICONERROR);
+		return res;
+	}
+
+	if ((res = measureLoads(p_rules, arg, &stats)) != 0)
+		MessageBoxA(NULL, "Couldn't read the spec files!",
+		            "Load Benchmark", MB_ICONERROR);
+	else if ((res = writeLoadReport(&stats, "load_bench.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Load Benchmark", MB_ICONERROR);
+
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runFetchBench                                                              //
+//                                                                            //
+// Looks up the URLs listed in the file named by 'arg' with a new session per //
+// lookup, through one session, and through one session without compression   //
+// (see measureFetches() in vss_connect.c), and writes the times of all       //
+// three, and whether the pages matched with and without compression, to      //
+// fetch_bench.txt in the current directory.                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runFetchBench(const char* arg, const char* opt)
+{
+	// Too large for the stack
+	static FETCH_BENCH bench;
+	int res;
+
+	(void)opt;
+
+	if ((res = measureFetches(arg, &bench)) != 0)
+		MessageBoxA(NULL, (res == -1) ? "Couldn't read the URL list!" :
+		            "Couldn't open an internet session!",
+		            "Fetch Benchmark", MB_ICONERROR);
+	else if ((res = writeFetchReport(&bench, "fetch_bench.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Fetch Benchmark", MB_ICONERROR);
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runPrefetchList                                                            //
+//                                                                            //
+// runPrefetchList                                                            //
+//                                                                            //
+// Loads the VSS and order numbers listed in the file named by 'arg' into the //
+// spec cache, several at a time (see prefetch.c), so the main window finds   //
+// them there afterwards. 'opt' is the number of downloads at a time, from 1  //
+// to MAX_PREFETCH_CONNS, or "" for PREFETCH_CONNS; WinInet is allowed as     //
+// many connections to EDB. The result of each is written to                  //
+// prefetch_report.txt in the current directory. Returns 1 if any of them     //
+// couldn't be loaded.                                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runPrefetchList(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	P_SPEC_CACHE p_cache = NULL;
+	P_EDB_SESSION p_session = NULL;
+	P_FETCH_COALESCER p_flights = NULL;
+	P_PREFETCH_RUN p_run = NULL;
+	long num_conns = PREFETCH_CONNS;
+	int res;
+
+	if (opt[0]) {
+		char* end;
+
+		num_conns = strtol(opt, &end, 10);
+		if (*end || num_conns < 1 || num_conns > MAX_PREFETCH_CONNS) {
+			MessageBoxA(NULL, "The number of downloads at a time must be "
+			            "from 1 to 16!", "Prefetch", MB_ICONERROR);
+			return -1;
+		}
+	}
+
+	if ((res = readPrefetchList(arg, &p_run)) != 0) {
+		MessageBoxA(NULL, "Couldn't read the list of numbers!",
+		            "Prefetch", MB_ICONERROR);
+		return res;
+	}
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Prefetch", MB_ICONERROR);
+		freePrefetch(p_run);
+		return res;
+	}
+
+	// Without the cache there's nowhere to put the specs
+	if ((res = openSpecCache(NULL, &p_cache)) != 0 ||
+	    (res = openEdbSession(SPEC_JOB_TIMEOUT, &p_session)) != 0) {
+		MessageBoxA(NULL, p_cache ? "Couldn't open an internet session!" :
+		            "Couldn't open the spec cache!",
+		            "Prefetch", MB_ICONERROR);
+		closeSpecCache(p_cache);
+		freeRuleSet(p_rules);
+		freePrefetch(p_run);
+		return res;
+	}
+
+	setMaxEdbConnections((DWORD)num_conns);
+
+	// A number listed twice is downloaded once, if its jobs overlap
+	if (openFetchCoalescer(&(p_session->transport), &p_flights) != 0) {
+		MessageBoxA(NULL, "Not enough memory!", "Prefetch", MB_ICONERROR);
+		closeEdbSession(p_session);
+		closeSpecCache(p_cache);
+		freeRuleSet(p_rules);
+		freePrefetch(p_run);
+		return -1;
+	}
+
+	if ((res = runPrefetch(p_run, (int)num_conns, p_rules,
+	                       &(p_flights->transport), p_cache)) != 0)
+		MessageBoxA(NULL, "Couldn't start the downloads!",
+		            "Prefetch", MB_ICONERROR);
+	else if ((res = writePrefetchReport(p_run, "prefetch_report.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Prefetch", MB_ICONERROR);
+	else if (p_run->num_failed)
+		res = 1;
+
+	// Frees the arena the last job left behind
+	waitSpecJobs(SPEC_JOB_TIMEOUT);
+	closeFetchCoalescer(p_flights);
+	closeEdbSession(p_session);
+	closeSpecCache(p_cache);
+	freeRuleSet(p_rules);
+	freePrefetch(p_run);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runRecordList                                                              //
+//                                                                            //
+// Loads the VSS and order numbers listed in the file named by 'arg' from     //
+// EDB, PREFETCH_CONNS at a time, the way /prefetch does, and records every   //
+// lookup to the REPLAY_DIR directory (see fetch_replay.c), replacing any     //
+// earlier recording. The spec cache isn't used, so every number is           //
+// downloaded. The result of each is written to record_report.txt in the      //
+// current directory. Returns 1 if any of them couldn't be loaded.            //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runRecordList(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	P_EDB_SESSION p_session = NULL;
+	P_FETCH_RECORDER p_rec = NULL;
+	P_PREFETCH_RUN p_run = NULL;
+	int res;
+
+	(void)opt;
+
+	if ((res = readPrefetchList(arg, &p_run)) != 0) {
+		MessageBoxA(NULL, "Couldn't read the list of numbers!",
+		            "Record", MB_ICONERROR);
+		return res;
+	}
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Record", MB_ICONERROR);
+		freePrefetch(p_run);
+		return res;
+	}
+
+	if ((res = openEdbSession(SPEC_JOB_TIMEOUT, &p_session)) != 0 ||
+	    (res = openFetchRecorder(REPLAY_DIR, &(p_session->transport),
+	                             &p_rec)) != 0) {
+		MessageBoxA(NULL, p_session ? "Couldn't start the recording!" :
+		            "Couldn't open an internet session!",
+		            "Record", MB_ICONERROR);
+		closeEdbSession(p_session);
+		freeRuleSet(p_rules);
+		freePrefetch(p_run);
+		return res;
+	}
+
+	setMaxEdbConnections(PREFETCH_CONNS);
+
+	if ((res = runPrefetch(p_run, PREFETCH_CONNS, p_rules,
+	                       &(p_rec->transport), NULL)) != 0)
+		MessageBoxA(NULL, "Couldn't start the downloads!",
+		            "Record", MB_ICONERROR);
+	else if ((res = writePrefetchReport(p_run, "record_report.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Record", MB_ICONERROR);
+	else if (p_run->num_failed)
+		res = 1;
+
+	// Frees the arena the last job left behind
+	waitSpecJobs(SPEC_JOB_TIMEOUT);
+	closeFetchRecorder(p_rec);
+	closeEdbSession(p_session);
+	freeRuleSet(p_rules);
+	freePrefetch(p_run);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runReplayBench                                                             //
+//                                                                            //
+// Loads the VSS and order numbers listed in the file named by 'arg' from the //
+// recording /record made of them, without a network, under each replay       //
+// profile, one at a time and PREFETCH_CONNS at a time (see measureReplay()   //
+// in fetch_replay.c), and writes the times of every run to replay_bench.txt  //
+// in the current directory.                                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runReplayBench(const char* arg, const char* opt)
+{
+	P_RULE_SET p_rules = NULL;
+	REPLAY_BENCH bench;
+	int res;
+
+	(void)opt;
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "Replay Benchmark", MB_ICONERROR);
+		return res;
+	}
+
+	if ((res = measureReplay(arg, REPLAY_DIR, p_rules, &bench)) != 0)
+		MessageBoxA(NULL, (res == -1) ? "Couldn't read the list of numbers!" :
+		            (res == -2) ? "Couldn't load the recording!" :
+		            "Couldn't start the loads!",
+		            "Replay Benchmark", MB_ICONERROR);
+	else if ((res = writeReplayReport(&bench, "replay_bench.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Replay Benchmark", MB_ICONERROR);
+
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runFaultCheck                                                              //
+//                                                                            //
+// Checks that EDB lookups follow their FETCH_POLICY against a stand-in       //
+// server that fails and stalls on purpose (see fetch_fault.c), without a     //
+// network, and writes the result of each check to the file named by 'arg'.   //
+// Returns 1 if any of them failed.                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runFaultCheck(const char* arg, const char* opt)
+{
+	FAULT_REPORT report;
+	int res;
+
+	(void)opt;
+
+	if ((res = runFaultChecks(&report)) != 0)
+		MessageBoxA(NULL, "Couldn't open an internet session!",
+		            "Fault Check", MB_ICONERROR);
+	else if ((res = writeFaultReport(&report, arg)) != 0)
+		MessageBoxA(NULL, "Couldn't write the report file!",
+		            "Fault Check", MB_ICONERROR);
+	else if (report.num_failed)
+		res = 1;
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runHttpCheck                                                               //
+//                                                                            //
+// Serves the pages in the directory named by 'arg' from a stand-in HTTP      //
+// server, looks them up through EDB sessions, and checks that the            //
+// connections are kept alive, that the pages sent compressed decode to the   //
+// same bytes, that revalidating a page is answered 304, and that the specs   //
+// among them can be prefetched from the server while it's slow and failing   //
+// (see http_server.c). The checks are written to http_check.txt, and the     //
+// lookups to fetch_bench.txt as /fetchbench writes them, in the current      //
+// directory. Returns 1 if a check failed.                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int runHttpCheck(const char* arg, const char* opt)
+{
+	// Too large for the stack
+	static HTTP_REPORT report;
+	P_RULE_SET p_rules = NULL;
+	int res;
+
+	(void)opt;
+
+	if ((res = compileRuleSet(&p_rules)) != 0) {
+		MessageBoxA(NULL, "Couldn't compile the switch rules!",
+		            "HTTP Check", MB_ICONERROR);
+		return res;
+	}
+
+	if ((res = runHttpChecks(arg, p_rules, &report)) != 0)
+		MessageBoxA(NULL, (res == -3) ? "Couldn't read the pages!" :
+		            (res == -4) ? "Couldn't open an internet session!" :
+		            (res == -5) ? "Couldn't start the prefetch!" :
+		            "Couldn't start the stand-in server!",
+		            "HTTP Check", MB_ICONERROR);
+	else if ((res = writeHttpReport(&report, "http_check.txt")) != 0 ||
+	         (res = writeFetchReport(&(report.bench), "fetch_bench.txt")) != 0)
+		MessageBoxA(NULL, "Couldn't write the report files!",
+		            "HTTP Check", MB_ICONERROR);
+	else if (report.num_failed)
+		res = 1;
+
+	freeRuleSet(p_rules);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// runToolMode                                                                //
+//                                                                            //
+// runToolMode                                                                //
+//                                                                            //
+// Parses the command line ("/name" followed by an optional argument, which   //
+// may be quoted, and an optional option after it, e.g. the number of         //
+// downloads at a time for /prefetch) and runs the matching mode. The family  //
+// hash (see fam_hash.c) is built before the mode runs, the same way          //
+// WM_CREATE builds it, and it and the strings the mode interned (see         //
+// intern.c) are freed after it returns. Returns the mode's result, or -1 if  //
+// the mode isn't known.                                                      //
+////////////////////////////////////////////////////////////////////////////////
+
+int runToolMode(const char* cmd_line)
+{
+	char name[32] = { 0 };
+	char arg[MAX_PATH] = { 0 };
+	char opt[32] = { 0 };
+	const char* c = cmd_line;
+	int i;
+
+	while (*c == ' ')
+		c++;
+	if (*c == '/' || *c == '-')
+		c++;
+
+	for (i = 0; *c && *c != ' ' && i < (int)sizeof(name) - 1; i++)
+		name[i] = *c++;
+
+	while (*c == ' ')
+		c++;
+
+	if (*c == '"') {
+		c++;
+		for (i = 0; *c && *c != '"' && i < MAX_PATH - 1; i++)
+			arg[i] = *c++;
+		if (*c == '"')
+			c++;
+	}
+	else {
+		for (i = 0; *c && *c != ' ' && i < MAX_PATH - 1; i++)
+			arg[i] = *c++;
+	}
+
+	while (*c == ' ')
+		c++;
+
+	for (i = 0; *c && *c != ' ' && i < (int)sizeof(opt) - 1; i++)
+		opt[i] = *c++;
+
+	for (i = 0; i < (int)(sizeof(tool_modes) / sizeof(tool_modes[0])); i++) {
+		if (_stricmp(name, tool_modes[i].name) == 0) {
+			const char* mode_arg = arg[0] ? arg : tool_modes[i].default_arg;
+			int res;
+
+			loadFamHash();
+			res = tool_modes[i].run(mode_arg, opt);
+
+			freeFamHash();
+			freeInternPool();
+			return res;
+		}
+	}
+
+	MessageBoxA(NULL, "Unknown command line option!", "CE Dash Visualizer",
+	            MB_ICONERROR);
+	return -1;
+}
\ No newline at end of file
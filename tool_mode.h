@@ -0,0 +1,16 @@
+#ifndef TOOL_MODE_H_
+#define TOOL_MODE_H_
+
+#include <Windows.h>
+
+// A command line mode: OSTool.exe /<name> [argument [option]]. 'opt' is ""
+// when no option is given, and modes that don't take one ignore it.
+struct tool_mode {
+	const char* name;
+	const char* default_arg;
+	int (*run)(const char* arg, const char* opt);
+};
+
+int runToolMode(const char* cmd_line);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,345 @@
+////////////////////////////////////////////////////////////////////////////////
+// var_store.c                                                                //
+//                                                                            //
+// This TU contains the variant store, the form a spec is kept in once it's   //
+// parsed (see struct var_store in ost_data.h). A spec used to be an array of //
+// struct variant, one record per line, with the symbol, the IDVAR6 and the   //
+// two descriptions next to each other. Every scan for a symbol               //
+// (checkVarString() in parse_switch.c, matchRuleSet() in rule_set.c) or a    //
+// family (getSwPanel() in ostool.c) read the whole record of every variant   //
+// to look at a few bytes of it, and repacked the symbol each time.           //
+//                                                                            //
+// The store keeps each field in its own array instead. The symbol, the       //
+// IDVAR6 and the family code are packed into keys once, when the line is     //
+// parsed, so a scan reads one dense array of keys: 8 bytes per variant for a //
+// symbol and 4 for a family. The descriptions are handles from the intern    //
+// pool (see intern.c), so the strings themselves are in a separate area and  //
+// are only touched when they're shown.                                       //
+//                                                                            //
+// Each store also carries a family index, filled in as the spec is parsed,   //
+// so findFamily() answers "which variant of family X does this spec have?"   //
+// with one lookup in the perfect hash of the known families (see fam_hash.c) //
+// instead of a scan.                                                         //
+//                                                                            //
+// Once every line is stored, the parser calls finishVarStore(), which sorts  //
+// the spec's symbols into its symbol set (see ost_data.h). Looking up a      //
+// symbol is then a binary search, testing whether a spec has every symbol of //
+// a rule is one pass over both sorted lists, galloping over the symbols in   //
+// between (see specHasAll()), and unions, intersections and differences of   //
+// specs are linear merges (see mergeSymbols()). matchRuleSet() in rule_set.c //
+// finds the rule symbols of a spec the same way.                             //
+//                                                                            //
+// A store is a single allocation: the struct, followed by its arrays. Like   //
+// the variant list before it, it comes from the spec arena (see              //
+// spec_arena.c), or from the heap if no arena is given, in which case it's   //
+// released with one call to memFree().                                       //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "var_store.h"
+#include "fam_hash.h"
+#include "rule_set.h"   // for variantKey() and variantFamily()
+
+////////////////////////////////////////////////////////////////////////////////
+// packIdvar6                                                                 //
+//                                                                            //
+// Packs an IDVAR6 into an ID6_KEY, the same way packSymbol() packs a symbol. //
+// The IDVAR6 doesn't have to be null terminated.                             //
+////////////////////////////////////////////////////////////////////////////////
+
+ID6_KEY packIdvar6(const char* idvar6)
+{
+	ID6_KEY key = 0;
+	int i;
+
+	for (i = 0; i < IDVAR6_LENGTH; i++)
+		key = (key << 8) | (BYTE)idvar6[i];
+
+	return key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// allocVarStore                                                              //
+//                                                                            //
+// Allocates a store for 'num_var' variants from the spec arena 'p_arena', or //
+// on the heap if 'p_arena' is NULL. The arrays follow the struct in the same //
+// allocation, the 8-byte columns first so every column is aligned, and the   //
+// family index last. The entries aren't initialized; the parsers fill every  //
+// one of them with storeVariant(), and then call finishVarStore(). The       //
+// family index and the symbol set start out empty. Returns NULL if the       //
+// memory couldn't be allocated.                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+P_VAR_STORE allocVarStore(int num_var, P_SPEC_ARENA p_arena)
+{
+	P_VAR_STORE p_vars;
+	BYTE* col;
+	int num_slots = famHashSize();
+
+	if ((p_vars = arenaAlloc(p_arena, sizeof(VAR_STORE) +
+	                         VAR_STORE_ROW_SIZE * (size_t)num_var +
+	                         sizeof(short) * (size_t)num_slots)) == NULL)
+		return NULL;
+
+	col = (BYTE*)(p_vars + 1);
+	p_vars->num_var = num_var;
+	p_vars->num_fam_slots = num_slots;
+	p_vars->sym_keys = (SYM_KEY*)col;
+	col += sizeof(SYM_KEY) * (size_t)num_var;
+	p_vars->id_keys = (ID6_KEY*)col;
+	col += sizeof(ID6_KEY) * (size_t)num_var;
+	p_vars->sym_set = (SYM_KEY*)col;
+	col += sizeof(SYM_KEY) * (size_t)num_var;
+	p_vars->fam_descs = (const char**)col;
+	col += sizeof(const char*) * (size_t)num_var;
+	p_vars->var_descs = (const char**)col;
+	col += sizeof(const char*) * (size_t)num_var;
+	p_vars->fam_keys = (FAM_KEY*)col;
+	col += sizeof(FAM_KEY) * (size_t)num_var;
+	p_vars->sym_set_var = (short*)col;
+	col += sizeof(short) * (size_t)num_var;
+	p_vars->fam_index = num_slots ? (short*)col : NULL;
+	p_vars->num_set = 0;
+
+	// Every entry is -1
+	if (num_slots)
+		memset(p_vars->fam_index, 0xFF, sizeof(short) * (size_t)num_slots);
+
+	return p_vars;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// storeVariant                                                               //
+//                                                                            //
+// Packs one parsed line of a spec into entry 'index' of the store, and adds  //
+// it to the family index if it's the first variant of a known family.        //
+////////////////////////////////////////////////////////////////////////////////
+
+void storeVariant(P_VAR_STORE p_vars, int index, const Variant* var)
+{
+	p_vars->sym_keys[index] = variantKey(var);
+	p_vars->id_keys[index] = packIdvar6(var->idvar6);
+	p_vars->fam_keys[index] = variantFamily(var);
+	p_vars->fam_descs[index] = var->fam_desc;
+	p_vars->var_descs[index] = var->var_desc;
+
+	if (p_vars->fam_index) {
+		int slot = famSlot(p_vars->fam_keys[index]);
+
+		if (slot >= 0 && slot < p_vars->num_fam_slots &&
+		    p_vars->fam_index[slot] < 0)
+			p_vars->fam_index[slot] = (short)index;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// finishVarStore                                                             //
+//                                                                            //
+// Builds the symbol set of the store once every variant is stored. The non-  //
+// empty symbols are copied with their variant indices, sorted by key and     //
+// then by index with a shell sort of the two arrays together, and each key's //
+// first variant is kept.                                                     //
+////////////////////////////////////////////////////////////////////////////////
+
+void finishVarStore(P_VAR_STORE p_vars)
+{
+	static const int gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+	SYM_KEY* set = p_vars->sym_set;
+	short* set_var = p_vars->sym_set_var;
+	int num = 0;
+	int g, i, j;
+
+	for (i = 0; i < p_vars->num_var; i++) {
+		if (p_vars->sym_keys[i]) {
+			set[num] = p_vars->sym_keys[i];
+			set_var[num++] = (short)i;
+		}
+	}
+
+	for (g = 0; g < (int)(sizeof(gaps) / sizeof(gaps[0])); g++) {
+		int gap = gaps[g];
+
+		for (i = gap; i < num; i++) {
+			SYM_KEY key = set[i];
+			short var = set_var[i];
+
+			for (j = i; j >= gap && (set[j - gap] > key ||
+			     (set[j - gap] == key && set_var[j - gap] > var)); j -= gap) {
+				set[j] = set[j - gap];
+				set_var[j] = set_var[j - gap];
+			}
+			set[j] = key;
+			set_var[j] = var;
+		}
+	}
+
+	// Keep the first variant of each key
+	for (i = 0, j = 0; i < num; i++) {
+		if (j == 0 || set[i] != set[j - 1]) {
+			set[j] = set[i];
+			set_var[j++] = set_var[i];
+		}
+	}
+	p_vars->num_set = j;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findVariant                                                                //
+//                                                                            //
+// Returns the index of the first variant in the store with the packed symbol //
+// 'key', or -1 if the spec doesn't have it. The key is found with a binary   //
+// search of the symbol set. An empty or unpackable symbol (a key of 0) is    //
+// never found.                                                               //
+////////////////////////////////////////////////////////////////////////////////
+
+int findVariant(const VAR_STORE* p_vars, SYM_KEY key)
+{
+	int pos;
+
+	if (key == 0)
+		return -1;
+
+	pos = gallopSymbol(p_vars->sym_set, p_vars->num_set, 0, key);
+	if (pos < p_vars->num_set && p_vars->sym_set[pos] == key)
+		return p_vars->sym_set_var[pos];
+
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// gallopSymbol                                                               //
+//                                                                            //
+// Returns the position of the first key in the sorted array 'keys' at or     //
+// after 'start' that isn't less than 'key', or 'num_keys' if there's none.   //
+// The search gallops forward from 'start' in steps of 1, 2, 4, ... and then  //
+// does a binary search of the last step, so finding a key that's near        //
+// 'start' takes only a few comparisons. A search from 0 costs about the same //
+// as a plain binary search.                                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+int gallopSymbol(const SYM_KEY* keys, int num_keys, int start, SYM_KEY key)
+{
+	int lo = start;
+	int hi;
+	int step = 1;
+
+	if (lo >= num_keys || keys[lo] >= key)
+		return lo;
+
+	// keys[lo] < key from here on
+	while (lo + step < num_keys && keys[lo + step] < key) {
+		lo += step;
+		step <<= 1;
+	}
+	hi = lo + step < num_keys ? lo + step : num_keys;
+
+	// keys[lo] < key, and keys[hi] >= key or hi == num_keys
+	while (hi - lo > 1) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (keys[mid] < key)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return hi;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// specHasAll                                                                 //
+//                                                                            //
+// Returns TRUE if the spec has every symbol in 'keys', which must be sorted. //
+// Both lists are walked once: each key is searched for from where the last   //
+// one was found, so the spec's symbols between two keys are galloped over    //
+// rather than compared one at a time.                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+BOOL specHasAll(const VAR_STORE* p_vars, const SYM_KEY* keys, int num_keys)
+{
+	int pos = 0;
+	int i;
+
+	for (i = 0; i < num_keys; i++) {
+		pos = gallopSymbol(p_vars->sym_set, p_vars->num_set, pos, keys[i]);
+		if (pos == p_vars->num_set || p_vars->sym_set[pos] != keys[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// mergeSymbols                                                               //
+//                                                                            //
+// Merges two sorted sets of symbols, such as the symbol sets of two specs,   //
+// into 'out' and returns the size of the result. 'op' is SYM_UNION,          //
+// SYM_INTERSECT, or SYM_DIFF (the symbols of 'a' that aren't in 'b'). 'out'  //
+// must be able to hold 'num_a' + 'num_b' keys for a union and 'num_a' keys   //
+// otherwise, and can be 'a' itself for an intersection or a difference.      //
+////////////////////////////////////////////////////////////////////////////////
+
+int mergeSymbols(const SYM_KEY* a, int num_a, const SYM_KEY* b, int num_b,
+                 SYM_KEY* out, int op)
+{
+	int i = 0;
+	int j = 0;
+	int n = 0;
+
+	while (i < num_a && j < num_b) {
+		if (a[i] < b[j]) {
+			if (op != SYM_INTERSECT)
+				out[n++] = a[i];
+			i++;
+		}
+		else if (a[i] > b[j]) {
+			if (op == SYM_UNION)
+				out[n++] = b[j];
+			j++;
+		}
+		else {
+			if (op != SYM_DIFF)
+				out[n++] = a[i];
+			i++;
+			j++;
+		}
+	}
+
+	if (op != SYM_INTERSECT)
+		while (i < num_a)
+			out[n++] = a[i++];
+	if (op == SYM_UNION)
+		while (j < num_b)
+			out[n++] = b[j++];
+
+	return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// findFamily                                                                 //
+//                                                                            //
+// Returns the index of the first variant in the store from the family 'fam', //
+// or -1 if the spec doesn't have that family. A known family is looked up in //
+// the family index; any other family is found by scanning the family codes   //
+// of the spec.                                                               //
+////////////////////////////////////////////////////////////////////////////////
+
+int findFamily(const VAR_STORE* p_vars, FAM_KEY fam)
+{
+	const FAM_KEY* fams = p_vars->fam_keys;
+	int i;
+
+	if (p_vars->fam_index) {
+		int slot = famSlot(fam);
+
+		if (slot >= 0 && slot < p_vars->num_fam_slots)
+			return p_vars->fam_index[slot];
+	}
+
+	for (i = 0; i < p_vars->num_var; i++)
+		if (fams[i] == fam)
+			return i;
+
+	return -1;
+}
\ No newline at end of file
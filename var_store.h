@@ -0,0 +1,27 @@
+#ifndef VAR_STORE_H_
+#define VAR_STORE_H_
+
+#include <Windows.h>
+#include "ost_data.h"
+
+// Bytes one variant takes in a store, over all of its columns
+#define VAR_STORE_ROW_SIZE  (3 * sizeof(SYM_KEY) + 2 * sizeof(const char*) + \
+                             sizeof(FAM_KEY) + sizeof(short))
+
+// Operations of mergeSymbols()
+#define SYM_UNION           0
+#define SYM_INTERSECT       1
+#define SYM_DIFF            2   // in the first set and not in the second
+
+ID6_KEY packIdvar6(const char* idvar6);
+P_VAR_STORE allocVarStore(int num_var, P_SPEC_ARENA p_arena);
+void storeVariant(P_VAR_STORE p_vars, int index, const Variant* var);
+void finishVarStore(P_VAR_STORE p_vars);
+int findVariant(const VAR_STORE* p_vars, SYM_KEY key);
+int gallopSymbol(const SYM_KEY* keys, int num_keys, int start, SYM_KEY key);
+BOOL specHasAll(const VAR_STORE* p_vars, const SYM_KEY* keys, int num_keys);
+int mergeSymbols(const SYM_KEY* a, int num_a, const SYM_KEY* b, int num_b,
+                 SYM_KEY* out, int op);
+int findFamily(const VAR_STORE* p_vars, FAM_KEY fam);
+
+#endif
\ No newline at end of file
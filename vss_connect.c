@@ -4,8 +4,9 @@
 // This TU contains data and functions used to download a truck spec from our //
 // database, called EDB. It achieves this in two steps:                       //
 //                                                                            //
-// 1) An internet handle to the EDB URL is acquired through a series of       //
-//    WinInet function calls.                                                 //
+// 1) A request for the EDB URL is opened with HttpOpenRequest(), through a   //
+//    session handle that's opened once and reused, and sent with             //
+//    HttpSendRequest().                                                      //
 // 2) The webpage data is downloaded and stored into a temporary buffer       //
 //    using the InternetReadFile() function, which uses the aforementioned    //
 //    internet handle.                                                        //
@@ -17,152 +18,1157 @@
 // functions, making development of internet-connected applications easier.   //
 //                                                                            //
 // The retrieveSpec() function, which calls InternetReadFile(), reads 64 KiB  //
-// of data at a time. A spec is around ~192 KiB so it needs to be called a    //
-// few times before the spec is completely downloaded.                        //
+// of data at a time. A spec is around ~130 KiB so it needs to be called a    //
+// few times before the spec is completely downloaded. The page used to be    //
+// read into a fixed 200000 byte buffer and marked with a '~' after its end,  //
+// which every parser had to look for, and a '~' in the page cut it short.    //
+// The buffer is now sized from the length the server gives for the page, or  //
+// grown by doubling when it doesn't give one, and the page is handed on as a //
+// pointer and a length.                                                      //
+//                                                                            //
+// The calls are still synchronous, but they no longer run on the window's    //
+// thread: the main window downloads specs on a worker thread (see            //
+// spec_job.c), through the VSS_TRANSPORT interface in vss_connect.h, which   //
+// an EDB_SESSION implements with connectToEDB(). A FETCH_CTL bounds the      //
+// download: WinInet's receive timeout is set to its timeout, so neither the  //
+// wait for the answer's headers nor any single read blocks for longer than   //
+// that, and its cancel flag and the overall time are checked between reads.  //
+//                                                                            //
+// Every lookup used to open its own session, after probing EDB with          //
+// InternetCheckConnection(), and to ask for the page to be resynchronized.   //
+// That cost a DNS lookup and the TCP and TLS handshakes for the probe and    //
+// again for the page, several round trips to a server that's far away,       //
+// before the first byte of the spec arrived. The session is now opened once, //
+// when the main window is created, and WinInet keeps its connection to EDB   //
+// alive between lookups. There's no probe: the page is requested straight    //
+// away, and when EDB can't be reached that request fails after one           //
+// connection attempt. The session counts the time spent opening and reading  //
+// each URL (see FETCH_STATS), and measureFetches() compares both ways of     //
+// looking up a list of URLs, for the /fetchbench command line mode.          //
+// /httpcheck runs them against a stand-in HTTP server (see http_server.c),   //
+// which checks that the connection is kept alive.                            //
+//                                                                            //
+// A spec page is fixed-width text that's mostly spaces and repeated field    //
+// names, and compresses to around a tenth of its length. The session asks    //
+// for pages gzip or deflate compressed, and tells WinInet to decode them     //
+// (INTERNET_OPTION_HTTP_DECODING). WinInet inflates what has arrived on      //
+// every InternetReadFile() call, so the page is decompressed while it's      //
+// still downloading, and retrieveSpec() gets the same text as before. Over a //
+// slow link, most of the time of a lookup is spent transferring the page,    //
+// and that time shrinks with its compressed length. A server that doesn't    //
+// compress just sends the page as it is.                                     //
+//                                                                            //
+// A page that's already in the spec cache, but stale, doesn't have to be     //
+// transferred at all if it hasn't changed. The ETag and Last-Modified time   //
+// sent with a page (see PAGE_VALIDATORS) are kept with it in the cache, and  //
+// the next request for it is made conditional on them; a server that still   //
+// has the same page answers 304 Not Modified, and connectToEDB() returns     //
+// VSS_NOT_MODIFIED.                                                          //
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <Windows.h>
+#include <stdio.h>
+#include <string.h>
 #include <strsafe.h>
 #include <tchar.h>	// for _itot_s()
 
 #include "vss_connect.h"
+#include "fetch_policy.h"
+#include "mem_track.h"
+
+// 100 ns ticks from 1601, where FILETIMEs count from, to 1970
+#define UNIX_EPOCH_TICKS    116444736000000000ULL
+
+// The upper bounds in ms of the latency histogram's buckets but the last,
+// each about one and a half times the one before
+static const double hist_bounds[FETCH_HIST_BUCKETS - 1] = {
+	1, 2, 3, 5, 7, 10, 15, 20, 30, 50, 70, 100, 150, 200, 300, 500, 700,
+	1000, 1500, 2000, 3000, 5000, 7000, 10000, 15000, 20000, 30000
+};
+
+static int retrieveSpec(HINTERNET h_url, const FETCH_CTL* p_ctl,
+                        double start, DWORD size_hint, char** p_data,
+                        DWORD* p_size);
+static HINTERNET openRequest(P_EDB_SESSION p_session, const char* p_url,
+                             HINTERNET* p_connect);
+static DWORD getWireLength(HINTERNET h_url, BOOL* pf_encoded);
+static void buildHeaders(const EDB_SESSION* p_session,
+                         const PAGE_VALIDATORS* p_validators, char* headers);
+static void getValidators(HINTERNET h_url, PAGE_VALIDATORS* p_validators);
+static int fetchStopped(const FETCH_CTL* p_ctl, double start);
+static BOOL watchRequest(const FETCH_CTL* p_ctl, HINTERNET h_url);
+static BOOL unwatchRequest(const FETCH_CTL* p_ctl);
+static int askServer(P_EDB_SESSION p_session, const char* p_url,
+                     const FETCH_CTL* p_ctl, char** p_data, DWORD* p_size);
+static int fetchEDB(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                    char** p_data, DWORD* p_size);
+static void recordFetch(P_EDB_SESSION p_session, int res, DWORD bytes,
+                        DWORD wire_bytes, double open_ms, double read_ms);
+static int timeFetch(P_EDB_SESSION p_session, const char* p_url,
+                     PAGE_VALIDATORS* p_validators, FETCH_TIME* p_time,
+                     char** p_data);
+
+////////////////////////////////////////////////////////////////////////////////
+// openEdbSession                                                             //
+//                                                                            //
+// Opens the WinInet session that EDB lookups share, and returns it in        //
+// '*pp_session'. 'timeout_ms' bounds connecting to EDB, sending a request    //
+// and waiting for the answer; WinInet is told to make a single attempt, so a //
+// lookup fails within that time when EDB can't be reached (e.g. when the     //
+// computer isn't connected to Volvo's internal network), instead of retrying //
+// for several times as long. The timeouts themselves are set by              //
+// setFetchPolicy(), from the session's FETCH_POLICY, which may lower them to //
+// its time limit per request. Returns 0 on success, -1 if there isn't enough //
+// memory, or -2 if the session can't be opened.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+int openEdbSession(DWORD timeout_ms, P_EDB_SESSION* pp_session)
+{
+	P_EDB_SESSION p_session;
+	FETCH_POLICY policy;
+	DWORD retries = 1;
+
+	*pp_session = NULL;
+
+	if ((p_session = memCalloc(MEM_NETWORK, 1, sizeof(EDB_SESSION))) == NULL)
+		return -1;
+
+	p_session->h_open = InternetOpenA("CE_SW_TOOL",
+	                                  INTERNET_OPEN_TYPE_PRECONFIG,
+	                                  NULL, NULL, 0);
+	if (!p_session->h_open) {
+		memFree(p_session);
+		return -2;
+	}
+
+	InternetSetOptionA(p_session->h_open, INTERNET_OPTION_CONNECT_RETRIES,
+	                   &retries, sizeof(retries));
+	setEdbCompression(p_session, TRUE);
+
+	p_session->timeout_ms = timeout_ms;
+	p_session->transport.fetch = fetchEDB;
+	p_session->transport.ctx = p_session;
+	InitializeSRWLock(&(p_session->lock));
+
+	// This also sets the connect, send and receive timeouts, which belong
+	// to setFetchPolicy() alone
+	getFetchPolicyDefaults(&policy);
+	setFetchPolicy(p_session, &policy);
+
+	*pp_session = p_session;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getFetchStats                                                              //
+//                                                                            //
+// Copies the counters of 'p_session' to '*p_stats'. Lookups may be running   //
+// on other threads, so they're copied under the session's lock.              //
+////////////////////////////////////////////////////////////////////////////////
+
+void getFetchStats(P_EDB_SESSION p_session, FETCH_STATS* p_stats)
+{
+	AcquireSRWLockShared(&(p_session->lock));
+	*p_stats = p_session->stats;
+	ReleaseSRWLockShared(&(p_session->lock));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getFetchPercentile                                                         //
+//                                                                            //
+// Returns the time in ms that 'percent' percent of the lookups counted in    //
+// the latency histogram of '*p_stats' took no longer than, or 0 if there are //
+// none. The histogram only knows which bucket a lookup fell in, so this is   //
+// the upper bound of that bucket, which errs on the long side by up to the   //
+// bucket's width, but never past the slowest lookup's time.                  //
+////////////////////////////////////////////////////////////////////////////////
+
+double getFetchPercentile(const FETCH_STATS* p_stats, double percent)
+{
+	DWORD total = 0;
+	DWORD count = 0;
+	int i;
+
+	for (i = 0; i < FETCH_HIST_BUCKETS; i++)
+		total += p_stats->latency_hist[i];
+
+	if (total == 0)
+		return 0;
+
+	for (i = 0; i < FETCH_HIST_BUCKETS - 1; i++) {
+		count += p_stats->latency_hist[i];
+		if (count * 100.0 >= total * percent)
+			return min(hist_bounds[i], p_stats->max_ms);
+	}
+
+	return p_stats->max_ms;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setMaxEdbConnections                                                       //
+//                                                                            //
+// Lets WinInet open up to 'num_conns' connections to one server at once, for //
+// concurrent lookups (see prefetch.c). By default it only opens a few, and   //
+// lookups past that wait for a free connection. The limit applies to the     //
+// whole process, not just one session.                                       //
+////////////////////////////////////////////////////////////////////////////////
+
+void setMaxEdbConnections(DWORD num_conns)
+{
+	InternetSetOptionA(NULL, INTERNET_OPTION_MAX_CONNS_PER_SERVER,
+	                   &num_conns, sizeof(num_conns));
+	InternetSetOptionA(NULL, INTERNET_OPTION_MAX_CONNS_PER_1_0_SERVER,
+	                   &num_conns, sizeof(num_conns));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setEdbCompression                                                          //
+//                                                                            //
+// Sets whether lookups through 'p_session' ask for the page compressed.      //
+// Sessions ask for it by default; measureFetches() turns it off to compare.  //
+// Lookups that are running may make their request either way.                //
+////////////////////////////////////////////////////////////////////////////////
+
+void setEdbCompression(P_EDB_SESSION p_session, BOOL f_compress)
+{
+	p_session->f_compress = f_compress;
+	InternetSetOptionA(p_session->h_open, INTERNET_OPTION_HTTP_DECODING,
+	                   &f_compress, sizeof(f_compress));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// setEdbServer                                                               //
+//                                                                            //
+// Sends the requests of lookups through 'p_session' to 'p_server' instead of //
+// EDB, or to EDB again if it's NULL. The session's FETCH_POLICY, statistics  //
+// and hedging work the same either way, so with a stand-in server that fails //
+// on purpose (see fetch_fault.c) they can be checked without a network. No   //
+// lookup may be running through the session.                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+void setEdbServer(P_EDB_SESSION p_session, const VSS_TRANSPORT* p_server)
+{
+	p_session->p_server = p_server;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// closeEdbSession                                                            //
+//                                                                            //
+// Closes the session's handle, which closes the connections WinInet kept     //
+// alive, and frees the session, once the hedged attempts that lost their     //
+// race have finished. No lookup may be running through it. 'p_session' may   //
+// be NULL.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+void closeEdbSession(P_EDB_SESSION p_session)
+{
+	if (!p_session)
+		return;
+
+	// Closing the handle makes the requests of hedged attempts that are
+	// still running fail, so they finish soon after (see fetch_policy.c)
+	InternetCloseHandle(p_session->h_open);
+	while (p_session->num_attempts)
+		Sleep(10);
+
+	memFree(p_session);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 // connectToEDB                                                               //
 //                                                                            //
-// Calls a series of WinInet functions to retrieve a HINTERNET (internet      //
-// handle) that can be used to call InternetReadFile(). First, the function   //
-// checks to see if a connection can be established to the EDB URL provided.  //
-// This will fail if the computer is not connected to Volvo's internal        //
-// network.                                                                   //
+// Requests the EDB URL provided through 'p_session' (see openEdbSession()),  //
+// and reads the page with retrieveSpec().                                    //
+//                                                                            //
+// The request is opened with openRequest(), which returns a HINTERNET that's //
+// sent with HttpSendRequest() and then passed to retrieveSpec(). It used to  //
+// be opened and sent in one call to InternetOpenUrl(), which doesn't return  //
+// a handle until the answer's headers have arrived, so nothing could stop a  //
+// request to a server that stalled before sending them. The handle is now    //
+// handed to abortFetch() before the request is sent, and its receive timeout //
+// is set from 'p_ctl', so the wait for the headers is bounded and can be     //
+// aborted like the reads. If an error is encountered, it's closed with       //
+// InternetCloseHandle(). It's also closed at the end of the function, once   //
+// the whole page has been read, which lets WinInet keep the connection for   //
+// the next lookup. This is a requirement of using the WinInet functions per  //
+// official documentation.                                                    //
+//                                                                            //
+// Unless compression has been turned off for the session, the request        //
+// carries VSS_ACCEPT_ENCODING, and the page comes back decoded.              //
+//                                                                            //
+// If 'p_ctl' has validators from an earlier download of the page (see        //
+// PAGE_VALIDATORS), the request is conditional: it carries If-None-Match     //
+// with the ETag and If-Modified-Since with the time, and a server that still //
+// has the same page answers 304 Not Modified, in a single short round trip,  //
+// without sending it. The function then returns VSS_NOT_MODIFIED, with no    //
+// page, and updates the validators with any the answer gives. When a page is //
+// sent, the validators are replaced with the ones that came with it.         //
+//                                                                            //
+// Returns 0 on success, VSS_NOT_MODIFIED as above, VSS_NO_URL if the URL     //
+// can't be opened (e.g. EDB can't be reached), in which case GetLastError()  //
+// tells why, VSS_NO_MEMORY if there isn't enough memory, VSS_READ_FAILED if  //
+// the page can't be read, or VSS_SERVER_ERROR if the server answered with a  //
+// 5xx status. -1 and -2, for the connection check and the session this       //
+// function used to open itself, are no longer returned.                      //
 //                                                                            //
-// InternetOpen() returns a HINTERNET that is used to call                    //
-// InternetOpenUrl(), which also returns a HINTERNET. This latter HINTERNET   //
-// is passed to retrieveSpec(). If at any point an error is encountered, the  //
-// internet handles are closed with InternetCloseHandle(). They are also      //
-// closed at the end of the function. This is a requirement of using the      //
-// WinInet functions per official documentation.                              //
+// Once a spec is successfully acquired, '*p_data' points to the buffer on    //
+// the heap in which it's stored, and '*p_size' is its length. The buffer is  //
+// freed by the parser (see parseVssBuffer()), in the spec job that           //
+// downloaded it (see spec_job.c).                                            //
 //                                                                            //
-// This function takes a pointer to pointer named 'data', which points to the //
-// address of the buffer in which the spec is stored. Once a spec is          //
-// successfully acquired, the 'data' argument provided to connectToEDB()      //
-// will point to an address of memory on the heap. It's freed in              //
-// parseVssBuffer(), in the WM_COMMAND processing in ostool.c.                //
+// Pages longer than VSS_MAX_PAGE_SIZE aren't read, and return                //
+// VSS_READ_FAILED. The limit applies to the page once it's decoded, when the //
+// server sent it compressed.                                                 //
 //                                                                            //
-// The parameter buf_size is the size of the destination buffer and is        //
-// provided to ensure the end of the buffer is not written past.              //
+// 'p_ctl' may be NULL for a download without a time limit. Otherwise the     //
+// function returns VSS_CANCELLED if its cancel flag is set, or VSS_TIMED_OUT //
+// if the download takes longer than its timeout. If its 'p_abort' isn't      //
+// NULL, abortFetch() stops the request, whether it's waiting for the answer  //
+// or reading the page, and the function returns VSS_CANCELLED.               //
+//                                                                            //
+// When a stand-in server has been set for the session (see setEdbServer()),  //
+// the request goes to it instead, and the function returns what it does.     //
 ////////////////////////////////////////////////////////////////////////////////
 
-int connectToEDB(void** data, const char* p_url, DWORD buf_size)
+int connectToEDB(P_EDB_SESSION p_session, const char* p_url,
+                 const FETCH_CTL* p_ctl, char** p_data, DWORD* p_size)
 {
-	HINTERNET h_open = NULL;
+	HINTERNET h_connect = NULL;
 	HINTERNET h_url = NULL;
+	double start = nowMs();
+	double t1;
+	double read_ms = 0;
+	PAGE_VALIDATORS* p_validators = p_ctl ? p_ctl->p_validators : NULL;
+	char headers[VSS_HEADERS_LENGTH];
+	DWORD status = 0;
+	DWORD status_size = sizeof(status);
+	DWORD wire_bytes = 0;
+	DWORD error = 0;
+	BOOL f_encoded;
+	BOOL f_watched;
+	BOOL f_open = TRUE;
+	int res = 0;
 
-	if (!InternetCheckConnectionA("https://edb.volvo.net/edb2/index.htm",
-	                              FLAG_ICC_FORCE_CONNECTION, 0))
-		return -1;
+	*p_data = NULL;
+	*p_size = 0;
 
-	h_open = InternetOpenA("CE_SW_TOOL", INTERNET_OPEN_TYPE_PRECONFIG,
-	                       NULL, NULL, 0);
+	if (p_session->p_server)
+		return askServer(p_session, p_url, p_ctl, p_data, p_size);
 
-	if (!h_open)
-		return -2;
+	buildHeaders(p_session, p_validators, headers);
 
-	// At this point h_open is a valid handle
-	h_url = InternetOpenUrlA(h_open, p_url, NULL, 0,
-	                         INTERNET_FLAG_RESYNCHRONIZE |
-	                         INTERNET_FLAG_NO_UI | INTERNET_FLAG_SECURE, 0);
+	if ((h_url = openRequest(p_session, p_url, &h_connect)) == NULL) {
+		error = GetLastError();
+		recordFetch(p_session, VSS_NO_URL, 0, 0, nowMs() - start, 0);
+		SetLastError(error);
+		return VSS_NO_URL;
+	}
 
-	if (!h_url) {
-		InternetCloseHandle(h_open);
-		return -3;
+	// At this point h_url is a valid handle. WinInet waits for the
+	// answer's headers as long as it waits for any read.
+	if (p_ctl && p_ctl->timeout_ms) {
+		DWORD timeout = p_ctl->timeout_ms;
+
+		InternetSetOptionA(h_url, INTERNET_OPTION_RECEIVE_TIMEOUT,
+		                   &timeout, sizeof(timeout));
 	}
 
-	// At this point, both h_open and h_url are valid handles
+	// From here until the page has been read, abortFetch() may close the
+	// handle, which makes the call that's waiting on it fail at once
+	f_watched = watchRequest(p_ctl, h_url);
+	if (!f_watched)
+		res = VSS_CANCELLED;
+	else if (!HttpSendRequestA(h_url, headers[0] ? headers : NULL,
+	                           headers[0] ? (DWORD)-1L : 0, NULL, 0)) {
+		error = GetLastError();
+		res = fetchStopped(p_ctl, start);
+		res = res ? res : VSS_NO_URL;
+	}
+	t1 = nowMs();
 
-	if ((*data = malloc(buf_size)) == NULL) {
-		InternetCloseHandle(h_url);
-		InternetCloseHandle(h_open);
-		return -4;
+	if (res == 0)
+		HttpQueryInfoA(h_url, HTTP_QUERY_STATUS_CODE |
+		               HTTP_QUERY_FLAG_NUMBER, &status, &status_size, NULL);
+
+	// An error page from a server that's overloaded or restarting isn't
+	// a spec, and the lookup may well succeed if it's made again
+	if (res == 0 && status >= 500)
+		res = VSS_SERVER_ERROR;
+	else if (res == 0 && p_validators &&
+	         status == HTTP_STATUS_NOT_MODIFIED) {
+		getValidators(h_url, p_validators);
+		res = VSS_NOT_MODIFIED;
+	}
+	else if (res == 0) {
+		// The length of a compressed page says little about how long it
+		// is once it's decoded, so the buffer isn't sized from it
+		wire_bytes = getWireLength(h_url, &f_encoded);
+		res = retrieveSpec(h_url, p_ctl, start, f_encoded ? 0 : wire_bytes,
+		                   p_data, p_size);
+		if (res != 0)
+			res = (res < -2) ? res : VSS_READ_FAILED;
+		read_ms = nowMs() - t1;
 	}
 
-	// At this point, both h_open and h_url are still valid handles.
-	// 'data' is pointing to memory on the heap
+	if (f_watched)
+		f_open = unwatchRequest(p_ctl);
 
-	if (retrieveSpec(h_url, *data, buf_size)) {
-		InternetCloseHandle(h_url);
-		InternetCloseHandle(h_open);
-		free(*data);
-		return -5;
+	// An aborted request's handle is already closed, and whatever was read
+	// is thrown away, as if it had been cancelled
+	if (!f_open) {
+		memFree(*p_data);
+		*p_data = NULL;
+		*p_size = 0;
+		res = VSS_CANCELLED;
 	}
 
-	InternetCloseHandle(h_url);
-	InternetCloseHandle(h_open);
+	// A page without validators of its own replaces one that had them
+	if (res == 0 && p_validators) {
+		memset(p_validators, 0, sizeof(PAGE_VALIDATORS));
+		getValidators(h_url, p_validators);
+	}
+	if (f_open)
+		InternetCloseHandle(h_url);
+	InternetCloseHandle(h_connect);
+
+	recordFetch(p_session, res, *p_size, wire_bytes, t1 - start, read_ms);
 
 	// At this point, the handles have been closed.
-	// 'data' is pointing to memory on the heap. It will be up to
+	// '*p_data' is pointing to memory on the heap. It will be up to
 	// the application to free it.
-	return 0;
+	SetLastError(error);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// openRequest                                                                //
+//                                                                            //
+// Opens a GET request for 'p_url' through 'p_session', without sending it,   //
+// and returns its handle, or NULL if the URL can't be parsed or the request  //
+// can't be opened, in which case GetLastError() tells why. The handle of the //
+// connection to the URL's server is returned in '*p_connect', to be closed   //
+// after the request's; it's only a handle, and WinInet keeps the connection  //
+// alive for the session either way.                                          //
+//                                                                            //
+// The page is always downloaded anew; copies are kept by the spec cache (see //
+// spec_cache.c), not by WinInet. EDB's URLs are https, and a stand-in        //
+// server's on the loopback interface (see http_server.c) are plain http.     //
+////////////////////////////////////////////////////////////////////////////////
+
+static HINTERNET openRequest(P_EDB_SESSION p_session, const char* p_url,
+                             HINTERNET* p_connect)
+{
+	URL_COMPONENTSA parts;
+	char host[INTERNET_MAX_HOST_NAME_LENGTH];
+	HINTERNET h_url;
+	DWORD error;
+
+	*p_connect = NULL;
+
+	// A path with no buffer is pointed into 'p_url', whose query follows it
+	memset(&parts, 0, sizeof(parts));
+	parts.dwStructSize = sizeof(parts);
+	parts.lpszHostName = host;
+	parts.dwHostNameLength = sizeof(host);
+	parts.dwUrlPathLength = 1;
+
+	if (!InternetCrackUrlA(p_url, 0, 0, &parts))
+		return NULL;
+
+	*p_connect = InternetConnectA(p_session->h_open, host, parts.nPort,
+	                              NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
+	if (!*p_connect)
+		return NULL;
+
+	h_url = HttpOpenRequestA(*p_connect, "GET",
+	                         parts.dwUrlPathLength ? parts.lpszUrlPath : "/",
+	                         NULL, NULL, NULL,
+	                         INTERNET_FLAG_RELOAD |
+	                         INTERNET_FLAG_NO_CACHE_WRITE |
+	                         INTERNET_FLAG_KEEP_CONNECTION |
+	                         INTERNET_FLAG_NO_UI |
+	                         (parts.nScheme == INTERNET_SCHEME_HTTPS ?
+	                          INTERNET_FLAG_SECURE : 0), 0);
+	if (!h_url) {
+		error = GetLastError();
+		InternetCloseHandle(*p_connect);
+		*p_connect = NULL;
+		SetLastError(error);
+	}
+
+	return h_url;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // retrieveSpec                                                               //
 //                                                                            //
 // Helper function for connectToEDB(). This function makes repeated calls to  //
-// InternetReadFile() until the entire spec is downloaded. It downloads 64    //
-// KiB at a time.                                                             //
+// InternetReadFile() until the entire spec is downloaded. It downloads up to //
+// 64 KiB at a time, straight into the buffer it returns in '*p_data'.        //
+//                                                                            //
+// 'h_url' is a HINTERNET defined in the connectToEDB() function, and is      //
+// checked for validity there before it's used here. 'size_hint' is the       //
+// length of the page, from its Content-Length, or 0 if it isn't known. When  //
+// it's known, the buffer is allocated one byte larger than that, so the read //
+// that finds the end of the page doesn't have to grow it, and the page is    //
+// read without being copied. Otherwise it starts at VSS_PAGE_SIZE and        //
+// doubles whenever it fills up; memRealloc() can often extend a block in     //
+// place, and at most a few copies are made. If the page is longer than       //
+// VSS_MAX_PAGE_SIZE, the function returns -1 to indicate an error, or -4 if  //
+// there isn't enough memory.                                                 //
 //                                                                            //
-// 'h_url' is a HINTERNET defined in the connectToEDB() function, and         //
-// 'buf_size' provides the size of the destination buffer. This is used to    //
-// ensure writes aren't made past the end of the buffer. If the buffer is     //
-// too small to hold a spec, the function returns -1 to indicate an error.    //
-// Both 'h_url' and 'data' are checked for validity in connectToEDB() before  //
-// they are used here.                                                        //
+// When this function returns successfully, '*p_data' will contain a full     //
+// truck spec downloaded from the EDB database, and '*p_size' its length.     //
+// Otherwise the buffer has been freed and '*p_data' is NULL.                 //
 //                                                                            //
-// When this function returns successfully, the destination buffer will       //
-// contain a full truck spec downloaded from the EDB database.                //
+// Between reads, and after a read fails, fetchStopped() checks whether the   //
+// download was cancelled or has run out of time; if so, VSS_CANCELLED or     //
+// VSS_TIMED_OUT is returned.                                                 //
 //                                                                            //
-// Possible future improvement: InternetReadFile() is called                  //
-// synchronously. If the connection is interrupted before InternetReadFile()  //
-// returns, it could freeze the application. The download is quite small      //
-// (around 192 KiB), so a connection loss during a download is unlikely.      //
-// Additionally, the program does not perform a critical function or have     //
-// safety implications, so having to force close it in an unlikely scenario   //
-// is not a serious issue. Still, it's high on the priority list of future    //
-// fixes because it's suboptimal design.                                      //
+// InternetReadFile() is called synchronously. A connection that stops        //
+// sending blocks it until WinInet's receive timeout, which connectToEDB()    //
+// sets from 'p_ctl', and since it runs on a worker thread (see spec_job.c),  //
+// the window keeps responding in the meantime.                               //
 ////////////////////////////////////////////////////////////////////////////////
 
-static int retrieveSpec(HINTERNET h_url, void* data, DWORD buf_size)
+static int retrieveSpec(HINTERNET h_url, const FETCH_CTL* p_ctl,
+                        double start, DWORD size_hint, char** p_data,
+                        DWORD* p_size)
 {
 	BOOL f_read_ok = FALSE;
 
+	char* data;
+	DWORD buf_size = VSS_PAGE_SIZE;
+
 	DWORD bytes_read = 0;
 	DWORD bytes_accum = 0;
-	DWORD min_read = 0;
 
 	DWORD bytes_per_call = 65536;
+	int res = 0;
 
-	if (buf_size < bytes_per_call + 1)		// + 1 for EOF marker
-		return -1;
+	if (size_hint && size_hint < VSS_MAX_PAGE_SIZE)
+		buf_size = size_hint + 1;
+
+	if ((data = memAlloc(MEM_NETWORK, buf_size)) == NULL)
+		return -4;
 
 	do {
-		// This macro ensures writes aren't made past the end of the
-		// buffer. The -1 accounts for the EOF marker
-		min_read = min(bytes_per_call, buf_size - bytes_accum - 1);
+		if (bytes_accum == buf_size) {
+			char* p_new;
+
+			if (buf_size >= VSS_MAX_PAGE_SIZE) {
+				res = -1;
+				break;
+			}
+
+			buf_size = min(buf_size * 2, VSS_MAX_PAGE_SIZE);
+			if ((p_new = memRealloc(MEM_NETWORK, data, buf_size)) == NULL) {
+				res = -4;
+				break;
+			}
+			data = p_new;
+		}
 
 		f_read_ok =
-		InternetReadFile(h_url, (LPBYTE)(data) + bytes_accum, min_read,
+		InternetReadFile(h_url, data + bytes_accum,
+		                 min(bytes_per_call, buf_size - bytes_accum),
 		                 &bytes_read);
 
-		if (!f_read_ok)
-			return -2;
+		res = fetchStopped(p_ctl, start);
+
+		if (!f_read_ok && !res)
+			res = -2;
+		if (res)
+			break;
 
 		bytes_accum += bytes_read;
 
 	} while (bytes_read);
 
-	// Add EOF marker
-	*((char*)(data) + bytes_accum) = '~';
+	if (res) {
+		memFree(data);
+		return res;
+	}
+
+	*p_data = data;
+	*p_size = bytes_accum;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getWireLength                                                              //
+//                                                                            //
+// Returns the Content-Length of the response of 'h_url', the number of bytes //
+// the server sends, or 0 if it doesn't give one (e.g. when it sends the page //
+// in chunks). '*pf_encoded' is set to TRUE if the page is sent compressed,   //
+// in which case that's the compressed length, and WinInet hands on more      //
+// bytes than that.                                                           //
+////////////////////////////////////////////////////////////////////////////////
+
+static DWORD getWireLength(HINTERNET h_url, BOOL* pf_encoded)
+{
+	char encoding[32];
+	DWORD encoding_size = sizeof(encoding);
+	DWORD length = 0;
+	DWORD length_size = sizeof(length);
+
+	*pf_encoded = HttpQueryInfoA(h_url, HTTP_QUERY_CONTENT_ENCODING,
+	                             encoding, &encoding_size, NULL) &&
+	              _stricmp(encoding, "identity") != 0;
+
+	if (!HttpQueryInfoA(h_url, HTTP_QUERY_CONTENT_LENGTH |
+	                    HTTP_QUERY_FLAG_NUMBER, &length, &length_size, NULL))
+		return 0;
+
+	return length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buildHeaders                                                               //
+//                                                                            //
+// Builds the request headers of a lookup through 'p_session' into 'headers', //
+// which holds VSS_HEADERS_LENGTH characters: VSS_ACCEPT_ENCODING, unless     //
+// compression is turned off, and the conditions made from 'p_validators', if //
+// it isn't NULL. 'headers' is left empty if there are none.                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static void buildHeaders(const EDB_SESSION* p_session,
+                         const PAGE_VALIDATORS* p_validators, char* headers)
+{
+	char line[VSS_ETAG_LENGTH + 32];
+
+	headers[0] = '\0';
+
+	if (p_session->f_compress)
+		StringCchCatA(headers, VSS_HEADERS_LENGTH, VSS_ACCEPT_ENCODING);
+
+	if (!p_validators)
+		return;
+
+	if (p_validators->etag[0]) {
+		StringCchPrintfA(line, sizeof(line), "If-None-Match: %s\r\n",
+		                 p_validators->etag);
+		StringCchCatA(headers, VSS_HEADERS_LENGTH, line);
+	}
+
+	if (p_validators->modified) {
+		ULARGE_INTEGER ticks;
+		FILETIME ft;
+		SYSTEMTIME st;
+		char date[INTERNET_RFC1123_BUFSIZE];
+
+		// time() seconds to 100 ns ticks since 1601
+		ticks.QuadPart = (ULONGLONG)p_validators->modified * 10000000 +
+		                 UNIX_EPOCH_TICKS;
+		ft.dwLowDateTime = ticks.LowPart;
+		ft.dwHighDateTime = ticks.HighPart;
+
+		if (FileTimeToSystemTime(&ft, &st) &&
+		    InternetTimeFromSystemTimeA(&st, INTERNET_RFC1123_FORMAT, date,
+		                                sizeof(date))) {
+			StringCchPrintfA(line, sizeof(line),
+			                 "If-Modified-Since: %s\r\n", date);
+			StringCchCatA(headers, VSS_HEADERS_LENGTH, line);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// getValidators                                                              //
+//                                                                            //
+// Stores the ETag and the Last-Modified time of the response of 'h_url' in   //
+// '*p_validators'. A validator the response doesn't have is left as it was.  //
+// An ETag longer than VSS_ETAG_LENGTH, or with spaces in it, isn't kept,     //
+// since it couldn't be stored in the cache's index.                          //
+////////////////////////////////////////////////////////////////////////////////
+
+static void getValidators(HINTERNET h_url, PAGE_VALIDATORS* p_validators)
+{
+	char etag[VSS_ETAG_LENGTH];
+	DWORD etag_size = sizeof(etag);
+	SYSTEMTIME st;
+	DWORD st_size = sizeof(st);
+	FILETIME ft;
+	ULARGE_INTEGER ticks;
+
+	if (HttpQueryInfoA(h_url, HTTP_QUERY_ETAG, etag, &etag_size, NULL) &&
+	    etag[strcspn(etag, " \t")] == '\0')
+		strcpy_s(p_validators->etag, VSS_ETAG_LENGTH, etag);
+
+	if (HttpQueryInfoA(h_url, HTTP_QUERY_LAST_MODIFIED |
+	                   HTTP_QUERY_FLAG_SYSTEMTIME, &st, &st_size, NULL) &&
+	    SystemTimeToFileTime(&st, &ft)) {
+		ticks.LowPart = ft.dwLowDateTime;
+		ticks.HighPart = ft.dwHighDateTime;
+		if (ticks.QuadPart > UNIX_EPOCH_TICKS)
+			p_validators->modified =
+			    (long long)((ticks.QuadPart - UNIX_EPOCH_TICKS) / 10000000);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// fetchStopped                                                               //
+//                                                                            //
+// Returns VSS_CANCELLED if the cancel flag of 'p_ctl' is set, VSS_TIMED_OUT  //
+// if more than its timeout has passed since 'start' (a nowMs() value), or 0  //
+// if the download can go on or 'p_ctl' is NULL.                              //
+////////////////////////////////////////////////////////////////////////////////
+
+static int fetchStopped(const FETCH_CTL* p_ctl, double start)
+{
+	if (!p_ctl)
+		return 0;
+
+	if (p_ctl->p_cancel && *p_ctl->p_cancel)
+		return VSS_CANCELLED;
+
+	if (p_ctl->timeout_ms && nowMs() - start > p_ctl->timeout_ms)
+		return VSS_TIMED_OUT;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// waitFetch                                                                  //
+//                                                                            //
+// Waits until 'wait_ms' after 'start' (a nowMs() value), for a lookup        //
+// bounded by 'p_ctl', which may be NULL, checking every 'poll_ms' whether it //
+// was stopped. Returns 0 after the wait, VSS_CANCELLED as soon as the        //
+// lookup's cancel flag is set, or VSS_TIMED_OUT once its timeout, counted    //
+// from 'start', has passed. The flag is checked before anything else, so a   //
+// lookup that's cancelled before the wait starts returns VSS_CANCELLED at    //
+// once.                                                                      //
+//                                                                            //
+// Used wherever a lookup has to wait without a request of its own: a retry's //
+// backoff (see fetch_policy.c), and the latency of a stand-in server (see    //
+// fetch_fault.c and fetch_replay.c).                                         //
+////////////////////////////////////////////////////////////////////////////////
+
+int waitFetch(const FETCH_CTL* p_ctl, double start, double wait_ms,
+              DWORD poll_ms)
+{
+	for (;;) {
+		double elapsed = nowMs() - start;
+		int stop = fetchStopped(p_ctl, start);
+
+		if (stop)
+			return stop;
+		if (elapsed >= wait_ms)
+			return 0;
+
+		Sleep((DWORD)min(wait_ms - elapsed, poll_ms));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// abortFetch                                                                 //
+//                                                                            //
+// Stops the download that was given 'p_abort' in its FETCH_CTL: the          //
+// request's handle is closed, which makes a send that's waiting for the      //
+// answer's headers or a read that's waiting for the page fail at once, and   //
+// the download returns VSS_CANCELLED instead of sending the request if it    //
+// hasn't started to yet. May be called from any thread, more than once.      //
+////////////////////////////////////////////////////////////////////////////////
+
+void abortFetch(FETCH_ABORT* p_abort)
+{
+	AcquireSRWLockExclusive(&(p_abort->lock));
+	p_abort->f_aborted = TRUE;
+	if (p_abort->h_url) {
+		InternetCloseHandle(p_abort->h_url);
+		p_abort->h_url = NULL;
+	}
+	ReleaseSRWLockExclusive(&(p_abort->lock));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// watchRequest                                                               //
+//                                                                            //
+// Hands 'h_url' to the FETCH_ABORT of 'p_ctl', if it has one, so             //
+// abortFetch() can close it while the request is sent and the page is read.  //
+// Returns FALSE, without handing it over, if the download has already been   //
+// aborted.                                                                   //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL watchRequest(const FETCH_CTL* p_ctl, HINTERNET h_url)
+{
+	FETCH_ABORT* p_abort = p_ctl ? p_ctl->p_abort : NULL;
+	BOOL f_aborted;
+
+	if (!p_abort)
+		return TRUE;
+
+	AcquireSRWLockExclusive(&(p_abort->lock));
+	f_aborted = p_abort->f_aborted;
+	if (!f_aborted)
+		p_abort->h_url = h_url;
+	ReleaseSRWLockExclusive(&(p_abort->lock));
+
+	return !f_aborted;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// unwatchRequest                                                             //
+//                                                                            //
+// Takes the request back from the FETCH_ABORT of 'p_ctl' once the page has   //
+// been read. Returns TRUE if its handle is still open, and FALSE if          //
+// abortFetch() closed it, in which case it must not be used again.           //
+////////////////////////////////////////////////////////////////////////////////
+
+static BOOL unwatchRequest(const FETCH_CTL* p_ctl)
+{
+	FETCH_ABORT* p_abort = p_ctl ? p_ctl->p_abort : NULL;
+	BOOL f_open;
+
+	if (!p_abort)
+		return TRUE;
+
+	AcquireSRWLockExclusive(&(p_abort->lock));
+	f_open = p_abort->h_url != NULL;
+	p_abort->h_url = NULL;
+	ReleaseSRWLockExclusive(&(p_abort->lock));
+
+	return f_open;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// askServer                                                                  //
+//                                                                            //
+// Makes the request of connectToEDB() to the stand-in server of 'p_session'  //
+// (see setEdbServer()), and counts it in the session's statistics the way a  //
+// request to EDB is. The server doesn't say how the time splits between      //
+// opening the URL and reading the page, so all of it counts as opening it.   //
+////////////////////////////////////////////////////////////////////////////////
+
+static int askServer(P_EDB_SESSION p_session, const char* p_url,
+                     const FETCH_CTL* p_ctl, char** p_data, DWORD* p_size)
+{
+	const VSS_TRANSPORT* p_server = p_session->p_server;
+	double t0 = nowMs();
+	DWORD error;
+	int res;
+
+	res = p_server->fetch(p_server->ctx, p_url, p_ctl, p_data, p_size);
+
+	error = GetLastError();
+	recordFetch(p_session, res, *p_size, 0, nowMs() - t0, 0);
+	SetLastError(error);
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// fetchEDB                                                                   //
+//                                                                            //
+// The 'fetch' function of an EDB session's transport. 'ctx' is the session.  //
+// Unlike connectToEDB(), which makes a single request, it follows the        //
+// session's FETCH_POLICY.                                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+static int fetchEDB(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+                    char** p_data, DWORD* p_size)
+{
+	return fetchWithPolicy((P_EDB_SESSION)ctx, p_url, p_ctl, p_data, p_size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// recordFetch                                                                //
+//                                                                            //
+// Adds a lookup through 'p_session' to its counters. 'res' is the result of  //
+// connectToEDB(), 'bytes' the length of the page, 'wire_bytes' the number of //
+// bytes the server sent for it (0 if it didn't say, in which case the page   //
+// counts as sent as it is), and 'open_ms' and 'read_ms' the times spent      //
+// opening the URL and reading the page. A lookup that succeeded is counted   //
+// in the latency histogram.                                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+static void recordFetch(P_EDB_SESSION p_session, int res, DWORD bytes,
+                        DWORD wire_bytes, double open_ms, double read_ms)
+{
+	FETCH_STATS* p_stats = &(p_session->stats);
+
+	AcquireSRWLockExclusive(&(p_session->lock));
+
+	p_stats->num_fetches++;
+	if (res < 0)
+		p_stats->num_failures++;
+	else if (res == VSS_NOT_MODIFIED)
+		p_stats->num_not_modified++;
+
+	if (res >= 0) {
+		int i = 0;
+
+		while (i < FETCH_HIST_BUCKETS - 1 &&
+		       open_ms + read_ms >= hist_bounds[i])
+			i++;
+		p_stats->latency_hist[i]++;
+	}
+	p_stats->num_bytes += bytes;
+	p_stats->num_wire_bytes += wire_bytes ? wire_bytes : bytes;
+	p_stats->open_ms += open_ms;
+	p_stats->read_ms += read_ms;
+	if (open_ms + read_ms > p_stats->max_ms)
+		p_stats->max_ms = open_ms + read_ms;
+	p_stats->last_open_ms = open_ms;
+	p_stats->last_read_ms = read_ms;
+	p_stats->last_wire_bytes = wire_bytes;
+
+	ReleaseSRWLockExclusive(&(p_session->lock));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// nowMs                                                                      //
+//                                                                            //
+// Returns the QueryPerformanceCounter() reading in ms, for timing lookups    //
+// and for waitFetch(). GetTickCount64() only advances every 10 to 16 ms,     //
+// which is about the length of a lookup over a connection that's kept alive. //
+////////////////////////////////////////////////////////////////////////////////
+
+double nowMs(void)
+{
+	LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart * 1000.0 / (double)freq.QuadPart;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// measureFetches                                                             //
+//                                                                            //
+// Reads the URLs listed in the file 'url_file', one per line, and looks them //
+// up with measureFetchList(). At most MAX_BENCH_URLS URLs are read; empty    //
+// lines and lines starting with '#' are skipped.                             //
+//                                                                            //
+// The times depend on the round trip time to the server more than on         //
+// anything else, so for numbers that can be compared from run to run the     //
+// URLs should point at a stand-in server with a fixed delay, rather than at  //
+// EDB. Returns 0 on success, -1 if the file can't be read or lists no URLs,  //
+// or -2 if a session can't be opened.                                        //
+////////////////////////////////////////////////////////////////////////////////
+
+int measureFetches(const char* url_file, FETCH_BENCH* p_bench)
+{
+	FILE* p_file;
+	char line[256];
+
+	memset(p_bench, 0, sizeof(FETCH_BENCH));
+
+	if (fopen_s(&p_file, url_file, "r") != 0)
+		return -1;
+
+	while (p_bench->num_urls < MAX_BENCH_URLS &&
+	       fgets(line, sizeof(line), p_file)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#')
+			continue;
+		strcpy_s(p_bench->urls[p_bench->num_urls++], sizeof(line), line);
+	}
+	fclose(p_file);
+
+	if (p_bench->num_urls == 0)
+		return -1;
+
+	return measureFetchList(p_bench);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// measureFetchList                                                           //
+//                                                                            //
+// Looks up each of the 'num_urls' URLs in 'p_bench->urls' four times: first  //
+// with a new session per lookup, the way every lookup used to be made, then  //
+// through one session, the way the main window makes them, alongside that    //
+// through a second session that doesn't ask for compression, and finally     //
+// through the first session again, conditional on the validators it got the  //
+// first time, the way a stale page in the spec cache is looked up. The       //
+// result, the lengths and the times of each lookup are stored in '*p_bench', //
+// and the page read without compression is compared with the compressed one, //
+// which should have decoded to exactly the same bytes. The rest of           //
+// '*p_bench' is overwritten. Returns 0 on success, or -2 if a session can't  //
+// be opened.                                                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+int measureFetchList(FETCH_BENCH* p_bench)
+{
+	P_EDB_SESSION p_session;
+	P_EDB_SESSION p_plain;
+	int i;
+
+	memset(p_bench->cold, 0, sizeof(p_bench->cold));
+	memset(p_bench->warm, 0, sizeof(p_bench->warm));
+	memset(p_bench->plain, 0, sizeof(p_bench->plain));
+	memset(p_bench->reval, 0, sizeof(p_bench->reval));
+	memset(p_bench->same, 0, sizeof(p_bench->same));
+	memset(&(p_bench->stats), 0, sizeof(p_bench->stats));
+
+	// A new session per lookup
+	for (i = 0; i < p_bench->num_urls; i++) {
+		if (openEdbSession(INFINITE, &p_session) != 0)
+			return -2;
+		timeFetch(p_session, p_bench->urls[i], NULL, p_bench->cold + i,
+		          NULL);
+		closeEdbSession(p_session);
+	}
+
+	// One session for all of them, with and without compression. The
+	// two take turns, so both see the same conditions on the link.
+	if (openEdbSession(INFINITE, &p_session) != 0)
+		return -2;
+	if (openEdbSession(INFINITE, &p_plain) != 0) {
+		closeEdbSession(p_session);
+		return -2;
+	}
+	setEdbCompression(p_plain, FALSE);
+
+	for (i = 0; i < p_bench->num_urls; i++) {
+		const FETCH_TIME* p_warm = p_bench->warm + i;
+		const FETCH_TIME* p_raw = p_bench->plain + i;
+		PAGE_VALIDATORS validators = { 0 };
+		char* data = NULL;
+		char* raw = NULL;
+
+		timeFetch(p_session, p_bench->urls[i], &validators,
+		          p_bench->warm + i, &data);
+		timeFetch(p_plain, p_bench->urls[i], NULL, p_bench->plain + i,
+		          &raw);
+		timeFetch(p_session, p_bench->urls[i], &validators,
+		          p_bench->reval + i, NULL);
+
+		p_bench->same[i] = p_warm->res == 0 && p_raw->res == 0 &&
+		                   p_warm->bytes == p_raw->bytes &&
+		                   memcmp(data, raw, p_warm->bytes) == 0;
+		memFree(data);
+		memFree(raw);
+	}
+
+	getFetchStats(p_session, &(p_bench->stats));
+	closeEdbSession(p_plain);
+	closeEdbSession(p_session);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// timeFetch                                                                  //
+//                                                                            //
+// Looks up 'p_url' through 'p_session', for measureFetches(), and stores the //
+// result, the lengths and the times of the lookup in '*p_time'. The lookup   //
+// is conditional on '*p_validators', which gets the ones of the response,    //
+// unless it's NULL. If 'p_data' isn't NULL, the page is returned in it, for  //
+// the caller to free; otherwise it's freed here. Returns the result.         //
+////////////////////////////////////////////////////////////////////////////////
+
+static int timeFetch(P_EDB_SESSION p_session, const char* p_url,
+                     PAGE_VALIDATORS* p_validators, FETCH_TIME* p_time,
+                     char** p_data)
+{
+	FETCH_CTL ctl = { 0 };
+	FETCH_STATS stats;
+	char* data = NULL;
+
+	ctl.p_validators = p_validators;
+	p_time->res = connectToEDB(p_session, p_url, &ctl, &data,
+	                           &(p_time->bytes));
+	if (p_data)
+		*p_data = data;
+	else
+		memFree(data);
+
+	getFetchStats(p_session, &stats);
+	p_time->wire_bytes = stats.last_wire_bytes;
+	p_time->open_ms = stats.last_open_ms;
+	p_time->read_ms = stats.last_read_ms;
+	return p_time->res;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// writeFetchReport                                                           //
+//                                                                            //
+// Writes the lookups of 'p_bench' to the file 'path': the times of each URL  //
+// with a new session per lookup, through one session, and through one        //
+// session without compression, with the bytes the server sent for the last   //
+// two and whether they decoded to the same page, and the result and time of  //
+// the revalidation. The averages and the totals of each run follow, and the  //
+// percentiles of the times of the lookups through one session, from its      //
+// latency histogram. Failed lookups are listed with their result and left    //
+// out of the averages. A page the server sent in chunks, without saying how  //
+// long it was, counts with its decoded length. Returns 0 on success, or -1   //
+// if the file can't be written.                                              //
+////////////////////////////////////////////////////////////////////////////////
+
+int writeFetchReport(const FETCH_BENCH* p_bench, const char* path)
+{
+	const FETCH_TIME* runs[4] = { p_bench->cold, p_bench->warm,
+	                              p_bench->plain, p_bench->reval };
+	const char* names[4] = { "new session per lookup", "one session",
+	                         "uncompressed", "revalidated" };
+	FILE* p_file;
+	int num_same = 0;
+	int num_unchanged = 0;
+	int i, j;
+
+	if (fopen_s(&p_file, path, "w") != 0)
+		return -1;
+
+	fprintf(p_file, "EDB lookups, %d URLs\n\n", p_bench->num_urls);
+	fprintf(p_file, "%-8s %-8s %10s %10s   %-8s %-8s %10s %10s   "
+	        "%-8s %-8s %10s %-4s   %-8s %10s   %s\n",
+	        "cold", "bytes", "open ms", "read ms",
+	        "warm", "sent", "open ms", "read ms",
+	        "plain", "sent", "read ms", "same",
+	        "reval", "ms", "URL");
+
+	for (i = 0; i < p_bench->num_urls; i++) {
+		const FETCH_TIME* p_cold = p_bench->cold + i;
+		const FETCH_TIME* p_warm = p_bench->warm + i;
+		const FETCH_TIME* p_raw = p_bench->plain + i;
+		const FETCH_TIME* p_reval = p_bench->reval + i;
+
+		fprintf(p_file, "%-8d %-8lu %10.1f %10.1f   %-8d %-8lu %10.1f "
+		        "%10.1f   %-8d %-8lu %10.1f %-4s   %-8d %10.1f   %s\n",
+		        p_cold->res, p_cold->bytes, p_cold->open_ms, p_cold->read_ms,
+		        p_warm->res, p_warm->wire_bytes, p_warm->open_ms,
+		        p_warm->read_ms, p_raw->res, p_raw->wire_bytes,
+		        p_raw->read_ms, (p_warm->res || p_raw->res) ? "-" :
+		        p_bench->same[i] ? "yes" : "NO", p_reval->res,
+		        p_reval->open_ms + p_reval->read_ms, p_bench->urls[i]);
+		num_same += p_bench->same[i];
+		num_unchanged += (p_reval->res == VSS_NOT_MODIFIED);
+	}
+
+	fprintf(p_file, "\n");
+	for (j = 0; j < 4; j++) {
+		double open_ms = 0;
+		double read_ms = 0;
+		long long wire_bytes = 0;
+		int num_ok = 0;
+
+		for (i = 0; i < p_bench->num_urls; i++) {
+			if (runs[j][i].res < 0)
+				continue;
+			open_ms += runs[j][i].open_ms;
+			read_ms += runs[j][i].read_ms;
+			wire_bytes += runs[j][i].wire_bytes ? runs[j][i].wire_bytes :
+			              runs[j][i].bytes;
+			num_ok++;
+		}
+
+		fprintf(p_file, "%-24s %d of %d ok, avg open %.1f ms, "
+		        "avg read %.1f ms, total %.1f ms, %lld bytes sent\n",
+		        names[j], num_ok, p_bench->num_urls,
+		        num_ok ? open_ms / num_ok : 0.0,
+		        num_ok ? read_ms / num_ok : 0.0, open_ms + read_ms,
+		        wire_bytes);
+	}
+
+	fprintf(p_file, "\n%d of %d pages the same with and without "
+	        "compression\n", num_same, p_bench->num_urls);
+	fprintf(p_file, "%d of %d pages unchanged when revalidated\n",
+	        num_unchanged, p_bench->num_urls);
+	fprintf(p_file, "one session: p50 %.0f ms, p95 %.0f ms, p99 %.0f ms, "
+	        "max %.1f ms\n", getFetchPercentile(&(p_bench->stats), 50),
+	        getFetchPercentile(&(p_bench->stats), 95),
+	        getFetchPercentile(&(p_bench->stats), 99), p_bench->stats.max_ms);
 
+	fclose(p_file);
 	return 0;
 }
\ No newline at end of file
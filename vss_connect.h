@@ -3,7 +3,186 @@
 
 #include <WinInet.h>
 
-int connectToEDB(void** data, const char* p_url, DWORD buf_size);
-static int retrieveSpec(HINTERNET h_url, void* data, DWORD buf_size);
+// connectToEDB() results besides 0
+#define VSS_NOT_MODIFIED 1  // the page is the one 'p_validators' describe
+#define VSS_NO_URL      -3  // the URL can't be opened; see GetLastError()
+#define VSS_NO_MEMORY   -4
+#define VSS_READ_FAILED -5  // the page can't be read
+#define VSS_CANCELLED   -6
+#define VSS_TIMED_OUT   -7
+#define VSS_SERVER_ERROR -8 // the server answered with a 5xx status
+
+// The receive buffer starts at this size when the server doesn't say how
+// long the page is, and doubles as needed up to VSS_MAX_PAGE_SIZE. A spec
+// page is around 130 KiB.
+#define VSS_PAGE_SIZE       (256 * 1024)
+#define VSS_MAX_PAGE_SIZE   (16 * 1024 * 1024)
+
+// The request header a session sends to get pages compressed
+#define VSS_ACCEPT_ENCODING "Accept-Encoding: gzip, deflate\r\n"
+
+// Room for all the request headers of a lookup
+#define VSS_HEADERS_LENGTH  256
+
+// Longest ETag that's kept, including the terminating null
+#define VSS_ETAG_LENGTH     64
+
+// What a server gave to tell versions of a page apart: its ETag, and the
+// time it was last modified, in time() seconds. Either may be missing
+// (empty, or 0). Sent back with the next request for the page, they let
+// the server answer that it hasn't changed instead of sending it again.
+typedef struct page_validators {
+	char etag[VSS_ETAG_LENGTH];
+	long long modified;
+} PAGE_VALIDATORS;
+
+// Lets another thread stop a download through connectToEDB() while it waits
+// for the server. The cancel flag is only polled between reads, and a send
+// or a read from a server that has stopped answering blocks until the
+// receive timeout; abortFetch() closes the request's handle, which makes
+// the call fail at once. The lock must be initialized before the download
+// starts.
+typedef struct fetch_abort {
+	SRWLOCK lock;
+	HINTERNET h_url;            // the request being made, or NULL
+	BOOL f_aborted;
+} FETCH_ABORT;
+
+// How long a download may take, and a flag that stops it early. The flag
+// is polled between reads, so it can be set from another thread. If
+// 'p_validators' isn't NULL, the request is made conditional on what it
+// holds, and it's updated with what the response gives; if the page hasn't
+// changed, the download returns VSS_NOT_MODIFIED and no page.
+typedef struct fetch_ctl {
+	volatile LONG* p_cancel;    // NULL if the download can't be cancelled
+	DWORD timeout_ms;           // 0 for no time limit
+	PAGE_VALIDATORS* p_validators;
+	FETCH_ABORT* p_abort;       // NULL if reads can't be aborted
+} FETCH_CTL;
+
+// A way of downloading a spec page. The download pipeline (see spec_job.c)
+// only calls 'fetch', so it can be given something other than WinInet,
+// e.g. a plain socket client talking to a stand-in server. 'fetch' has the
+// same contract as connectToEDB(): on success '*p_data' is a heap buffer
+// holding the page and '*p_size' its length, and the caller frees the
+// buffer. The page isn't terminated in any way.
+typedef struct vss_transport {
+	int (*fetch)(void* ctx, const char* p_url, const FETCH_CTL* p_ctl,
+	             char** p_data, DWORD* p_size);
+	void* ctx;
+} VSS_TRANSPORT;
+
+// Defaults for FETCH_POLICY
+#define FETCH_MAX_ATTEMPTS      3
+#define FETCH_ATTEMPT_MS        10000
+#define FETCH_BACKOFF_MS        200
+#define FETCH_MAX_BACKOFF_MS    3000
+#define FETCH_HEDGE_MIN_SAMPLES 20
+
+// How lookups through a session's transport deal with a slow or failing
+// server. An attempt that fails in a way that may not last (a timeout, a
+// dropped connection or a 5xx answer) is retried after a random wait of up
+// to 'backoff_ms', which doubles for every retry, up to 'max_backoff_ms'.
+// No attempt takes more than 'attempt_ms', and none goes past the lookup's
+// own timeout. With 'f_hedge' set, once the session has timed
+// 'hedge_min_samples' lookups, an attempt that's taken longer than 95% of
+// them did gets a second request alongside it, and the first to answer
+// wins.
+typedef struct fetch_policy {
+	int max_attempts;           // 1 for no retries
+	DWORD attempt_ms;           // 0 for no limit besides the lookup's
+	DWORD backoff_ms;
+	DWORD max_backoff_ms;
+	BOOL f_hedge;
+	int hedge_min_samples;
+} FETCH_POLICY;
+
+// Buckets of the latency histogram (see getFetchPercentile())
+#define FETCH_HIST_BUCKETS      28
+
+// The lookups made through an EDB session, with their times in ms. Opening
+// a URL covers connecting, unless the session still has a connection to
+// the server, and waiting for the response headers; reading covers the
+// rest of the page.
+typedef struct fetch_stats {
+	int num_fetches;
+	int num_failures;
+	int num_not_modified;       // answered VSS_NOT_MODIFIED
+	int num_retries;
+	int num_hedges;             // second requests made
+	int num_hedge_wins;         // second requests that answered first
+	long long num_bytes;        // of the pages, after decoding
+	long long num_wire_bytes;   // as sent, or num_bytes where not known
+	double open_ms;             // total over all lookups
+	double read_ms;
+	double max_ms;              // the slowest lookup
+	double last_open_ms;        // the latest lookup
+	double last_read_ms;
+	DWORD last_wire_bytes;      // 0 if the server didn't say
+	DWORD latency_hist[FETCH_HIST_BUCKETS];    // lookups that succeeded
+} FETCH_STATS;
+
+// A WinInet session for EDB lookups. It's opened once and shared by every
+// lookup, so WinInet can keep the connection to the server alive between
+// them, and lookups after the first skip the TCP and TLS handshakes. It
+// asks for pages compressed unless 'f_compress' is cleared (see
+// setEdbCompression()).
+typedef struct edb_session {
+	HINTERNET h_open;
+	DWORD timeout_ms;           // see openEdbSession()
+	BOOL f_compress;
+	VSS_TRANSPORT transport;    // downloads through this session
+	const VSS_TRANSPORT* p_server; // NULL for EDB, see setEdbServer()
+	SRWLOCK lock;               // for 'stats' and 'policy'
+	FETCH_STATS stats;
+	FETCH_POLICY policy;        // for lookups through 'transport'
+	volatile LONG num_attempts; // hedged attempts still running
+} EDB_SESSION, * P_EDB_SESSION;
+
+// The maximum number of URLs measureFetches() looks up
+#define MAX_BENCH_URLS  256
+
+// One lookup of measureFetches()
+typedef struct fetch_time {
+	int res;                    // connectToEDB() result
+	DWORD bytes;
+	DWORD wire_bytes;           // 0 if the server didn't say
+	double open_ms;
+	double read_ms;
+} FETCH_TIME;
+
+// The lookups of measureFetches(), made once with a new session per lookup
+// and once through a single session, both compressed, and once more
+// through a single session without compression. 'same' tells whether the
+// page read without compression matched the compressed one byte for byte.
+// 'reval' is the lookup of each page again, conditional on the validators
+// the lookup through a single session got.
+typedef struct fetch_bench {
+	int num_urls;
+	char urls[MAX_BENCH_URLS][256];
+	FETCH_TIME cold[MAX_BENCH_URLS];
+	FETCH_TIME warm[MAX_BENCH_URLS];
+	FETCH_TIME plain[MAX_BENCH_URLS];
+	FETCH_TIME reval[MAX_BENCH_URLS];
+	BOOL same[MAX_BENCH_URLS];
+	FETCH_STATS stats;          // of the single session
+} FETCH_BENCH;
+
+int openEdbSession(DWORD timeout_ms, P_EDB_SESSION* pp_session);
+void getFetchStats(P_EDB_SESSION p_session, FETCH_STATS* p_stats);
+double getFetchPercentile(const FETCH_STATS* p_stats, double percent);
+void setMaxEdbConnections(DWORD num_conns);
+void setEdbCompression(P_EDB_SESSION p_session, BOOL f_compress);
+void setEdbServer(P_EDB_SESSION p_session, const VSS_TRANSPORT* p_server);
+void closeEdbSession(P_EDB_SESSION p_session);
+int connectToEDB(P_EDB_SESSION p_session, const char* p_url,
+                 const FETCH_CTL* p_ctl, char** p_data, DWORD* p_size);
+void abortFetch(FETCH_ABORT* p_abort);
+int waitFetch(const FETCH_CTL* p_ctl, double start, double wait_ms,
+              DWORD poll_ms);
+double nowMs(void);
+int measureFetches(const char* url_file, FETCH_BENCH* p_bench);
+int measureFetchList(FETCH_BENCH* p_bench);
+int writeFetchReport(const FETCH_BENCH* p_bench, const char* path);
 
 #endif
\ No newline at end of file